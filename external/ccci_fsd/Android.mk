@@ -4,7 +4,7 @@ LOCAL_ARM_MODE:=arm
 LOCAL_C_INCLUDES := vendor/mediatek/opensource/hardware/ccci/include \
 	                  $(LOCAL_PATH)/platform
 
-LOCAL_SRC_FILES:=$(call all-subdir-c-files,$(LOCAL_PATH))
+LOCAL_SRC_FILES:=$(filter-out test/%,$(call all-subdir-c-files,$(LOCAL_PATH)))
 LOCAL_MODULE:=ccci_fsd
 LOCAL_PROPRIETARY_MODULE := true
 LOCAL_MODULE_OWNER := mtk
@@ -14,3 +14,43 @@ LOCAL_MODULE_TAGS := optional
 LOCAL_INIT_RC := init.cccifsd.rc
 include $(call all-makefiles-under,$(LOCAL_PATH))
 include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_ARM_MODE:=arm
+LOCAL_C_INCLUDES := vendor/mediatek/opensource/hardware/ccci/include \
+	                  $(LOCAL_PATH)/platform
+LOCAL_SRC_FILES := test/ccci_fsd_test.c fsd_cache.c fsd_index.c \
+	                  $(call all-c-files-under,platform)
+LOCAL_MODULE := ccci_fsd_test
+LOCAL_PROPRIETARY_MODULE := true
+LOCAL_MODULE_OWNER := mtk
+LOCAL_MULTILIB := 32
+LOCAL_CFLAGS := -Wno-attributes
+LOCAL_GTEST := false
+include $(LOCAL_PATH)/platform/Android.mk
+include $(BUILD_NATIVE_TEST)
+
+# host benchmark of the stream path against a fake MD, prints MB/s
+include $(CLEAR_VARS)
+LOCAL_C_INCLUDES := vendor/mediatek/opensource/hardware/ccci/include \
+	                  $(LOCAL_PATH) \
+	                  $(LOCAL_PATH)/platform
+LOCAL_SRC_FILES := test/ccci_fsd_benchmark.c test/fsd_host_platform.c \
+	                  fsd_cache.c fsd_index.c
+LOCAL_MODULE := ccci_fsd_benchmark
+# bionic's <sys/cdefs.h> has __packed, glibc's does not
+LOCAL_CFLAGS := -Wno-attributes -D__packed='__attribute__((__packed__))'
+LOCAL_SHARED_LIBRARIES := liblog libcutils
+LOCAL_GTEST := false
+include $(BUILD_HOST_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_C_INCLUDES := vendor/mediatek/opensource/hardware/ccci/include \
+	                  $(LOCAL_PATH) \
+	                  $(LOCAL_PATH)/platform
+LOCAL_SRC_FILES := test/fsd_cache_test.c test/fsd_host_platform.c
+LOCAL_MODULE := fsd_cache_test
+LOCAL_CFLAGS := -Wno-attributes -D__packed='__attribute__((__packed__))'
+LOCAL_SHARED_LIBRARIES := liblog
+LOCAL_GTEST := false
+include $(BUILD_HOST_NATIVE_TEST)
@@ -35,6 +35,8 @@
 #include "ccci_fs.h"
 #include "hardware/ccci_intf.h"
 #include "fsd_platform.h"
+#include "fsd_cache.h"
+#include "fsd_index.h"
 #include <pthread.h>
 
 #define PROFILE_NVRAM_API
@@ -58,6 +60,7 @@ static unsigned int FS_MAX_BUF_SIZE = 0x4000;
 static unsigned int FS_MAX_ARG_NUM = 5;
 static pthread_t thread_id;
 static int md_status_fd;
+static pthread_mutex_t g_FsHandleLock = PTHREAD_MUTEX_INITIALIZER;
 
 #ifdef PROFILE_NVRAM_API
 typedef struct
@@ -407,7 +410,6 @@ static void FS_EntryLinuxToDos(FS_DOSDirEntry *DosFileInfo, const char* file)
 {
 	struct tm *ModifyTime, *AccessTime;
 	struct stat StatBuf;
-	static unsigned int total_size;
 
 	if(stat(file, &StatBuf) == -1)
 	{
@@ -460,7 +462,6 @@ static void FS_EntryLinuxToDos(FS_DOSDirEntry *DosFileInfo, const char* file)
 
 	DosFileInfo->FirstCluster = 0;
 	DosFileInfo->FileSize = (unsigned int)StatBuf.st_size;
-	total_size += DosFileInfo->FileSize;
 
 	return;
 
@@ -516,6 +517,11 @@ static bool FS_GetPackInfo(FS_PACKET_INFO* pPackInfo, char* pData)
 // 5 = CCCI header + Operation ID
 unsigned int g_bak[5];
 
+// stream mode: request buffer of each slot, plus the spare one at FS_BUFFER_SLOT_NUM
+#define FS_STREAM_SLOT_LEN (sizeof(STREAM_DATA) + FS_MAX_BUF_SIZE)
+static STREAM_DATA *g_FsStreamSlot[FS_BUFFER_SLOT_NUM + 1];
+static int g_FsWaitSlot = -1;
+
 /*
  * @brief Prepare a packet buffer for sending to MD
  * @param
@@ -589,7 +595,7 @@ static bool FS_WriteToMD(int DeviceFd, int BufIndex, FS_PACKET_INFO* pPacketSrc,
 	int pkt_size = 0;
 	int data_to_send = 0;
 	int local_errno = 0;
-	STREAM_DATA *buffer_slot = (STREAM_DATA *)((char *)g_FsInfo.pFsBuf + (FS_MAX_BUF_SIZE + sizeof(STREAM_DATA))*BufIndex);
+	STREAM_DATA *buffer_slot = g_FsStreamSlot[BufIndex];
 
 	if(!stream_support) {
 		pFsBuf = (FS_BUF *)((char *)g_FsInfo.pFsBuf + (FS_MAX_BUF_SIZE + sizeof(FS_BUF))*BufIndex);
@@ -701,21 +707,115 @@ _Exit:
 	return bRet;
 }
 
-static unsigned int FS_GetFreeHandle()
+/*
+ * Requests run on several workers, so a handle is reserved (fInUse set, hFile still
+ * invalid) under g_FsHandleLock before the slow open() and given back with
+ * FS_PutHandle() on failure or close.
+ */
+static unsigned int FS_GetFreeHandle(unsigned int Key)
 {
 	unsigned int i;
+	unsigned int HandleIndex = 0xFFFFFFFF;
+
+	pthread_mutex_lock(&g_FsHandleLock);
 	if(g_FsInfo.FileNum >= FS_FILE_MAX)
 	{
 		LOGE("GetFreeHandle: [error]file handle is full: %d \n", g_FsInfo.FileNum);
-		return 0xFFFFFFFF;
+		goto Exit;
 	}
 
 	for(i = 1; i < FS_FILE_MAX; i++)
 	{
 		if(g_FsInfo.hFileHandle[i].fInUse == false)
-			return i;
+		{
+			g_FsInfo.hFileHandle[i].fInUse = true;
+			g_FsInfo.hFileHandle[i].fSearch = false;
+			g_FsInfo.hFileHandle[i].hFile = INVALID_HANDLE_VALUE;
+			g_FsInfo.hFileHandle[i].pFsFileName = NULL;
+			g_FsInfo.hFileHandle[i].pFsSearchPattern = NULL;
+			g_FsInfo.hFileHandle[i].Key = Key;
+			g_FsInfo.hFileHandle[i].pCache = NULL;
+			g_FsInfo.hFileHandle[i].pSearchDir = NULL;
+			g_FsInfo.hFileHandle[i].Pos = 0;
+			g_FsInfo.FileNum++;
+			HandleIndex = i;
+			break;
+		}
+	}
+
+Exit:
+	pthread_mutex_unlock(&g_FsHandleLock);
+	return HandleIndex;
+}
+
+static void FS_PutHandle(unsigned int HandleIndex)
+{
+	pthread_mutex_lock(&g_FsHandleLock);
+	g_FsInfo.hFileHandle[HandleIndex].hFile = INVALID_HANDLE_VALUE;
+	g_FsInfo.hFileHandle[HandleIndex].fInUse = false;
+	free(g_FsInfo.hFileHandle[HandleIndex].pFsFileName);
+	g_FsInfo.hFileHandle[HandleIndex].pFsFileName = NULL;
+	free(g_FsInfo.hFileHandle[HandleIndex].pFsSearchPattern);
+	g_FsInfo.hFileHandle[HandleIndex].pFsSearchPattern = NULL;
+	g_FsInfo.hFileHandle[HandleIndex].pCache = NULL;
+	g_FsInfo.FileNum--;
+	pthread_mutex_unlock(&g_FsHandleLock);
+}
+
+/* the directory a search reads from when the index does not serve it, 0 or closedir()'s result */
+static int FS_CloseSearchDir(unsigned int HandleIndex)
+{
+	DIR* pDir = (DIR*)g_FsInfo.hFileHandle[HandleIndex].pSearchDir;
+
+	g_FsInfo.hFileHandle[HandleIndex].pSearchDir = NULL;
+	return pDir != NULL ? closedir(pDir) : 0;
+}
+
+/*
+ * Ordering key of an MD path (UCS-2): FNV-1a over the case-folded name with '\' and '/'
+ * treated alike and repeated or trailing separators dropped. With Dir set the key of
+ * the parent directory is returned instead, as FindFirst names a pattern inside it.
+ * 0 is kept for requests which need no ordering.
+ */
+static unsigned int FS_PathKey(const wchar_t* Name, bool Dir)
+{
+	const char *ptr = (const char *)Name;
+	unsigned int Key = 2166136261U;
+	unsigned int DirKey = Key;
+	bool bSeparator = false;
+	int i;
+	char c;
+
+	for(i = 0; i < PATH_MAX && (c = ptr[i * 2]) != 0; i++)
+	{
+		if(c == '\\' || c == '/') {
+			DirKey = Key;
+			bSeparator = true;
+			continue;
+		}
+		if(bSeparator) {
+			Key = (Key ^ '/') * 16777619U;
+			bSeparator = false;
+		}
+		Key = (Key ^ (unsigned char)tolower(c)) * 16777619U;
 	}
-	return 0xFFFFFFFF;
+
+	if(Dir)
+		Key = DirKey;
+	return Key ? Key : 1;
+}
+
+static unsigned int FS_HandleKey(int HandleIndex)
+{
+	unsigned int Key = 0;
+
+	if((unsigned int)HandleIndex >= FS_FILE_MAX)
+		return 0;
+	pthread_mutex_lock(&g_FsHandleLock);
+	if(g_FsInfo.hFileHandle[HandleIndex].fInUse)
+		Key = g_FsInfo.hFileHandle[HandleIndex].Key;
+	pthread_mutex_unlock(&g_FsHandleLock);
+	return Key;
 }
 
 static inline int is_protect_path(char *ConvFileName)
@@ -785,7 +885,7 @@ static int FS_CCCI_Open(const wchar_t* FileName, unsigned int Flag)
 	unsigned int HandleIndex;
 	int ret = FS_GENERAL_FAILURE;
 	int FsFileNameCount;
-	static char FsFileName[PATH_MAX] = {0};
+	char FsFileName[PATH_MAX] = {0};
 	unsigned int LinuxFlag=0;
 	char ConvFileName[PATH_MAX] = {0};
 	int len = 0;
@@ -849,7 +949,7 @@ static int FS_CCCI_Open(const wchar_t* FileName, unsigned int Flag)
 	if(Flag & FS_NONBLOCK_MODE)
 		LinuxFlag |= O_NONBLOCK;
 
-	if((HandleIndex = FS_GetFreeHandle()) == 0xFFFFFFFF)
+	if((HandleIndex = FS_GetFreeHandle(FS_PathKey(FileName, false))) == 0xFFFFFFFF)
 	{
 		LOGE("Open: [error]fail get free handle for %s \n", ConvFileName);
 		ret = FS_TOO_MANY_FILES;
@@ -863,26 +963,30 @@ static int FS_CCCI_Open(const wchar_t* FileName, unsigned int Flag)
 		local_errno = errno;
 		LOGE("Open: [error]fail open %s %s :%d (0x%X)\n", ConvFileName, FsFileName, local_errno, LinuxFlag);
 		CCCI_Dump_FS_Path(FsFileName);
+		FS_PutHandle(HandleIndex);
 		ret = FS_ErrorConv(local_errno);
 		goto _Exit;
 	}
 	else
 	{
-		g_FsInfo.FileNum++;
-		g_FsInfo.hFileHandle[HandleIndex].hFile = Fd;
-		g_FsInfo.hFileHandle[HandleIndex].fInUse = true;
 		g_FsInfo.hFileHandle[HandleIndex].Flag = Flag;
-		g_FsInfo.hFileHandle[HandleIndex].fSearch = false;
 		g_FsInfo.hFileHandle[HandleIndex].pFsFileName = malloc(sizeof(char)*(FsFileNameCount+1));
 
 		if(g_FsInfo.hFileHandle[HandleIndex].pFsFileName == NULL)
 		{
 			LOGE("Open: [error]fail malloc memory for %s \n", ConvFileName);
+			close(Fd);
+			FS_PutHandle(HandleIndex);
 			ret = FS_ERROR_RESERVED;
 			goto _Exit;
 		}
 		memcpy(g_FsInfo.hFileHandle[HandleIndex].pFsFileName, FsFileName, sizeof(char)*(FsFileNameCount+1));
+		g_FsInfo.hFileHandle[HandleIndex].pCache = FS_CacheOpen(FsFileName, Fd, Flag);
+		// publish the fd last, the handle reads as invalid until then
+		g_FsInfo.hFileHandle[HandleIndex].hFile = Fd;
 		ret = HandleIndex;
+		if(LinuxFlag & O_CREAT)
+			FS_IndexUpdate(FsFileName, false);
 	}
 
 _Exit:
@@ -905,6 +1009,7 @@ static int FS_CCCI_Seek(int HandleIndex, int Offset, int Whence)
 	int Fd;
 	int LinuxWhence;
 	off_t	NewPos;
+	FS_CACHE_FILE *pCache;
 	int ret = FS_GENERAL_FAILURE;
 	int local_errno;
 
@@ -923,18 +1028,22 @@ static int FS_CCCI_Seek(int HandleIndex, int Offset, int Whence)
 		goto Exit;
 	}
 	Fd = g_FsInfo.hFileHandle[HandleIndex].hFile;
+	pCache = g_FsInfo.hFileHandle[HandleIndex].pCache;
 	switch(Whence)
 	{
 		case FS_FILE_BEGIN:
 			LinuxWhence = SEEK_SET;
+			NewPos = 0;
 			break;
 
 		case FS_FILE_CURRENT:
 			LinuxWhence = SEEK_CUR;
+			NewPos = g_FsInfo.hFileHandle[HandleIndex].Pos;
 			break;
 
 		case FS_FILE_END:
 			LinuxWhence = SEEK_END;
+			NewPos = pCache ? FS_CacheSize(pCache) : 0;
 			break;
 
 		default:
@@ -942,7 +1051,18 @@ static int FS_CCCI_Seek(int HandleIndex, int Offset, int Whence)
 			goto Exit;
 	}
 
-	NewPos = lseek(Fd, (off_t) Offset, LinuxWhence);
+	if(pCache) {
+		// a cached handle only keeps its position here
+		NewPos += Offset;
+		if(NewPos < 0 || NewPos > INT_MAX) {
+			errno = EINVAL;
+			NewPos = (off_t) -1;
+		} else {
+			g_FsInfo.hFileHandle[HandleIndex].Pos = (unsigned int)NewPos;
+		}
+	} else {
+		NewPos = lseek(Fd, (off_t) Offset, LinuxWhence);
+	}
 
 	if(NewPos == (off_t) -1)
 	{
@@ -986,7 +1106,14 @@ static int FS_CCCI_Read(int HandleIndex, void* pBuffer, int NumOfByte, unsigned
 	//LOGD("Read: %s: (%d,%d)\n", g_FsInfo.hFileHandle[HandleIndex].pFsFileName,
 	//HandleIndex, Fd);
 
-    *ReadByte = read(Fd, pBuffer, (size_t)NumOfByte);
+	if(g_FsInfo.hFileHandle[HandleIndex].pCache) {
+		*ReadByte = FS_CacheRead(g_FsInfo.hFileHandle[HandleIndex].pCache, Fd,
+			g_FsInfo.hFileHandle[HandleIndex].Pos, pBuffer, (unsigned int)NumOfByte);
+		if((int)*ReadByte > 0)
+			g_FsInfo.hFileHandle[HandleIndex].Pos += *ReadByte;
+	} else {
+		*ReadByte = read(Fd, pBuffer, (size_t)NumOfByte);
+	}
 	temp_val = (int)*ReadByte;
 	if(temp_val == -1) {
 		local_errno = errno;
@@ -1033,7 +1160,15 @@ static int FS_CCCI_Write(int HandleIndex, void* pBuffer, int NumOfByte, int* Wri
 #ifdef PROFILE_NVRAM_API
 	clock_gettime(CLOCK_REALTIME, &time_start);
 #endif
-	*WriteByte = write(Fd, pBuffer, (size_t)NumOfByte);
+	if(g_FsInfo.hFileHandle[HandleIndex].pCache) {
+		// written through, the cache updates the blocks it holds
+		*WriteByte = FS_CacheWrite(g_FsInfo.hFileHandle[HandleIndex].pCache, Fd,
+			g_FsInfo.hFileHandle[HandleIndex].Pos, pBuffer, (unsigned int)NumOfByte);
+		if(*WriteByte > 0)
+			g_FsInfo.hFileHandle[HandleIndex].Pos += *WriteByte;
+	} else {
+		*WriteByte = write(Fd, pBuffer, (size_t)NumOfByte);
+	}
 #ifdef PROFILE_NVRAM_API
 	if (slower_100ms.profiling)
 	{
@@ -1077,6 +1212,7 @@ static int FS_CCCI_Close(int HandleIndex)
 {
 	int ret = FS_GENERAL_FAILURE;
 	int local_errno;
+	FS_CACHE_FILE *pCache = NULL;
 #ifdef PROFILE_NVRAM_API
 	struct timespec time_start, time_end;
 	long diff;
@@ -1102,7 +1238,7 @@ static int FS_CCCI_Close(int HandleIndex)
 	//	HandleIndex, g_FsInfo.hFileHandle[HandleIndex].hFile);
 	if(g_FsInfo.hFileHandle[HandleIndex].fSearch)
 	{
-		if(closedir((DIR*)g_FsInfo.hFileHandle[HandleIndex].hFile) != 0)
+		if(FS_CloseSearchDir(HandleIndex) != 0)
 		{
 			local_errno = errno;
 			LOGE("Close: [error]fail close %s(%d): %d \n",
@@ -1111,9 +1247,10 @@ static int FS_CCCI_Close(int HandleIndex)
 			goto Exit;
 		}
 	} else {
+		pCache = g_FsInfo.hFileHandle[HandleIndex].pCache;
 		if (g_FsInfo.hFileHandle[HandleIndex].Flag & (FS_CREATE|FS_CREATE_ALWAYS|FS_COMMITTED)) {
             LOGD("C:fsync+ %d, %d, FLAG:0x%x\n", HandleIndex, ret, g_FsInfo.hFileHandle[HandleIndex].Flag);
-			ret=fsync(g_FsInfo.hFileHandle[HandleIndex].hFile);
+			ret=FS_CacheSync(g_FsInfo.hFileHandle[HandleIndex].hFile);
 			LOGD("C:fsync- %d, %d, FLAG:0x%x\n", HandleIndex, ret,g_FsInfo.hFileHandle[HandleIndex].Flag);
    			if(ret<0)
    			{
@@ -1133,6 +1270,10 @@ static int FS_CCCI_Close(int HandleIndex)
 			ret = FS_ErrorConv(local_errno);
 			goto Exit;
 		}
+		if (pCache)
+			FS_CacheRelease(pCache);
+		if (!(g_FsInfo.hFileHandle[HandleIndex].Flag & FS_READ_ONLY))
+			FS_IndexUpdate(g_FsInfo.hFileHandle[HandleIndex].pFsFileName, false);
 #ifdef PROFILE_NVRAM_API
 		if (slower_100ms.profiling)
 		{
@@ -1158,11 +1299,7 @@ static int FS_CCCI_Close(int HandleIndex)
 #endif
 	}
 
-	g_FsInfo.hFileHandle[HandleIndex].hFile = INVALID_HANDLE_VALUE;
-	g_FsInfo.hFileHandle[HandleIndex].fInUse = false;
-
-	free(g_FsInfo.hFileHandle[HandleIndex].pFsFileName);
-	g_FsInfo.FileNum--;
+	FS_PutHandle(HandleIndex);
 	ret = FS_NO_ERROR;
 
 Exit:
@@ -1182,10 +1319,21 @@ static int FS_CCCI_CloseAll()
 		{
 			if(g_FsInfo.hFileHandle[i].fSearch)
 			{
-				//Todo;
+				if(FS_CloseSearchDir(i) != 0)
+				{
+					local_errno = errno;
+					LOGE("CloseAll: [error]fail close %s(%d): %d \n",
+						g_FsInfo.hFileHandle[i].pFsFileName, i, local_errno);
+					ret = FS_ErrorConv(local_errno);
+					goto Exit;
+				}
 			}
 			else
 			{
+				if(g_FsInfo.hFileHandle[i].pCache) {
+					FS_CacheRelease(g_FsInfo.hFileHandle[i].pCache);
+					g_FsInfo.hFileHandle[i].pCache = NULL;
+				}
 				if(close(g_FsInfo.hFileHandle[i].hFile) == -1)
 				{
 					local_errno = errno;
@@ -1198,11 +1346,7 @@ static int FS_CCCI_CloseAll()
 
 			LOGD("CA:%d, %d\n", i, g_FsInfo.hFileHandle[i].hFile);
 
-			g_FsInfo.hFileHandle[i].hFile = INVALID_HANDLE_VALUE;
-			g_FsInfo.hFileHandle[i].fInUse = false;
-
-			free(g_FsInfo.hFileHandle[i].pFsFileName);
-			g_FsInfo.FileNum--;
+			FS_PutHandle(i);
 		}
 	}
 	ret = FS_NO_ERROR;
@@ -1215,7 +1359,7 @@ Exit:
 static int FS_CCCI_CreateDir(const wchar_t* FileName)
 {
 	int FsFileNameCount;
-	static char FsFileName[PATH_MAX] = {0};
+	char FsFileName[PATH_MAX] = {0};
 	char ConvFileName[PATH_MAX] = {0};
 	struct stat buf;
 	int ret = FS_GENERAL_FAILURE;
@@ -1263,8 +1407,9 @@ static int FS_CCCI_CreateDir(const wchar_t* FileName)
 		ret = FS_ErrorConv(local_errno);
 		goto Exit;
 	}
-	else
-		ret = FS_NO_ERROR;
+
+	FS_IndexUpdate(FsFileName, false);
+	ret = FS_NO_ERROR;
 
 Exit:
 	len = strlen(ConvFileName);
@@ -1282,7 +1427,7 @@ Exit:
 static int FS_CCCI_RemoveDir(const wchar_t* FileName)
 {
 	int FsFileNameCount;
-	static char FsFileName[PATH_MAX] = {0};
+	char FsFileName[PATH_MAX] = {0};
 	char ConvFileName[PATH_MAX] = {0};
 	int ret = FS_GENERAL_FAILURE;
 	int len = 0;
@@ -1316,8 +1461,9 @@ static int FS_CCCI_RemoveDir(const wchar_t* FileName)
 		ret = FS_ErrorConv(local_errno);
 		goto Exit;
 	}
-	else
-		ret = FS_NO_ERROR;
+
+	FS_IndexUpdate(FsFileName, false);
+	ret = FS_NO_ERROR;
 
 Exit:
 	len = strlen(ConvFileName);
@@ -1358,7 +1504,11 @@ static int FS_CCCI_GetFileSize(int HandleIndex, unsigned int* pFileSize)
 
 	Fd = g_FsInfo.hFileHandle[HandleIndex].hFile;
 
-	if(fstat(Fd, &StatBuf) == -1) {
+	if(g_FsInfo.hFileHandle[HandleIndex].pCache) {
+		// the cache follows its own writes, no fstat needed
+		*pFileSize = FS_CacheSize(g_FsInfo.hFileHandle[HandleIndex].pCache);
+		ret = FS_NO_ERROR;
+	} else if(fstat(Fd, &StatBuf) == -1) {
 		local_errno = errno;
 		LOGE("GetFileSize: [error]fail get file size %s: %d \n",
 			g_FsInfo.hFileHandle[HandleIndex].pFsFileName, local_errno);
@@ -1379,7 +1529,7 @@ Exit:
 static int FS_CCCI_Rename(const wchar_t* FileName, const wchar_t* NewFileName)
 {
 	int FsFileNameCount;
-	static char FsFileName[PATH_MAX] = {0};
+	char FsFileName[PATH_MAX] = {0};
 	char FsNewFileName[PATH_MAX] = {0};
 	char ConvFileName[PATH_MAX] = {0};
 	char NewConvFileName[PATH_MAX] = {0};
@@ -1440,8 +1590,10 @@ static int FS_CCCI_Rename(const wchar_t* FileName, const wchar_t* NewFileName)
 		ret = FS_ErrorConv(local_errno);
 		goto Exit;
 	}
-	else
-		ret = FS_NO_ERROR;
+
+	FS_IndexUpdate(FsFileName, false);
+	FS_IndexUpdate(FsNewFileName, true);
+	ret = FS_NO_ERROR;
 
 Exit:
 	len1 = strlen(ConvFileName);
@@ -1462,7 +1614,7 @@ Exit:
 static int FS_CCCI_Delete(const wchar_t* FileName)
 {
 	int FsFileNameCount;
-	static char FsFileName[PATH_MAX] = {0};
+	char FsFileName[PATH_MAX] = {0};
 	char ConvFileName[PATH_MAX] = {0};
 	int ret = FS_GENERAL_FAILURE;
 	int len = 0;
@@ -1497,8 +1649,9 @@ static int FS_CCCI_Delete(const wchar_t* FileName)
 		ret = FS_ErrorConv(local_errno);
 		goto Exit;
 	}
-	else
-		ret = FS_NO_ERROR;
+
+	FS_IndexUpdate(FsFileName, false);
+	ret = FS_NO_ERROR;
 
 Exit:
 	len = strlen(ConvFileName);
@@ -1880,7 +2033,7 @@ _Exit:
 static int FS_CCCI_GetFolderSize(const wchar_t* FullPath, unsigned int Flag)
 {
 	int FsFileNameCount;
-	static char FsFileName[PATH_MAX] = {0};
+	char FsFileName[PATH_MAX] = {0};
 	unsigned int ClusterCount, ClusterSize;
 	int FileCount;
 	struct stat StatBuf;
@@ -1929,7 +2082,8 @@ static int FS_CCCI_GetFolderSize(const wchar_t* FullPath, unsigned int Flag)
 	}
 
 	ClusterCount = 0;
-	FileCount = FS_RecursiveSearch(FsFileName, FS_FILE_TYPE | FS_DIR_TYPE | FS_RECURSIVE_TYPE, &ClusterCount);
+	if(!FS_IndexCount(FsFileName, FS_FILE_TYPE | FS_DIR_TYPE | FS_RECURSIVE_TYPE, &FileCount, &ClusterCount))
+		FileCount = FS_RecursiveSearch(FsFileName, FS_FILE_TYPE | FS_DIR_TYPE | FS_RECURSIVE_TYPE, &ClusterCount);
 
 	if(FileCount < 0) {
 		local_errno = errno;
@@ -1959,7 +2113,7 @@ static int FS_CCCI_GetFolderSize(const wchar_t* FullPath, unsigned int Flag)
 static int FS_CCCI_Count(const wchar_t* FullPath, unsigned int Flag)
 {
 	int FsFileNameCount;
-	static char FsFileName[PATH_MAX] = {0};
+	char FsFileName[PATH_MAX] = {0};
 	struct stat StatBuf;
 	unsigned int ClusterCount;
 	char ConvFullPath[PATH_MAX] = {0};
@@ -2003,7 +2157,8 @@ static int FS_CCCI_Count(const wchar_t* FullPath, unsigned int Flag)
 	}
 
 	ClusterCount = 0;
-	ret = FS_RecursiveSearch(FsFileName, Flag, &ClusterCount);
+	if(!FS_IndexCount(FsFileName, Flag, &ret, &ClusterCount))
+		ret = FS_RecursiveSearch(FsFileName, Flag, &ClusterCount);
 
 Exit:
 	len = strlen(ConvFullPath);
@@ -2021,7 +2176,7 @@ Exit:
 static int FS_CCCI_GetAttributes(const wchar_t* FileName)
 {
 	int FsFileNameCount;
-	static char FsFileName[PATH_MAX] = {0};
+	char FsFileName[PATH_MAX] = {0};
 	char ConvFileName[PATH_MAX] = {0};
 	int ret = FS_GENERAL_FAILURE;
 	int len = 0;
@@ -2066,7 +2221,7 @@ Exit:
 static int FS_CCCI_GetFileDetail(const wchar_t* FileName, FS_FileDetail *FileDetail)
 {
 	int FsFileNameCount;
-	static char FsFileName[PATH_MAX] = {0};
+	char FsFileName[PATH_MAX] = {0};
 	char ConvFileName[PATH_MAX] = {0};
 	int ret = FS_GENERAL_FAILURE;
 	int len = 0;
@@ -2111,7 +2266,7 @@ Exit:
 static int FS_CCCI_XDelete(const wchar_t* FileName, unsigned int Flag)
 {
 	int FsFileNameCount;
-	static char FsFileName[PATH_MAX] = {0};
+	char FsFileName[PATH_MAX] = {0};
 	int DelFileNum;
 	struct stat StatBuf;
 	char ConvFileName[PATH_MAX] = {0};
@@ -2186,6 +2341,7 @@ static int FS_CCCI_XDelete(const wchar_t* FileName, unsigned int Flag)
 		}
 	}
 	ret = DelFileNum;
+	FS_IndexUpdate(FsFileName, true);
 
 Exit:
 	len = strlen(ConvFileName);
@@ -2205,7 +2361,7 @@ Exit:
 static int FS_CCCI_Move(const wchar_t* SrcFullPath, const wchar_t* DstFullPath, unsigned int Flag)
 {
 	int FsFileNameCount;
-	static char FsFileName[PATH_MAX] = {0};
+	char FsFileName[PATH_MAX] = {0};
 	char FsNewFileName[PATH_MAX] = {0};
 	char ConvFullPath[PATH_MAX]= {0};
 	char DstConvFullPath[PATH_MAX]= {0};
@@ -2402,6 +2558,7 @@ static int FS_CCCI_Move(const wchar_t* SrcFullPath, const wchar_t* DstFullPath,
 			close(fd);
 		if(newfd >= 0)
 			close(newfd);
+		FS_IndexUpdate(FsNewFileName, false);
 	}
 Exit:
 	len1 = strlen(ConvFullPath);
@@ -2421,24 +2578,130 @@ Exit:
 	return ret;
 }
 
+/*
+ * Smallest name in FsDirName after Name matching Pattern, read from the directory
+ * when it is not indexed. Returns 1 with Name updated, 0 if none or an FS error.
+ */
+static int FS_ScanDirNext(const char *FsDirName, const char *Pattern, char *Name)
+{
+	DIR* 		pDir;
+	struct dirent*	pDirent;
+	char Next[NAME_MAX + 1];
+	bool bFound = false;
+	int local_errno;
+
+	pDir = opendir(FsDirName);
+	if(pDir == NULL)
+	{
+		local_errno = errno;
+		LOGE("FindFile: [error]fail open %s: %d \n", FsDirName, local_errno);
+		return FS_ErrorConv(local_errno);
+	}
+
+	while((pDirent = readdir(pDir))!= NULL)
+	{
+		if( strcmp(pDirent->d_name, ".") == 0 || strcmp(pDirent->d_name, "..") == 0 )
+			continue;
+		if(strcmp(pDirent->d_name, Name) <= 0 || !PatMatch(Pattern, pDirent->d_name))
+			continue;
+		if(!bFound || strcmp(pDirent->d_name, Next) < 0) {
+			snprintf(Next, sizeof(Next), "%s", pDirent->d_name);
+			bFound = true;
+		}
+	}
+	closedir(pDir);
+
+	if(!bFound)
+		return 0;
+	snprintf(Name, NAME_MAX + 1, "%s", Next);
+	return 1;
+}
+
+/*
+ * Next name matching Pattern from the directory cursor of a search the index does
+ * not serve. Same return values as FS_ScanDirNext().
+ */
+static int FS_ReadDirNext(DIR *pDir, const char *Pattern, char *Name)
+{
+	struct dirent*	pDirent;
+
+	while((pDirent = readdir(pDir))!= NULL)
+	{
+		if( strcmp(pDirent->d_name, ".") == 0 || strcmp(pDirent->d_name, "..") == 0 )
+			continue;
+		if(PatMatch(Pattern, pDirent->d_name)) {
+			snprintf(Name, NAME_MAX + 1, "%s", pDirent->d_name);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Next match of a search in FsDirName after Name, the last one returned. With the
+ * index enabled at FindFirst (*ppDir NULL, Name empty) names come from the index in
+ * strcmp() order and the search keeps no directory open. Otherwise FindFirst opens
+ * the directory into *ppDir and the search reads on from its cursor, in readdir()
+ * order. Should the index get disabled halfway through a search, the rest of it is
+ * scanned after Name. Same return values as FS_ScanDirNext().
+ */
+static int FS_FindMatch(const char *FsDirName, const char *Pattern, char Attr, char AttrMask,
+	char *Name, DIR **ppDir)
+{
+	char FsFileName[PATH_MAX];
+	char FileAttr;
+	int local_errno;
+	int ret;
+
+	while(1)
+	{
+		if(*ppDir != NULL) {
+			ret = FS_ReadDirNext(*ppDir, Pattern, Name);
+		} else {
+			ret = FS_IndexFindNext(FsDirName, Pattern, Name);
+			if(ret < 0 && Name[0] != '\0') {
+				ret = FS_ScanDirNext(FsDirName, Pattern, Name);
+			} else if(ret < 0) {
+				*ppDir = opendir(FsDirName);
+				if(*ppDir == NULL) {
+					local_errno = errno;
+					LOGE("FindFile: [error]fail open %s: %d \n", FsDirName, local_errno);
+					return FS_ErrorConv(local_errno);
+				}
+				ret = FS_ReadDirNext(*ppDir, Pattern, Name);
+			}
+		}
+		if(ret <= 0)
+			return ret;
+
+		if(snprintf(FsFileName, sizeof(FsFileName), "%s/%s", FsDirName, Name) >= PATH_MAX) {
+			LOGE("FindFile: [error]file path too long: %s/%s \n", FsDirName, Name);
+			return FS_PATH_OVER_LEN_ERROR;
+		}
+		FileAttr = FS_AttrReconv(FsFileName);
+		if((FileAttr & Attr ) == Attr && (FileAttr & AttrMask) ==  0)
+			return 1;
+		LOGD("FindFile: <%s> not match:fileAttr=%d, Attr=%d,AttrMask=%d\n",
+			FsFileName, FileAttr, Attr, AttrMask);
+	}
+}
+
 static int FS_CCCI_FindFirst(const wchar_t* PatternName, char Attr, char AttrMask, FS_DOSDirEntry *pFileInfo, wchar_t* FileName, unsigned int *pMaxLength)
 {
-		static char FsPatternName[PATH_MAX] = {0};
+		char FsPatternName[PATH_MAX] = {0};
 		char FsDirName[PATH_MAX] = {0};
 		char FsFileName[PATH_MAX] = {0};
 		int FsFileNameCount;
 		int i;
 		char ConvPatternName[PATH_MAX] = {0};
-		DIR* 	pDir = NULL;
-		struct dirent*	pDirent = NULL;
-		char FileAttr;
+		char Name[NAME_MAX + 1] = {0};
+		DIR*	pDir = NULL;
 		bool bFound = false;
 		unsigned int HandleIndex;
 		unsigned int max_len = *pMaxLength;
 		int ret = FS_GENERAL_FAILURE;
 		int len1 = 0;
 		int len2 = 0;
-		int local_errno;
 
 		*pMaxLength = 0;
 		FS_ConvWcsToCs(PatternName, ConvPatternName);
@@ -2485,91 +2748,53 @@ static int FS_CCCI_FindFirst(const wchar_t* PatternName, char Attr, char AttrMas
 		strncpy(FsDirName, FsPatternName, i-1); // skip '/'
 		FsDirName[i-1] = '\0';
 
-		dbg_printf("FindFirst: Open Dir <%s> ... \n", FsDirName);
+		dbg_printf("FindFirst: Search Dir <%s> ... \n", FsDirName);
 
-		pDir = opendir(FsDirName);
-		if(pDir == NULL)
-		{
-			local_errno = errno;
-			LOGE("FindFirst: [error]fail open %s: %d \n", FsDirName, local_errno);
-			ret = FS_ErrorConv(local_errno);
+		ret = FS_FindMatch(FsDirName, FsFileName, Attr, AttrMask, Name, &pDir);
+		if(ret < 0)
 			goto Exit;
-		}
-
-		while((pDirent = readdir(pDir))!= NULL)
-		{
-	       if( strcmp(pDirent->d_name, ".") == 0 || strcmp(pDirent->d_name, "..") == 0 )
-			    continue;
-
-			//check if file name match
-			if(PatMatch(FsFileName, pDirent->d_name))
-			{
-				if(i+strlen(pDirent->d_name) > PATH_MAX) {
-					LOGE("FindFirst: [error]file path[2] too long: %s \n", FsPatternName);
-					ret = FS_PATH_OVER_LEN_ERROR;
-					goto Exit;
-				}
-
-				snprintf((FsPatternName+i), (PATH_MAX - i), "%s", pDirent->d_name);
-				FileAttr = FS_AttrReconv(FsPatternName);
-				if((FileAttr & Attr ) == Attr && (FileAttr & AttrMask) ==  0)	{
-				    LOGD("FindFirst: FsPatternName = <%s> ... \n", FsPatternName);
-					bFound = true;
-					break;
-				} else {
-					LOGD("FindFirst: FsPatternName = <%s> not match:fileAttr=%d, Attr=%d,AttrMask=%d\n",
-						FsPatternName, FileAttr, Attr, AttrMask);
-				}
-			}
-		}
 
-        if(bFound == true)
+        if(ret > 0)
         {
-    		if((HandleIndex = FS_GetFreeHandle()) == 0xFFFFFFFF)
+			bFound = true;
+			snprintf((FsPatternName+i), (PATH_MAX - i), "%s", Name);
+			LOGD("FindFirst: FsPatternName = <%s> ... \n", FsPatternName);
+    		if((HandleIndex = FS_GetFreeHandle(FS_PathKey(PatternName, true))) == 0xFFFFFFFF)
     		{
 				LOGE("FindFirst: [error]fail get handle index \n");
 				ret = FS_TOO_MANY_FILES;
 				goto Exit;
     		}
     		dbg_printf("FindFirst: FileNum:%d, HandleIndex:%d \n", g_FsInfo.FileNum,HandleIndex);
-		    g_FsInfo.FileNum++;
-		    g_FsInfo.hFileHandle[HandleIndex].hFile = (int)pDir;
-		    g_FsInfo.hFileHandle[HandleIndex].fInUse = true;
 		    g_FsInfo.hFileHandle[HandleIndex].fSearch = true;
 		    g_FsInfo.hFileHandle[HandleIndex].Attr = Attr;
 		    g_FsInfo.hFileHandle[HandleIndex].AttrMask = AttrMask;
 		    g_FsInfo.hFileHandle[HandleIndex].pFsFileName = (char*)malloc(sizeof(char)*(strlen(FsPatternName)+1));
-		    if(g_FsInfo.hFileHandle[HandleIndex].pFsFileName == NULL) {
+		    g_FsInfo.hFileHandle[HandleIndex].pFsSearchPattern = (char*)malloc(sizeof(char)*(strlen(FsFileName)+1));
+		    if(g_FsInfo.hFileHandle[HandleIndex].pFsFileName == NULL ||
+		       g_FsInfo.hFileHandle[HandleIndex].pFsSearchPattern == NULL) {
 				LOGE("FindFirst: [error]fail alloc memory for FileName \n");
+				FS_PutHandle(HandleIndex);
 				ret = FS_ERROR_RESERVED;
 				goto Exit;
 		    }
 			memcpy(g_FsInfo.hFileHandle[HandleIndex].pFsFileName, FsPatternName, sizeof(char)*(strlen(FsPatternName)+1));
-
-			g_FsInfo.hFileHandle[HandleIndex].pFsSearchPattern = (char*)malloc(sizeof(char)*(strlen(FsFileName)+1));
-            if(g_FsInfo.hFileHandle[HandleIndex].pFsSearchPattern == NULL) {
-				LOGE("FindFirst: [error]fail alloc memory for SearchPattern \n");
-        		ret = FS_ERROR_RESERVED;
-				goto Exit;
-            }
 			memcpy(g_FsInfo.hFileHandle[HandleIndex].pFsSearchPattern, FsFileName, sizeof(char)*(strlen(FsFileName)+1));
+			// FindNext goes on from pDir or, searching the index, after the name in pFsFileName
+		    g_FsInfo.hFileHandle[HandleIndex].hFile = 0;
+		    g_FsInfo.hFileHandle[HandleIndex].pSearchDir = pDir;
+		    pDir = NULL;
 
 			FS_EntryLinuxToDos(pFileInfo, FsPatternName);
 
-		    *pMaxLength = FS_ConvCsToWcs(pDirent->d_name, FileName, max_len);
-			if(strlen(pDirent->d_name) < max_len)
+		    *pMaxLength = FS_ConvCsToWcs(Name, FileName, max_len);
+			if(strlen(Name) < max_len)
 				pFileInfo->NTReserved = FS_LFN_MATCH;
 			else
 				pFileInfo->NTReserved = FS_NOT_MATCH;
 	}  	else {
         *pMaxLength = 0;
         LOGE("FindFirst: [error]no more files...\n");
-
-		if(pDir != NULL) {
-			if(closedir(pDir) != 0) {
-				LOGE("FindFirst: [error]fail close dir %s: %d \n", FsDirName, errno);
-			}
-		}
 		ret = FS_NO_MORE_FILES;
 		goto Exit;
     }
@@ -2577,7 +2802,12 @@ static int FS_CCCI_FindFirst(const wchar_t* PatternName, char Attr, char AttrMas
 	ret = HandleIndex;
 
 Exit:
-	if(pDirent == NULL) {
+	if(pDir != NULL) {
+		if(closedir(pDir) != 0) {
+			LOGE("FindFirst: [error]fail close dir %s: %d \n", FsDirName, errno);
+		}
+	}
+	if(!bFound) {
 		len1 = strlen(FsDirName);
 		if(len1>=8) {
 			LOGD("FF: [%02X%02X%02X%02X%02X%02X%02X%02X](%d %d %d): [null] %d \n",
@@ -2589,14 +2819,14 @@ Exit:
 		}
 	} else {
 		len1 = strlen(FsDirName);
-		len2 = strlen(pDirent->d_name);
+		len2 = strlen(Name);
 		if( (len2>=8)&&(len1>=8)) {
 			LOGD("FF: [%02X%02X%02X%02X%02X%02X%02X%02X](%d %d %d): [%02X%02X%02X%02X%02X%02X%02X%02X] %d \n",
 			(FsDirName[len1-1]-32),(FsDirName[len1-2]-32),(FsDirName[len1-3]-32),(FsDirName[len1-4]-32),
 			(FsDirName[len1-5]-32),(FsDirName[len1-6]-32),(FsDirName[len1-7]-32),(FsDirName[len1-8]-32),
 			Attr, AttrMask, *pMaxLength,
-			(pDirent->d_name[len2-1]-32),(pDirent->d_name[len2-2]-32),(pDirent->d_name[len2-3]-32),(pDirent->d_name[len2-4]-32),
-			(pDirent->d_name[len2-5]-32),(pDirent->d_name[len2-6]-32),(pDirent->d_name[len2-7]-32),(pDirent->d_name[len2-8]-32),
+			(Name[len2-1]-32),(Name[len2-2]-32),(Name[len2-3]-32),(Name[len2-4]-32),
+			(Name[len2-5]-32),(Name[len2-6]-32),(Name[len2-7]-32),(Name[len2-8]-32),
 			ret);
 		} else {
 			LOGD("FF: len1 %d, len2 %d\n", len1, len2);
@@ -2608,11 +2838,10 @@ Exit:
 
 static int FS_CCCI_FindNext(int HandleIndex, FS_DOSDirEntry *pFileInfo, wchar_t* FileName, unsigned int *pMaxLength)
 {
-	static char FsPatternName[PATH_MAX] = {0};
+	char FsPatternName[PATH_MAX] = {0};
 	bool bFound = false;
-	DIR* 	pDir;
-	struct dirent*	pDirent = NULL;
-	char FileAttr, Attr, AttrMask;
+	char Name[NAME_MAX + 1] = {0};
+	char Attr, AttrMask;
 	char* pSearchPattern;
 	int i;
 	char ConvFileName[PATH_MAX];
@@ -2638,7 +2867,6 @@ static int FS_CCCI_FindNext(int HandleIndex, FS_DOSDirEntry *pFileInfo, wchar_t*
 		goto Exit;
 	}
 
-	pDir = (DIR*)g_FsInfo.hFileHandle[HandleIndex].hFile;
 	pSearchPattern = g_FsInfo.hFileHandle[HandleIndex].pFsSearchPattern;
 	Attr = g_FsInfo.hFileHandle[HandleIndex].Attr;
 	AttrMask = g_FsInfo.hFileHandle[HandleIndex].AttrMask;
@@ -2657,34 +2885,21 @@ static int FS_CCCI_FindNext(int HandleIndex, FS_DOSDirEntry *pFileInfo, wchar_t*
 		goto Exit;
 	}
 
+	// the last name returned is the cursor, the directory part is the one searched
+	snprintf(Name, sizeof(Name), "%s", FsPatternName + i + 1);
+	FsPatternName[i] = '\0';
+	ret = FS_FindMatch(FsPatternName, pSearchPattern, Attr, AttrMask, Name,
+		(DIR**)&g_FsInfo.hFileHandle[HandleIndex].pSearchDir);
+	if(ret < 0)
+		goto Exit;
+	bFound = (ret > 0);
+	FsPatternName[i] = '/';
 	i = i+1; // '/' should be excluded.
 
-	while((pDirent = readdir(pDir))!= NULL)
-	{
-		//check if file name match
-		if(PatMatch(pSearchPattern, pDirent->d_name))
-		{
-			if(i + strlen(pDirent->d_name) > PATH_MAX) {
-				LOGE("FindNext: [error]file path[0] too long:%s \n", pDirent->d_name);
-				ret = FS_PATH_OVER_LEN_ERROR;
-				goto Exit;
-			}
-			snprintf((FsPatternName+i), (PATH_MAX - i), "%s", pDirent->d_name);
-
-			FileAttr = FS_AttrReconv(FsPatternName);
-			if((FileAttr & Attr ) == Attr && (FileAttr & AttrMask) ==  0)	{
-			    LOGD("FindNext: FsPatternName = <%s> ... \n", FsPatternName);
-				bFound = true;
-				break;
-			} else {
-				LOGD("FindNext: FsPatternName = <%s> not match:fileAttr=%d, Attr=%d,AttrMask=%d\n",
-					FsPatternName, FileAttr, Attr, AttrMask);
-			}
-		}
-	}
-
     if(bFound == true)
     {
+		snprintf((FsPatternName+i), (PATH_MAX - i), "%s", Name);
+		LOGD("FindNext: FsPatternName = <%s> ... \n", FsPatternName);
 	    free(g_FsInfo.hFileHandle[HandleIndex].pFsFileName);
 
 	    g_FsInfo.hFileHandle[HandleIndex].pFsFileName = (char*)malloc(sizeof(char)*(strlen(FsPatternName)+1));
@@ -2698,8 +2913,8 @@ static int FS_CCCI_FindNext(int HandleIndex, FS_DOSDirEntry *pFileInfo, wchar_t*
 
 		FS_EntryLinuxToDos(pFileInfo, FsPatternName);
 
-	    *pMaxLength = FS_ConvCsToWcs(pDirent->d_name, FileName, max_len);
-		if(strlen(pDirent->d_name) < max_len)
+	    *pMaxLength = FS_ConvCsToWcs(Name, FileName, max_len);
+		if(strlen(Name) < max_len)
 			pFileInfo->NTReserved = FS_LFN_MATCH;
 		else
 			pFileInfo->NTReserved = FS_NOT_MATCH;
@@ -2714,17 +2929,17 @@ static int FS_CCCI_FindNext(int HandleIndex, FS_DOSDirEntry *pFileInfo, wchar_t*
     }
 
 Exit:
-	if(pDirent == NULL)
+	if(!bFound)
 	{
 		LOGD("FN: %d %d: [NULL] %d \n", HandleIndex, *pMaxLength, ret);
     }
 	else
 	{
-		len = strlen(pDirent->d_name);
+		len = strlen(Name);
 		if(len>=8) {
 			LOGD("FN: %d %d: [%02X%02X%02X%02X%02X%02X%02X%02X] %d \n", HandleIndex, *pMaxLength,
-			(pDirent->d_name[len-1]-32),(pDirent->d_name[len-2]-32),(pDirent->d_name[len-3]-32),(pDirent->d_name[len-4]-32),
-			(pDirent->d_name[len-5]-32),(pDirent->d_name[len-6]-32),(pDirent->d_name[len-7]-32),(pDirent->d_name[len-8]-32),
+			(Name[len-1]-32),(Name[len-2]-32),(Name[len-3]-32),(Name[len-4]-32),
+			(Name[len-5]-32),(Name[len-6]-32),(Name[len-7]-32),(Name[len-8]-32),
 			ret);
 		} else {
 			LOGD("FN: stren < 8(%d)\n", len);
@@ -2758,7 +2973,7 @@ static int FS_CCCI_FindClose(int HandleIndex)
 
 	if(g_FsInfo.hFileHandle[HandleIndex].fSearch)
 	{
-		if(closedir((DIR*)g_FsInfo.hFileHandle[HandleIndex].hFile) != 0)
+		if(FS_CloseSearchDir(HandleIndex) != 0)
 		{
 			local_errno = errno;
 			LOGE("FindClose: [error]fail close Dir %s: %d \n", g_FsInfo.hFileHandle[HandleIndex].pFsFileName, errno);
@@ -2777,15 +2992,7 @@ static int FS_CCCI_FindClose(int HandleIndex)
 		}
 	}
 
-	g_FsInfo.hFileHandle[HandleIndex].hFile = INVALID_HANDLE_VALUE;
-	g_FsInfo.hFileHandle[HandleIndex].fInUse = false;
-
-	if(g_FsInfo.hFileHandle[HandleIndex].pFsFileName != NULL)
-	    free(g_FsInfo.hFileHandle[HandleIndex].pFsFileName);
-
-	if(g_FsInfo.hFileHandle[HandleIndex].pFsSearchPattern != NULL)
-	    free(g_FsInfo.hFileHandle[HandleIndex].pFsSearchPattern);
-	g_FsInfo.FileNum--;
+	FS_PutHandle(HandleIndex);
 
 	ret = FS_NO_ERROR;
 
@@ -2827,9 +3034,19 @@ Exit:
 	return ret;
 }
 
+static void FS_CacheDumpStat(void)
+{
+	FS_CACHE_STAT Stat;
+
+	FS_CacheGetStat(&Stat);
+	LOGD("[Profile]cache: hit=%u, miss=%u, write=%u, fsync=%u\n",
+		Stat.Hit, Stat.Miss, Stat.Write, Stat.Fsync);
+}
+
 static void FS_CCCI_ShutDown()
 {
 	FS_CCCI_CloseAll();
+	FS_CacheDumpStat();
 }
 
 static int FS_CCCI_GetDiskInfo(FS_DiskInfo *pDiskInfo)
@@ -2896,6 +3113,7 @@ static int FS_CCCI_Restore(const wchar_t* FileName)
     LOGD("RS %s PASS\n", FsFileName);
 
     ret = FS_NO_ERROR;
+    FS_IndexUpdate(FsFileName, false);
 _Exit:
     return ret;
 }
@@ -3299,6 +3517,13 @@ void FS_Init(int md_id)
 		g_FsInfo.hFileHandle[i].fInUse = false;
 		g_FsInfo.hFileHandle[i].hFile = INVALID_HANDLE_VALUE;
 	}
+
+	for(i = 0; i < FS_MAX_DIR_NUM; i++)
+	{
+		if(FsRootDir[i][0] != '\0')
+			FS_IndexAddRoot(FsRootDir[i]);
+	}
+	FS_IndexInit(FS_CCCI_GetClusterSize('Z'));
 }
 
 void FS_Deinit(void)
@@ -3420,63 +3645,968 @@ static void ccci_create_md_status_listen_thread()
 	//pthread_join(thread_id, NULL);
 }
 
-int main(int argc, char *argv[])
+/*
+ * Request dispatch: main() only reassembles and decodes requests from the FS device,
+ * the FS operations run on FS_WORKER_NUM workers. A request may run when no earlier
+ * request still queued or running has the same key (path, or the path a handle was
+ * opened on) and none of them is exclusive; an exclusive request waits until it is the
+ * oldest one. Requests which touch several paths or global state are exclusive.
+ * Each FS_REQ belongs to one request buffer slot, MD reuses a slot only after it got
+ * the response. A request is unlinked only once its response is written: the next
+ * request on the same key cannot answer first, and an empty queue means every
+ * response is out.
+ */
+typedef struct FS_REQ_STRUCT
 {
-	int mdstatus;
-	int ReqBufIndex = 0;
-	FS_BUF *pFsBuf;
-	int PacketNum = 0;
-	int RetVal;
-	FS_PACKET_INFO *PackInfo;
-	FS_DOSDirEntry DosDirEntry;
-	FS_DiskInfo DiskInfo;
-	static wchar_t FileNameTemp[PATH_MAX] = {0};
-	unsigned int Length;
-	char dev_node[32];
-	int  using_old_ver = 0;
-	int  port_open_retry = 600;
-	int i = 0;
-	CCCI_BUFF_T *ccci_h = NULL;
-	char *pkt_buff;//[MAX_FS_BUF_BYTE] = {0};
-	STREAM_DATA *stream = NULL; // data packet received from MD
-	STREAM_DATA *buffer_slot = NULL; // local buffer slot
-	char *p_fs_buff = NULL;
-	nvram_fs_para_cmpt_t in_cmpt_para;
-	nvram_fs_para_cmptw_t in_cmptw_para;
-	FS_FileDetail FileDetail;
-	int WriteByte = 0;
-	unsigned int ReadByte = 0;
-	unsigned int FileSize = 0;
-	char ConvFileName[PATH_MAX];
+	struct FS_REQ_STRUCT	*pNext;		// arrival order
+	int			BufIndex;
+	FS_BUF			*pFsBuf;
+	unsigned int		Key;		// 0: no ordering needed
+	bool			fExclusive;
+	bool			fQueued;
+	bool			fRunning;
+	int			PacketNum;
+	FS_PACKET_INFO		PackInfo[FS_REQ_ARG_MAX];
+	// response data referenced by PackInfo until it is written to MD
+	int			RetVal;
+	unsigned int		FileSize;
+	unsigned int		ReadByte;
+	int			WriteByte;
+	unsigned int		Length;
+	FS_DOSDirEntry		DosDirEntry;
+	FS_DiskInfo		DiskInfo;
+	FS_FileDetail		FileDetail;
+	nvram_fs_para_cmpt_t	in_cmpt_para;
+	nvram_fs_para_cmptw_t	in_cmptw_para;
+	wchar_t			FileNameTemp[PATH_MAX];
+} FS_REQ;
+
+static FS_REQ g_FsReq[FS_REQ_BUFFER_MUN];
+static FS_REQ *g_FsReqHead = NULL;
+static pthread_mutex_t g_FsReqLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_FsReqCond = PTHREAD_COND_INITIALIZER;
+// g_bak and the fragments of one response must not interleave with another response
+static pthread_mutex_t g_FsWriteLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t g_FsWorker[FS_WORKER_NUM];
+
+// FS_WAKE_LOCK() is not reference counted, hold it while any request is in flight
+static pthread_mutex_t g_FsWakeLockMutex = PTHREAD_MUTEX_INITIALIZER;
+static int g_FsWakeLockCount = 0;
+
+static void FS_WakeLockGet(void)
+{
+	pthread_mutex_lock(&g_FsWakeLockMutex);
+	if(g_FsWakeLockCount++ == 0)
+		FS_WAKE_LOCK();
+	pthread_mutex_unlock(&g_FsWakeLockMutex);
+}
 
-	LOGE_COM("md_fsd Ver:v2.3, CCCI Ver:%d", ccci_get_version());
+static void FS_WakeLockPut(void)
+{
+	pthread_mutex_lock(&g_FsWakeLockMutex);
+	if(--g_FsWakeLockCount == 0)
+		FS_WAKE_UNLOCK();
+	pthread_mutex_unlock(&g_FsWakeLockMutex);
+}
 
-	//Check if input parameter is valid
-	if(argc != 2) {
-		md_id = 0;
-		LOGE("[Warning]Parameter number not correct,use old version!\n");
-		using_old_ver = 1;
-		snprintf(dev_node, 32, "/dev/ccci_fs");
-		for (i = 0; i < FS_MAX_DIR_NUM; i++) {
-			snprintf(FsRootDir[i], 36, "%s", FsRootDir_MD1[i]);
+static void FS_ClassifyRequest(FS_REQ *req)
+{
+	FS_PACKET_INFO *PackInfo = req->PackInfo;
+
+	req->Key = 0;
+	req->fExclusive = false;
+
+	switch(req->pFsBuf->OperateID)
+	{
+		case FS_CCCI_OP_OPEN:
+		case FS_CCCI_OP_OPENHINT:
+		case FS_CCCI_OP_CMPT_READ:
+		case FS_CCCI_OP_CREATEDIR:
+		case FS_CCCI_OP_DELETE:
+		case FS_CCCI_OP_GETATTRIBUTES:
+		case FS_CCCI_OP_GETFILEDETAIL:
+		case FS_CCCI_OP_GETFOLDERSIZE:
+		case FS_CCCI_OP_COUNT:
+			req->Key = FS_PathKey((wchar_t*)PackInfo[0].pData, false);
+			break;
+		case FS_CCCI_OP_FINDFIRST:
+			req->Key = FS_PathKey((wchar_t*)PackInfo[0].pData, true);
+			break;
+		case FS_CCCI_OP_CMPT_WRITE:
+		{
+			int HandleIndex = ((nvram_fs_para_cmptw_t*)PackInfo[1].pData)->file_handle;
+
+			if(HandleIndex < 0)
+				req->Key = FS_PathKey((wchar_t*)PackInfo[0].pData, false);
+			else
+				req->Key = FS_HandleKey(HandleIndex);
+			break;
 		}
-	} else {
-		if(strcmp(argv[1],"0")==0) {
-			snprintf(dev_node, 32, "%s", ccci_get_node_name(USR_CCCI_FS, MD_SYS1));
-			for (i = 0; i < FS_MAX_DIR_NUM; i++) {
-				snprintf(FsRootDir[i], 36, "%s", FsRootDir_MD1[i]);
-			}
-			md_id = 0;
-		} else if(strcmp(argv[1],"1")==0) {
-			snprintf(dev_node, 32, "%s", ccci_get_node_name(USR_CCCI_FS, MD_SYS2));
-			for (i = 0; i < FS_MAX_DIR_NUM; i++) {
-				snprintf(FsRootDir[i], 36, "%s", FsRootDir_MD2[i]);
-			}
-			md_id =1;
-		} else if (strcmp(argv[1],"2")==0) {
-			snprintf(dev_node, 32, "%s", ccci_get_node_name(USR_CCCI_FS, MD_SYS3));
-			for (i = 0; i < FS_MAX_DIR_NUM; i++) {
-				snprintf(FsRootDir[i], 36, "%s", FsRootDir_MD3[i]);
+		case FS_CCCI_OP_SEEK:
+		case FS_CCCI_OP_READ:
+		case FS_CCCI_OP_WRITE:
+		case FS_CCCI_OP_CLOSE:
+		case FS_CCCI_OP_GETFILESIZE:
+		case FS_CCCI_OP_FINDNEXT:
+		case FS_CCCI_OP_FINDCLOSE:
+			req->Key = FS_HandleKey(*((int*)PackInfo[0].pData));
+			break;
+		case FS_CCCI_OP_GETDISKINFO:
+		case FS_CCCI_OP_GETDRIVE:
+		case FS_CCCI_OP_GETCLUSTERSIZE:
+		case FS_CCCI_OP_LOCKFAT:
+		case FS_CCCI_OP_UNLOCKALL:
+		case FS_CCCI_OP_CLEARDISKFLAG:
+		case FS_CCCI_OP_SETDISKFLAG:
+			break;
+		default:
+			// CloseAll, ShutDown, Rename, Move, XDelete, RemoveDir, Restore, OTP, bin region
+			req->fExclusive = true;
+			break;
+	}
+}
+
+// called with g_FsReqLock held
+static FS_REQ *FS_PickRequest(void)
+{
+	FS_REQ *req, *prev;
+
+	for(req = g_FsReqHead; req != NULL; req = req->pNext)
+	{
+		if(req->fRunning)
+			continue;
+		if(req->fExclusive) {
+			if(req == g_FsReqHead)
+				return req;
+			continue;
+		}
+		for(prev = g_FsReqHead; prev != req; prev = prev->pNext)
+		{
+			if(prev->fExclusive || (req->Key != 0 && prev->Key == req->Key))
+				break;
+		}
+		if(prev == req)
+			return req;
+	}
+	return NULL;
+}
+
+static void FS_QueueRequest(FS_REQ *req)
+{
+	FS_REQ **pp;
+
+	pthread_mutex_lock(&g_FsReqLock);
+	req->pNext = NULL;
+	req->fQueued = true;
+	req->fRunning = false;
+	for(pp = &g_FsReqHead; *pp != NULL; pp = &(*pp)->pNext)
+		;
+	*pp = req;
+	pthread_cond_broadcast(&g_FsReqCond);
+	pthread_mutex_unlock(&g_FsReqLock);
+}
+
+// a new request must not land in a slot still queued: MD reuses a slot as
+// soon as it has the response, the worker unlinks the request right after
+static void FS_WaitSlotIdle(int BufIndex)
+{
+	FS_REQ *req = &g_FsReq[BufIndex];
+
+	pthread_mutex_lock(&g_FsReqLock);
+	while(req->fQueued)
+		pthread_cond_wait(&g_FsReqCond, &g_FsReqLock);
+	pthread_mutex_unlock(&g_FsReqLock);
+}
+
+static void FS_ExecRequest(FS_REQ *req)
+{
+	FS_BUF *pFsBuf = req->pFsBuf;
+	FS_PACKET_INFO *PackInfo = req->PackInfo;
+	int PacketNum = 0;
+	char ConvFileName[PATH_MAX];
+
+	switch(pFsBuf->OperateID)
+	{
+		/* cmpt_read */
+		case FS_CCCI_OP_CMPT_READ:
+		{
+			wchar_t* FileName = (wchar_t*)PackInfo[0].pData;
+
+			// For debug only ===
+			//char FsFileName[PATH_MAX] = {0};
+			//int FsFileNameCount;
+
+			// For debug only ===
+			memcpy(&req->in_cmpt_para, PackInfo[1].pData, sizeof(req->in_cmpt_para));
+			FS_ConvWcsToCs(FileName, ConvFileName);
+			//FS_MD2APPath(FileName, ConvFileName, FsFileName, PATH_MAX, &FsFileNameCount);
+			LOGD("CMPT File name:%s opid_map:0x%08x Flag:0x%08x Offset:%d Whence:%d Length:%d",
+				ConvFileName, req->in_cmpt_para.opid_map, req->in_cmpt_para.flag, req->in_cmpt_para.offset,
+				req->in_cmpt_para.whence, req->in_cmpt_para.length);
+
+			// PacketNum                          1 DWORD
+			// PackInfo[0].Length = 2*sizeof(int) 1 DWORD
+			// PackInfo[0].pData: ret[0], ret[1]  2 DWORD
+			// PackInfo[1].Length = 1*sizeof(int) 1 DWORD
+			// PackInfo[1].pData                  1 DWORD
+			// PackInfo[2].Length = 1*sizeof(int) 1 DWORD
+			// PackInfo[2].pData                  1 DWORD
+			// PackInfo[3].Lenght = 1*sizeof(int) 1 DWORD
+			// PackInfo[3].pData    <-- here
+			req->in_cmpt_para.data_ptr = pFsBuf->Buffer + (1+1+2+1+1+1+1+1) * sizeof(int);
+
+			req->RetVal = FS_CCCI_CMPT_Read(FileName, &req->in_cmpt_para);
+
+			PackInfo[PacketNum].Length = sizeof(req->in_cmpt_para.ret);
+			PackInfo[PacketNum++].pData = (void*)req->in_cmpt_para.ret;
+			PackInfo[PacketNum].Length = sizeof(unsigned int);
+			PackInfo[PacketNum++].pData = (void*)&req->in_cmpt_para.file_size;
+			PackInfo[PacketNum].Length = sizeof(unsigned int);
+			PackInfo[PacketNum++].pData = (void*)&req->in_cmpt_para.act_read;
+			PackInfo[PacketNum].Length = req->in_cmpt_para.act_read;
+			PackInfo[PacketNum++].pData = req->in_cmpt_para.data_ptr;
+			//LOGD("cmpt_read ret (%d)\n", req->RetVal);
+			break;
+		}
+		/* cmpt_write */
+		case FS_CCCI_OP_CMPT_WRITE:
+		{
+			wchar_t* FileName = (wchar_t*)PackInfo[0].pData;
+
+			// For debug only ===
+			//char FsFileName[PATH_MAX] = {0};
+			//int FsFileNameCount;
+
+			// For debug only ===
+			memcpy(&req->in_cmptw_para, PackInfo[1].pData, sizeof(req->in_cmptw_para));
+			void* pBuffer = PackInfo[2].pData;
+			FS_ConvWcsToCs(FileName, ConvFileName);
+			//FS_MD2APPath(FileName, ConvFileName, FsFileName, PATH_MAX, &FsFileNameCount);
+			LOGD("CMPTW File name:%s opid_map:0x%08x Flag:0x%08x Offset:%d Whence:%d Length:%d file_handle:%d",
+				ConvFileName, req->in_cmptw_para.opid_map, req->in_cmptw_para.flag, req->in_cmptw_para.offset,
+				req->in_cmptw_para.whence, req->in_cmptw_para.length, req->in_cmptw_para.file_handle);
+
+			req->RetVal = FS_CCCI_CMPT_Write(FileName, &req->in_cmptw_para, pBuffer);
+
+			PackInfo[PacketNum].Length = sizeof(req->in_cmptw_para.ret);
+			PackInfo[PacketNum++].pData = (void*)req->in_cmptw_para.ret;
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*)&req->in_cmptw_para.file_handle_ptr;
+			PackInfo[PacketNum].Length = sizeof(unsigned int);
+			PackInfo[PacketNum++].pData = (void*)&req->in_cmptw_para.act_write_size;
+			LOGD("cmpt_write ret (%d)\n", req->RetVal);
+			break;
+		}
+		case FS_CCCI_OP_RESTORE:
+		{
+			wchar_t* FileName = (wchar_t*)PackInfo[0].pData;
+			dbg_printf("Main: FS_CCCI_RESTORE \n");
+			req->RetVal = FS_CCCI_Restore(FileName);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*)&req->RetVal;
+			break;
+		}
+		case FS_CCCI_OP_OPEN:
+		{
+			wchar_t* FileName = (wchar_t*)PackInfo[0].pData;
+			int	Flag = *((int*)PackInfo[1].pData);
+			dbg_printf("Main: FS_CCCI_OPEN \n");
+			req->RetVal = FS_CCCI_Open(FileName, Flag);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*)&req->RetVal;
+			break;
+		}
+		case FS_CCCI_OP_GETFILESIZE:
+		{
+			int HandleIndex = *((unsigned int*)PackInfo[0].pData);
+			dbg_printf("Main: FS_CCCI_GetFileSize \n");
+			req->RetVal = FS_CCCI_GetFileSize(HandleIndex, &req->FileSize);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			PackInfo[PacketNum].Length = sizeof(unsigned int);
+			PackInfo[PacketNum++].pData = (void*) &req->FileSize;
+			break;
+		}
+		case FS_CCCI_OP_SEEK:
+		{
+			int HandleIndex = *((unsigned int*)PackInfo[0].pData);
+			unsigned int Offset = *((unsigned int*)PackInfo[1].pData);
+			unsigned int Whence = *((unsigned int*)PackInfo[2].pData);
+			dbg_printf("Main: FS_CCCI_SEEK \n");
+			req->RetVal = FS_CCCI_Seek(HandleIndex, Offset, Whence);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			break;
+		}
+		case FS_CCCI_OP_READ:
+		{
+			int HandleIndex = *((unsigned int*)PackInfo[0].pData);
+			int NumOfByte = *((int*)PackInfo[1].pData);
+			void* pBuffer = pFsBuf->Buffer + 6*sizeof(int);
+			/*memory corrupt issue: there are only two parameters for read from modem CCCI, so PackInfo[2] is invalid*/
+			//void* pBuffer = PackInfo[2].pData;
+			dbg_printf("Main: FS_CCCI_READ \n");
+			req->RetVal = FS_CCCI_Read(HandleIndex, pBuffer, NumOfByte, &req->ReadByte);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			PackInfo[PacketNum].Length = sizeof(unsigned int);
+			PackInfo[PacketNum++].pData = (void*) &req->ReadByte;
+			PackInfo[PacketNum].Length = req->ReadByte;
+			PackInfo[PacketNum++].pData = pBuffer;
+			break;
+		}
+		case FS_CCCI_OP_WRITE:
+		{
+			int HandleIndex = *((unsigned int*)PackInfo[0].pData);
+			void* pBuffer = PackInfo[1].pData;
+			int NumOfByte = *((int*)PackInfo[2].pData);
+			dbg_printf("Main: FS_CCCI_WRITE \n");
+			req->RetVal = FS_CCCI_Write(HandleIndex, pBuffer, NumOfByte, &req->WriteByte);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			PackInfo[PacketNum].Length = sizeof(unsigned int);
+			PackInfo[PacketNum++].pData = (void*) &req->WriteByte;
+			break;
+		}
+		case FS_CCCI_OP_CLOSE:
+		{
+			int HandleIndex = *((unsigned int*)PackInfo[0].pData);
+			dbg_printf("Main: FS_CCCI_CLOSE \n");
+			req->RetVal = FS_CCCI_Close(HandleIndex);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			break;
+		}
+		case FS_CCCI_OP_CLOSEALL:
+		{
+			dbg_printf("Main: FS_CCCI_CloseAll \n");
+			req->RetVal = FS_CCCI_CloseAll();
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			break;
+		}
+		case FS_CCCI_OP_CREATEDIR:
+		{
+			wchar_t* DirName = (wchar_t*)PackInfo[0].pData;
+			dbg_printf("Main: FS_CCCI_CreateDir \n");
+			req->RetVal = FS_CCCI_CreateDir(DirName);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			break;
+		}
+		case FS_CCCI_OP_REMOVEDIR:
+		{
+			wchar_t* DirName = (wchar_t*)PackInfo[0].pData;
+			dbg_printf("Main: FS_CCCI_RemoveDir \n");
+			req->RetVal = FS_CCCI_RemoveDir(DirName);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			break;
+		}
+		case FS_CCCI_OP_GETFOLDERSIZE:
+		{
+			wchar_t* DirName = (wchar_t*)PackInfo[0].pData;
+			unsigned int Flag = *((unsigned int*)PackInfo[1].pData);
+			dbg_printf("Main: FS_CCCI_GetFolderSize \n");
+			req->RetVal = FS_CCCI_GetFolderSize(DirName, Flag);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			break;
+		}
+		case FS_CCCI_OP_RENAME:
+		{
+			wchar_t* FileName = (wchar_t*)PackInfo[0].pData;
+			wchar_t* NewFileName = (wchar_t*)PackInfo[1].pData;
+			dbg_printf("Main: FS_CCCI_Rename \n");
+			req->RetVal = FS_CCCI_Rename(FileName, NewFileName);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			break;
+		}
+		case FS_CCCI_OP_MOVE:
+		{
+			wchar_t* SrcFullPath = (wchar_t*)PackInfo[0].pData;
+			wchar_t* DstFullPath = (wchar_t*)PackInfo[1].pData;
+			unsigned int Flag = *((unsigned int*)PackInfo[2].pData);
+			dbg_printf("Main: FS_CCCI_Move \n");
+			req->RetVal = FS_CCCI_Move(SrcFullPath, DstFullPath, Flag);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			break;
+		}
+		case FS_CCCI_OP_COUNT:
+		{
+			wchar_t* FullPath = (wchar_t*)PackInfo[0].pData;
+			unsigned int Flag = *((unsigned int*)PackInfo[1].pData);
+			dbg_printf("Main: FS_CCCI_Count \n");
+			req->RetVal = FS_CCCI_Count(FullPath, Flag);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			break;
+		}
+		case FS_CCCI_OP_GETDISKINFO:
+		{
+			/*char* DriverName = (char*)PackInfo[0].pData;
+			unsigned int Flag = *((unsigned int*)PackInfo[1].pData);*/
+			dbg_printf("Main: FS_CCCI_GetDiskInfo \n");
+			req->RetVal = FS_CCCI_GetDiskInfo(&req->DiskInfo);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			PackInfo[PacketNum].Length = sizeof(FS_DiskInfo);
+			PackInfo[PacketNum++].pData = (void*) &req->DiskInfo;
+			break;
+		}
+		case FS_CCCI_OP_DELETE:
+		{
+			wchar_t* FileName = (wchar_t*)PackInfo[0].pData;
+			dbg_printf("Main: FS_CCCI_Delete \n");
+			req->RetVal = FS_CCCI_Delete(FileName);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			break;
+		}
+		case FS_CCCI_OP_GETATTRIBUTES:
+		{
+			wchar_t* FileName = (wchar_t*)PackInfo[0].pData;
+			dbg_printf("Main: FS_CCCI_GetAttributes \n");
+			req->RetVal = FS_CCCI_GetAttributes(FileName);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			break;
+		}
+		case FS_CCCI_OP_OPENHINT:
+		{
+			wchar_t* FileName = (wchar_t*)PackInfo[0].pData;
+			int	Flag = *((int*)PackInfo[1].pData);
+			dbg_printf("Main: FS_CCCI_OpenHint \n");
+			//LOGD("OpenHint \n");
+			req->RetVal = FS_CCCI_Open(FileName, Flag);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*)&req->RetVal;
+			PackInfo[PacketNum].Length = 8;
+			PackInfo[PacketNum++].pData = PackInfo[2].pData;
+			break;
+		}
+		case FS_CCCI_OP_FINDFIRST:
+		{
+			wchar_t* PatternName = (wchar_t*)PackInfo[0].pData;
+			char Attr = *((char*)PackInfo[1].pData);
+			char AttrMask = *((char*)PackInfo[2].pData);
+			unsigned int MaxLength = *((unsigned int*)PackInfo[3].pData);
+			dbg_printf("Main: FS_CCCI_FindFirst \n");
+			req->RetVal = FS_CCCI_FindFirst(PatternName, Attr, AttrMask, &req->DosDirEntry, req->FileNameTemp, &MaxLength);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*)&req->RetVal;
+			PackInfo[PacketNum].Length = sizeof(FS_DOSDirEntry);
+			PackInfo[PacketNum++].pData = &req->DosDirEntry;
+			PackInfo[PacketNum].Length = (MaxLength > 0)?((MaxLength+1)*2):0; //wide character
+			PackInfo[PacketNum++].pData = (void*)req->FileNameTemp;
+			break;
+		}
+		case FS_CCCI_OP_FINDNEXT:
+		{
+			int HandleIndex = *((int*)PackInfo[0].pData);
+			unsigned int MaxLength = *((unsigned int*)PackInfo[1].pData);
+			dbg_printf("Main: FS_CCCI_FindNext \n");
+			req->RetVal = FS_CCCI_FindNext(HandleIndex, &req->DosDirEntry, req->FileNameTemp, &MaxLength);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*)&req->RetVal;
+			PackInfo[PacketNum].Length = sizeof(FS_DOSDirEntry);
+			PackInfo[PacketNum++].pData = &req->DosDirEntry;
+			PackInfo[PacketNum].Length = (MaxLength > 0) ? ((MaxLength+1) * 2) : 0; //wide character
+			PackInfo[PacketNum++].pData = (void*)req->FileNameTemp;
+			break;
+		}
+		case FS_CCCI_OP_FINDCLOSE:
+		{
+			int HandleIndex = *((int*)PackInfo[0].pData);
+			dbg_printf("Main: FS_CCCI_FindClose (%d) \n", HandleIndex);
+			req->RetVal = FS_CCCI_FindClose(HandleIndex);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*)&req->RetVal;
+			break;
+		}
+		case FS_CCCI_OP_LOCKFAT:
+		{
+			dbg_printf("Main: FS_CCCI_LockFAT \n");
+			req->RetVal = FS_NO_ERROR;
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			LOGD("LF: %d \n", req->RetVal);
+			break;
+		}
+		case FS_CCCI_OP_UNLOCKALL:
+		{
+			dbg_printf("Main: FS_CCCI_UnLockAll \n");
+			req->RetVal = 1;
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			LOGD("UK: %d \n", req->RetVal);
+			break;
+		}
+		case FS_CCCI_OP_SHUTDOWN:
+		{
+			dbg_printf("Main: FS_CCCI_Shutdown \n");
+			LOGD("Shutdown \n");
+			FS_CCCI_ShutDown();
+			break;
+		}
+		case FS_CCCI_OP_XDELETE:
+		{
+			wchar_t* FileName = (wchar_t*)PackInfo[0].pData;
+			unsigned int Flag = *((unsigned int*)PackInfo[1].pData);
+			dbg_printf("Main: FS_CCCI_XDelete \n");
+			req->RetVal = FS_CCCI_XDelete(FileName, Flag);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			break;
+		}
+		case FS_CCCI_OP_CLEARDISKFLAG:
+		{
+			dbg_printf("Main: FS_CCCI_ClearDiskFlag \n");
+			req->RetVal = FS_NO_ERROR;
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			LOGD("CDF: %d \n", req->RetVal);
+			break;
+		}
+		case FS_CCCI_OP_GETDRIVE:
+		{
+			unsigned int Type = *((unsigned int*)PackInfo[0].pData);
+			unsigned int Serial = *((unsigned int*)PackInfo[1].pData);
+			unsigned int AltMask = *((unsigned int*)PackInfo[2].pData);
+			dbg_printf("Main: FS_CCCI_GetDrive \n");
+			req->RetVal = FS_CCCI_GetDrive(Type, Serial, AltMask);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*)&req->RetVal;
+			break;
+		}
+		case FS_CCCI_OP_GETCLUSTERSIZE:
+		{
+			unsigned int DriverIdx = *((unsigned int*)PackInfo[0].pData);
+			dbg_printf("Main: FS_CCCI_GetClusterSize \n");
+			req->RetVal = FS_CCCI_GetClusterSize(DriverIdx);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*)&req->RetVal;
+			break;
+		}
+		case FS_CCCI_OP_SETDISKFLAG:
+		{
+			dbg_printf("Main: FS_CCCI_SetDiskFlag \n");
+			req->RetVal = FS_NO_ERROR;
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			LOGD("SDF: %d \n", req->RetVal);
+			break;
+		}
+
+		case FS_CCCI_OP_OTP_WRITE:
+		{
+			int devtype;
+			unsigned int Offset;
+			void * BufferPtr;
+			unsigned int  Length;
+			devtype = *(int*)PackInfo[0].pData;
+			Offset = *(unsigned int*)PackInfo[1].pData;
+			BufferPtr = PackInfo[2].pData;
+			Length = *(unsigned int*)PackInfo[3].pData;
+			dbg_printf("Main: FS_CCCI_OP_OTP_WRITE \n");
+			req->RetVal = FS_OTPWrite(devtype, Offset, BufferPtr, Length);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			break;
+		}
+		case FS_CCCI_OP_OTP_READ:
+		{
+			int devtype;
+			unsigned int Offset;
+			void * BufferPtr = pFsBuf->Buffer + 4*sizeof(int);
+			unsigned int  Length;
+
+			devtype = *(int*)PackInfo[0].pData;
+			Offset = *(unsigned int*)PackInfo[1].pData;
+			Length = *(unsigned int*)PackInfo[2].pData;
+
+			dbg_printf("Main: FS_CCCI_OP_OTP_READ \n");
+			req->RetVal = FS_OTPRead(devtype, Offset, BufferPtr, Length);
+
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			PackInfo[PacketNum].Length = Length;
+			PackInfo[PacketNum++].pData = BufferPtr;
+			break;
+		}
+		case FS_CCCI_OP_OTP_QUERYLEN:
+		{
+			int devtype;
+
+			devtype = *(int*)PackInfo[0].pData;
+			req->RetVal = FS_OTPQueryLength(devtype, &req->Length);
+			dbg_printf("Main: FS_CCCI_OP_OTP_QUERYLEN \n");
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			PackInfo[PacketNum].Length = sizeof(unsigned int);
+			PackInfo[PacketNum++].pData = (void*)&req->Length;
+			break;
+		}
+		case FS_CCCI_OP_OTP_LOCK:
+		{
+			int devtype;
+
+			devtype = *(int*)PackInfo[0].pData;
+			dbg_printf("Main: FS_CCCI_OP_OTP_LOCK \n");
+			req->RetVal = FS_OTPLock(devtype);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			break;
+		}
+		case FS_CCCI_OP_BIN_REGION_ACCESS:
+		{
+			int access_type;
+
+			access_type = *(int*)PackInfo[0].pData;
+			LOGD("Main: FS_CCCI_OP_BIN_REGION_ACCESS \n");
+			req->RetVal = FS_BinRegion_Access(access_type);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			break;
+		}
+		case FS_CCCI_OP_GETFILEDETAIL:
+		{
+			wchar_t* FileName = (wchar_t*)PackInfo[0].pData;
+			dbg_printf("Main: FS_CCCI_GetFileDetail \n");
+			req->RetVal = FS_CCCI_GetFileDetail(FileName, &req->FileDetail);
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			PackInfo[PacketNum].Length = sizeof(FS_FileDetail);
+			PackInfo[PacketNum++].pData = (void*)&req->FileDetail;
+			break;
+		}
+		default:
+			LOGE("Main: [error]Unknow File Op ID (%d)\n", pFsBuf->OperateID);
+			req->RetVal = FS_PARAM_ERROR;
+			PackInfo[PacketNum].Length = sizeof(int);
+			PackInfo[PacketNum++].pData = (void*) &req->RetVal;
+			break;
+	}
+	req->PacketNum = PacketNum;
+}
+
+static void *FS_WorkerThread(void *arg __attribute__((unused)))
+{
+	FS_REQ *req, **pp;
+
+	while(1)
+	{
+		pthread_mutex_lock(&g_FsReqLock);
+		while((req = FS_PickRequest()) == NULL)
+			pthread_cond_wait(&g_FsReqCond, &g_FsReqLock);
+		req->fRunning = true;
+		pthread_mutex_unlock(&g_FsReqLock);
+
+		FS_ExecRequest(req);
+
+		pthread_mutex_lock(&g_FsWriteLock);
+		if(!FS_WriteToMD(DeviceFd, req->BufIndex, req->PackInfo, req->PacketNum))
+			LOGE("Worker: [error]fail write fs stream: op_id=%x\n", req->pFsBuf->OperateID);
+		pthread_mutex_unlock(&g_FsWriteLock);
+		FS_WakeLockPut();
+
+		// the slot buffer may be reused and the key runs again from here on
+		pthread_mutex_lock(&g_FsReqLock);
+		for(pp = &g_FsReqHead; *pp != req; pp = &(*pp)->pNext)
+			;
+		*pp = req->pNext;
+		req->fRunning = false;
+		req->fQueued = false;
+		pthread_cond_broadcast(&g_FsReqCond);
+		pthread_mutex_unlock(&g_FsReqLock);
+	}
+	return NULL;
+}
+
+static int FS_StartWorkers(void)
+{
+	int i, ret;
+
+	for(i = 0; i < FS_WORKER_NUM; i++)
+	{
+		ret = pthread_create(&g_FsWorker[i], NULL, FS_WorkerThread, NULL);
+		if(ret != 0) {
+			LOGE_COM("[%s] error: pthread_create() = %d", __func__, ret);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+// answer a request which could not be decoded, from the reader thread
+static void FS_ReplyError(int BufIndex, int RetVal)
+{
+	FS_PACKET_INFO PackInfo;
+
+	if ((BufIndex < 0) || (BufIndex >= FS_REQ_BUFFER_MUN)) {
+		LOGE("Main: [error] Request check fail(%d), force md assert\n", BufIndex);
+		if(ioctl(DeviceFd, CCCI_IOC_FORCE_MD_ASSERT, &RetVal) != 0)
+			LOGD("update modem type to kernel fail: err=%d", errno);
+	} else {
+		PackInfo.Length = sizeof(int);
+		PackInfo.pData = (void*)&RetVal;
+		pthread_mutex_lock(&g_FsWriteLock);
+		if(!FS_WriteToMD(DeviceFd, BufIndex, &PackInfo, 1))
+			LOGE("Main: [error]fail write fs stream: slot %d\n", BufIndex);
+		pthread_mutex_unlock(&g_FsWriteLock);
+	}
+	FS_WakeLockPut();
+}
+
+// stream mode: the request slots and the spare buffer, see g_FsStreamSlot
+static void FS_AllocStreamSlots(void)
+{
+	int i;
+
+	// FS_MAX_BUF_SIZE : ccci_h + opid + argc + MAX_ARG * arg.len + MAX_ARG * arg.align + 16KB data + align(128B)
+	FS_MAX_BUF_SIZE = (16 + 4 + 4 + 4*12 + 0x4000 + 128);
+	FS_MAX_ARG_NUM = 6;
+	// one more slot as the spare buffer a new request is read into
+	int alloc_length = FS_STREAM_SLOT_LEN * (FS_BUFFER_SLOT_NUM + 1);
+	g_FsInfo.pFsBuf = malloc(alloc_length);
+	if(g_FsInfo.pFsBuf != NULL) {
+		memset(g_FsInfo.pFsBuf, 0, alloc_length);
+		for (i = 0; i <= FS_BUFFER_SLOT_NUM; i++)
+			g_FsStreamSlot[i] = (STREAM_DATA *)((char *)g_FsInfo.pFsBuf + FS_STREAM_SLOT_LEN * i);
+	}
+}
+
+// read and dispatch requests until a signal stops the daemon, then wait for the answers
+static void FS_ServeRequests(void)
+{
+	int mdstatus;
+	int ReqBufIndex = 0;
+	FS_BUF *pFsBuf;
+	FS_REQ *req;
+	int RetVal;
+	int i = 0;
+	CCCI_BUFF_T *ccci_h = NULL;
+	char *pkt = NULL; // data packet received from MD
+	char *payload = NULL;
+	unsigned int length;
+	STREAM_DATA pkt_hdr;
+	char pkt_bak[sizeof(STREAM_DATA)];
+	int WaitSlot;
+	STREAM_DATA *buffer_slot = NULL; // local buffer slot
+	char *p_fs_buff = NULL;
+
+	while(exit_signal == 0)
+	{
+#ifdef PROFILE_NVRAM_API
+		mdstatus = get_modem_status();
+
+		if (mdstatus == CCCI_MD_STA_BOOT_UP)
+		{
+			slower_100ms.profiling = true;
+		}
+		else if (mdstatus == CCCI_MD_STA_BOOT_READY)
+		{
+			if (slower_100ms.profiling) {
+				LOGD("[Profile]slower than 100ms: count=%d, totatime=%d\n", slower_100ms.count, slower_100ms.totaltime);
+				FS_CacheDumpStat();
+			}
+
+			memset(&slower_100ms, 0, sizeof(SLOW_THAN_100MS_T));
+		}
+
+#endif
+
+retry:
+		if(!stream_support) {
+			ReqBufIndex = ioctl(DeviceFd, CCCI_FS_IOCTL_GET_INDEX, 0);
+			FS_WakeLockGet();
+
+			if(ReqBufIndex < 0 || ReqBufIndex >= FS_REQ_BUFFER_MUN)
+			{
+				LOGE("Main: [error]fail get CCCI_FS buffer index: %d \n", errno);
+				RetVal = FS_PARAM_ERROR;
+				goto _Error;
+			}
+			pFsBuf = (FS_BUF *)((char *)g_FsInfo.pFsBuf + (FS_MAX_BUF_SIZE + sizeof(FS_BUF))*ReqBufIndex);
+			FS_WaitSlotIdle(ReqBufIndex);
+		} else {
+			while (1) {
+				/*
+				 * A first fragment is read into the spare buffer, which then takes the
+				 * place of its slot. While a slot waits for more fragments, the next packet
+				 * is read in place at its reassembly offset: CCCI header and OP id overlay
+				 * the last bytes already received, which are saved and put back as
+				 * FS_PreparePktEx() does for responses. The CCCI port has no iovec ops, so
+				 * readv() would frame every segment as a packet of its own.
+				 */
+				WaitSlot = g_FsWaitSlot;
+				if (WaitSlot >= 0 && g_FsInfo.fs_buff_offset[WaitSlot] + MAX_FS_PKT_BYTE <= FS_STREAM_SLOT_LEN) {
+					pkt = (char *)g_FsStreamSlot[WaitSlot] + g_FsInfo.fs_buff_offset[WaitSlot] - sizeof(STREAM_DATA);
+					memcpy(pkt_bak, pkt, sizeof(STREAM_DATA));
+				} else {
+					WaitSlot = -1;
+					pkt = (char *)g_FsStreamSlot[FS_BUFFER_SLOT_NUM];
+				}
+				// add an extra integer as MD consider OP_ID as not part of the "payload"
+				RetVal = read(DeviceFd, pkt, (MAX_FS_PKT_BYTE+sizeof(CCCI_BUFF_T)+sizeof(unsigned int)));
+				memcpy(&pkt_hdr, pkt, sizeof(STREAM_DATA));
+				if (WaitSlot >= 0)
+					memcpy(pkt, pkt_bak, sizeof(STREAM_DATA));
+				if (RetVal <= 0) {
+					LOGE("Failed to read from FS device (%d) !! errno = %d", RetVal, errno);
+					goto retry;
+				} else {
+					LOGD("Read %d bytes from FS device", RetVal);
+				}
+				FS_WakeLockGet();
+				ccci_h = &pkt_hdr.header;
+				ReqBufIndex = ccci_h->reserved;
+				LOGD("Read %d bytes from slot %d, CCCI_H(0x%X)(0x%X)(0x%X)(0x%X)",
+					RetVal, ReqBufIndex,
+					ccci_h->data[0], ccci_h->data[1], ccci_h->channel, ccci_h->reserved);
+				if (((ccci_h->channel&0xFFFF)  != 0x0e) || (ReqBufIndex < 0) || (ReqBufIndex >= FS_REQ_BUFFER_MUN) ||
+					(ccci_h->data[1] > (sizeof(STREAM_DATA) + FS_MAX_BUF_SIZE) )) {
+					LOGE("Main: [error]packet data check fail: ch =0x%x, fs_buf_idx=%d, data[1] = 0x%x, 0x%x \n",
+						ccci_h->channel, ReqBufIndex, ccci_h->data[1], (sizeof(STREAM_DATA) + FS_MAX_BUF_SIZE));
+					RetVal = FS_PARAM_ERROR;
+					goto _Error;
+				}
+				payload = pkt + sizeof(STREAM_DATA);
+				length = (ccci_h->data[1] > sizeof(STREAM_DATA)) ? (ccci_h->data[1] - sizeof(STREAM_DATA)) : 0;
+				/******************************************
+				 *
+				 *  FSM description for re-sent mechanism
+				 *   (ccci_fs_buff_state == CCCI_FS_BUFF_IDLE) ==> initial status & end status
+				 *   (ccci_fs_buff_state == CCCI_FS_BUFF_WAIT) ==> need to receive again
+				 *
+				 ******************************************/
+				if (g_FsInfo.fs_buff_state[ReqBufIndex] == FS_BUFF_IDLE) {
+					/* CCCI header, OP id and data */
+					FS_WaitSlotIdle(ReqBufIndex);
+					buffer_slot = g_FsStreamSlot[ReqBufIndex];
+					if (pkt == (char *)g_FsStreamSlot[FS_BUFFER_SLOT_NUM]) {
+						g_FsStreamSlot[ReqBufIndex] = (STREAM_DATA *)pkt;
+						g_FsStreamSlot[FS_BUFFER_SLOT_NUM] = buffer_slot;
+					} else {
+						memcpy(buffer_slot, &pkt_hdr, sizeof(STREAM_DATA));
+						memcpy(buffer_slot->payload.Buffer, payload, length);
+					}
+					g_FsInfo.fs_buff_offset[ReqBufIndex] = sizeof(STREAM_DATA) + length;
+				} else if (g_FsInfo.fs_buff_state[ReqBufIndex] == FS_BUFF_WAIT) {
+					/* only "data", excluding CCCI header and OP id */
+					p_fs_buff = (char *)g_FsStreamSlot[ReqBufIndex] + g_FsInfo.fs_buff_offset[ReqBufIndex];
+					if (length == 0) {
+						LOGE("Wrong packet data length: %d\n", ccci_h->data[1]);
+					} else if (g_FsInfo.fs_buff_offset[ReqBufIndex] + length > FS_STREAM_SLOT_LEN) {
+						LOGE("Main: [error]slot %d overflow: %d + %d\n", ReqBufIndex,
+							g_FsInfo.fs_buff_offset[ReqBufIndex], length);
+						g_FsInfo.fs_buff_state[ReqBufIndex] = FS_BUFF_IDLE;
+						g_FsInfo.fs_buff_offset[ReqBufIndex] = 0;
+						if (g_FsWaitSlot == ReqBufIndex)
+							g_FsWaitSlot = -1;
+						RetVal = FS_PARAM_ERROR;
+						goto _Error;
+					} else if (payload != p_fs_buff) {
+						memcpy(p_fs_buff, payload, length);
+					}
+					g_FsInfo.fs_buff_offset[ReqBufIndex] += length;
+					/* update CCCI header info */
+					if (!CCCI_FS_PEER_REQ_SEND_AGAIN(ccci_h))
+						memcpy(g_FsStreamSlot[ReqBufIndex], ccci_h, sizeof(CCCI_BUFF_T));
+				} else {
+					/* No such fs_buff_state state */
+					assert(0);
+				}
+
+				if (!CCCI_FS_PEER_REQ_SEND_AGAIN(ccci_h)) {
+					g_FsInfo.fs_buff_state[ReqBufIndex] = FS_BUFF_IDLE;
+					g_FsInfo.fs_buff_offset[ReqBufIndex] = 0;
+				} else {
+					g_FsInfo.fs_buff_state[ReqBufIndex] = FS_BUFF_WAIT;
+				}
+
+				/* the next fragment most likely continues the last slot left waiting */
+				if (g_FsInfo.fs_buff_state[ReqBufIndex] == FS_BUFF_WAIT) {
+					g_FsWaitSlot = ReqBufIndex;
+				} else if (g_FsWaitSlot == ReqBufIndex || g_FsWaitSlot < 0) {
+					for (i = 0; i < FS_BUFFER_SLOT_NUM; i++)
+						if (g_FsInfo.fs_buff_state[i] == FS_BUFF_WAIT)
+							break;
+					g_FsWaitSlot = (i < FS_BUFFER_SLOT_NUM) ? i : -1;
+				}
+
+				if (g_FsInfo.fs_buff_state[ReqBufIndex] == FS_BUFF_IDLE)
+					break;
+				FS_WakeLockPut();
+			};
+			pFsBuf = &g_FsStreamSlot[ReqBufIndex]->payload;
+		}
+		//LOGD("Main: operation ID = %x\n", pFsBuf->OperateID);
+
+		req = &g_FsReq[ReqBufIndex];
+		if(!FS_GetPackInfo(req->PackInfo, pFsBuf->Buffer))
+		{
+			LOGE("Main: [error]fail get packet info: op_id=0x%x, fs_buf_idx=%d \n",
+				pFsBuf->OperateID, ReqBufIndex);
+			RetVal = FS_PARAM_ERROR;
+			goto _Error;
+		}
+
+		req->BufIndex = ReqBufIndex;
+		req->pFsBuf = pFsBuf;
+		FS_ClassifyRequest(req);
+		FS_QueueRequest(req);
+		continue;
+_Error:
+		FS_ReplyError(ReqBufIndex, RetVal);
+	}
+
+	// let the workers answer what is still in flight, a request leaves the queue
+	// only after its worker is done with it
+	pthread_mutex_lock(&g_FsReqLock);
+	while(g_FsReqHead != NULL)
+		pthread_cond_wait(&g_FsReqCond, &g_FsReqLock);
+	pthread_mutex_unlock(&g_FsReqLock);
+}
+
+int main(int argc, char *argv[])
+{
+	int mdstatus;
+	char dev_node[32];
+	int  using_old_ver = 0;
+	int  port_open_retry = 600;
+	int i = 0;
+
+	LOGE_COM("md_fsd Ver:v2.3, CCCI Ver:%d", ccci_get_version());
+
+	//Check if input parameter is valid
+	if(argc != 2) {
+		md_id = 0;
+		LOGE("[Warning]Parameter number not correct,use old version!\n");
+		using_old_ver = 1;
+		snprintf(dev_node, 32, "/dev/ccci_fs");
+		for (i = 0; i < FS_MAX_DIR_NUM; i++) {
+			snprintf(FsRootDir[i], 36, "%s", FsRootDir_MD1[i]);
+		}
+	} else {
+		if(strcmp(argv[1],"0")==0) {
+			snprintf(dev_node, 32, "%s", ccci_get_node_name(USR_CCCI_FS, MD_SYS1));
+			for (i = 0; i < FS_MAX_DIR_NUM; i++) {
+				snprintf(FsRootDir[i], 36, "%s", FsRootDir_MD1[i]);
+			}
+			md_id = 0;
+		} else if(strcmp(argv[1],"1")==0) {
+			snprintf(dev_node, 32, "%s", ccci_get_node_name(USR_CCCI_FS, MD_SYS2));
+			for (i = 0; i < FS_MAX_DIR_NUM; i++) {
+				snprintf(FsRootDir[i], 36, "%s", FsRootDir_MD2[i]);
+			}
+			md_id =1;
+		} else if (strcmp(argv[1],"2")==0) {
+			snprintf(dev_node, 32, "%s", ccci_get_node_name(USR_CCCI_FS, MD_SYS3));
+			for (i = 0; i < FS_MAX_DIR_NUM; i++) {
+				snprintf(FsRootDir[i], 36, "%s", FsRootDir_MD3[i]);
 			}
 			md_id =2;
 		} else if(strcmp(argv[1],"4")==0) {
@@ -3539,18 +4669,7 @@ int main(int argc, char *argv[])
 	if(!stream_support) {
 		g_FsInfo.pFsBuf = mmap(NULL, sizeof(fs_stream_buffer_t) * 5, PROT_READ | PROT_WRITE, MAP_SHARED, DeviceFd, 0);
 	} else {
-		// FS_MAX_BUF_SIZE : ccci_h + opid + argc + MAX_ARG * arg.len + MAX_ARG * arg.align + 16KB data + align(128B)
-		FS_MAX_BUF_SIZE = (16 + 4 + 4 + 4*12 + 0x4000 + 128);
-		FS_MAX_ARG_NUM = 6;
-		int alloc_length = (sizeof(STREAM_DATA) + FS_MAX_BUF_SIZE) * FS_BUFFER_SLOT_NUM;
-		g_FsInfo.pFsBuf = malloc(alloc_length);
-		memset(g_FsInfo.pFsBuf, 0, alloc_length);
-	}
-	PackInfo = malloc(sizeof(FS_PACKET_INFO) * FS_MAX_ARG_NUM);
-	pkt_buff = malloc(MAX_FS_BUF_BYTE);
-	if (PackInfo == NULL || pkt_buff == NULL) {
-		LOGE("Main: [error]malloc buffer fail:%d \n", errno);
-		return -1;
+		FS_AllocStreamSlots();
 	}
 
 	if(g_FsInfo.pFsBuf == NULL)
@@ -3573,6 +4692,9 @@ int main(int argc, char *argv[])
 
 	FS_OTP_init(md_id);
 
+	if(FS_StartWorkers() < 0)
+		return -1;
+
 	LOGD("register signal hadler\n");
 	if(signal(SIGHUP, signal_treatment)==SIG_ERR)
 		LOGE("can't catch SIGHUP\n");
@@ -3591,614 +4713,10 @@ int main(int argc, char *argv[])
 	if(signal(SIGALRM, signal_treatment)==SIG_ERR)
 		LOGE("can't catch SIGALRM\n");
 
-	while(exit_signal == 0)
-	{
-#ifdef PROFILE_NVRAM_API
-		mdstatus = get_modem_status();
-
-		if (mdstatus == CCCI_MD_STA_BOOT_UP)
-		{
-			slower_100ms.profiling = true;
-		}
-		else if (mdstatus == CCCI_MD_STA_BOOT_READY)
-		{
-			if (slower_100ms.profiling)
-				LOGD("[Profile]slower than 100ms: count=%d, totatime=%d\n", slower_100ms.count, slower_100ms.totaltime);
-
-			memset(&slower_100ms, 0, sizeof(SLOW_THAN_100MS_T));
-		}
-
-#endif
-
-		PacketNum = 0;
-retry:
-		if(!stream_support) {
-			ReqBufIndex = ioctl(DeviceFd, CCCI_FS_IOCTL_GET_INDEX, 0);
-			FS_WAKE_LOCK();
-
-			if(ReqBufIndex < 0 || ReqBufIndex >= FS_REQ_BUFFER_MUN)
-			{
-				LOGE("Main: [error]fail get CCCI_FS buffer index: %d \n", errno);
-				RetVal = FS_PARAM_ERROR;
-				PackInfo[PacketNum].Length = sizeof(unsigned int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				goto _Next;
-			}
-			pFsBuf = (FS_BUF *)((char *)g_FsInfo.pFsBuf + (FS_MAX_BUF_SIZE + sizeof(FS_BUF))*ReqBufIndex);
-		} else {
-			while (1) {
-                memset(pkt_buff, 0, MAX_FS_BUF_BYTE);
-				// add an extra integer as MD consider OP_ID as not part of the "payload"
-                RetVal = read(DeviceFd, pkt_buff, (MAX_FS_PKT_BYTE+sizeof(CCCI_BUFF_T)+sizeof(unsigned int)));
-                if (RetVal <= 0) {
-                    LOGE("Failed to read from FS device (%d) !! errno = %d", RetVal, errno);
-                        goto retry;
-                } else {
-                    LOGD("Read %d bytes from FS device", RetVal);
-                }
-				FS_WAKE_LOCK();
-                stream = (STREAM_DATA *)pkt_buff;
-                ccci_h = (CCCI_BUFF_T *)&stream->header;
-                ReqBufIndex = ccci_h->reserved;
-                LOGD("Read %d bytes from slot %d, CCCI_H(0x%X)(0x%X)(0x%X)(0x%X)",
-                     RetVal, ReqBufIndex,
-                     ccci_h->data[0], ccci_h->data[1], ccci_h->channel, ccci_h->reserved);
-                if (((ccci_h->channel&0xFFFF)  != 0x0e) || (ReqBufIndex < 0) || (ReqBufIndex >= FS_REQ_BUFFER_MUN) ||
-                    (ccci_h->data[1] > (sizeof(STREAM_DATA) + FS_MAX_BUF_SIZE) )) {
-                    LOGE("Main: [error]packet data check fail: ch =0x%x, fs_buf_idx=%d, data[1] = 0x%x, 0x%x \n",
-                        ccci_h->channel, ReqBufIndex, ccci_h->data[1], (sizeof(STREAM_DATA) + FS_MAX_BUF_SIZE));
-                    RetVal = FS_PARAM_ERROR;
-                    PackInfo[PacketNum].Length = sizeof(unsigned int);
-                    PackInfo[PacketNum++].pData = (void*) &RetVal;
-                    goto _Next;
-                }
-				buffer_slot = (STREAM_DATA *)((char *)g_FsInfo.pFsBuf + (FS_MAX_BUF_SIZE + sizeof(STREAM_DATA))*ReqBufIndex);
-                p_fs_buff = (char *)buffer_slot;
-                /******************************************
-                 *
-                 *  FSM description for re-sent mechanism
-                 *   (ccci_fs_buff_state == CCCI_FS_BUFF_IDLE) ==> initial status & end status
-                 *   (ccci_fs_buff_state == CCCI_FS_BUFF_WAIT) ==> need to receive again
-                 *
-                 ******************************************/
-                if (!CCCI_FS_PEER_REQ_SEND_AGAIN(ccci_h)) {
-                    if (g_FsInfo.fs_buff_state[ReqBufIndex] == FS_BUFF_IDLE) {
-                        /* copy data memory and CCCI header */
-                        memcpy(p_fs_buff, ccci_h, ccci_h->data[1]);
-                        /* don't need to update FS_Address */
-                    } else if (g_FsInfo.fs_buff_state[ReqBufIndex] == FS_BUFF_WAIT) {
-                        /* copy data memory and NULL, excluding CCCI header, OP id */
-						if (ccci_h->data[1] > (sizeof(CCCI_BUFF_T) + sizeof(unsigned int)))
-						{
-							memcpy(p_fs_buff + g_FsInfo.fs_buff_offset[ReqBufIndex],
-									stream->payload.Buffer,
-									ccci_h->data[1] - sizeof(CCCI_BUFF_T) - sizeof(unsigned int));
-						} else {
-							LOGE("Wrong packet data length: %d\n", ccci_h->data[1]);
-						}
-                        /* update CCCI header info */
-                        memcpy(p_fs_buff, ccci_h, sizeof(CCCI_BUFF_T));
-                    } else {
-                        /* No such fs_buff_state state */
-                        assert(0);
-                    }
-                    g_FsInfo.fs_buff_state[ReqBufIndex] = FS_BUFF_IDLE;
-                    g_FsInfo.fs_buff_offset[ReqBufIndex] = 0;
-                } else {
-                    if (g_FsInfo.fs_buff_state[ReqBufIndex] == FS_BUFF_IDLE) {
-                        /* only "OP id" and "data" size and "CCCI header" */
-                        unsigned int length = ccci_h->data[1];
-                        memcpy(p_fs_buff, ccci_h, length);
-                        g_FsInfo.fs_buff_offset[ReqBufIndex] += length;
-                    } else if (g_FsInfo.fs_buff_state[ReqBufIndex] == FS_BUFF_WAIT) {
-                        /* only "data" size, excluding CCCI header and OP id */
-                        unsigned int length = ccci_h->data[1] - sizeof(CCCI_BUFF_T) - sizeof(unsigned int);
-                        memcpy(p_fs_buff + g_FsInfo.fs_buff_offset[ReqBufIndex],
-                               stream->payload.Buffer,
-                               length);    /* CCCI_HEADER + FS_OP_ID */
-                        g_FsInfo.fs_buff_offset[ReqBufIndex] += length;
-                    } else {
-                        /* No such ccci_fs_buff_state state */
-                        assert(0);
-                    }
-                    g_FsInfo.fs_buff_state[ReqBufIndex] = FS_BUFF_WAIT;
-                }
-                if (g_FsInfo.fs_buff_state[ReqBufIndex] == FS_BUFF_IDLE)
-                    break;
-		FS_WAKE_UNLOCK();
-            };
-			pFsBuf = &buffer_slot->payload;
-		}
-		//LOGD("Main: operation ID = %x\n", pFsBuf->OperateID);
-
-		if(!FS_GetPackInfo(PackInfo, pFsBuf->Buffer))
-		{
-			LOGE("Main: [error]fail get packet info: op_id=0x%x, fs_buf_idx=%d \n",
-				pFsBuf->OperateID, ReqBufIndex);
-			RetVal = FS_PARAM_ERROR;
-			PackInfo[PacketNum].Length = sizeof(unsigned int);
-			PackInfo[PacketNum++].pData = (void*) &RetVal;
-			goto _Next;
-		}
+	FS_ServeRequests();
 
-		switch(pFsBuf->OperateID)
-		{
-			/* cmpt_read */
-			case FS_CCCI_OP_CMPT_READ:
-			{
-				wchar_t* FileName = (wchar_t*)PackInfo[0].pData;
-
-				// For debug only ===
-				//char FsFileName[PATH_MAX] = {0};
-				//int FsFileNameCount;
-
-				// For debug only ===
-				memcpy(&in_cmpt_para, PackInfo[1].pData, sizeof(in_cmpt_para));
-				FS_ConvWcsToCs(FileName, ConvFileName);
-				//FS_MD2APPath(FileName, ConvFileName, FsFileName, PATH_MAX, &FsFileNameCount);
-				LOGD("CMPT File name:%s opid_map:0x%08x Flag:0x%08x Offset:%d Whence:%d Length:%d",
-					ConvFileName, in_cmpt_para.opid_map, in_cmpt_para.flag, in_cmpt_para.offset,
-					in_cmpt_para.whence, in_cmpt_para.length);
-
-				// PacketNum                          1 DWORD
-				// PackInfo[0].Length = 2*sizeof(int) 1 DWORD
-				// PackInfo[0].pData: ret[0], ret[1]  2 DWORD
-				// PackInfo[1].Length = 1*sizeof(int) 1 DWORD
-				// PackInfo[1].pData                  1 DWORD
-				// PackInfo[2].Length = 1*sizeof(int) 1 DWORD
-				// PackInfo[2].pData                  1 DWORD
-				// PackInfo[3].Lenght = 1*sizeof(int) 1 DWORD
-				// PackInfo[3].pData    <-- here
-				in_cmpt_para.data_ptr = pFsBuf->Buffer + (1+1+2+1+1+1+1+1) * sizeof(int);
-
-				RetVal = FS_CCCI_CMPT_Read(FileName, &in_cmpt_para);
-
-				PackInfo[PacketNum].Length = sizeof(in_cmpt_para.ret);
-				PackInfo[PacketNum++].pData = (void*)in_cmpt_para.ret;
-				PackInfo[PacketNum].Length = sizeof(unsigned int);
-				PackInfo[PacketNum++].pData = (void*)&in_cmpt_para.file_size;
-				PackInfo[PacketNum].Length = sizeof(unsigned int);
-				PackInfo[PacketNum++].pData = (void*)&in_cmpt_para.act_read;
-				PackInfo[PacketNum].Length = in_cmpt_para.act_read;
-				PackInfo[PacketNum++].pData = in_cmpt_para.data_ptr;
-				//LOGD("cmpt_read ret (%d)\n", RetVal);
-				break;
-			}
-			/* cmpt_write */
-			case FS_CCCI_OP_CMPT_WRITE:
-			{
-				wchar_t* FileName = (wchar_t*)PackInfo[0].pData;
-
-				// For debug only ===
-				//char FsFileName[PATH_MAX] = {0};
-				//int FsFileNameCount;
-
-				// For debug only ===
-				memcpy(&in_cmptw_para, PackInfo[1].pData, sizeof(in_cmptw_para));
-				void* pBuffer = PackInfo[2].pData;
-				FS_ConvWcsToCs(FileName, ConvFileName);
-				//FS_MD2APPath(FileName, ConvFileName, FsFileName, PATH_MAX, &FsFileNameCount);
-				LOGD("CMPTW File name:%s opid_map:0x%08x Flag:0x%08x Offset:%d Whence:%d Length:%d file_handle:%d",
-					ConvFileName, in_cmptw_para.opid_map, in_cmptw_para.flag, in_cmptw_para.offset,
-					in_cmptw_para.whence, in_cmptw_para.length, in_cmptw_para.file_handle);
-
-				RetVal = FS_CCCI_CMPT_Write(FileName, &in_cmptw_para, pBuffer);
-
-				PackInfo[PacketNum].Length = sizeof(in_cmptw_para.ret);
-				PackInfo[PacketNum++].pData = (void*)in_cmptw_para.ret;
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*)&in_cmptw_para.file_handle_ptr;
-				PackInfo[PacketNum].Length = sizeof(unsigned int);
-				PackInfo[PacketNum++].pData = (void*)&in_cmptw_para.act_write_size;
-				LOGD("cmpt_write ret (%d)\n", RetVal);
-				break;
-			}
-			case FS_CCCI_OP_RESTORE:
-			{
-				wchar_t* FileName = (wchar_t*)PackInfo[0].pData;
-				dbg_printf("Main: FS_CCCI_RESTORE \n");
-				RetVal = FS_CCCI_Restore(FileName);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*)&RetVal;
-				break;
-			}
-			case FS_CCCI_OP_OPEN:
-			{
-				wchar_t* FileName = (wchar_t*)PackInfo[0].pData;
-				int	Flag = *((int*)PackInfo[1].pData);
-				dbg_printf("Main: FS_CCCI_OPEN \n");
-				RetVal = FS_CCCI_Open(FileName, Flag);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*)&RetVal;
-				break;
-			}
-			case FS_CCCI_OP_GETFILESIZE:
-			{
-				int HandleIndex = *((unsigned int*)PackInfo[0].pData);
-				dbg_printf("Main: FS_CCCI_GetFileSize \n");
-				RetVal = FS_CCCI_GetFileSize(HandleIndex, &FileSize);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				PackInfo[PacketNum].Length = sizeof(unsigned int);
-				PackInfo[PacketNum++].pData = (void*) &FileSize;
-				break;
-			}
-			case FS_CCCI_OP_SEEK:
-			{
-				int HandleIndex = *((unsigned int*)PackInfo[0].pData);
-				unsigned int Offset = *((unsigned int*)PackInfo[1].pData);
-				unsigned int Whence = *((unsigned int*)PackInfo[2].pData);
-				dbg_printf("Main: FS_CCCI_SEEK \n");
-				RetVal = FS_CCCI_Seek(HandleIndex, Offset, Whence);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				break;
-			}
-			case FS_CCCI_OP_READ:
-			{
-				int HandleIndex = *((unsigned int*)PackInfo[0].pData);
-				int NumOfByte = *((int*)PackInfo[1].pData);
-				void* pBuffer = pFsBuf->Buffer + 6*sizeof(int);
-				/*memory corrupt issue: there are only two parameters for read from modem CCCI, so PackInfo[2] is invalid*/
-				//void* pBuffer = PackInfo[2].pData;
-				dbg_printf("Main: FS_CCCI_READ \n");
-				RetVal = FS_CCCI_Read(HandleIndex, pBuffer, NumOfByte, &ReadByte);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				PackInfo[PacketNum].Length = sizeof(unsigned int);
-				PackInfo[PacketNum++].pData = (void*) &ReadByte;
-				PackInfo[PacketNum].Length = ReadByte;
-				PackInfo[PacketNum++].pData = pBuffer;
-				break;
-			}
-			case FS_CCCI_OP_WRITE:
-			{
-				int HandleIndex = *((unsigned int*)PackInfo[0].pData);
-				void* pBuffer = PackInfo[1].pData;
-				int NumOfByte = *((int*)PackInfo[2].pData);
-				dbg_printf("Main: FS_CCCI_WRITE \n");
-				RetVal = FS_CCCI_Write(HandleIndex, pBuffer, NumOfByte, &WriteByte);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				PackInfo[PacketNum].Length = sizeof(unsigned int);
-				PackInfo[PacketNum++].pData = (void*) &WriteByte;
-				break;
-			}
-			case FS_CCCI_OP_CLOSE:
-			{
-				int HandleIndex = *((unsigned int*)PackInfo[0].pData);
-				dbg_printf("Main: FS_CCCI_CLOSE \n");
-				RetVal = FS_CCCI_Close(HandleIndex);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				break;
-			}
-			case FS_CCCI_OP_CLOSEALL:
-			{
-				dbg_printf("Main: FS_CCCI_CloseAll \n");
-				RetVal = FS_CCCI_CloseAll();
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				break;
-			}
-			case FS_CCCI_OP_CREATEDIR:
-			{
-				wchar_t* DirName = (wchar_t*)PackInfo[0].pData;
-				dbg_printf("Main: FS_CCCI_CreateDir \n");
-				RetVal = FS_CCCI_CreateDir(DirName);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				break;
-			}
-			case FS_CCCI_OP_REMOVEDIR:
-			{
-				wchar_t* DirName = (wchar_t*)PackInfo[0].pData;
-				dbg_printf("Main: FS_CCCI_RemoveDir \n");
-				RetVal = FS_CCCI_RemoveDir(DirName);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				break;
-			}
-			case FS_CCCI_OP_GETFOLDERSIZE:
-			{
-				wchar_t* DirName = (wchar_t*)PackInfo[0].pData;
-				unsigned int Flag = *((unsigned int*)PackInfo[1].pData);
-				dbg_printf("Main: FS_CCCI_GetFolderSize \n");
-				RetVal = FS_CCCI_GetFolderSize(DirName, Flag);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				break;
-			}
-			case FS_CCCI_OP_RENAME:
-			{
-				wchar_t* FileName = (wchar_t*)PackInfo[0].pData;
-				wchar_t* NewFileName = (wchar_t*)PackInfo[1].pData;
-				dbg_printf("Main: FS_CCCI_Rename \n");
-				RetVal = FS_CCCI_Rename(FileName, NewFileName);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				break;
-			}
-			case FS_CCCI_OP_MOVE:
-			{
-				wchar_t* SrcFullPath = (wchar_t*)PackInfo[0].pData;
-				wchar_t* DstFullPath = (wchar_t*)PackInfo[1].pData;
-				unsigned int Flag = *((unsigned int*)PackInfo[2].pData);
-				dbg_printf("Main: FS_CCCI_Move \n");
-				RetVal = FS_CCCI_Move(SrcFullPath, DstFullPath, Flag);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				break;
-			}
-			case FS_CCCI_OP_COUNT:
-			{
-				wchar_t* FullPath = (wchar_t*)PackInfo[0].pData;
-				unsigned int Flag = *((unsigned int*)PackInfo[1].pData);
-				dbg_printf("Main: FS_CCCI_Count \n");
-				RetVal = FS_CCCI_Count(FullPath, Flag);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				break;
-			}
-			case FS_CCCI_OP_GETDISKINFO:
-			{
-				/*char* DriverName = (char*)PackInfo[0].pData;
-				unsigned int Flag = *((unsigned int*)PackInfo[1].pData);*/
-				dbg_printf("Main: FS_CCCI_GetDiskInfo \n");
-				RetVal = FS_CCCI_GetDiskInfo(&DiskInfo);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				PackInfo[PacketNum].Length = sizeof(FS_DiskInfo);
-				PackInfo[PacketNum++].pData = (void*) &DiskInfo;
-				break;
-			}
-			case FS_CCCI_OP_DELETE:
-			{
-				wchar_t* FileName = (wchar_t*)PackInfo[0].pData;
-				dbg_printf("Main: FS_CCCI_Delete \n");
-				RetVal = FS_CCCI_Delete(FileName);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				break;
-			}
-			case FS_CCCI_OP_GETATTRIBUTES:
-			{
-				wchar_t* FileName = (wchar_t*)PackInfo[0].pData;
-				dbg_printf("Main: FS_CCCI_GetAttributes \n");
-				RetVal = FS_CCCI_GetAttributes(FileName);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				break;
-			}
-			case FS_CCCI_OP_OPENHINT:
-			{
-				wchar_t* FileName = (wchar_t*)PackInfo[0].pData;
-				int	Flag = *((int*)PackInfo[1].pData);
-				dbg_printf("Main: FS_CCCI_OpenHint \n");
-				//LOGD("OpenHint \n");
-				RetVal = FS_CCCI_Open(FileName, Flag);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*)&RetVal;
-				PackInfo[PacketNum].Length = 8;
-				PackInfo[PacketNum++].pData = PackInfo[2].pData;
-				break;
-			}
-			case FS_CCCI_OP_FINDFIRST:
-			{
-				wchar_t* PatternName = (wchar_t*)PackInfo[0].pData;
-				char Attr = *((char*)PackInfo[1].pData);
-				char AttrMask = *((char*)PackInfo[2].pData);
-				unsigned int MaxLength = *((unsigned int*)PackInfo[3].pData);
-				dbg_printf("Main: FS_CCCI_FindFirst \n");
-				RetVal = FS_CCCI_FindFirst(PatternName, Attr, AttrMask, &DosDirEntry, FileNameTemp, &MaxLength);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*)&RetVal;
-				PackInfo[PacketNum].Length = sizeof(FS_DOSDirEntry);
-				PackInfo[PacketNum++].pData = &DosDirEntry;
-				PackInfo[PacketNum].Length = (MaxLength > 0)?((MaxLength+1)*2):0; //wide character
-				PackInfo[PacketNum++].pData = (void*)FileNameTemp;
-				break;
-			}
-			case FS_CCCI_OP_FINDNEXT:
-			{
-				int HandleIndex = *((int*)PackInfo[0].pData);
-				unsigned int MaxLength = *((unsigned int*)PackInfo[1].pData);
-				dbg_printf("Main: FS_CCCI_FindNext \n");
-				RetVal = FS_CCCI_FindNext(HandleIndex, &DosDirEntry, FileNameTemp, &MaxLength);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*)&RetVal;
-				PackInfo[PacketNum].Length = sizeof(FS_DOSDirEntry);
-				PackInfo[PacketNum++].pData = &DosDirEntry;
-				PackInfo[PacketNum].Length = (MaxLength > 0) ? ((MaxLength+1) * 2) : 0; //wide character
-				PackInfo[PacketNum++].pData = (void*)FileNameTemp;
-				break;
-			}
-			case FS_CCCI_OP_FINDCLOSE:
-			{
-				int HandleIndex = *((int*)PackInfo[0].pData);
-				dbg_printf("Main: FS_CCCI_FindClose (%d) \n", HandleIndex);
-				RetVal = FS_CCCI_FindClose(HandleIndex);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*)&RetVal;
-				break;
-			}
-			case FS_CCCI_OP_LOCKFAT:
-			{
-				dbg_printf("Main: FS_CCCI_LockFAT \n");
-				RetVal = FS_NO_ERROR;
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				LOGD("LF: %d \n", RetVal);
-				break;
-			}
-			case FS_CCCI_OP_UNLOCKALL:
-			{
-				dbg_printf("Main: FS_CCCI_UnLockAll \n");
-				RetVal = 1;
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				LOGD("UK: %d \n", RetVal);
-				break;
-			}
-			case FS_CCCI_OP_SHUTDOWN:
-			{
-				dbg_printf("Main: FS_CCCI_Shutdown \n");
-				LOGD("Shutdown \n");
-				FS_CCCI_ShutDown();
-				break;
-			}
-			case FS_CCCI_OP_XDELETE:
-			{
-				wchar_t* FileName = (wchar_t*)PackInfo[0].pData;
-				unsigned int Flag = *((unsigned int*)PackInfo[1].pData);
-				dbg_printf("Main: FS_CCCI_XDelete \n");
-				RetVal = FS_CCCI_XDelete(FileName, Flag);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				break;
-			}
-			case FS_CCCI_OP_CLEARDISKFLAG:
-			{
-				dbg_printf("Main: FS_CCCI_ClearDiskFlag \n");
-				RetVal = FS_NO_ERROR;
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				LOGD("CDF: %d \n", RetVal);
-				break;
-			}
-			case FS_CCCI_OP_GETDRIVE:
-			{
-				unsigned int Type = *((unsigned int*)PackInfo[0].pData);
-				unsigned int Serial = *((unsigned int*)PackInfo[1].pData);
-				unsigned int AltMask = *((unsigned int*)PackInfo[2].pData);
-				dbg_printf("Main: FS_CCCI_GetDrive \n");
-				RetVal = FS_CCCI_GetDrive(Type, Serial, AltMask);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*)&RetVal;
-				break;
-			}
-			case FS_CCCI_OP_GETCLUSTERSIZE:
-			{
-				unsigned int DriverIdx = *((unsigned int*)PackInfo[0].pData);
-				dbg_printf("Main: FS_CCCI_GetClusterSize \n");
-				RetVal = FS_CCCI_GetClusterSize(DriverIdx);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*)&RetVal;
-				break;
-			}
-			case FS_CCCI_OP_SETDISKFLAG:
-			{
-				dbg_printf("Main: FS_CCCI_SetDiskFlag \n");
-				RetVal = FS_NO_ERROR;
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				LOGD("SDF: %d \n", RetVal);
-				break;
-			}
-
-			case FS_CCCI_OP_OTP_WRITE:
-			{
-				int devtype;
-				unsigned int Offset;
-				void * BufferPtr;
-				unsigned int  Length;
-				devtype = *(int*)PackInfo[0].pData;
-				Offset = *(unsigned int*)PackInfo[1].pData;
-				BufferPtr = PackInfo[2].pData;
-				Length = *(unsigned int*)PackInfo[3].pData;
-				dbg_printf("Main: FS_CCCI_OP_OTP_WRITE \n");
-				RetVal = FS_OTPWrite(devtype, Offset, BufferPtr, Length);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				break;
-			}
-			case FS_CCCI_OP_OTP_READ:
-			{
-				int devtype;
-				unsigned int Offset;
-				void * BufferPtr = pFsBuf->Buffer + 4*sizeof(int);
-				unsigned int  Length;
-
-				devtype = *(int*)PackInfo[0].pData;
-				Offset = *(unsigned int*)PackInfo[1].pData;
-				Length = *(unsigned int*)PackInfo[2].pData;
-
-				dbg_printf("Main: FS_CCCI_OP_OTP_READ \n");
-				RetVal = FS_OTPRead(devtype, Offset, BufferPtr, Length);
-
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				PackInfo[PacketNum].Length = Length;
-				PackInfo[PacketNum++].pData = BufferPtr;
-				break;
-			}
-			case FS_CCCI_OP_OTP_QUERYLEN:
-			{
-				int devtype;
-
-				devtype = *(int*)PackInfo[0].pData;
-				RetVal = FS_OTPQueryLength(devtype, &Length);
-				dbg_printf("Main: FS_CCCI_OP_OTP_QUERYLEN \n");
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				PackInfo[PacketNum].Length = sizeof(unsigned int);
-				PackInfo[PacketNum++].pData = (void*)&Length;
-				break;
-			}
-			case FS_CCCI_OP_OTP_LOCK:
-			{
-				int devtype;
-
-				devtype = *(int*)PackInfo[0].pData;
-				dbg_printf("Main: FS_CCCI_OP_OTP_LOCK \n");
-				RetVal = FS_OTPLock(devtype);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				break;
-			}
-			case FS_CCCI_OP_BIN_REGION_ACCESS:
-			{
-				int access_type;
-
-				access_type = *(int*)PackInfo[0].pData;
-				LOGD("Main: FS_CCCI_OP_BIN_REGION_ACCESS \n");
-				RetVal = FS_BinRegion_Access(access_type);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				break;
-			}
-			case FS_CCCI_OP_GETFILEDETAIL:
-			{
-				wchar_t* FileName = (wchar_t*)PackInfo[0].pData;
-				dbg_printf("Main: FS_CCCI_GetFileDetail \n");
-				RetVal = FS_CCCI_GetFileDetail(FileName, &FileDetail);
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				PackInfo[PacketNum].Length = sizeof(FS_FileDetail);
-				PackInfo[PacketNum++].pData = (void*)&FileDetail;
-				break;
-			}
-			default:
-				LOGE("Main: [error]Unknow File Op ID (%d)\n", pFsBuf->OperateID);
-				RetVal = FS_PARAM_ERROR;
-				PackInfo[PacketNum].Length = sizeof(int);
-				PackInfo[PacketNum++].pData = (void*) &RetVal;
-				break;
-		}
-_Next:
-		if ((ReqBufIndex < 0) || (ReqBufIndex >= FS_REQ_BUFFER_MUN) || (pFsBuf == NULL)) {
-			LOGE("Main: [error] Request check fail(%d), force md assert\n", ReqBufIndex);
-			if(ioctl(DeviceFd, CCCI_IOC_FORCE_MD_ASSERT, &RetVal) != 0)
-				LOGD("update modem type to kernel fail: err=%d", errno);
-		} else if(!FS_WriteToMD(DeviceFd, ReqBufIndex, PackInfo, PacketNum)) {
-			LOGE("Main: [error]fail write fs stream: op_id=%x\n", pFsBuf->OperateID);
-			//return -1;
-		}
-		FS_WAKE_UNLOCK();
-	}
 	LOGD("ccci_fsd exit, free buffer\n");
 	close(DeviceFd);
-	free(PackInfo);
 	if(stream_support)
 		free(g_FsInfo.pFsBuf);
 	return 0;
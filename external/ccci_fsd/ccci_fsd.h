@@ -21,6 +21,8 @@
 #define FS_FILE_MAX			129
 #define FS_MAX_RETRY			7
 #define FS_REQ_BUFFER_MUN		5
+#define FS_REQ_ARG_MAX			6
+#define FS_WORKER_NUM			FS_REQ_BUFFER_MUN
 #define FS_MAX_DIR_NUM			8
 
 #define MD1_FS_TAG	"ccci_fsd(1)" //"ccci_fsd"
@@ -307,6 +309,10 @@ typedef struct
 		char	AttrMask;
 		char*	pFsFileName;
 		char* pFsSearchPattern;
+		unsigned int Key;	// ordering key of the path it was opened on
+		void*	pCache;	// FS_CACHE_FILE of a file under the nvdata tree, NULL if not cached
+		unsigned int Pos;	// file position of a cached handle
+		void*	pSearchDir;	// DIR read by a search the index does not serve, else NULL
 } FS_FILE_HANDLE;
 
 typedef struct
@@ -451,6 +457,7 @@ typedef struct _nvram_fs_para_cmptw
 } nvram_fs_para_cmptw_t;
 
 extern char md_id;
+int PatMatch(const char* pattern, const char* string);
 enum {
     CCCI_MD_STA_UNDEFINED = -3,
     CCCI_MD_STA_INVALID = -2,
@@ -0,0 +1,331 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "fsd_platform.h"
+#include "fsd_cache.h"
+
+#define FS_CACHE_HASH_SIZE	64
+#define FS_CACHE_BIT(_i)	(1ULL << (_i))
+
+/*
+ * Lock order is g_FsCacheLock, then FS_CACHE_FILE.Lock. The global lock guards the
+ * hash, the LRU list and Ref; the file lock guards everything else of a file.
+ * Files nobody has open sit on the LRU list until the cache grows over
+ * FS_CACHE_MAX_BYTE.
+ */
+struct FS_CACHE_FILE_STRUCT
+{
+	FS_CACHE_FILE	*pNext;		// hash chain
+	FS_CACHE_FILE	*pLruPrev;
+	FS_CACHE_FILE	*pLruNext;
+	pthread_mutex_t	Lock;
+	dev_t			Dev;
+	ino_t			Ino;
+	struct timespec	MTime;		// of the backing file when Size was taken
+	struct timespec	CTime;
+	unsigned int	Size;
+	unsigned int	Ref;		// handles open on it
+	unsigned char	*Block[FS_CACHE_FILE_BLOCKS];
+};
+
+static pthread_mutex_t g_FsCacheLock = PTHREAD_MUTEX_INITIALIZER;
+static FS_CACHE_FILE *g_FsCacheHash[FS_CACHE_HASH_SIZE];
+static FS_CACHE_FILE *g_FsCacheLruHead;	// most recently closed
+static FS_CACHE_FILE *g_FsCacheLruTail;
+static unsigned int g_FsCacheBytes;
+static FS_CACHE_STAT g_FsCacheStat;
+
+static unsigned int FS_CacheHash(dev_t Dev, ino_t Ino)
+{
+	return (unsigned int)(Ino ^ Dev) % FS_CACHE_HASH_SIZE;
+}
+
+static void FS_CacheSetStat(FS_CACHE_FILE *pFile, const struct stat *pStat)
+{
+	pFile->Size = (unsigned int)pStat->st_size;
+	pFile->MTime = pStat->st_mtim;
+	pFile->CTime = pStat->st_ctim;
+}
+
+static bool FS_CacheChanged(FS_CACHE_FILE *pFile, const struct stat *pStat)
+{
+	return pFile->Size != (unsigned int)pStat->st_size ||
+		pFile->MTime.tv_sec != pStat->st_mtim.tv_sec || pFile->MTime.tv_nsec != pStat->st_mtim.tv_nsec ||
+		pFile->CTime.tv_sec != pStat->st_ctim.tv_sec || pFile->CTime.tv_nsec != pStat->st_ctim.tv_nsec;
+}
+
+static void FS_CacheDropLocked(FS_CACHE_FILE *pFile)
+{
+	int i;
+
+	for (i = 0; i < FS_CACHE_FILE_BLOCKS; i++) {
+		if (pFile->Block[i]) {
+			free(pFile->Block[i]);
+			pFile->Block[i] = NULL;
+			__sync_fetch_and_sub(&g_FsCacheBytes, FS_CACHE_BLOCK_SIZE);
+		}
+	}
+}
+
+/* Block Index of the file, loaded from Fd if it is not cached yet */
+static unsigned char *FS_CacheBlockLocked(FS_CACHE_FILE *pFile, int Fd, unsigned int Index)
+{
+	unsigned char *pBlock = pFile->Block[Index];
+	off_t Offset = (off_t)Index * FS_CACHE_BLOCK_SIZE;
+	ssize_t Len = 0;
+
+	if (pBlock)
+		return pBlock;
+
+	pBlock = malloc(FS_CACHE_BLOCK_SIZE);
+	if (pBlock == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	if (Offset < pFile->Size) {
+		Len = pread(Fd, pBlock, FS_CACHE_BLOCK_SIZE, Offset);
+		if (Len < 0) {
+			int local_errno = errno;
+
+			LOGE("Cache: [error]fail load block %u: %d\n", Index, local_errno);
+			free(pBlock);
+			errno = local_errno;
+			return NULL;
+		}
+	}
+	// past EOF or a hole
+	memset(pBlock + Len, 0, FS_CACHE_BLOCK_SIZE - Len);
+	pFile->Block[Index] = pBlock;
+	__sync_fetch_and_add(&g_FsCacheBytes, FS_CACHE_BLOCK_SIZE);
+	return pBlock;
+}
+
+static void FS_CacheLruUnlink(FS_CACHE_FILE *pFile)
+{
+	if (pFile->pLruPrev)
+		pFile->pLruPrev->pLruNext = pFile->pLruNext;
+	else
+		g_FsCacheLruHead = pFile->pLruNext;
+	if (pFile->pLruNext)
+		pFile->pLruNext->pLruPrev = pFile->pLruPrev;
+	else
+		g_FsCacheLruTail = pFile->pLruPrev;
+	pFile->pLruPrev = pFile->pLruNext = NULL;
+}
+
+/* free closed files from the cold end, called with g_FsCacheLock held */
+static void FS_CacheTrimLocked(void)
+{
+	FS_CACHE_FILE *pFile, **ppFile;
+
+	while (g_FsCacheBytes > FS_CACHE_MAX_BYTE && g_FsCacheLruTail) {
+		pFile = g_FsCacheLruTail;
+		FS_CacheLruUnlink(pFile);
+		for (ppFile = &g_FsCacheHash[FS_CacheHash(pFile->Dev, pFile->Ino)]; *ppFile; ppFile = &(*ppFile)->pNext) {
+			if (*ppFile == pFile) {
+				*ppFile = pFile->pNext;
+				break;
+			}
+		}
+		FS_CacheDropLocked(pFile);
+		pthread_mutex_destroy(&pFile->Lock);
+		free(pFile);
+	}
+}
+
+/* NULL if FsFileName is not cached, the handle then does plain I/O on Fd */
+FS_CACHE_FILE *FS_CacheOpen(const char *FsFileName, int Fd, unsigned int Flag)
+{
+	struct stat StatBuf;
+	FS_CACHE_FILE *pFile;
+	unsigned int Hash;
+
+	if (strncmp(FsFileName, FS_CACHE_ROOT, strlen(FS_CACHE_ROOT)) != 0)
+		return NULL;
+	if (fstat(Fd, &StatBuf) == -1 || !S_ISREG(StatBuf.st_mode) || StatBuf.st_size > FS_CACHE_FILE_MAX)
+		return NULL;
+
+	Hash = FS_CacheHash(StatBuf.st_dev, StatBuf.st_ino);
+	pthread_mutex_lock(&g_FsCacheLock);
+	for (pFile = g_FsCacheHash[Hash]; pFile; pFile = pFile->pNext) {
+		if (pFile->Ino == StatBuf.st_ino && pFile->Dev == StatBuf.st_dev)
+			break;
+	}
+	if (pFile == NULL) {
+		pFile = calloc(1, sizeof(*pFile));
+		if (pFile == NULL) {
+			pthread_mutex_unlock(&g_FsCacheLock);
+			return NULL;
+		}
+		pthread_mutex_init(&pFile->Lock, NULL);
+		pFile->Dev = StatBuf.st_dev;
+		pFile->Ino = StatBuf.st_ino;
+		FS_CacheSetStat(pFile, &StatBuf);
+		pFile->pNext = g_FsCacheHash[Hash];
+		g_FsCacheHash[Hash] = pFile;
+	} else if (pFile->Ref == 0) {
+		FS_CacheLruUnlink(pFile);
+	}
+	pFile->Ref++;
+
+	pthread_mutex_lock(&pFile->Lock);
+	// truncated by this open, or changed by someone else since it was cached
+	if ((Flag & FS_CREATE_ALWAYS) || FS_CacheChanged(pFile, &StatBuf)) {
+		FS_CacheDropLocked(pFile);
+		FS_CacheSetStat(pFile, &StatBuf);
+	}
+	pthread_mutex_unlock(&pFile->Lock);
+
+	FS_CacheTrimLocked();
+	pthread_mutex_unlock(&g_FsCacheLock);
+	return pFile;
+}
+
+/* drop a handle's reference */
+void FS_CacheRelease(FS_CACHE_FILE *pFile)
+{
+	pthread_mutex_lock(&g_FsCacheLock);
+	if (--pFile->Ref == 0) {
+		pFile->pLruNext = g_FsCacheLruHead;
+		if (g_FsCacheLruHead)
+			g_FsCacheLruHead->pLruPrev = pFile;
+		else
+			g_FsCacheLruTail = pFile;
+		g_FsCacheLruHead = pFile;
+	}
+	FS_CacheTrimLocked();
+	pthread_mutex_unlock(&g_FsCacheLock);
+}
+
+int FS_CacheRead(FS_CACHE_FILE *pFile, int Fd, unsigned int Pos, void *pBuffer, unsigned int Len)
+{
+	unsigned int Done = 0, Index, Offset, Count;
+	unsigned char *pBlock;
+	int ret;
+
+	pthread_mutex_lock(&pFile->Lock);
+	if (Pos >= pFile->Size)
+		Len = 0;
+	else if (Len > pFile->Size - Pos)
+		Len = pFile->Size - Pos;
+
+	if (Pos + Len > FS_CACHE_FILE_MAX) {
+		// grown past the cached range by a write
+		ret = pread(Fd, pBuffer, Len, Pos);
+		goto Exit;
+	}
+
+	while (Done < Len) {
+		Index = (Pos + Done) / FS_CACHE_BLOCK_SIZE;
+		Offset = (Pos + Done) % FS_CACHE_BLOCK_SIZE;
+		Count = FS_CACHE_BLOCK_SIZE - Offset;
+		if (Count > Len - Done)
+			Count = Len - Done;
+		if (pFile->Block[Index])
+			__sync_fetch_and_add(&g_FsCacheStat.Hit, 1);
+		else
+			__sync_fetch_and_add(&g_FsCacheStat.Miss, 1);
+		pBlock = FS_CacheBlockLocked(pFile, Fd, Index);
+		if (pBlock == NULL) {
+			ret = -1;
+			goto Exit;
+		}
+		memcpy((char *)pBuffer + Done, pBlock + Offset, Count);
+		Done += Count;
+	}
+	ret = Done;
+
+Exit:
+	pthread_mutex_unlock(&pFile->Lock);
+	return ret;
+}
+
+/*
+ * Written through to the file first, so a write is where it would be without the
+ * cache when it returns and a read-only Fd fails it with EBADF. Blocks already
+ * cached are updated, others are loaded by the next read.
+ */
+int FS_CacheWrite(FS_CACHE_FILE *pFile, int Fd, unsigned int Pos, const void *pBuffer, unsigned int Len)
+{
+	unsigned int Done = 0, Index, Offset, Count;
+	struct stat StatBuf;
+	ssize_t Written;
+
+	__sync_fetch_and_add(&g_FsCacheStat.Write, 1);
+	pthread_mutex_lock(&pFile->Lock);
+	Written = pwrite(Fd, pBuffer, Len, Pos);
+	if (Written <= 0)
+		goto Exit;
+
+	if (Pos + Written > FS_CACHE_FILE_MAX) {
+		// too large to cache, reads past the limit go to the file
+		FS_CacheDropLocked(pFile);
+	} else {
+		while (Done < (unsigned int)Written) {
+			Index = (Pos + Done) / FS_CACHE_BLOCK_SIZE;
+			Offset = (Pos + Done) % FS_CACHE_BLOCK_SIZE;
+			Count = FS_CACHE_BLOCK_SIZE - Offset;
+			if (Count > Written - Done)
+				Count = Written - Done;
+			if (pFile->Block[Index])
+				memcpy(pFile->Block[Index] + Offset, (const char *)pBuffer + Done, Count);
+			Done += Count;
+		}
+	}
+	// our own write changed size and times
+	if (fstat(Fd, &StatBuf) == 0) {
+		FS_CacheSetStat(pFile, &StatBuf);
+	} else {
+		FS_CacheDropLocked(pFile);
+		if (Pos + Written > pFile->Size)
+			pFile->Size = Pos + Written;
+	}
+
+Exit:
+	pthread_mutex_unlock(&pFile->Lock);
+	return (int)Written;
+}
+
+unsigned int FS_CacheSize(FS_CACHE_FILE *pFile)
+{
+	unsigned int Size;
+
+	pthread_mutex_lock(&pFile->Lock);
+	Size = pFile->Size;
+	pthread_mutex_unlock(&pFile->Lock);
+	return Size;
+}
+
+int FS_CacheSync(int Fd)
+{
+	__sync_fetch_and_add(&g_FsCacheStat.Fsync, 1);
+	return fsync(Fd);
+}
+
+void FS_CacheGetStat(FS_CACHE_STAT *pStat)
+{
+	pthread_mutex_lock(&g_FsCacheLock);
+	*pStat = g_FsCacheStat;
+	pthread_mutex_unlock(&g_FsCacheLock);
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __FSD_CACHE_H__
+#define __FSD_CACHE_H__
+
+/*
+ * Block cache for MD files under the nvdata tree.
+ *
+ * Reads are served from 4KB blocks loaded on first use. Writes go through to the
+ * file before they return, as without the cache, and update the blocks already
+ * loaded; FS_CCCI_Close() fsyncs as before, so crash consistency is unchanged.
+ * Cached handles keep their own file position, all I/O on them is positional.
+ * A cached file is checked against its inode, size and times on every open and
+ * dropped if it was changed behind the daemon's back.
+ *
+ * Like read()/write(), the I/O functions return -1 and set errno on failure.
+ */
+
+#ifndef FS_CACHE_ROOT
+#define FS_CACHE_ROOT			"/mnt/vendor/nvdata/"
+#endif
+#define FS_CACHE_BLOCK_SIZE		4096
+#define FS_CACHE_FILE_BLOCKS	64
+#define FS_CACHE_FILE_MAX		(FS_CACHE_BLOCK_SIZE * FS_CACHE_FILE_BLOCKS)
+#define FS_CACHE_MAX_BYTE		(2 * 1024 * 1024)
+
+typedef struct FS_CACHE_FILE_STRUCT FS_CACHE_FILE;
+
+typedef struct
+{
+	unsigned int	Hit;		// blocks read from the cache
+	unsigned int	Miss;		// blocks loaded from the backing file
+	unsigned int	Write;		// writes from MD
+	unsigned int	Fsync;
+} FS_CACHE_STAT;
+
+FS_CACHE_FILE *FS_CacheOpen(const char *FsFileName, int Fd, unsigned int Flag);
+void FS_CacheRelease(FS_CACHE_FILE *pFile);
+int FS_CacheRead(FS_CACHE_FILE *pFile, int Fd, unsigned int Pos, void *pBuffer, unsigned int Len);
+int FS_CacheWrite(FS_CACHE_FILE *pFile, int Fd, unsigned int Pos, const void *pBuffer, unsigned int Len);
+unsigned int FS_CacheSize(FS_CACHE_FILE *pFile);
+int FS_CacheSync(int Fd);
+void FS_CacheGetStat(FS_CACHE_STAT *pStat);
+
+#endif //__FSD_CACHE_H__
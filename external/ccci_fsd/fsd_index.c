@@ -0,0 +1,624 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include "fsd_platform.h"
+#include "fsd_index.h"
+
+#define FS_INDEX_WD_HASH	64
+#define FS_INDEX_EVENTS		(IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | \
+							 IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+// same type tests as FS_RecursiveSearch()
+#define FS_INDEX_IS_DIR(_m)		(((_m) & S_IFDIR) != 0)
+#define FS_INDEX_IS_FILE(_m)	(!FS_INDEX_IS_DIR(_m) && ((_m) & S_IFREG) != 0)
+
+typedef struct FS_INDEX_NODE_STRUCT FS_INDEX_NODE;
+
+struct FS_INDEX_NODE_STRUCT
+{
+	FS_INDEX_NODE	*pParent;	// NULL for a root
+	FS_INDEX_NODE	**ppChild;	// sorted by name
+	unsigned int	ChildNum;
+	unsigned int	ChildMax;
+	FS_INDEX_NODE	*pWdNext;	// chain in g_FsIndexWd
+	int				Wd;			// inotify watch of a directory, -1 if none
+	mode_t			Mode;
+	unsigned int	Size;
+	unsigned int	Files;		// direct children
+	unsigned int	Dirs;
+	unsigned int	TreeFiles;	// everything below
+	unsigned int	TreeDirs;
+	unsigned int	TreeClusters;
+	char			Name[];		// the full path for a root
+};
+
+/* All of it is guarded by g_FsIndexLock */
+static pthread_mutex_t g_FsIndexLock = PTHREAD_MUTEX_INITIALIZER;
+static char *g_FsIndexRootPath[FS_MAX_DIR_NUM];
+static FS_INDEX_NODE *g_FsIndexRoot[FS_MAX_DIR_NUM];
+static int g_FsIndexRootNum;
+static FS_INDEX_NODE *g_FsIndexWd[FS_INDEX_WD_HASH];
+static int g_FsIndexFd = -1;
+static int g_FsIndexClusterSize;
+static unsigned int g_FsIndexNodeNum;
+static bool g_FsIndexStale;		// rebuild before the next query
+static bool g_FsIndexDisabled = true;	// until FS_IndexInit()
+
+static unsigned int FS_IndexClusters(const FS_INDEX_NODE *pNode)
+{
+	// a file takes one cluster more than its size, as FS_RecursiveSearch() counts
+	if (!FS_INDEX_IS_FILE(pNode->Mode) || pNode->Size == 0 || g_FsIndexClusterSize <= 0)
+		return 0;
+	return pNode->Size / g_FsIndexClusterSize + 1;
+}
+
+static int FS_IndexPath(const FS_INDEX_NODE *pNode, char *Path)
+{
+	int Len;
+
+	if (pNode->pParent == NULL)
+		return snprintf(Path, PATH_MAX, "%s", pNode->Name);
+
+	Len = FS_IndexPath(pNode->pParent, Path);
+	if (Len < 0 || Len >= PATH_MAX)
+		return -1;
+	Len += snprintf(Path + Len, PATH_MAX - Len, "/%s", pNode->Name);
+	return (Len < PATH_MAX) ? Len : -1;
+}
+
+static int FS_IndexDepth(const FS_INDEX_NODE *pNode)
+{
+	int Depth = 0;
+
+	for (; pNode->pParent; pNode = pNode->pParent)
+		Depth++;
+	return Depth;
+}
+
+/* position of Name among the children of pDir, or where it would go */
+static unsigned int FS_IndexSearch(const FS_INDEX_NODE *pDir, const char *Name, bool *pFound)
+{
+	unsigned int Low = 0, High = pDir->ChildNum, Mid;
+	int Cmp;
+
+	*pFound = false;
+	while (Low < High) {
+		Mid = (Low + High) / 2;
+		Cmp = strcmp(pDir->ppChild[Mid]->Name, Name);
+		if (Cmp == 0) {
+			*pFound = true;
+			return Mid;
+		}
+		if (Cmp < 0)
+			Low = Mid + 1;
+		else
+			High = Mid;
+	}
+	return Low;
+}
+
+static FS_INDEX_NODE *FS_IndexChild(const FS_INDEX_NODE *pDir, const char *Name)
+{
+	bool bFound;
+	unsigned int Pos = FS_IndexSearch(pDir, Name, &bFound);
+
+	return bFound ? pDir->ppChild[Pos] : NULL;
+}
+
+static FS_INDEX_NODE *FS_IndexNewNode(const char *Name, const struct stat *pStat)
+{
+	FS_INDEX_NODE *pNode;
+
+	if (g_FsIndexNodeNum >= FS_INDEX_NODE_MAX) {
+		LOGE("Index: [error]more than %d entries\n", FS_INDEX_NODE_MAX);
+		return NULL;
+	}
+	pNode = calloc(1, sizeof(*pNode) + strlen(Name) + 1);
+	if (pNode == NULL)
+		return NULL;
+	strcpy(pNode->Name, Name);
+	pNode->Wd = -1;
+	pNode->Mode = pStat->st_mode;
+	pNode->Size = (unsigned int)pStat->st_size;
+	g_FsIndexNodeNum++;
+	return pNode;
+}
+
+/* add the totals of a subtree to pNode and all above it */
+static void FS_IndexAdjust(FS_INDEX_NODE *pNode, int Files, int Dirs, int Clusters)
+{
+	for (; pNode; pNode = pNode->pParent) {
+		pNode->TreeFiles += Files;
+		pNode->TreeDirs += Dirs;
+		pNode->TreeClusters += Clusters;
+	}
+}
+
+static int FS_IndexLink(FS_INDEX_NODE *pDir, FS_INDEX_NODE *pNode)
+{
+	FS_INDEX_NODE **ppChild;
+	unsigned int Pos;
+	bool bFound;
+
+	Pos = FS_IndexSearch(pDir, pNode->Name, &bFound);
+	if (pDir->ChildNum == pDir->ChildMax) {
+		unsigned int Max = pDir->ChildMax ? pDir->ChildMax * 2 : 8;
+
+		ppChild = realloc(pDir->ppChild, Max * sizeof(*ppChild));
+		if (ppChild == NULL)
+			return -1;
+		pDir->ppChild = ppChild;
+		pDir->ChildMax = Max;
+	}
+	memmove(&pDir->ppChild[Pos + 1], &pDir->ppChild[Pos], (pDir->ChildNum - Pos) * sizeof(*ppChild));
+	pDir->ppChild[Pos] = pNode;
+	pDir->ChildNum++;
+	pNode->pParent = pDir;
+
+	if (FS_INDEX_IS_DIR(pNode->Mode))
+		pDir->Dirs++;
+	else if (FS_INDEX_IS_FILE(pNode->Mode))
+		pDir->Files++;
+	FS_IndexAdjust(pDir, pNode->TreeFiles + FS_INDEX_IS_FILE(pNode->Mode),
+		pNode->TreeDirs + FS_INDEX_IS_DIR(pNode->Mode), pNode->TreeClusters + FS_IndexClusters(pNode));
+	return 0;
+}
+
+static void FS_IndexUnlink(FS_INDEX_NODE *pNode)
+{
+	FS_INDEX_NODE *pDir = pNode->pParent;
+	unsigned int Pos;
+	bool bFound;
+
+	Pos = FS_IndexSearch(pDir, pNode->Name, &bFound);
+	if (!bFound)
+		return;
+	memmove(&pDir->ppChild[Pos], &pDir->ppChild[Pos + 1], (pDir->ChildNum - Pos - 1) * sizeof(pNode));
+	pDir->ChildNum--;
+
+	if (FS_INDEX_IS_DIR(pNode->Mode))
+		pDir->Dirs--;
+	else if (FS_INDEX_IS_FILE(pNode->Mode))
+		pDir->Files--;
+	FS_IndexAdjust(pDir, -(int)(pNode->TreeFiles + FS_INDEX_IS_FILE(pNode->Mode)),
+		-(int)(pNode->TreeDirs + FS_INDEX_IS_DIR(pNode->Mode)),
+		-(int)(pNode->TreeClusters + FS_IndexClusters(pNode)));
+	pNode->pParent = NULL;
+}
+
+static void FS_IndexUnwatch(FS_INDEX_NODE *pNode)
+{
+	FS_INDEX_NODE **ppNode;
+
+	if (pNode->Wd < 0)
+		return;
+	for (ppNode = &g_FsIndexWd[pNode->Wd % FS_INDEX_WD_HASH]; *ppNode; ppNode = &(*ppNode)->pWdNext) {
+		if (*ppNode == pNode) {
+			*ppNode = pNode->pWdNext;
+			break;
+		}
+	}
+	if (g_FsIndexFd >= 0)
+		inotify_rm_watch(g_FsIndexFd, pNode->Wd);
+	pNode->Wd = -1;
+}
+
+static void FS_IndexFree(FS_INDEX_NODE *pNode)
+{
+	unsigned int i;
+
+	for (i = 0; i < pNode->ChildNum; i++)
+		FS_IndexFree(pNode->ppChild[i]);
+	FS_IndexUnwatch(pNode);
+	free(pNode->ppChild);
+	free(pNode);
+	g_FsIndexNodeNum--;
+}
+
+static FS_INDEX_NODE *FS_IndexWdNode(int Wd)
+{
+	FS_INDEX_NODE *pNode;
+
+	for (pNode = g_FsIndexWd[Wd % FS_INDEX_WD_HASH]; pNode; pNode = pNode->pWdNext) {
+		if (pNode->Wd == Wd)
+			return pNode;
+	}
+	return NULL;
+}
+
+/* watch the directory, then read everything below it */
+static int FS_IndexScan(FS_INDEX_NODE *pNode, const char *Path, int Depth)
+{
+	char FsFileName[PATH_MAX];
+	struct dirent *pDirent;
+	struct stat StatBuf;
+	FS_INDEX_NODE *pChild;
+	DIR *pDir;
+	int Wd;
+	int ret = 0;
+
+	if (Depth > FS_INDEX_DEPTH_MAX) {
+		LOGE("Index: [error]%s nested too deep\n", Path);
+		return -1;
+	}
+
+	Wd = inotify_add_watch(g_FsIndexFd, Path, FS_INDEX_EVENTS);
+	if (Wd < 0) {
+		LOGE("Index: [error]fail watch %s: %d\n", Path, errno);
+		return -1;
+	}
+	pNode->Wd = Wd;
+	pNode->pWdNext = g_FsIndexWd[Wd % FS_INDEX_WD_HASH];
+	g_FsIndexWd[Wd % FS_INDEX_WD_HASH] = pNode;
+
+	pDir = opendir(Path);
+	if (pDir == NULL) {
+		// gone already, the parent's event removes it
+		LOGE("Index: fail open dir %s: %d\n", Path, errno);
+		return 0;
+	}
+	while ((pDirent = readdir(pDir)) != NULL) {
+		if (strcmp(pDirent->d_name, ".") == 0 || strcmp(pDirent->d_name, "..") == 0)
+			continue;
+		if (snprintf(FsFileName, sizeof(FsFileName), "%s/%s", Path, pDirent->d_name) >= PATH_MAX)
+			continue;
+		if (stat(FsFileName, &StatBuf) == -1)
+			continue;
+		pChild = FS_IndexNewNode(pDirent->d_name, &StatBuf);
+		if (pChild == NULL) {
+			ret = -1;
+			break;
+		}
+		if ((FS_INDEX_IS_DIR(pChild->Mode) && FS_IndexScan(pChild, FsFileName, Depth + 1) < 0) ||
+			FS_IndexLink(pNode, pChild) < 0) {
+			FS_IndexFree(pChild);
+			ret = -1;
+			break;
+		}
+	}
+	closedir(pDir);
+	return ret;
+}
+
+static void FS_IndexFreeAll(void)
+{
+	int i;
+
+	// closing the fd drops every watch
+	if (g_FsIndexFd >= 0) {
+		close(g_FsIndexFd);
+		g_FsIndexFd = -1;
+	}
+	for (i = 0; i < g_FsIndexRootNum; i++) {
+		if (g_FsIndexRoot[i]) {
+			FS_IndexFree(g_FsIndexRoot[i]);
+			g_FsIndexRoot[i] = NULL;
+		}
+	}
+	memset(g_FsIndexWd, 0, sizeof(g_FsIndexWd));
+}
+
+static int FS_IndexBuildRoot(int i)
+{
+	struct stat StatBuf;
+	FS_INDEX_NODE *pRoot;
+
+	// a root which does not exist is looked up on disk
+	if (stat(g_FsIndexRootPath[i], &StatBuf) == -1 || !FS_INDEX_IS_DIR(StatBuf.st_mode))
+		return 0;
+	pRoot = FS_IndexNewNode(g_FsIndexRootPath[i], &StatBuf);
+	if (pRoot == NULL)
+		return -1;
+	g_FsIndexRoot[i] = pRoot;
+	return FS_IndexScan(pRoot, pRoot->Name, 0);
+}
+
+static void FS_IndexBuild(void)
+{
+	int i;
+
+	FS_IndexFreeAll();
+	g_FsIndexStale = false;
+	g_FsIndexFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (g_FsIndexFd < 0) {
+		LOGE("Index: [error]fail init inotify: %d\n", errno);
+		goto Fail;
+	}
+	for (i = 0; i < g_FsIndexRootNum; i++) {
+		if (FS_IndexBuildRoot(i) < 0)
+			goto Fail;
+	}
+	LOGD("Index: %u entries\n", g_FsIndexNodeNum);
+	return;
+
+Fail:
+	LOGE("Index: [error]disabled, searching the file system instead\n");
+	FS_IndexFreeAll();
+	g_FsIndexDisabled = true;
+}
+
+/* make the entry Name of pDir match the file system */
+static void FS_IndexReconcile(FS_INDEX_NODE *pDir, const char *Name)
+{
+	char FsFileName[PATH_MAX];
+	struct stat StatBuf;
+	FS_INDEX_NODE *pNode;
+	int Len;
+	int Clusters;
+
+	Len = FS_IndexPath(pDir, FsFileName);
+	if (Len < 0 || snprintf(FsFileName + Len, PATH_MAX - Len, "/%s", Name) >= PATH_MAX - Len)
+		return;
+
+	pNode = FS_IndexChild(pDir, Name);
+	if (stat(FsFileName, &StatBuf) == -1) {
+		if (pNode) {
+			FS_IndexUnlink(pNode);
+			FS_IndexFree(pNode);
+		}
+		return;
+	}
+
+	if (pNode && FS_INDEX_IS_DIR(pNode->Mode) == FS_INDEX_IS_DIR(StatBuf.st_mode) &&
+		FS_INDEX_IS_FILE(pNode->Mode) == FS_INDEX_IS_FILE(StatBuf.st_mode)) {
+		// same kind of entry, only a file's size matters
+		Clusters = FS_IndexClusters(pNode);
+		pNode->Mode = StatBuf.st_mode;
+		pNode->Size = (unsigned int)StatBuf.st_size;
+		FS_IndexAdjust(pDir, 0, 0, (int)FS_IndexClusters(pNode) - Clusters);
+		return;
+	}
+	if (pNode) {
+		FS_IndexUnlink(pNode);
+		FS_IndexFree(pNode);
+	}
+
+	pNode = FS_IndexNewNode(Name, &StatBuf);
+	if (pNode == NULL ||
+		(FS_INDEX_IS_DIR(pNode->Mode) && FS_IndexScan(pNode, FsFileName, FS_IndexDepth(pDir) + 1) < 0) ||
+		FS_IndexLink(pDir, pNode) < 0) {
+		if (pNode)
+			FS_IndexFree(pNode);
+		g_FsIndexStale = true;
+	}
+}
+
+/* apply the inotify events queued so far */
+static void FS_IndexDrain(void)
+{
+	char Buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *pEvent;
+	FS_INDEX_NODE *pNode;
+	ssize_t Len;
+	char *ptr;
+
+	while ((Len = read(g_FsIndexFd, Buf, sizeof(Buf))) > 0) {
+		for (ptr = Buf; ptr < Buf + Len; ptr += sizeof(struct inotify_event) + pEvent->len) {
+			pEvent = (const struct inotify_event *)ptr;
+			if (pEvent->mask & IN_Q_OVERFLOW) {
+				LOGW("Index: inotify queue overflow\n");
+				g_FsIndexStale = true;
+				continue;
+			}
+			pNode = FS_IndexWdNode(pEvent->wd);
+			if (pNode == NULL)
+				continue;
+			if (pEvent->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+				// the parent's event takes care of it, a root is read again
+				if (pNode->pParent == NULL)
+					g_FsIndexStale = true;
+				continue;
+			}
+			if (pEvent->len > 0)
+				FS_IndexReconcile(pNode, pEvent->name);
+		}
+	}
+}
+
+/* called with g_FsIndexLock held before using the index */
+static bool FS_IndexReady(void)
+{
+	if (g_FsIndexDisabled)
+		return false;
+	if (!g_FsIndexStale)
+		FS_IndexDrain();
+	if (g_FsIndexStale)
+		FS_IndexBuild();
+	return !g_FsIndexDisabled;
+}
+
+static FS_INDEX_NODE *FS_IndexLookup(const char *FsFileName)
+{
+	char Name[NAME_MAX + 1];
+	FS_INDEX_NODE *pNode = NULL;
+	const char *ptr, *end;
+	size_t Len;
+	int i;
+
+	for (i = 0; i < g_FsIndexRootNum; i++) {
+		if (g_FsIndexRoot[i] == NULL)
+			continue;
+		Len = strlen(g_FsIndexRoot[i]->Name);
+		if (strncmp(FsFileName, g_FsIndexRoot[i]->Name, Len) == 0 &&
+			(FsFileName[Len] == '/' || FsFileName[Len] == '\0')) {
+			pNode = g_FsIndexRoot[i];
+			break;
+		}
+	}
+	if (pNode == NULL)
+		return NULL;
+
+	for (ptr = FsFileName + Len; *ptr; ptr = end) {
+		while (*ptr == '/')
+			ptr++;
+		if (*ptr == '\0')
+			break;
+		end = strchr(ptr, '/');
+		if (end == NULL)
+			end = ptr + strlen(ptr);
+		if ((size_t)(end - ptr) > NAME_MAX)
+			return NULL;
+		memcpy(Name, ptr, end - ptr);
+		Name[end - ptr] = '\0';
+		if (strcmp(Name, ".") == 0 || strcmp(Name, "..") == 0)
+			return NULL;
+		pNode = FS_IndexChild(pNode, Name);
+		if (pNode == NULL)
+			return NULL;
+	}
+	return pNode;
+}
+
+void FS_IndexAddRoot(const char *FsRootDir)
+{
+	pthread_mutex_lock(&g_FsIndexLock);
+	if (g_FsIndexRootNum < FS_MAX_DIR_NUM) {
+		g_FsIndexRootPath[g_FsIndexRootNum] = strdup(FsRootDir);
+		if (g_FsIndexRootPath[g_FsIndexRootNum])
+			g_FsIndexRootNum++;
+	}
+	pthread_mutex_unlock(&g_FsIndexLock);
+}
+
+/* read the trees of all roots added so far */
+void FS_IndexInit(int ClusterSize)
+{
+	pthread_mutex_lock(&g_FsIndexLock);
+	g_FsIndexClusterSize = ClusterSize;
+	g_FsIndexDisabled = false;
+	FS_IndexBuild();
+	pthread_mutex_unlock(&g_FsIndexLock);
+}
+
+/*
+ * Tell the index FsFileName was created, deleted, renamed or written. With Tree
+ * set a directory is read again as a whole, for operations working on subtrees.
+ */
+void FS_IndexUpdate(const char *FsFileName, bool Tree)
+{
+	char FsDirName[PATH_MAX];
+	FS_INDEX_NODE *pDir, *pNode;
+	const char *Name;
+
+	pthread_mutex_lock(&g_FsIndexLock);
+	if (g_FsIndexDisabled || g_FsIndexStale)
+		goto Exit;
+
+	Name = strrchr(FsFileName, '/');
+	if (Name == NULL || Name == FsFileName || (size_t)(Name - FsFileName) >= sizeof(FsDirName))
+		goto Exit;
+	memcpy(FsDirName, FsFileName, Name - FsFileName);
+	FsDirName[Name - FsFileName] = '\0';
+	Name++;
+
+	pDir = FS_IndexLookup(FsDirName);
+	if (pDir == NULL || !FS_INDEX_IS_DIR(pDir->Mode) || *Name == '\0')
+		goto Exit;
+	if (Tree && (pNode = FS_IndexChild(pDir, Name)) != NULL) {
+		FS_IndexUnlink(pNode);
+		FS_IndexFree(pNode);
+	}
+	FS_IndexReconcile(pDir, Name);
+
+Exit:
+	pthread_mutex_unlock(&g_FsIndexLock);
+}
+
+/* FS_RecursiveSearch() without the walk, false if FsDirName is not indexed */
+bool FS_IndexCount(const char *FsDirName, unsigned int Flag, int *pCount, unsigned int *pClusterCount)
+{
+	FS_INDEX_NODE *pDir;
+	unsigned int Count = 0, ClusterCount = 0;
+	unsigned int i;
+	bool ret = false;
+
+	pthread_mutex_lock(&g_FsIndexLock);
+	if (!FS_IndexReady())
+		goto Exit;
+	pDir = FS_IndexLookup(FsDirName);
+	if (pDir == NULL || !FS_INDEX_IS_DIR(pDir->Mode))
+		goto Exit;
+
+	if (Flag & FS_RECURSIVE_TYPE) {
+		if (Flag & FS_DIR_TYPE)
+			Count += pDir->TreeDirs;
+		if (Flag & FS_FILE_TYPE) {
+			Count += pDir->TreeFiles;
+			ClusterCount = pDir->TreeClusters;
+		}
+	} else {
+		if (Flag & FS_DIR_TYPE)
+			Count += pDir->Dirs;
+		if (Flag & FS_FILE_TYPE) {
+			Count += pDir->Files;
+			for (i = 0; i < pDir->ChildNum; i++)
+				ClusterCount += FS_IndexClusters(pDir->ppChild[i]);
+		}
+	}
+	*pCount = (int)Count;
+	*pClusterCount += ClusterCount;
+	ret = true;
+
+Exit:
+	pthread_mutex_unlock(&g_FsIndexLock);
+	return ret;
+}
+
+/*
+ * Next entry of FsDirName after Name (in strcmp() order, "" for the first) whose
+ * name matches Pattern. Returns 1 and the entry in Name, 0 if there is none, or
+ * -1 if FsDirName is not indexed.
+ */
+int FS_IndexFindNext(const char *FsDirName, const char *Pattern, char *Name)
+{
+	FS_INDEX_NODE *pDir;
+	unsigned int Pos;
+	bool bFound;
+	int ret = -1;
+
+	pthread_mutex_lock(&g_FsIndexLock);
+	if (!FS_IndexReady())
+		goto Exit;
+	pDir = FS_IndexLookup(FsDirName);
+	if (pDir == NULL || !FS_INDEX_IS_DIR(pDir->Mode))
+		goto Exit;
+
+	Pos = FS_IndexSearch(pDir, Name, &bFound);
+	if (bFound)
+		Pos++;
+	for (ret = 0; Pos < pDir->ChildNum; Pos++) {
+		if (PatMatch(Pattern, pDir->ppChild[Pos]->Name)) {
+			strcpy(Name, pDir->ppChild[Pos]->Name);
+			ret = 1;
+			break;
+		}
+	}
+
+Exit:
+	pthread_mutex_unlock(&g_FsIndexLock);
+	return ret;
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __FSD_INDEX_H__
+#define __FSD_INDEX_H__
+
+/*
+ * In-memory index of the trees under FsRootDir, so FindFirst/FindNext, Count and
+ * GetFolderSize need no directory walks.
+ *
+ * It is built at FS_Init and kept current by FS_IndexUpdate() from the daemon's
+ * own create/delete/rename/write paths. Changes made by other processes come in
+ * through inotify; queued events are applied before each query, so a query sees
+ * everything done before it. An event queue overflow rebuilds the index on the
+ * next query. Trees with more than FS_INDEX_NODE_MAX entries, or no inotify,
+ * disable it and the callers walk the file system as before.
+ */
+
+#define FS_INDEX_NODE_MAX	16384
+#define FS_INDEX_DEPTH_MAX	32
+
+void FS_IndexAddRoot(const char *FsRootDir);
+void FS_IndexInit(int ClusterSize);
+void FS_IndexUpdate(const char *FsFileName, bool Tree);
+bool FS_IndexCount(const char *FsDirName, unsigned int Flag, int *pCount, unsigned int *pClusterCount);
+int FS_IndexFindNext(const char *FsDirName, const char *Pattern, char *Name);
+
+#endif //__FSD_INDEX_H__
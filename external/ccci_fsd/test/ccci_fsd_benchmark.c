@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Throughput of large FS_CCCI_Write and FS_CCCI_Read transfers through the
+ * stream path of ccci_fsd: every slot carries a 16KB request on a file of
+ * its own, so each write is reassembled from five fragments and each read
+ * answered in five. The fake MD of fsd_fake_md.h keeps all slots busy and
+ * the files in the page cache, what is measured is the daemon's packet
+ * handling. Prints MB/s of file data.
+ */
+
+#include <time.h>
+
+#define main ccci_fsd_main
+#include "../ccci_fsd.c"
+#undef main
+
+#include "fsd_fake_md.h"
+
+#define BENCH_XFER      0x4000
+#define BENCH_FILE_LEN  (1024 * 1024)
+#define BENCH_BYTES     (256 * 1024 * 1024)
+
+static int handles[FS_REQ_BUFFER_MUN];
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void rewind_files(void)
+{
+    int slot;
+
+    for (slot = 0; slot < FS_REQ_BUFFER_MUN; slot++)
+        EXPECT(md_seek(slot, handles[slot], 0) >= 0);
+}
+
+/* one request per slot, then the answers; files wrap at BENCH_FILE_LEN */
+static void bench(const char *name, int op)
+{
+    static char data[BENCH_XFER];
+    static struct md_response resp;
+    unsigned long long bytes = 0;
+    double start, elapsed;
+    int slot, done, offset = 0;
+
+    memset(data, 'x', sizeof(data));
+    rewind_files();
+    start = now_sec();
+    while (bytes < BENCH_BYTES) {
+        for (slot = 0; slot < FS_REQ_BUFFER_MUN; slot++) {
+            if (op == FS_CCCI_OP_WRITE)
+                md_write(slot, handles[slot], data, BENCH_XFER);
+            else
+                md_read(slot, handles[slot], BENCH_XFER);
+        }
+        for (done = 0; done < FS_REQ_BUFFER_MUN; done++) {
+            if (md_recv(&resp, 0)) {
+                EXPECT(!"no response");
+                return;
+            }
+            EXPECT(resp.op == op && resp_int(&resp, 0) == FS_NO_ERROR);
+            EXPECT(resp_int(&resp, 1) == BENCH_XFER);
+            if (op == FS_CCCI_OP_READ)
+                EXPECT(resp.argc == 3 && resp.arg_len[2] == BENCH_XFER);
+        }
+        if (failures)
+            return;
+        bytes += FS_REQ_BUFFER_MUN * BENCH_XFER;
+        offset += BENCH_XFER;
+        if (offset == BENCH_FILE_LEN) {
+            rewind_files();
+            offset = 0;
+        }
+    }
+    elapsed = now_sec() - start;
+    printf("%-6s %d x %5d B: %8.1f MB/s, %8.0f requests/s\n", name, FS_REQ_BUFFER_MUN, BENCH_XFER,
+           bytes / elapsed / (1024 * 1024), bytes / BENCH_XFER / elapsed);
+}
+
+int main(void)
+{
+    char path[32];
+    int slot;
+
+    if (fake_md_start("ccci_fsd_benchmark"))
+        return 1;
+
+    for (slot = 0; slot < FS_REQ_BUFFER_MUN; slot++) {
+        snprintf(path, sizeof(path), "Z:\\bench%d.bin", slot);
+        handles[slot] = md_open(slot, path, FS_CREATE_ALWAYS);
+        EXPECT(handles[slot] >= 0);
+    }
+    if (!failures)
+        bench("write", FS_CCCI_OP_WRITE);
+    if (!failures)
+        bench("read", FS_CCCI_OP_READ);
+    for (slot = 0; slot < FS_REQ_BUFFER_MUN; slot++)
+        md_close(slot, handles[slot]);
+
+    // the reader stays blocked on the device until the process exits
+    fake_md_remove_scratch();
+    if (failures) {
+        fprintf(stderr, "ccci_fsd_benchmark: %d failures\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test of the ccci_fsd request dispatcher against a fake MD: requests go
+ * into the buffer slots over the socketpair of fsd_fake_md.h, the test
+ * checks the responses and what reached the files.
+ */
+
+#define main ccci_fsd_main
+#include "../ccci_fsd.c"
+#undef main
+
+#include "fsd_fake_md.h"
+
+#include <sys/stat.h>
+
+#define TEST_ROUNDS     50
+#define TEST_FIND_FILES 100
+
+/*
+ * writes to one handle fill every slot at once: they must reach the file
+ * and be answered in the order MD sent them
+ */
+static void test_same_handle_in_order(void)
+{
+    char expected[FS_REQ_BUFFER_MUN * TEST_ROUNDS + 1], data[sizeof(expected)], path[PATH_MAX];
+    struct md_response resp;
+    int handle, round, slot, fd;
+
+    handle = md_open(0, "Z:\\ordered.bin", FS_CREATE_ALWAYS);
+    EXPECT(handle >= 0);
+    if (handle < 0)
+        return;
+
+    for (round = 0; round < TEST_ROUNDS; round++) {
+        for (slot = 0; slot < FS_REQ_BUFFER_MUN; slot++) {
+            char c = 'A' + (round * FS_REQ_BUFFER_MUN + slot) % 26;
+
+            expected[round * FS_REQ_BUFFER_MUN + slot] = c;
+            md_write(slot, handle, &c, 1);
+        }
+        for (slot = 0; slot < FS_REQ_BUFFER_MUN; slot++) {
+            if (md_recv(&resp, 0))
+                break;
+            EXPECT(resp.slot == slot);
+            EXPECT(resp.op == FS_CCCI_OP_WRITE);
+            EXPECT(resp_int(&resp, 0) == FS_NO_ERROR && resp_int(&resp, 1) == 1);
+        }
+    }
+    EXPECT(md_close(0, handle) == FS_NO_ERROR);
+
+    snprintf(path, sizeof(path), "%s/ordered.bin", md_root_dir);
+    fd = open(path, O_RDONLY);
+    EXPECT(fd >= 0);
+    EXPECT(read(fd, data, sizeof(data)) == FS_REQ_BUFFER_MUN * TEST_ROUNDS);
+    EXPECT(memcmp(data, expected, FS_REQ_BUFFER_MUN * TEST_ROUNDS) == 0);
+    close(fd);
+}
+
+/* requests on different files all get their own answer, in any order */
+static void test_independent_files(void)
+{
+    struct md_response resp;
+    int handles[FS_REQ_BUFFER_MUN], seen = 0, slot;
+    char path[32];
+
+    for (slot = 0; slot < FS_REQ_BUFFER_MUN; slot++) {
+        snprintf(path, sizeof(path), "Z:\\file%d.bin", slot);
+        handles[slot] = md_open(slot, path, FS_CREATE_ALWAYS);
+        EXPECT(handles[slot] >= 0);
+    }
+    for (slot = 0; slot < FS_REQ_BUFFER_MUN; slot++)
+        md_write(slot, handles[slot], "data", 4);
+    for (slot = 0; slot < FS_REQ_BUFFER_MUN; slot++) {
+        if (md_recv(&resp, 0))
+            break;
+        EXPECT(resp.slot >= 0 && resp.slot < FS_REQ_BUFFER_MUN);
+        EXPECT(resp_int(&resp, 0) == FS_NO_ERROR);
+        seen |= 1 << resp.slot;
+    }
+    EXPECT(seen == (1 << FS_REQ_BUFFER_MUN) - 1);
+    for (slot = 0; slot < FS_REQ_BUFFER_MUN; slot++)
+        EXPECT(md_close(slot, handles[slot]) == FS_NO_ERROR);
+}
+
+/*
+ * once FS_ServeRequests returns, main closes the device and frees the slots:
+ * every request it took must be answered by then
+ */
+static void test_exit_waits_for_answers(void)
+{
+    struct md_response resp;
+    char data[2048], unread[sizeof(STREAM_DATA) + MAX_FS_PKT_BYTE];
+    int handle, slot, answered = 0, taken;
+
+    handle = md_open(0, "Z:\\exit.bin", FS_CREATE_ALWAYS);
+    EXPECT(handle >= 0);
+    memset(data, 'x', sizeof(data));
+
+    for (slot = 0; slot < FS_REQ_BUFFER_MUN - 1; slot++)
+        md_write(slot, handle, data, sizeof(data));
+    // let the reader take them, then it stops at its next look at exit_signal
+    while (recv(DeviceFd, unread, sizeof(unread), MSG_PEEK | MSG_DONTWAIT) > 0)
+        usleep(100);
+    exit_signal = SIGTERM;
+    md_write(FS_REQ_BUFFER_MUN - 1, handle, data, sizeof(data));
+    pthread_join(md_reader, NULL);
+
+    taken = FS_REQ_BUFFER_MUN;
+    while (recv(DeviceFd, unread, sizeof(unread), MSG_DONTWAIT) > 0)
+        taken--;
+    while (md_recv(&resp, MSG_DONTWAIT) == 0) {
+        EXPECT(resp_int(&resp, 0) == FS_NO_ERROR);
+        answered++;
+    }
+    EXPECT(taken >= FS_REQ_BUFFER_MUN - 1);
+    EXPECT(answered == taken);
+    pthread_mutex_lock(&g_FsReqLock);
+    EXPECT(g_FsReqHead == NULL);
+    for (slot = 0; slot < FS_REQ_BUFFER_MUN; slot++)
+        EXPECT(!g_FsReq[slot].fQueued);
+    pthread_mutex_unlock(&g_FsReqLock);
+}
+
+/*
+ * X: is a root the index was not built on, so its searches read the
+ * directory: every file comes back once, and the directory is closed with
+ * the search
+ */
+static void test_find_without_index(void)
+{
+    char dir[sizeof(md_root_dir) + 4], path[PATH_MAX], seen[TEST_FIND_FILES] = {0};
+    char name[NAME_MAX + 1];
+    wchar_t pattern[16], file_name[NAME_MAX + 1];
+    FS_DOSDirEntry info;
+    unsigned int len;
+    int handle, ret, i, n, found = 0;
+
+    snprintf(dir, sizeof(dir), "%s.x", md_root_dir);
+    EXPECT(mkdir(dir, 0770) == 0);
+    for (i = 0; i < TEST_FIND_FILES; i++) {
+        snprintf(path, sizeof(path), "%s/f%03d.bin", dir, i);
+        close(open(path, O_WRONLY | O_CREAT, 0660));
+    }
+    snprintf(path, sizeof(path), "%s/other.txt", dir);
+    close(open(path, O_WRONLY | O_CREAT, 0660));
+    strcpy(FsRootDir[1], dir);
+
+    FS_ConvCsToWcs("X:\\*.bin", pattern, sizeof(pattern) / sizeof(pattern[0]));
+    len = NAME_MAX;
+    handle = ret = FS_CCCI_FindFirst(pattern, 0, 0, &info, file_name, &len);
+    EXPECT(handle > 0 && g_FsInfo.hFileHandle[handle].pSearchDir != NULL);
+    while (ret >= 0) {
+        FS_ConvWcsToCs(file_name, name);
+        EXPECT(sscanf(name, "f%03d.bin", &n) == 1 && n >= 0 && n < TEST_FIND_FILES);
+        if (n >= 0 && n < TEST_FIND_FILES) {
+            EXPECT(!seen[n]);
+            seen[n] = 1;
+        }
+        found++;
+        len = NAME_MAX;
+        ret = FS_CCCI_FindNext(handle, &info, file_name, &len);
+    }
+    EXPECT(ret == FS_NO_MORE_FILES);
+    EXPECT(found == TEST_FIND_FILES);
+    EXPECT(FS_CCCI_FindClose(handle) == FS_NO_ERROR);
+    EXPECT(g_FsInfo.hFileHandle[handle].pSearchDir == NULL);
+
+    for (i = 0; i < TEST_FIND_FILES; i++) {
+        snprintf(path, sizeof(path), "%s/f%03d.bin", dir, i);
+        unlink(path);
+    }
+    snprintf(path, sizeof(path), "%s/other.txt", dir);
+    unlink(path);
+    rmdir(dir);
+    FsRootDir[1][0] = '\0';
+}
+
+int main(void)
+{
+    if (fake_md_start("ccci_fsd_test"))
+        return 1;
+
+    test_same_handle_in_order();
+    test_independent_files();
+    test_find_without_index();
+    test_exit_waits_for_answers();
+
+    close(md_fd);
+    close(DeviceFd);
+    if (failures) {
+        fprintf(stderr, "ccci_fsd_test: %d failures (scratch directory %s)\n", failures, md_root_dir);
+        return 1;
+    }
+    fake_md_remove_scratch();
+    printf("ccci_fsd_test: OK\n");
+    return 0;
+}
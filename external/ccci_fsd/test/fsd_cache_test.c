@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host test of the nvdata block cache on files in a scratch directory that
+ * stands in for FS_CACHE_ROOT. What a write returns must already be in the
+ * file, and handles on one inode share blocks but not their access mode.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+
+static char test_cache_root[64];
+#define FS_CACHE_ROOT test_cache_root
+
+#include "../fsd_cache.c"
+
+#define TEST_FILE_LEN   (2 * FS_CACHE_BLOCK_SIZE)
+
+char md_id;     // of ccci_fsd.c, tags the log
+
+static char test_path[sizeof(test_cache_root) + 16];
+static int failures;
+
+#define EXPECT(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: expect %s failed\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+static void create_file(char fill, unsigned int len)
+{
+    char buf[TEST_FILE_LEN];
+    int fd;
+
+    memset(buf, fill, sizeof(buf));
+    fd = open(test_path, O_RDWR | O_CREAT | O_TRUNC, 0660);
+    EXPECT(fd >= 0);
+    EXPECT(write(fd, buf, len) == (ssize_t)len);
+    close(fd);
+}
+
+/* what another reader of the file sees, bypassing the daemon */
+static char disk_byte(unsigned int pos)
+{
+    char c = 0;
+    int fd = open(test_path, O_RDONLY);
+
+    EXPECT(pread(fd, &c, 1, pos) == 1);
+    close(fd);
+    return c;
+}
+
+static char cached_byte(FS_CACHE_FILE *pFile, int fd, unsigned int pos)
+{
+    char c = 0;
+
+    EXPECT(FS_CacheRead(pFile, fd, pos, &c, 1) == 1);
+    return c;
+}
+
+static void test_write_through(void)
+{
+    FS_CACHE_FILE *pFile;
+    FS_CACHE_STAT stat;
+    int fd;
+
+    create_file('a', TEST_FILE_LEN);
+    fd = open(test_path, O_RDWR);
+    pFile = FS_CacheOpen(test_path, fd, FS_READ_WRITE);
+    EXPECT(pFile != NULL);
+
+    EXPECT(cached_byte(pFile, fd, 10) == 'a');
+    EXPECT(FS_CacheWrite(pFile, fd, 10, "b", 1) == 1);
+    // in the file before the handle is closed, and in the loaded block
+    EXPECT(disk_byte(10) == 'b');
+    EXPECT(cached_byte(pFile, fd, 10) == 'b');
+
+    // extending the file
+    EXPECT(FS_CacheWrite(pFile, fd, TEST_FILE_LEN + 100, "c", 1) == 1);
+    EXPECT(FS_CacheSize(pFile) == TEST_FILE_LEN + 101);
+    EXPECT(disk_byte(TEST_FILE_LEN + 100) == 'c');
+    EXPECT(cached_byte(pFile, fd, TEST_FILE_LEN + 50) == 0);
+
+    FS_CacheGetStat(&stat);
+    EXPECT(stat.Hit > 0 && stat.Miss > 0 && stat.Write == 2);
+    FS_CacheRelease(pFile);
+    close(fd);
+}
+
+/* a read-only handle on a file another handle writes */
+static void test_read_only_handle(void)
+{
+    FS_CACHE_FILE *pWriter, *pReader;
+    int wfd, rfd;
+
+    create_file('a', TEST_FILE_LEN);
+    wfd = open(test_path, O_RDWR);
+    rfd = open(test_path, O_RDONLY);
+    pWriter = FS_CacheOpen(test_path, wfd, FS_READ_WRITE);
+    pReader = FS_CacheOpen(test_path, rfd, FS_READ_ONLY);
+    EXPECT(pWriter != NULL && pWriter == pReader);
+
+    EXPECT(FS_CacheWrite(pWriter, wfd, 0, "w", 1) == 1);
+    errno = 0;
+    EXPECT(FS_CacheWrite(pReader, rfd, 1, "r", 1) == -1);
+    EXPECT(errno == EBADF);
+
+    // the rejected write touched nothing, the other one is still there
+    EXPECT(cached_byte(pReader, rfd, 1) == 'a');
+    EXPECT(disk_byte(0) == 'w' && disk_byte(1) == 'a');
+    EXPECT(FS_CacheWrite(pWriter, wfd, 2, "x", 1) == 1);
+    EXPECT(cached_byte(pReader, rfd, 2) == 'x');
+
+    FS_CacheRelease(pReader);
+    FS_CacheRelease(pWriter);
+    close(rfd);
+    close(wfd);
+}
+
+static void test_changed_behind_our_back(void)
+{
+    FS_CACHE_FILE *pFile;
+    int fd;
+
+    create_file('a', TEST_FILE_LEN);
+    fd = open(test_path, O_RDWR);
+    pFile = FS_CacheOpen(test_path, fd, FS_READ_WRITE);
+    EXPECT(cached_byte(pFile, fd, 0) == 'a');
+    FS_CacheRelease(pFile);
+    close(fd);
+
+    // a restore rewrites the file by path
+    usleep(10000);
+    create_file('z', TEST_FILE_LEN / 2);
+    fd = open(test_path, O_RDWR);
+    pFile = FS_CacheOpen(test_path, fd, FS_READ_WRITE);
+    EXPECT(FS_CacheSize(pFile) == TEST_FILE_LEN / 2);
+    EXPECT(cached_byte(pFile, fd, 0) == 'z');
+    FS_CacheRelease(pFile);
+    close(fd);
+}
+
+static void test_past_cache_limit(void)
+{
+    FS_CACHE_FILE *pFile;
+    char c = 0;
+    int fd;
+
+    create_file('a', TEST_FILE_LEN);
+    fd = open(test_path, O_RDWR);
+    pFile = FS_CacheOpen(test_path, fd, FS_READ_WRITE);
+    EXPECT(cached_byte(pFile, fd, 0) == 'a');
+    EXPECT(FS_CacheWrite(pFile, fd, FS_CACHE_FILE_MAX, "q", 1) == 1);
+    EXPECT(FS_CacheRead(pFile, fd, FS_CACHE_FILE_MAX, &c, 1) == 1 && c == 'q');
+    EXPECT(cached_byte(pFile, fd, 0) == 'a');
+    FS_CacheRelease(pFile);
+    close(fd);
+
+    // a file too large is not cached at all
+    fd = open(test_path, O_RDWR);
+    EXPECT(FS_CacheOpen(test_path, fd, FS_READ_WRITE) == NULL);
+    close(fd);
+}
+
+int main(void)
+{
+    const char *tmpdir = getenv("TMPDIR");
+
+    snprintf(test_cache_root, sizeof(test_cache_root), "%s/fsd_cache_XXXXXX", tmpdir ? tmpdir : "/tmp");
+    if (mkdtemp(test_cache_root) == NULL) {
+        fprintf(stderr, "fsd_cache_test: no scratch directory\n");
+        return 1;
+    }
+    snprintf(test_path, sizeof(test_path), "%s/lid.bin", test_cache_root);
+
+    test_write_through();
+    test_read_only_handle();
+    test_changed_behind_our_back();
+    test_past_cache_limit();
+
+    unlink(test_path);
+    rmdir(test_cache_root);
+    if (failures) {
+        fprintf(stderr, "fsd_cache_test: %d failures\n", failures);
+        return 1;
+    }
+    printf("fsd_cache_test: OK\n");
+    return 0;
+}
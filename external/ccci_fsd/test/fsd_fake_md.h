@@ -0,0 +1,303 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * A fake MD for the ccci_fsd tests, included after ../ccci_fsd.c. A
+ * SOCK_SEQPACKET socketpair stands in for the CCCI FS device and keeps the
+ * packet framing of the port: requests larger than one packet go out in
+ * fragments flagged CCCI_FS_REQ_SEND_AGAIN, and the fragments of a response
+ * are joined again. FS_ServeRequests and the workers run as in the daemon,
+ * with Z: on a scratch directory.
+ */
+
+#ifndef FSD_FAKE_MD_H
+#define FSD_FAKE_MD_H
+
+#include <dirent.h>
+#include <sys/socket.h>
+
+#define FAKE_MD_CHANNEL     0x0e
+// a whole request or response: the 16KB stream buffer and its arguments
+#define FAKE_MD_BUF_LEN     (sizeof(STREAM_DATA) + 0x4000 + 256)
+
+static int md_fd = -1;
+static pthread_t md_reader;
+static char md_root_dir[36];
+static int failures;
+
+#define EXPECT(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: expect %s failed\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+struct md_packet {
+    STREAM_DATA *stream;
+    char buf[FAKE_MD_BUF_LEN];
+    unsigned int len;
+};
+
+struct md_response {
+    int slot;
+    int op;
+    unsigned int argc;
+    unsigned int arg_len[FS_REQ_ARG_MAX];
+    char *arg[FS_REQ_ARG_MAX];
+    char buf[FAKE_MD_BUF_LEN];
+};
+
+static inline void md_begin(struct md_packet *pkt, int slot, int op)
+{
+    memset(pkt->buf, 0, sizeof(STREAM_DATA) + sizeof(unsigned int));
+    pkt->stream = (STREAM_DATA *)pkt->buf;
+    pkt->stream->header.channel = FAKE_MD_CHANNEL;
+    pkt->stream->header.reserved = slot;
+    pkt->stream->payload.OperateID = op;
+    pkt->len = sizeof(STREAM_DATA) + sizeof(unsigned int);
+}
+
+static inline void md_arg(struct md_packet *pkt, const void *data, unsigned int len)
+{
+    unsigned int *argc = (unsigned int *)pkt->stream->payload.Buffer;
+    unsigned int align = ((len + 3) >> 2) << 2;
+
+    if (pkt->len + sizeof(len) + align > sizeof(pkt->buf)) {
+        EXPECT(!"request too large");
+        return;
+    }
+    memcpy(pkt->buf + pkt->len, &len, sizeof(len));
+    memcpy(pkt->buf + pkt->len + sizeof(len), data, len);
+    memset(pkt->buf + pkt->len + sizeof(len) + len, 0, align - len);
+    pkt->len += sizeof(len) + align;
+    (*argc)++;
+}
+
+static inline void md_arg_int(struct md_packet *pkt, int value)
+{
+    md_arg(pkt, &value, sizeof(value));
+}
+
+/* MD paths are UCS-2 */
+static inline void md_arg_path(struct md_packet *pkt, const char *path)
+{
+    char wide[2 * PATH_MAX];
+    size_t i;
+
+    memset(wide, 0, sizeof(wide));
+    for (i = 0; path[i]; i++)
+        wide[2 * i] = path[i];
+    md_arg(pkt, wide, 2 * (i + 1));
+}
+
+/* every fragment repeats CCCI header and OP id in front of its part of the data */
+static inline void md_send(struct md_packet *pkt)
+{
+    char frag[sizeof(STREAM_DATA) + MAX_FS_PKT_BYTE];
+    STREAM_DATA *hdr = (STREAM_DATA *)frag;
+    unsigned int offset = sizeof(STREAM_DATA), chunk;
+
+    do {
+        chunk = pkt->len - offset;
+        if (chunk > MAX_FS_PKT_BYTE)
+            chunk = MAX_FS_PKT_BYTE;
+        memcpy(frag, pkt->buf, sizeof(STREAM_DATA));
+        memcpy(frag + sizeof(STREAM_DATA), pkt->buf + offset, chunk);
+        offset += chunk;
+        if (offset < pkt->len)
+            hdr->header.data[0] |= CCCI_FS_REQ_SEND_AGAIN;
+        hdr->header.data[1] = sizeof(STREAM_DATA) + chunk;
+        EXPECT(write(md_fd, frag, sizeof(STREAM_DATA) + chunk) == (ssize_t)(sizeof(STREAM_DATA) + chunk));
+    } while (offset < pkt->len);
+}
+
+static inline int md_recv(struct md_response *resp, int flags)
+{
+    STREAM_DATA *stream = (STREAM_DATA *)resp->buf;
+    char frag[sizeof(STREAM_DATA) + MAX_FS_PKT_BYTE];
+    STREAM_DATA *hdr = (STREAM_DATA *)frag;
+    unsigned int offset = 0;
+    ssize_t len;
+    unsigned int i;
+
+    do {
+        len = recv(md_fd, frag, sizeof(frag), offset ? 0 : flags);
+        if (len < (ssize_t)sizeof(STREAM_DATA) ||
+            offset + len - (offset ? sizeof(STREAM_DATA) : 0) > sizeof(resp->buf))
+            return -1;
+        EXPECT(hdr->header.data[1] == (unsigned int)len);
+        EXPECT(hdr->header.channel == FAKE_MD_CHANNEL + 1);
+        EXPECT((hdr->payload.OperateID & FS_API_RESP_ID) == FS_API_RESP_ID);
+        if (offset == 0) {
+            memcpy(resp->buf, frag, len);
+            offset = len;
+        } else {
+            EXPECT(hdr->header.reserved == stream->header.reserved);
+            memcpy(resp->buf + offset, frag + sizeof(STREAM_DATA), len - sizeof(STREAM_DATA));
+            offset += len - sizeof(STREAM_DATA);
+        }
+    } while (CCCI_FS_PEER_REQ_SEND_AGAIN(&hdr->header));
+
+    resp->slot = stream->header.reserved;
+    resp->op = stream->payload.OperateID & ~FS_API_RESP_ID;
+    resp->argc = *(unsigned int *)stream->payload.Buffer;
+    offset = sizeof(STREAM_DATA) + sizeof(unsigned int);
+    for (i = 0; i < resp->argc && i < FS_REQ_ARG_MAX; i++) {
+        memcpy(&resp->arg_len[i], resp->buf + offset, sizeof(unsigned int));
+        resp->arg[i] = resp->buf + offset + sizeof(unsigned int);
+        offset += sizeof(unsigned int) + (((resp->arg_len[i] + 3) >> 2) << 2);
+    }
+    return 0;
+}
+
+static inline int resp_int(const struct md_response *resp, unsigned int i)
+{
+    int value = FS_GENERAL_FAILURE;
+
+    if (i < resp->argc)
+        memcpy(&value, resp->arg[i], sizeof(value));
+    return value;
+}
+
+/* send a request and wait for its answer, the first response argument */
+static inline int md_call(struct md_packet *pkt, struct md_response *resp)
+{
+    int slot = pkt->stream->header.reserved, op = pkt->stream->payload.OperateID;
+
+    md_send(pkt);
+    if (md_recv(resp, 0))
+        return FS_GENERAL_FAILURE;
+    EXPECT(resp->slot == slot && resp->op == op);
+    return resp_int(resp, 0);
+}
+
+static inline int md_open(int slot, const char *path, int flag)
+{
+    struct md_packet pkt;
+    struct md_response resp;
+
+    md_begin(&pkt, slot, FS_CCCI_OP_OPEN);
+    md_arg_path(&pkt, path);
+    md_arg_int(&pkt, flag);
+    return md_call(&pkt, &resp);
+}
+
+static inline void md_write(int slot, int handle, const void *data, int len)
+{
+    struct md_packet pkt;
+
+    md_begin(&pkt, slot, FS_CCCI_OP_WRITE);
+    md_arg_int(&pkt, handle);
+    md_arg(&pkt, data, len);
+    md_arg_int(&pkt, len);
+    md_send(&pkt);
+}
+
+static inline void md_read(int slot, int handle, int len)
+{
+    struct md_packet pkt;
+
+    md_begin(&pkt, slot, FS_CCCI_OP_READ);
+    md_arg_int(&pkt, handle);
+    md_arg_int(&pkt, len);
+    md_send(&pkt);
+}
+
+static inline int md_seek(int slot, int handle, int offset)
+{
+    struct md_packet pkt;
+    struct md_response resp;
+
+    md_begin(&pkt, slot, FS_CCCI_OP_SEEK);
+    md_arg_int(&pkt, handle);
+    md_arg_int(&pkt, offset);
+    md_arg_int(&pkt, FS_FILE_BEGIN);
+    return md_call(&pkt, &resp);
+}
+
+static inline int md_close(int slot, int handle)
+{
+    struct md_packet pkt;
+    struct md_response resp;
+
+    md_begin(&pkt, slot, FS_CCCI_OP_CLOSE);
+    md_arg_int(&pkt, handle);
+    return md_call(&pkt, &resp);
+}
+
+static void *md_reader_thread(void *arg __attribute__((unused)))
+{
+    FS_ServeRequests();
+    return NULL;
+}
+
+/* what main and FS_Init set up in stream mode, with Z: on a scratch directory */
+static inline int fake_md_start(const char *name)
+{
+    const char *tmpdir = getenv("TMPDIR");
+    int sv[2], i;
+
+    if (snprintf(md_root_dir, sizeof(md_root_dir), "%s/fsd_XXXXXX", tmpdir ? tmpdir : "/tmp") >=
+            (int)sizeof(md_root_dir) || mkdtemp(md_root_dir) == NULL) {
+        fprintf(stderr, "%s: no scratch directory\n", name);
+        return -1;
+    }
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv)) {
+        fprintf(stderr, "%s: socketpair: %s\n", name, strerror(errno));
+        return -1;
+    }
+    DeviceFd = sv[0];
+    md_fd = sv[1];
+
+    memset(FsRootDir, 0, sizeof(FsRootDir));
+    strcpy(FsRootDir[0], md_root_dir);
+    stream_support = 1;
+    FS_AllocStreamSlots();
+    for (i = 0; i < FS_FILE_MAX; i++) {
+        g_FsInfo.hFileHandle[i].fInUse = false;
+        g_FsInfo.hFileHandle[i].hFile = INVALID_HANDLE_VALUE;
+    }
+    FS_IndexAddRoot(FsRootDir[0]);
+    FS_IndexInit(FS_CCCI_GetClusterSize('Z'));
+    if (g_FsInfo.pFsBuf == NULL || FS_StartWorkers() < 0 ||
+        pthread_create(&md_reader, NULL, md_reader_thread, NULL)) {
+        fprintf(stderr, "%s: setup failed\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+/* the files MD created, the scratch directory is flat */
+static inline void fake_md_remove_scratch(void)
+{
+    char path[PATH_MAX];
+    struct dirent *entry;
+    DIR *dir;
+
+    dir = opendir(md_root_dir);
+    if (dir == NULL)
+        return;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.')
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", md_root_dir, entry->d_name);
+        unlink(path);
+    }
+    closedir(dir);
+    rmdir(md_root_dir);
+}
+
+#endif
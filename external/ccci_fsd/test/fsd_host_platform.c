@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host replacement of platform/: no wake lock sysfs, no OTP device, no
+ * libnvram. The modem is always ready and nothing can be restored.
+ */
+
+#include <stdbool.h>
+#include "fsd_platform.h"
+#include "power.h"
+
+#ifdef ENABLE_DEBUG_LOG
+char  debug_level = ANDROID_LOG_WARN;
+#endif
+
+void get_debug_log_level(void)
+{
+}
+
+int acquire_wake_lock(int lock __attribute__((unused)), const char *id __attribute__((unused)))
+{
+    return 0;
+}
+
+int release_wake_lock(const char *id __attribute__((unused)))
+{
+    return 0;
+}
+
+int FS_OTPLock(int devtype __attribute__((unused)))
+{
+    return FS_UNSUPPORTED_DEVICE;
+}
+
+int FS_OTPQueryLength(int devtype __attribute__((unused)), unsigned int *Length __attribute__((unused)))
+{
+    return FS_UNSUPPORTED_DEVICE;
+}
+
+int FS_OTPRead(int devtype __attribute__((unused)), unsigned int Offset __attribute__((unused)),
+               void *BufferPtr __attribute__((unused)), unsigned int Length __attribute__((unused)))
+{
+    return FS_UNSUPPORTED_DEVICE;
+}
+
+int FS_OTPWrite(int devtype __attribute__((unused)), unsigned int Offset __attribute__((unused)),
+                void *BufferPtr __attribute__((unused)), unsigned int Length __attribute__((unused)))
+{
+    return FS_UNSUPPORTED_DEVICE;
+}
+
+int FS_OTP_init(int md_id __attribute__((unused)))
+{
+    return 0;
+}
+
+int get_modem_status(void)
+{
+    return CCCI_MD_STA_BOOT_READY;
+}
+
+bool NVM_RestoreFromBinRegion_OneFile(int file_lid __attribute__((unused)),
+                                      const char *filename __attribute__((unused)))
+{
+    return false;
+}
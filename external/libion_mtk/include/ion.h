@@ -51,6 +51,76 @@ int ion_dma_unmap_area(int fd, ion_user_handle_t handle, int dir);
 int ion_dma_map_area_va(int fd, void *addr, size_t length, int dir);
 int ion_dma_unmap_area_va(int fd, void *addr, size_t length, int dir);
 
+// One range of a batched cache sync in the buffer of handle. With va set,
+// the range is [va + offset, va + offset + length); with va NULL, the whole
+// buffer is synced and length is ignored. dir is the dma direction, ignored
+// by ION_SYNC_OP_FLUSH.
+struct ion_sync_range {
+    ion_user_handle_t handle;
+    void *va;
+    size_t offset;
+    size_t length;
+    int dir;
+};
+
+enum {
+    ION_SYNC_OP_FLUSH,      // ion_cache_sync_flush_range_va
+    ION_SYNC_OP_MAP,        // ion_dma_map_area[_va]
+    ION_SYNC_OP_UNMAP,      // ion_dma_unmap_area[_va]
+};
+
+// Flushes of at least this many bytes of va ranges become one full flush.
+#define ION_SYNC_FULL_FLUSH_SIZE (4 * 1024 * 1024)
+#define ION_SYNC_STACK_RANGES 32
+
+// Sync many ranges at once: overlapping or adjacent ranges of one buffer
+// with the same direction are merged and each remaining range costs one
+// ioctl. Returns
+// the number of ioctls issued, or a negative error.
+int ion_cache_sync_ranges(int fd, const struct ion_sync_range *ranges, size_t count, int op);
+
+// Buffer handed out by an ion_pool, mapped read/write and shared.
+struct ion_pool_buffer {
+    ion_user_handle_t handle;
+    int share_fd;
+    void *va;
+    size_t len;             // size class actually allocated, >= requested
+    unsigned int heap_mask;
+    unsigned int flags;
+    size_t align;           // alignment it was allocated with, 0 up to a page
+};
+
+struct ion_pool_stats {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long trimmed;
+    unsigned long cached_count;
+    size_t cached_bytes;
+};
+
+// Allocation backend of a pool, ion_alloc/ion_share/ion_free by default.
+struct ion_pool_ops {
+    int (*alloc)(int fd, size_t len, size_t align, unsigned int heap_mask,
+                 unsigned int flags, ion_user_handle_t *handle);
+    int (*share)(int fd, ion_user_handle_t handle, int *share_fd);
+    int (*free)(int fd, ion_user_handle_t handle);
+};
+
+// Recycling pool on an fd from mt_ion_open. Freed buffers keep their
+// handle, share fd and mapping, up to high_water bytes in total.
+struct ion_pool *ion_pool_create(int ion_fd, size_t high_water);
+struct ion_pool *ion_pool_create_with_ops(int ion_fd, size_t high_water,
+                                          const struct ion_pool_ops *ops);
+int ion_pool_alloc(struct ion_pool *pool, size_t len, size_t align, unsigned int heap_mask,
+                   unsigned int flags, struct ion_pool_buffer *buf);
+int ion_pool_free(struct ion_pool *pool, struct ion_pool_buffer *buf);
+// Release parked buffers until at most target_bytes remain.
+void ion_pool_trim(struct ion_pool *pool, size_t target_bytes);
+void ion_pool_get_stats(struct ion_pool *pool, struct ion_pool_stats *stats);
+// Release all parked buffers; buffers still held by the caller are not touched.
+void ion_pool_destroy(struct ion_pool *pool);
+size_t ion_pool_size_class(size_t len);
+
 __END_DECLS
 
 #endif /* __MTK_ION_H */
@@ -22,7 +22,9 @@
 #include <log/log.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
@@ -299,3 +301,137 @@ int ion_dma_unmap_area_va(int fd, void * addr, size_t length, int dir) {
 		return -errno;
 	return ret;
 }
+
+static int ion_cache_sync_flush_handle(int fd, ion_user_handle_t handle)
+{
+	struct ion_sys_data sys_data;
+
+	memset(&sys_data, 0, sizeof(sys_data));
+	sys_data.sys_cmd = ION_SYS_CACHE_SYNC;
+	sys_data.cache_sync_param.handle = handle;
+	sys_data.cache_sync_param.sync_type = ION_CACHE_FLUSH_BY_RANGE;
+	if (ion_custom_ioctl(fd, ION_CMD_SYSTEM, &sys_data))
+		return -errno;
+	return 0;
+}
+
+static int ion_sync_range_cmp(const void *a, const void *b)
+{
+	const struct ion_sync_range *ra = a;
+	const struct ion_sync_range *rb = b;
+	uintptr_t sa, sb;
+
+	if (!ra->va != !rb->va)
+		return ra->va ? 1 : -1;
+	if (ra->dir != rb->dir)
+		return ra->dir < rb->dir ? -1 : 1;
+	if (ra->handle != rb->handle)
+		return ra->handle < rb->handle ? -1 : 1;
+	sa = (uintptr_t)ra->va + ra->offset;
+	sb = (uintptr_t)rb->va + rb->offset;
+	if (sa != sb)
+		return sa < sb ? -1 : 1;
+	return 0;
+}
+
+static int ion_sync_one(int fd, int op, const struct ion_sync_range *range)
+{
+	void *va = (char *)range->va + range->offset;
+
+	if (!range->va) {
+		/* by handle the driver syncs the whole buffer */
+		if (op == ION_SYNC_OP_FLUSH)
+			return ion_cache_sync_flush_handle(fd, range->handle);
+		if (op == ION_SYNC_OP_UNMAP)
+			return ion_dma_unmap_area(fd, range->handle, range->dir);
+		return ion_dma_map_area(fd, range->handle, range->dir);
+	}
+
+	switch (op) {
+	case ION_SYNC_OP_FLUSH:
+		return ion_cache_sync_flush_range_va(fd, va, range->length);
+	case ION_SYNC_OP_MAP:
+		return ion_dma_map_area_va(fd, va, range->length, range->dir);
+	case ION_SYNC_OP_UNMAP:
+		return ion_dma_unmap_area_va(fd, va, range->length, range->dir);
+	}
+	return -EINVAL;
+}
+
+int ion_cache_sync_ranges(int fd, const struct ion_sync_range *ranges, size_t count, int op)
+{
+	struct ion_sync_range stack_sorted[ION_SYNC_STACK_RANGES];
+	struct ion_sync_range *sorted = stack_sorted;
+	size_t i, merged = 0, total = 0;
+	int ret = 0, ioctls = 0;
+
+	if (!count)
+		return 0;
+	if (op != ION_SYNC_OP_FLUSH && op != ION_SYNC_OP_MAP && op != ION_SYNC_OP_UNMAP)
+		return -EINVAL;
+
+	if (count > ION_SYNC_STACK_RANGES) {
+		sorted = malloc(count * sizeof(*sorted));
+		if (!sorted)
+			return -ENOMEM;
+	}
+	memcpy(sorted, ranges, count * sizeof(*sorted));
+	/* a flush has no direction, let all its ranges merge */
+	if (op == ION_SYNC_OP_FLUSH) {
+		for (i = 0; i < count; i++)
+			sorted[i].dir = 0;
+	}
+	qsort(sorted, count, sizeof(*sorted), ion_sync_range_cmp);
+
+	/*
+	 * merge overlapping or adjacent ranges of the same kind, direction and
+	 * buffer; a range spanning two buffers would cross their mappings.
+	 * only va ranges count towards the full flush threshold, the size of a
+	 * whole buffer range is not known here
+	 */
+	for (i = 0; i < count; i++) {
+		struct ion_sync_range *last = merged ? &sorted[merged - 1] : NULL;
+		uintptr_t start = (uintptr_t)sorted[i].va + sorted[i].offset;
+		uintptr_t end = start + sorted[i].length;
+
+		if (sorted[i].va && !sorted[i].length)
+			continue;
+		if (last && !last->va == !sorted[i].va && last->dir == sorted[i].dir &&
+		    last->handle == sorted[i].handle) {
+			uintptr_t last_start = (uintptr_t)last->va + last->offset;
+			uintptr_t last_end = last_start + last->length;
+
+			if (!last->va)
+				continue;
+			if (last->va && start <= last_end) {
+				if (end > last_end) {
+					total += end - last_end;
+					last->length = end - last_start;
+				}
+				continue;
+			}
+		}
+		sorted[merged++] = sorted[i];
+		if (sorted[i].va)
+			total += sorted[i].length;
+	}
+
+	/* past the threshold one flush of the whole cache is cheaper */
+	if (op == ION_SYNC_OP_FLUSH && total >= ION_SYNC_FULL_FLUSH_SIZE) {
+		ret = ion_cache_sync_flush_all(fd);
+		ioctls = 1;
+		goto out;
+	}
+
+	for (i = 0; i < merged; i++) {
+		ret = ion_sync_one(fd, op, &sorted[i]);
+		ioctls++;
+		if (ret)
+			break;
+	}
+
+out:
+	if (sorted != stack_sorted)
+		free(sorted);
+	return ret ? ret : ioctls;
+}
@@ -0,0 +1,341 @@
+/*
+ *  ion_pool.c
+ *
+ * User space recycling pool for ion buffers
+ *
+ * MediaTek Inc. (C) 2021. All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+#define LOG_TAG "ion_pool"
+
+#include <log/log.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <ion/ion.h>
+#include <ion.h>
+
+/*
+ * Freed buffers keep their handle, share fd and mapping and are parked on
+ * a free list per (heap mask, flags, alignment, size class).  Size classes
+ * are pages up to 64KB and then 8 steps per power of two, so a recycled
+ * buffer is at most 12.5% larger than requested.  All parked buffers are
+ * also on one LRU list, trimmed from the cold end whenever the parked bytes
+ * exceed the high water mark.
+ *
+ * A recycled buffer is handed out with its previous contents; it never
+ * leaves the client that allocated it.
+ *
+ * Every buffer is page aligned, so alignments up to a page share one class
+ * (align 0); a larger alignment only reuses buffers allocated with it.
+ */
+
+#define ION_POOL_PAGE_SIZE      4096
+#define ION_POOL_FINE_LIMIT     (64 * 1024)
+#define ION_POOL_CLASS_STEPS    8
+#define ION_POOL_HASH_SIZE      64
+
+struct ion_pool_entry {
+    struct ion_pool_buffer buf;
+    struct ion_pool_entry *class_next;  /* LIFO free list of its class */
+    struct ion_pool_entry *lru_prev;
+    struct ion_pool_entry *lru_next;
+    struct ion_pool_class *cls;
+};
+
+struct ion_pool_class {
+    unsigned int heap_mask;
+    unsigned int flags;
+    size_t align;
+    size_t len;
+    struct ion_pool_entry *free;
+    struct ion_pool_class *hash_next;
+};
+
+struct ion_pool {
+    int ion_fd;
+    size_t high_water;
+    struct ion_pool_ops ops;
+    pthread_mutex_t lock;
+    struct ion_pool_class *classes[ION_POOL_HASH_SIZE];
+    /* lru_head is the most recently freed buffer */
+    struct ion_pool_entry *lru_head;
+    struct ion_pool_entry *lru_tail;
+    struct ion_pool_stats stats;
+};
+
+static const struct ion_pool_ops ion_pool_default_ops = {
+    .alloc = ion_alloc,
+    .share = ion_share,
+    .free = ion_free,
+};
+
+size_t ion_pool_size_class(size_t len)
+{
+    size_t step;
+    int shift;
+
+    len = (len + ION_POOL_PAGE_SIZE - 1) & ~((size_t)ION_POOL_PAGE_SIZE - 1);
+    if (len <= ION_POOL_FINE_LIMIT)
+        return len;
+
+    /* step is 1/ION_POOL_CLASS_STEPS of the power of two below len */
+    shift = (int)(sizeof(unsigned long) * 8) - 1 - __builtin_clzl(len - 1);
+    step = ((size_t)1 << shift) / ION_POOL_CLASS_STEPS;
+    return (len + step - 1) & ~(step - 1);
+}
+
+static size_t ion_pool_align(size_t align)
+{
+    return align <= ION_POOL_PAGE_SIZE ? 0 : align;
+}
+
+static unsigned int ion_pool_hash(unsigned int heap_mask, unsigned int flags, size_t align,
+                                  size_t len)
+{
+    size_t h = len / ION_POOL_PAGE_SIZE;
+
+    h = h * 31 + heap_mask;
+    h = h * 31 + flags;
+    h = h * 31 + align / ION_POOL_PAGE_SIZE;
+    return (unsigned int)(h % ION_POOL_HASH_SIZE);
+}
+
+static struct ion_pool_class *ion_pool_get_class(struct ion_pool *pool, unsigned int heap_mask,
+                                                 unsigned int flags, size_t align, size_t len,
+                                                 int create)
+{
+    unsigned int h = ion_pool_hash(heap_mask, flags, align, len);
+    struct ion_pool_class *cls;
+
+    for (cls = pool->classes[h]; cls; cls = cls->hash_next) {
+        if (cls->heap_mask == heap_mask && cls->flags == flags && cls->align == align &&
+            cls->len == len)
+            return cls;
+    }
+    if (!create)
+        return NULL;
+
+    cls = calloc(1, sizeof(*cls));
+    if (!cls)
+        return NULL;
+    cls->heap_mask = heap_mask;
+    cls->flags = flags;
+    cls->align = align;
+    cls->len = len;
+    cls->hash_next = pool->classes[h];
+    pool->classes[h] = cls;
+    return cls;
+}
+
+static void ion_pool_lru_unlink(struct ion_pool *pool, struct ion_pool_entry *entry)
+{
+    if (entry->lru_prev)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        pool->lru_head = entry->lru_next;
+    if (entry->lru_next)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        pool->lru_tail = entry->lru_prev;
+    entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void ion_pool_class_unlink(struct ion_pool_entry *entry)
+{
+    struct ion_pool_entry **pp;
+
+    for (pp = &entry->cls->free; *pp; pp = &(*pp)->class_next) {
+        if (*pp == entry) {
+            *pp = entry->class_next;
+            break;
+        }
+    }
+    entry->class_next = NULL;
+}
+
+static void ion_pool_release(struct ion_pool *pool, struct ion_pool_buffer *buf)
+{
+    if (buf->va && buf->va != MAP_FAILED)
+        ion_munmap(pool->ion_fd, buf->va, buf->len);
+    if (buf->share_fd >= 0)
+        ion_share_close(pool->ion_fd, buf->share_fd);
+    pool->ops.free(pool->ion_fd, buf->handle);
+}
+
+/* free parked buffers from the cold end until at most target bytes remain */
+static void ion_pool_trim_locked(struct ion_pool *pool, size_t target)
+{
+    while (pool->lru_tail && pool->stats.cached_bytes > target) {
+        struct ion_pool_entry *entry = pool->lru_tail;
+
+        ion_pool_lru_unlink(pool, entry);
+        ion_pool_class_unlink(entry);
+        pool->stats.cached_bytes -= entry->buf.len;
+        pool->stats.cached_count--;
+        pool->stats.trimmed++;
+        ion_pool_release(pool, &entry->buf);
+        free(entry);
+    }
+}
+
+struct ion_pool *ion_pool_create_with_ops(int ion_fd, size_t high_water,
+                                          const struct ion_pool_ops *ops)
+{
+    struct ion_pool *pool = calloc(1, sizeof(*pool));
+
+    if (!pool) {
+        ALOGE("ion_pool_create: out of memory\n");
+        return NULL;
+    }
+    pool->ion_fd = ion_fd;
+    pool->high_water = high_water;
+    pool->ops = ops ? *ops : ion_pool_default_ops;
+    pthread_mutex_init(&pool->lock, NULL);
+    return pool;
+}
+
+struct ion_pool *ion_pool_create(int ion_fd, size_t high_water)
+{
+    return ion_pool_create_with_ops(ion_fd, high_water, NULL);
+}
+
+int ion_pool_alloc(struct ion_pool *pool, size_t len, size_t align, unsigned int heap_mask,
+                   unsigned int flags, struct ion_pool_buffer *buf)
+{
+    struct ion_pool_class *cls;
+    struct ion_pool_entry *entry = NULL;
+    size_t class_len = ion_pool_size_class(len);
+    int ret;
+
+    pthread_mutex_lock(&pool->lock);
+    cls = ion_pool_get_class(pool, heap_mask, flags, ion_pool_align(align), class_len, 0);
+    if (cls && cls->free) {
+        entry = cls->free;
+        cls->free = entry->class_next;
+        entry->class_next = NULL;
+        ion_pool_lru_unlink(pool, entry);
+        pool->stats.cached_bytes -= entry->buf.len;
+        pool->stats.cached_count--;
+        pool->stats.hits++;
+    } else {
+        pool->stats.misses++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (entry) {
+        *buf = entry->buf;
+        free(entry);
+        return 0;
+    }
+
+    memset(buf, 0, sizeof(*buf));
+    buf->share_fd = -1;
+    buf->len = class_len;
+    buf->heap_mask = heap_mask;
+    buf->flags = flags;
+    buf->align = ion_pool_align(align);
+
+    ret = pool->ops.alloc(pool->ion_fd, class_len, align, heap_mask, flags, &buf->handle);
+    if (ret) {
+        ALOGE("ion_pool_alloc: alloc len %zu heap 0x%x failed %d\n", class_len, heap_mask, ret);
+        return ret;
+    }
+    ret = pool->ops.share(pool->ion_fd, buf->handle, &buf->share_fd);
+    if (ret) {
+        ALOGE("ion_pool_alloc: share failed %d\n", ret);
+        pool->ops.free(pool->ion_fd, buf->handle);
+        return ret;
+    }
+    buf->va = ion_mmap(pool->ion_fd, NULL, class_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       buf->share_fd, 0);
+    if (buf->va == MAP_FAILED) {
+        buf->va = NULL;
+        ion_pool_release(pool, buf);
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+int ion_pool_free(struct ion_pool *pool, struct ion_pool_buffer *buf)
+{
+    struct ion_pool_class *cls;
+    struct ion_pool_entry *entry;
+
+    entry = calloc(1, sizeof(*entry));
+    pthread_mutex_lock(&pool->lock);
+    cls = entry ? ion_pool_get_class(pool, buf->heap_mask, buf->flags, buf->align, buf->len, 1)
+                : NULL;
+    if (!cls || buf->len > pool->high_water) {
+        pthread_mutex_unlock(&pool->lock);
+        free(entry);
+        ion_pool_release(pool, buf);
+        return 0;
+    }
+
+    entry->buf = *buf;
+    entry->cls = cls;
+    entry->class_next = cls->free;
+    cls->free = entry;
+    entry->lru_next = pool->lru_head;
+    if (pool->lru_head)
+        pool->lru_head->lru_prev = entry;
+    else
+        pool->lru_tail = entry;
+    pool->lru_head = entry;
+    pool->stats.cached_bytes += buf->len;
+    pool->stats.cached_count++;
+
+    ion_pool_trim_locked(pool, pool->high_water);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+void ion_pool_trim(struct ion_pool *pool, size_t target_bytes)
+{
+    pthread_mutex_lock(&pool->lock);
+    ion_pool_trim_locked(pool, target_bytes);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void ion_pool_get_stats(struct ion_pool *pool, struct ion_pool_stats *stats)
+{
+    pthread_mutex_lock(&pool->lock);
+    *stats = pool->stats;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void ion_pool_destroy(struct ion_pool *pool)
+{
+    unsigned int i;
+
+    if (!pool)
+        return;
+
+    ion_pool_trim(pool, 0);
+    for (i = 0; i < ION_POOL_HASH_SIZE; i++) {
+        while (pool->classes[i]) {
+            struct ion_pool_class *cls = pool->classes[i];
+
+            pool->classes[i] = cls->hash_next;
+            free(cls);
+        }
+    }
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
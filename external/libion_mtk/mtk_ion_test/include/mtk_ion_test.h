@@ -43,6 +43,7 @@
 #include "include/sizes.h"
 #include <getopt.h>
 #include <sys/time.h>
+#include <sys/syscall.h>
 
 
 #define IONMSG(string, args...)	printf("[ION]"string, ##args)
@@ -110,6 +111,8 @@ int ion_alloc_fd_test(void);
 void show_usage(void);
 void ion_custom_ioctl_random_test(void);
 void ion_alloc_test_for_ref_check(void);
+void ion_pool_test(int use_memfd);
+void ion_cache_sync_ranges_test(void);
 
 
 
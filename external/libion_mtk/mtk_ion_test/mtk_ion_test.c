@@ -552,6 +552,15 @@ void *ion_thread_1(void *arg) {
     case 8:
         ion_alloc_test_for_ref_check();
         break;
+    case 9:
+        ion_pool_test(0);
+        break;
+    case 10:
+        ion_pool_test(1);
+        break;
+    case 11:
+        ion_cache_sync_ranges_test();
+        break;
     default:
         //ion_alloc_fd(fd, len, align, heap_mask, flags, handle_fd)
         break;
@@ -630,6 +639,182 @@ int ion_alloc_fd_test(void) {
     return ret;
 }
 
+/* memfd stand-in for the ion device, a handle is the memfd itself */
+static int ion_memfd_alloc(int fd, size_t len, size_t align, unsigned int heap_mask,
+                           unsigned int flags, ion_user_handle_t *handle)
+{
+    int memfd = syscall(__NR_memfd_create, "ion_pool_test", 0);
+
+    (void)fd; (void)align; (void)heap_mask; (void)flags;
+    if (memfd < 0)
+        return -errno;
+    if (ftruncate(memfd, len)) {
+        close(memfd);
+        return -errno;
+    }
+    *handle = memfd;
+    return 0;
+}
+
+static int ion_memfd_share(int fd, ion_user_handle_t handle, int *share_fd)
+{
+    (void)fd;
+    *share_fd = dup(handle);
+    return *share_fd < 0 ? -errno : 0;
+}
+
+static int ion_memfd_free(int fd, ion_user_handle_t handle)
+{
+    (void)fd;
+    return close(handle);
+}
+
+/* a parked buffer of the requested size but a smaller alignment must miss,
+ * the buffer freed with the stricter alignment must then hit */
+static void ion_pool_align_check(struct ion_pool *pool)
+{
+    size_t strict = (size_t)SZ_1M > (size_t)align ? SZ_1M : (size_t)align * 2;
+    struct ion_pool_stats before, after;
+    struct ion_pool_buffer buf;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        ion_pool_get_stats(pool, &before);
+        if (ion_pool_alloc(pool, bufsize / 2, strict, heap_id_mask, alloc_flags, &buf)) {
+            IONMSG("%s alloc align 0x%zx failed\n", __func__, strict);
+            return;
+        }
+        ion_pool_get_stats(pool, &after);
+        IONMSG("%s align 0x%zx: %s, expect %s\n", __func__, strict,
+               after.hits > before.hits ? "hit" : "miss", i ? "hit" : "miss");
+        ion_pool_free(pool, &buf);
+    }
+}
+
+/* ion_pool test, measures alloc+map+free time with and without the pool
+ * Flow: a preview-like pattern, every round allocates a few buffers of
+ *       fixed sizes (plus one of varying size) and frees them again.
+ * expect result: pool hit rate close to 100% after the first round, and a
+ *                stricter alignment misses once, then hits
+ */
+void ion_pool_test(int use_memfd)
+{
+    static const struct ion_pool_ops memfd_ops = {
+        .alloc = ion_memfd_alloc,
+        .share = ion_memfd_share,
+        .free = ion_memfd_free,
+    };
+    const struct ion_pool_ops *ops = use_memfd ? &memfd_ops : NULL;
+    size_t sizes[4] = { bufsize, bufsize / 2, bufsize / 4, 0 };
+    struct ion_pool_buffer bufs[4];
+    struct ion_pool_stats stats;
+    struct ion_pool *pool;
+    int rounds = 100, round, i, pooled;
+    int ion_fd;
+    long start_time, end_time;
+
+    ion_fd = use_memfd ? -1 : mt_ion_open(__func__);
+    if (!use_memfd && ion_fd < 0) {
+        IONMSG("%s open failed\n", __func__);
+        return;
+    }
+
+    for (pooled = 0; pooled < 2; pooled++) {
+        /* high water 0 frees every buffer right away, i.e. no pooling */
+        pool = ion_pool_create_with_ops(ion_fd, pooled ? 4 * (size_t)bufsize : 0, ops);
+        if (!pool)
+            break;
+
+        start_time = ION_GET_TIME();
+        for (round = 0; round < rounds; round++) {
+            sizes[3] = bufsize / 8 + (round % 4) * SZ_4K;
+            for (i = 0; i < 4; i++) {
+                if (ion_pool_alloc(pool, sizes[i], align, heap_id_mask, alloc_flags, &bufs[i])) {
+                    IONMSG("%s alloc %zu failed\n", __func__, sizes[i]);
+                    ion_pool_destroy(pool);
+                    goto out;
+                }
+                memset(bufs[i].va, round, SZ_4K);
+            }
+            for (i = 0; i < 4; i++)
+                ion_pool_free(pool, &bufs[i]);
+        }
+        end_time = ION_GET_TIME();
+
+        ion_pool_get_stats(pool, &stats);
+        IONMSG("%s %s pool: %d rounds %ld us, hits %lu misses %lu trimmed %lu cached %zu bytes\n",
+               use_memfd ? "memfd" : "ion", pooled ? "with" : "without", rounds,
+               end_time - start_time, stats.hits, stats.misses, stats.trimmed,
+               stats.cached_bytes);
+        if (pooled)
+            ion_pool_align_check(pool);
+        ion_pool_destroy(pool);
+    }
+
+out:
+    if (!use_memfd)
+        mt_ion_close(ion_fd);
+}
+
+/* ion_cache_sync_ranges test, per-tile flush vs one batched call
+ * Flow: split the buffer in 64 tiles where every other pair of tiles is
+ *       contiguous, flush them one by one, then through the batched api.
+ * expect result: batched call issues 32 ioctls (pairs merged) and takes
+ *                less time, or 1 ioctl once the total passes
+ *                ION_SYNC_FULL_FLUSH_SIZE
+ */
+void ion_cache_sync_ranges_test(void)
+{
+    struct ion_sync_range ranges[64];
+    size_t tile = bufsize / 128;
+    ion_user_handle_t handle;
+    int ion_fd, share_fd, i, ret;
+    void *va;
+    long start_time, end_time;
+
+    ion_fd = mt_ion_open(__func__);
+    if (ion_fd < 0)
+        return;
+    if (ion_alloc(ion_fd, bufsize, align, heap_id_mask, alloc_flags, &handle)) {
+        IONMSG("%s alloc failed\n", __func__);
+        goto exit_close;
+    }
+    if (ion_share(ion_fd, handle, &share_fd)) {
+        IONMSG("%s share failed\n", __func__);
+        goto exit_free;
+    }
+    va = ion_mmap(ion_fd, NULL, bufsize, prot, map_flags, share_fd, 0);
+    if (va == MAP_FAILED)
+        goto exit_share;
+
+    for (i = 0; i < 64; i++) {
+        ranges[i].handle = handle;
+        ranges[i].va = va;
+        ranges[i].offset = (i / 2) * 4 * tile + (i % 2) * tile;
+        ranges[i].length = tile;
+        ranges[i].dir = 0;
+    }
+
+    start_time = ION_GET_TIME();
+    for (i = 0; i < 64; i++)
+        ion_cache_sync_flush_range_va(ion_fd, (char *)va + ranges[i].offset, tile);
+    end_time = ION_GET_TIME();
+    IONMSG("%s per range: 64 ioctls %ld us\n", __func__, end_time - start_time);
+
+    start_time = ION_GET_TIME();
+    ret = ion_cache_sync_ranges(ion_fd, ranges, 64, ION_SYNC_OP_FLUSH);
+    end_time = ION_GET_TIME();
+    IONMSG("%s batched: %d ioctls %ld us\n", __func__, ret, end_time - start_time);
+
+    ion_munmap(ion_fd, va, bufsize);
+exit_share:
+    ion_share_close(ion_fd, share_fd);
+exit_free:
+    ion_free(ion_fd, handle);
+exit_close:
+    mt_ion_close(ion_fd);
+}
+
 /* test function with multi-thread
  */
 void ion_multithread_test(void) {
@@ -684,6 +869,9 @@ void show_usage(void){
     IONMSG("---\t6: int ion_alloc_fd_test(void);\n");
     IONMSG("---\t7: void ion_custom_ioctl_random_test(void);\n");
     IONMSG("---\t8: \n");
+    IONMSG("---\t9: void ion_pool_test(0); ion_pool hit rate and speed\n");
+    IONMSG("---\t10: void ion_pool_test(1); same on a memfd stand-in device\n");
+    IONMSG("---\t11: void ion_cache_sync_ranges_test(void);\n");
     IONMSG("---\t\n");
     IONMSG("\n\n");
 
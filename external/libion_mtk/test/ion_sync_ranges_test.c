@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test of ion_cache_sync_ranges against a fake ion device: the ioctls of
+ * libion_mtk are answered here and recorded, so the test checks how many
+ * reach the driver and what each one covers without touching /dev/ion.
+ */
+
+#include <sys/ioctl.h>
+
+static int test_ioctl(int fd, unsigned long request, void *arg);
+#define ioctl(fd, request, arg) test_ioctl(fd, request, (void *)(arg))
+
+#include "../ion.c"
+
+#define TEST_FD         3
+#define TEST_MAX_CALLS  64
+
+struct test_call {
+    int sys_cmd;
+    int type;           /* dma_type, or sync_type of ION_SYS_CACHE_SYNC */
+    int dir;
+    ion_user_handle_t handle;
+    void *va;
+    size_t size;
+};
+
+static struct test_call calls[TEST_MAX_CALLS];
+static int call_count;
+static int failures;
+
+#define EXPECT(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: expect %s failed\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+static int test_ioctl(int fd, unsigned long request, void *arg)
+{
+    struct ion_custom_data *custom = arg;
+    struct ion_sys_data *sys_data;
+    struct test_call *call;
+
+    if (fd != TEST_FD || request != ION_IOC_CUSTOM || custom->cmd != ION_CMD_SYSTEM ||
+        call_count == TEST_MAX_CALLS) {
+        errno = ENOTTY;
+        return -1;
+    }
+    sys_data = (struct ion_sys_data *)custom->arg;
+    call = &calls[call_count++];
+    memset(call, 0, sizeof(*call));
+    call->sys_cmd = sys_data->sys_cmd;
+    if (sys_data->sys_cmd == ION_SYS_CACHE_SYNC) {
+        call->type = sys_data->cache_sync_param.sync_type;
+        call->handle = sys_data->cache_sync_param.handle;
+    } else {
+        call->type = sys_data->dma_param.dma_type;
+        call->dir = sys_data->dma_param.dma_dir;
+        call->handle = sys_data->dma_param.handle;
+        call->va = sys_data->dma_param.va;
+        call->size = sys_data->dma_param.size;
+    }
+    return 0;
+}
+
+static int sync_ranges(const struct ion_sync_range *ranges, size_t count, int op)
+{
+    int ret;
+
+    call_count = 0;
+    ret = ion_cache_sync_ranges(TEST_FD, ranges, count, op);
+    /* the return value is the number of ioctls that reached the device */
+    EXPECT(ret < 0 || ret == call_count);
+    return ret;
+}
+
+/* two buffers mapped back to back, as a carveout or a pool may place them */
+static char mapping[2 * 64 * 1024];
+#define BUF_A   ((void *)mapping)
+#define BUF_B   ((void *)(mapping + sizeof(mapping) / 2))
+#define BUF_LEN (sizeof(mapping) / 2)
+
+static void test_merge_within_buffer(void)
+{
+    const struct ion_sync_range ranges[] = {
+        { 1, BUF_A, 4096, 4096, 0 },
+        { 1, BUF_A, 0, 4096, 0 },
+        { 1, BUF_A, 6144, 4096, 0 },
+        { 1, BUF_A, 32768, 4096, 0 },
+    };
+
+    EXPECT(sync_ranges(ranges, 4, ION_SYNC_OP_FLUSH) == 2);
+    EXPECT(calls[0].type == ION_DMA_FLUSH_BY_RANGE_USE_VA);
+    EXPECT(calls[0].va == BUF_A && calls[0].size == 10240);
+    EXPECT(calls[1].va == (char *)BUF_A + 32768 && calls[1].size == 4096);
+}
+
+static void test_no_merge_across_buffers(void)
+{
+    /* the tail of A touches the head of B */
+    const struct ion_sync_range ranges[] = {
+        { 2, BUF_B, 0, 4096, 0 },
+        { 1, BUF_A, BUF_LEN - 4096, 4096, 0 },
+    };
+    int i;
+
+    EXPECT(sync_ranges(ranges, 2, ION_SYNC_OP_FLUSH) == 2);
+    for (i = 0; i < call_count; i++)
+        EXPECT(calls[i].size == 4096);
+
+    EXPECT(sync_ranges(ranges, 2, ION_SYNC_OP_MAP) == 2);
+}
+
+static void test_no_merge_across_directions(void)
+{
+    const struct ion_sync_range ranges[] = {
+        { 1, BUF_A, 0, 4096, 1 },
+        { 1, BUF_A, 4096, 4096, 2 },
+        { 1, BUF_A, 8192, 4096, 1 },
+    };
+
+    EXPECT(sync_ranges(ranges, 3, ION_SYNC_OP_MAP) == 3);
+    EXPECT(calls[0].type == ION_DMA_MAP_AREA_VA);
+    /* a flush ignores the direction */
+    EXPECT(sync_ranges(ranges, 3, ION_SYNC_OP_FLUSH) == 1);
+    EXPECT(calls[0].size == 12288);
+}
+
+static void test_whole_buffers(void)
+{
+    /* length of a whole buffer range is ignored, here it is garbage */
+    const struct ion_sync_range ranges[] = {
+        { 2, NULL, 0, 64 << 20, 0 },
+        { 1, NULL, 0, 64 << 20, 0 },
+        { 2, NULL, 0, 0, 0 },
+        { 1, BUF_A, 0, 4096, 0 },
+    };
+
+    EXPECT(sync_ranges(ranges, 4, ION_SYNC_OP_FLUSH) == 3);
+    EXPECT(calls[0].sys_cmd == ION_SYS_CACHE_SYNC && calls[0].handle == 1);
+    EXPECT(calls[1].sys_cmd == ION_SYS_CACHE_SYNC && calls[1].handle == 2);
+    EXPECT(calls[2].type == ION_DMA_FLUSH_BY_RANGE_USE_VA);
+
+    EXPECT(sync_ranges(ranges, 3, ION_SYNC_OP_UNMAP) == 2);
+    EXPECT(calls[0].type == ION_DMA_UNMAP_AREA && calls[0].handle == 1);
+}
+
+static void test_full_flush_threshold(void)
+{
+    struct ion_sync_range ranges[80];
+    size_t i;
+
+    /* 80 disjoint 64KB ranges are past ION_SYNC_FULL_FLUSH_SIZE */
+    for (i = 0; i < 80; i++) {
+        ranges[i].handle = 1;
+        ranges[i].va = (void *)0x40000000;
+        ranges[i].offset = i * 128 * 1024;
+        ranges[i].length = 64 * 1024;
+        ranges[i].dir = 0;
+    }
+    EXPECT(sync_ranges(ranges, 80, ION_SYNC_OP_FLUSH) == 1);
+    EXPECT(calls[0].type == ION_DMA_CACHE_FLUSH_ALL);
+
+    /* one below it is flushed range by range */
+    EXPECT(sync_ranges(ranges, ION_SYNC_FULL_FLUSH_SIZE / (64 * 1024) - 1,
+                       ION_SYNC_OP_FLUSH) == ION_SYNC_FULL_FLUSH_SIZE / (64 * 1024) - 1);
+
+    /* map never takes the shortcut */
+    EXPECT(sync_ranges(ranges, TEST_MAX_CALLS, ION_SYNC_OP_MAP) == TEST_MAX_CALLS);
+}
+
+static void test_errors(void)
+{
+    const struct ion_sync_range range = { 1, BUF_A, 0, 4096, 0 };
+
+    EXPECT(sync_ranges(&range, 0, ION_SYNC_OP_FLUSH) == 0);
+    EXPECT(sync_ranges(&range, 1, 42) == -EINVAL);
+    EXPECT(call_count == 0);
+    EXPECT(ion_cache_sync_ranges(TEST_FD + 1, &range, 1, ION_SYNC_OP_FLUSH) < 0);
+}
+
+int main(void)
+{
+    test_merge_within_buffer();
+    test_no_merge_across_buffers();
+    test_no_merge_across_directions();
+    test_whole_buffers();
+    test_full_flush_threshold();
+    test_errors();
+
+    if (failures) {
+        fprintf(stderr, "ion_sync_ranges_test: %d failures\n", failures);
+        return 1;
+    }
+    printf("ion_sync_ranges_test: OK\n");
+    return 0;
+}
@@ -29,6 +29,7 @@
 #include <linux/fb.h>
 #include <wchar.h>
 #include <pthread.h>
+#include <unistd.h>
 
 #include <linux/mmprofile_internal.h>
 #include "mmprofile_function.h"
@@ -40,7 +41,9 @@
 #define LogPrint(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, ## __VA_ARGS__)
 
 static int MMProfile_FD = -1;
-static pthread_mutex_t MMProfile_FDMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Metadata up to this size is staged on the stack instead of malloc'ed
+#define MMPROFILE_META_STACK_SIZE 256
 
 #define likely(x)	__builtin_expect(!!(x), 1)
 #define unlikely(x)	__builtin_expect(!!(x), 0)
@@ -48,18 +51,20 @@ static pthread_mutex_t MMProfile_FDMutex = PTHREAD_MUTEX_INITIALIZER;
 // Internal functions begin
 static unsigned int MMProfileInitFD(void)
 {
-    unsigned int ret = 1;
-    pthread_mutex_lock(&MMProfile_FDMutex);
-    if (unlikely(MMProfile_FD < 0))
-    {
-        MMProfile_FD = open("/sys/kernel/debug/mmprofile/mmp", O_RDONLY);
-        if (MMProfile_FD < 0)
-        {
-            ret = 0;
-        }
-    }
-    pthread_mutex_unlock(&MMProfile_FDMutex);
-    return ret;
+    int fd;
+    int expected = -1;
+
+    if (likely(__atomic_load_n(&MMProfile_FD, __ATOMIC_ACQUIRE) >= 0))
+        return 1;
+
+    fd = open("/sys/kernel/debug/mmprofile/mmp", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+    // Another thread may have won the race, keep its fd
+    if (!__atomic_compare_exchange_n(&MMProfile_FD, &expected, fd, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        close(fd);
+    return 1;
 }
 
 static unsigned int IsMMProfileEnabled(void)
@@ -190,6 +195,7 @@ long MMProfileLogMetaStringEx(MMP_Event event, MMP_LogType type, unsigned long d
 {
     int ret = 0;
     MMP_MetaData_t MetaData;
+    char stage[MMPROFILE_META_STACK_SIZE];
 
     if (MMProfileInitFD() == 0)
         return -1;
@@ -201,12 +207,16 @@ long MMProfileLogMetaStringEx(MMP_Event event, MMP_LogType type, unsigned long d
     MetaData.data2 = data2;
     MetaData.data_type = MMProfileMetaStringMBS;
     MetaData.size = strlen(str) + 1;
-    MetaData.pData = malloc(MetaData.size);
+    if (MetaData.size <= sizeof(stage))
+        MetaData.pData = stage;
+    else
+        MetaData.pData = malloc(MetaData.size);
     if (!MetaData.pData)
         return -1;
-    strncpy((char*)MetaData.pData, str, strlen(str) + 1);
+    memcpy(MetaData.pData, str, MetaData.size);
     ret = MMProfileLogMeta(event, type, &MetaData);
-    free(MetaData.pData);
+    if (MetaData.pData != stage)
+        free(MetaData.pData);
     return ret;
 }
 
@@ -219,6 +229,7 @@ long MMProfileLogMetaStructure(MMP_Event event, MMP_LogType type, MMP_MetaDataSt
 {
     int ret = 0;
     MMP_MetaData_t MetaData;
+    char stage[MMPROFILE_META_STACK_SIZE];
 
     if (MMProfileInitFD() == 0)
         return -1;
@@ -230,13 +241,17 @@ long MMProfileLogMetaStructure(MMP_Event event, MMP_LogType type, MMP_MetaDataSt
     MetaData.data2 = pMetaData->data2;
     MetaData.data_type = MMProfileMetaStructure;
     MetaData.size = 32 + pMetaData->struct_size;
-    MetaData.pData = malloc(MetaData.size);
+    if (MetaData.size <= sizeof(stage))
+        MetaData.pData = stage;
+    else
+        MetaData.pData = malloc(MetaData.size);
     if (!MetaData.pData)
         return -1;
     memcpy(MetaData.pData, pMetaData->struct_name, 32);
     memcpy((void*)((unsigned long)(MetaData.pData)+32), pMetaData->pData, pMetaData->struct_size);
     ret = MMProfileLogMeta(event, type, &MetaData);
-    free(MetaData.pData);
+    if (MetaData.pData != stage)
+        free(MetaData.pData);
     return ret;
 }
 
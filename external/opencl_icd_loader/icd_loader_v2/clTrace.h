@@ -21,10 +21,19 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <type_traits>
 
 #include <utils/RefBase.h>
 #include <log/log.h>
 #include <utils/Trace.h>
+#include <cutils/properties.h>
 
 #define ATRACE_TAG ATRACE_TAG_GRAPHICS
 
@@ -35,7 +44,8 @@ using namespace android;
 #define CL_TRACE_CALL(_funcName, ...)  \
     if(sCLTraceLevel) \
         TraceCL(#_funcName, __VA_ARGS__); \
-    CL_Systrace_Object cl_systrace_object(#_funcName, sCLSystraceEnabled);
+    CL_Systrace_Object cl_systrace_object(#_funcName, sCLSystraceEnabled); \
+    CL_BinaryTrace_Object cl_binarytrace_object(sCLBinaryTraceEnabled, clTraceFuncId(#_funcName), __VA_ARGS__);
 
 class CL_Systrace_Object {
 
@@ -56,6 +66,247 @@ public:
     };
 };
 
+// Binary trace mode (debug.ocl.trace=binary)
+// Each call appends one fixed-size CLTraceRecord to a per-thread pair of
+// blocks, no formatting is done on the calling thread. A full block is handed
+// to a writer thread, which appends it to <dir>/ocl_trace.<pid>.<tid>.bin
+// while the caller fills the other block; if that one is still being
+// written, records are dropped and counted rather than waited for. <dir> is
+// sCLTraceDir, see initCLTraceLevel. The remainder is written when the thread
+// exits. "parseCLAPI.py --decode <file>" prints the records.
+#define CL_TRACE_MAX_ARGS       14
+// 2 blocks of 128 records, 36KB per traced thread, allocated on its first
+// traced call
+#define CL_TRACE_BLOCK_RECORDS  128
+
+struct CLTraceRecord {
+    uint32_t funcId;        // clTraceFuncId() of the API name
+    uint32_t tid;
+    uint64_t timestampNs;   // CLOCK_MONOTONIC at entry
+    uint64_t durationNs;
+    uint32_t numArgs;
+    uint32_t reserved;
+    uint64_t args[CL_TRACE_MAX_ARGS];   // raw argument words
+};
+
+// FNV-1a of the API name, must match entryPointHash(name, 0) in parseCLAPI.py
+constexpr uint32_t clTraceFuncIdStep(const char* name, uint32_t hash) {
+    return *name ? clTraceFuncIdStep(name + 1, (hash ^ (unsigned char)*name) * 16777619u) : hash;
+}
+
+constexpr uint32_t clTraceFuncId(const char* name) {
+    return clTraceFuncIdStep(name, 2166136261u);
+}
+
+static inline uint64_t clTraceNowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+struct CLTraceRing;
+
+struct CLTraceBlock {
+    CLTraceRecord records[CL_TRACE_BLOCK_RECORDS];
+    uint32_t count;
+    bool pending;           // queued or being written, under sCLTraceWriterLock
+    CLTraceRing* ring;
+    CLTraceBlock* next;     // writer queue
+};
+
+struct CLTraceRing {
+    CLTraceBlock blocks[2];
+    uint32_t active;
+    uint32_t tid;
+    uint64_t dropped;
+    int fd;                 // opened by whoever writes the first block
+};
+
+static pthread_mutex_t sCLTraceWriterLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sCLTraceWriterQueued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t sCLTraceWriterDone = PTHREAD_COND_INITIALIZER;
+static CLTraceBlock* sCLTraceWriterHead = NULL;
+static CLTraceBlock* sCLTraceWriterTail = NULL;
+static pthread_once_t sCLTraceWriterOnce = PTHREAD_ONCE_INIT;
+
+static void clTraceWriteBlock(CLTraceBlock* block) {
+    CLTraceRing* ring = block->ring;
+
+    if (ring->fd < 0) {
+        char path[PROPERTY_VALUE_MAX + 48];
+        snprintf(path, sizeof(path), "%s/ocl_trace.%d.%u.bin", sCLTraceDir, getpid(), ring->tid);
+        ring->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (ring->fd < 0) {
+            ALOGE("CL binary trace: open %s failed", path);
+            return;
+        }
+    }
+    if (write(ring->fd, block->records, block->count * sizeof(CLTraceRecord)) < 0)
+        ALOGE("CL binary trace: write failed");
+}
+
+static void* clTraceWriterMain(void*) {
+    pthread_mutex_lock(&sCLTraceWriterLock);
+    for (;;) {
+        CLTraceBlock* block;
+
+        while (!sCLTraceWriterHead)
+            pthread_cond_wait(&sCLTraceWriterQueued, &sCLTraceWriterLock);
+        block = sCLTraceWriterHead;
+        sCLTraceWriterHead = block->next;
+        if (!sCLTraceWriterHead)
+            sCLTraceWriterTail = NULL;
+        pthread_mutex_unlock(&sCLTraceWriterLock);
+
+        clTraceWriteBlock(block);
+
+        pthread_mutex_lock(&sCLTraceWriterLock);
+        block->count = 0;
+        __atomic_store_n(&block->pending, false, __ATOMIC_RELEASE);
+        pthread_cond_broadcast(&sCLTraceWriterDone);
+    }
+    return NULL;
+}
+
+static void clTraceWriterStart() {
+    pthread_t thread;
+    pthread_attr_t attr;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, clTraceWriterMain, NULL))
+        ALOGE("CL binary trace: no writer thread, records will be dropped");
+    else
+        pthread_setname_np(thread, "ocl_trace");
+    pthread_attr_destroy(&attr);
+}
+
+class CLTraceThread {
+    CLTraceRing* ring;
+
+public:
+    CLTraceThread() : ring(NULL) {}
+
+    // the thread is going away: wait for its queued block, then write the
+    // remainder here
+    ~CLTraceThread() {
+        CLTraceBlock* other;
+
+        if (!ring)
+            return;
+        other = &ring->blocks[ring->active ^ 1];
+        pthread_mutex_lock(&sCLTraceWriterLock);
+        while (other->pending)
+            pthread_cond_wait(&sCLTraceWriterDone, &sCLTraceWriterLock);
+        pthread_mutex_unlock(&sCLTraceWriterLock);
+
+        if (ring->blocks[ring->active].count)
+            clTraceWriteBlock(&ring->blocks[ring->active]);
+        if (ring->dropped)
+            ALOGW("CL binary trace: thread %u dropped %llu records", ring->tid,
+                  (unsigned long long)ring->dropped);
+        if (ring->fd >= 0)
+            close(ring->fd);
+        free(ring);
+    }
+
+    void commit(const CLTraceRecord& record) {
+        CLTraceBlock* block;
+
+        if (!ring) {
+            ring = (CLTraceRing*)calloc(1, sizeof(*ring));
+            if (!ring)
+                return;
+            ring->tid = (uint32_t)syscall(__NR_gettid);
+            ring->fd = -1;
+            ring->blocks[0].ring = ring;
+            ring->blocks[1].ring = ring;
+            pthread_once(&sCLTraceWriterOnce, clTraceWriterStart);
+        }
+
+        // pending is only cleared by the writer, a stale true only drops
+        block = &ring->blocks[ring->active];
+        if (__atomic_load_n(&block->pending, __ATOMIC_ACQUIRE)) {
+            ring->dropped++;
+            return;
+        }
+        block->records[block->count] = record;
+        block->records[block->count].tid = ring->tid;
+        if (++block->count < CL_TRACE_BLOCK_RECORDS)
+            return;
+
+        pthread_mutex_lock(&sCLTraceWriterLock);
+        __atomic_store_n(&block->pending, true, __ATOMIC_RELAXED);
+        block->next = NULL;
+        if (sCLTraceWriterTail)
+            sCLTraceWriterTail->next = block;
+        else
+            sCLTraceWriterHead = block;
+        sCLTraceWriterTail = block;
+        pthread_cond_signal(&sCLTraceWriterQueued);
+        pthread_mutex_unlock(&sCLTraceWriterLock);
+        ring->active ^= 1;
+    }
+};
+
+static inline CLTraceThread* clTraceThread() {
+    static thread_local CLTraceThread thread;
+    return &thread;
+}
+
+template <typename T>
+static inline uint64_t clTraceWord(T* value) {
+    return (uint64_t)reinterpret_cast<uintptr_t>(value);
+}
+
+template <typename T>
+static inline typename std::enable_if<std::is_arithmetic<T>::value || std::is_enum<T>::value, uint64_t>::type
+clTraceWord(T value) {
+    return (uint64_t)value;
+}
+
+static inline void clTracePack(CLTraceRecord*, uint32_t) {}
+
+// arguments come as ("type", value) pairs, only the value is kept
+template <typename T, typename... Rest>
+static inline void clTracePack(CLTraceRecord* record, uint32_t index, const char*, T value, Rest... rest) {
+    if (index < CL_TRACE_MAX_ARGS)
+        record->args[index] = clTraceWord(value);
+    clTracePack(record, index + 1, rest...);
+}
+
+// The record is staged on the stack and committed to the ring on return,
+// so a call made from inside the traced call cannot recycle its slot.
+class CL_BinaryTrace_Object {
+
+private:
+    cl_bool enabled;
+    CLTraceRecord record;
+
+public:
+    template <typename... Args>
+    CL_BinaryTrace_Object(cl_bool sCLBinaryTraceEnabled, uint32_t funcId, int numArgs, Args... args) {
+        enabled = sCLBinaryTraceEnabled;
+        if (!enabled)
+            return;
+
+        // unused argument slots must not carry stack contents to the file
+        memset(&record, 0, sizeof(record));
+        record.funcId = funcId;
+        record.numArgs = numArgs < CL_TRACE_MAX_ARGS ? numArgs : CL_TRACE_MAX_ARGS;
+        clTracePack(&record, 0, args...);
+        record.timestampNs = clTraceNowNs();
+    };
+
+    ~CL_BinaryTrace_Object() {
+        if (!enabled)
+            return;
+
+        record.durationNs = clTraceNowNs() - record.timestampNs;
+        clTraceThread()->commit(record);
+    };
+};
+
 class StringBuilder {
     static const int lineSize = 500;
     char line[lineSize];
@@ -16,6 +16,7 @@
 
 #include "icd.h"
 #include "icd_dispatch.h"
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -28,16 +29,36 @@ void khrIcdInitialize(void)
     khrIcdOsVendorsEnumerateOnce();
 }
 
-void khrIcdVendorAdd(const char *libraryName)
+// what probing one library found, before it goes into khrIcdVendors
+typedef struct
 {
-    void *library = NULL;
+    const char *libraryName;
+
+    // reference held while probing, identifies the library
+    void *library;
+
+    // its platforms, chained through next
+    KHRicdVendor *vendors;
+
+    // the thread probing it, when it has one
+    pthread_t thread;
+    bool threaded;
+} KHRicdVendorProbe;
+
+// load a library and collect a vendor for each of its platforms.  this runs
+// the vendor's platform query, which is where a GPU driver initializes, so
+// libraries are probed on threads of their own
+static void *khrIcdVendorProbe(void *arg)
+{
+    KHRicdVendorProbe *probe = (KHRicdVendorProbe *)arg;
+    const char *libraryName = probe->libraryName;
     cl_int result = CL_SUCCESS;
     pfn_clGetExtensionFunctionAddress p_clGetExtensionFunctionAddress = NULL;
     pfn_clIcdGetPlatformIDs p_clIcdGetPlatformIDs = NULL;
     cl_uint i = 0;
     cl_uint platformCount = 0;
     cl_platform_id *platforms = NULL;
-    KHRicdVendor *vendorIterator = NULL;
+    KHRicdVendor **vendorTail = &probe->vendors;
 
     // require that the library name be valid
     if (!libraryName)
@@ -47,25 +68,15 @@ void khrIcdVendorAdd(const char *libraryName)
     KHR_ICD_TRACE("attempting to add vendor %s...\n", libraryName);
 
     // load its library and query its function pointers
-    library = khrIcdOsLibraryLoad(libraryName);
-    if (!library)
+    probe->library = khrIcdOsLibraryLoad(libraryName);
+    if (!probe->library)
     {
         KHR_ICD_TRACE("failed to load library %s\n", libraryName);
         goto Done;
     }
 
-    // ensure that we haven't already loaded this vendor
-    for (vendorIterator = khrIcdVendors; vendorIterator; vendorIterator = vendorIterator->next)
-    {
-        if (vendorIterator->library == library)
-        {
-            KHR_ICD_TRACE("already loaded vendor %s, nothing to do here\n", libraryName);
-            goto Done;
-        }
-    }
-
     // get the library's clGetExtensionFunctionAddress pointer
-    p_clGetExtensionFunctionAddress = (pfn_clGetExtensionFunctionAddress)(size_t)khrIcdOsLibraryGetFunctionAddress(library, "clGetExtensionFunctionAddress");
+    p_clGetExtensionFunctionAddress = (pfn_clGetExtensionFunctionAddress)(size_t)khrIcdOsLibraryGetFunctionAddress(probe->library, "clGetExtensionFunctionAddress");
     if (!p_clGetExtensionFunctionAddress)
     {
         KHR_ICD_TRACE("failed to get function address clGetExtensionFunctionAddress\n");
@@ -163,27 +174,103 @@ void khrIcdVendorAdd(const char *libraryName)
         vendor->platform = platforms[i];
         vendor->suffix = suffix;
 
-        // add this vendor to the list of vendors at the tail
+        *vendorTail = vendor;
+        vendorTail = &vendor->next;
+    }
+
+Done:
+
+    if (platforms)
+    {
+        free(platforms);
+    }
+    return NULL;
+}
+
+// add the vendors a probe found at the tail of khrIcdVendors, unless the
+// library is already there under another name
+static void khrIcdVendorProbeAdd(KHRicdVendorProbe *probe)
+{
+    KHRicdVendor **prevNextPointer = NULL;
+    KHRicdVendor *vendor = NULL;
+
+    for (prevNextPointer = &khrIcdVendors; *prevNextPointer; prevNextPointer = &( (*prevNextPointer)->next) )
+    {
+        if ((*prevNextPointer)->library == probe->library)
         {
-            KHRicdVendor **prevNextPointer = NULL;
-            for (prevNextPointer = &khrIcdVendors; *prevNextPointer; prevNextPointer = &( (*prevNextPointer)->next) );
-            *prevNextPointer = vendor;
+            KHR_ICD_TRACE("already loaded vendor %s, nothing to do here\n", probe->libraryName);
+            break;
         }
+    }
 
-        KHR_ICD_TRACE("successfully added vendor %s with suffix %s\n", libraryName, suffix);
+    if (!*prevNextPointer)
+    {
+        *prevNextPointer = probe->vendors;
+        for (vendor = probe->vendors; vendor; vendor = vendor->next)
+        {
+            KHR_ICD_TRACE("successfully added vendor %s with suffix %s\n", probe->libraryName, vendor->suffix);
+        }
+    }
+    else
+    {
+        while (probe->vendors)
+        {
+            vendor = probe->vendors;
+            probe->vendors = vendor->next;
+            khrIcdOsLibraryUnload(vendor->library);
+            free(vendor->suffix);
+            free(vendor);
+        }
+    }
 
+    if (probe->library)
+    {
+        khrIcdOsLibraryUnload(probe->library);
     }
+}
 
-Done:
+void khrIcdVendorsAdd(const char * const *libraryNames, unsigned int count)
+{
+    KHRicdVendorProbe *probes = NULL;
+    unsigned int i = 0;
 
-    if (library)
+    probes = (KHRicdVendorProbe *)calloc(count, sizeof(*probes) );
+    if (!probes)
     {
-        khrIcdOsLibraryUnload(library);
+        KHR_ICD_TRACE("failed to allocate memory\n");
+        return;
     }
-    if (platforms)
+
+    // the last library is probed on the calling thread, as is any library
+    // no thread could be started for
+    for (i = 0; i < count; ++i)
     {
-        free(platforms);
+        probes[i].libraryName = libraryNames[i];
+        if (i + 1 < count)
+        {
+            probes[i].threaded = !pthread_create(&probes[i].thread, NULL, khrIcdVendorProbe, &probes[i]);
+        }
+        if (!probes[i].threaded)
+        {
+            khrIcdVendorProbe(&probes[i]);
+        }
+    }
+
+    // platforms keep the order of the search list
+    for (i = 0; i < count; ++i)
+    {
+        if (probes[i].threaded)
+        {
+            pthread_join(probes[i].thread, NULL);
+        }
+        khrIcdVendorProbeAdd(&probes[i]);
     }
+    free(probes);
+}
+
+void khrIcdVendorAdd(const char *libraryName)
+{
+    khrIcdVendorsAdd(&libraryName, 1);
 }
 
 void khrIcdContextPropertiesGetPlatform(const cl_context_properties *properties, cl_platform_id *outPlatform)
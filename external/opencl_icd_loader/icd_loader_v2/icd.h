@@ -102,6 +102,10 @@ void khrIcdOsVendorsEnumerateOnce(void);
 // add a vendor's implementation to the list of libraries
 void khrIcdVendorAdd(const char *libraryName);
 
+// add the vendors of several libraries, probed in parallel.  their platforms
+// are listed in the order of libraryNames
+void khrIcdVendorsAdd(const char * const *libraryNames, unsigned int count);
+
 // dynamically load a library.  returns NULL on failure
 // n.b, this call is OS-specific
 void *khrIcdOsLibraryLoad(const char *libraryName);
@@ -177,11 +181,51 @@ void khrIcdContextPropertiesGetPlatform(
         } \
     } while (0)
 
+// OpenCL command profiling, enabled by debug.ocl.profile
+// n.b, initCLProfile is OS-specific
+void initCLProfile(void);
+extern cl_bool sCLProfileEnabled;
+
+// event pointer to hand to the vendor enqueue: event itself, or localEvent
+// when profiling needs an event the caller did not ask for
+cl_event *khrIcdProfileEventPtr(cl_event *event, cl_event *localEvent);
+
+// register the enqueued command for profiling, returns result unchanged
+cl_int khrIcdProfileEnqueued(
+    cl_int result,
+    cl_command_queue queue,
+    cl_kernel kernel,
+    const char *commandName,
+    cl_event *event,
+    cl_event *localEvent);
+
+// whether releasing queue drops its last reference, checked before the release
+cl_bool khrIcdProfileQueueLastReference(cl_command_queue queue);
+
+// forget the counters of a destroyed queue, whose handle the vendor may hand
+// out again, returns result unchanged
+cl_int khrIcdProfileQueueReleased(cl_int result, cl_command_queue queue, cl_bool lastReference);
+
+// queue properties with CL_QUEUE_PROFILING_ENABLE added when profiling
+cl_command_queue_properties khrIcdProfileQueueProperties(cl_command_queue_properties properties);
+const cl_queue_properties *khrIcdProfileQueuePropertiesList(
+    const cl_queue_properties *properties,
+    cl_queue_properties *storage,
+    size_t storageCount);
+
+// write the per-queue and per-kernel counters as text to fd; exported for
+// tools, which look it up with dlsym
+extern "C" void khrIcdProfileDump(int fd);
+
 #ifdef CL_TRACE
 // OpenCL API Trace
 void initCLTraceLevel();
 extern cl_bool sCLSystraceEnabled;
 extern cl_bool sCLTraceLevel;
+extern cl_bool sCLBinaryTraceEnabled;
+// directory of the binary trace files, debug.ocl.trace.dir or a default
+// the process can write to
+extern char sCLTraceDir[];
 #endif
 
 #endif
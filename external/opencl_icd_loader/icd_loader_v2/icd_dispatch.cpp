@@ -18,6 +18,7 @@
 #include "icd.h"
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 #ifdef CL_TRACE
     #include "clTrace.h"
@@ -37,9 +38,6 @@ CL_TRACE_CALL ( clGetPlatformIDs, 3, "cl_uint", num_entries, "cl_platform_id*",
     KHRicdVendor* vendor = NULL;
     cl_uint i;
 
-    // initialize the platforms (in case they have not been already)
-    khrIcdInitialize();
-
     if (!num_entries && platforms)
     {
         return CL_INVALID_VALUE;
@@ -48,6 +46,9 @@ CL_TRACE_CALL ( clGetPlatformIDs, 3, "cl_uint", num_entries, "cl_platform_id*",
     {
         return CL_INVALID_VALUE;
     }
+    // initialize the platforms (in case they have not been already)
+    khrIcdInitialize();
+
     // set num_platforms to 0 and set all platform pointers to NULL
     if (num_platforms)
     {
@@ -317,7 +318,7 @@ CL_TRACE_CALL ( clCreateCommandQueue, 4, "cl_context", context, "cl_device_id",
     return context->dispatch->clCreateCommandQueue(
         context,
         device,
-        properties,
+        khrIcdProfileQueueProperties(properties),
         errcode_ret);
 }
 
@@ -341,8 +342,13 @@ clReleaseCommandQueue(cl_command_queue command_queue) CL_API_SUFFIX__VERSION_1_0
 CL_TRACE_CALL ( clReleaseCommandQueue, 1, "cl_command_queue", command_queue )
 #endif
 
+    cl_bool last_reference;
+    cl_int result;
+
     KHR_ICD_VALIDATE_HANDLE_RETURN_ERROR(command_queue, CL_INVALID_COMMAND_QUEUE);
-    return command_queue->dispatch->clReleaseCommandQueue(command_queue);
+    last_reference = khrIcdProfileQueueLastReference(command_queue);
+    result = command_queue->dispatch->clReleaseCommandQueue(command_queue);
+    return khrIcdProfileQueueReleased(result, command_queue, last_reference);
 }
 
 CL_API_ENTRY cl_int CL_API_CALL
@@ -1111,8 +1117,11 @@ clEnqueueReadBuffer(cl_command_queue    command_queue,
 CL_TRACE_CALL ( clEnqueueReadBuffer, 9, "cl_command_queue", command_queue, "cl_mem", buffer, "cl_bool", blocking_read, "size_t", offset, "size_t", cb, "void*", ptr, "cl_uint", num_events_in_wait_list, "const cl_event*", event_wait_list, "cl_event*", event )
 #endif
 
+    cl_event profile_event = NULL;
+    cl_int result;
+
     KHR_ICD_VALIDATE_HANDLE_RETURN_ERROR(command_queue, CL_INVALID_COMMAND_QUEUE);
-    return command_queue->dispatch->clEnqueueReadBuffer(
+    result = command_queue->dispatch->clEnqueueReadBuffer(
         command_queue,
         buffer,
         blocking_read,
@@ -1121,7 +1130,8 @@ CL_TRACE_CALL ( clEnqueueReadBuffer, 9, "cl_command_queue", command_queue, "cl_m
         ptr,
         num_events_in_wait_list,
         event_wait_list,
-        event);
+        khrIcdProfileEventPtr(event, &profile_event));
+    return khrIcdProfileEnqueued(result, command_queue, NULL, "clEnqueueReadBuffer", event, &profile_event);
 }
 
 CL_API_ENTRY cl_int CL_API_CALL
@@ -1146,8 +1156,11 @@ clEnqueueReadBufferRect(
 CL_TRACE_CALL ( clEnqueueReadBufferRect, 14, "cl_command_queue", command_queue, "cl_mem", buffer, "cl_bool", blocking_read, "const size_t*", buffer_origin, "const size_t*", host_origin, "const size_t*", region, "size_t", buffer_row_pitch, "size_t", buffer_slice_pitch, "size_t", host_row_pitch, "size_t", host_slice_pitch, "void*", ptr, "cl_uint", num_events_in_wait_list, "const cl_event*", event_wait_list, "cl_event*", event )
 #endif
 
+    cl_event profile_event = NULL;
+    cl_int result;
+
     KHR_ICD_VALIDATE_HANDLE_RETURN_ERROR(command_queue, CL_INVALID_COMMAND_QUEUE);
-    return command_queue->dispatch->clEnqueueReadBufferRect(
+    result = command_queue->dispatch->clEnqueueReadBufferRect(
         command_queue,
         buffer,
         blocking_read,
@@ -1161,7 +1174,8 @@ CL_TRACE_CALL ( clEnqueueReadBufferRect, 14, "cl_command_queue", command_queue,
         ptr,
         num_events_in_wait_list,
         event_wait_list,
-        event);
+        khrIcdProfileEventPtr(event, &profile_event));
+    return khrIcdProfileEnqueued(result, command_queue, NULL, "clEnqueueReadBufferRect", event, &profile_event);
 }
 
 CL_API_ENTRY cl_int CL_API_CALL
@@ -1180,8 +1194,11 @@ clEnqueueWriteBuffer(cl_command_queue   command_queue,
 CL_TRACE_CALL ( clEnqueueWriteBuffer, 9, "cl_command_queue", command_queue, "cl_mem", buffer, "cl_bool", blocking_write, "size_t", offset, "size_t", cb, "const void*", ptr, "cl_uint", num_events_in_wait_list, "const cl_event*", event_wait_list, "cl_event*", event )
 #endif
 
+    cl_event profile_event = NULL;
+    cl_int result;
+
     KHR_ICD_VALIDATE_HANDLE_RETURN_ERROR(command_queue, CL_INVALID_COMMAND_QUEUE);
-    return command_queue->dispatch->clEnqueueWriteBuffer(
+    result = command_queue->dispatch->clEnqueueWriteBuffer(
         command_queue,
         buffer,
         blocking_write,
@@ -1190,7 +1207,8 @@ CL_TRACE_CALL ( clEnqueueWriteBuffer, 9, "cl_command_queue", command_queue, "cl_
         ptr,
         num_events_in_wait_list,
         event_wait_list,
-        event);
+        khrIcdProfileEventPtr(event, &profile_event));
+    return khrIcdProfileEnqueued(result, command_queue, NULL, "clEnqueueWriteBuffer", event, &profile_event);
 }
 
 CL_API_ENTRY cl_int CL_API_CALL
@@ -1215,8 +1233,11 @@ clEnqueueWriteBufferRect(
 CL_TRACE_CALL ( clEnqueueWriteBufferRect, 14, "cl_command_queue", command_queue, "cl_mem", buffer, "cl_bool", blocking_read, "const size_t*", buffer_origin, "const size_t*", host_origin, "const size_t*", region, "size_t", buffer_row_pitch, "size_t", buffer_slice_pitch, "size_t", host_row_pitch, "size_t", host_slice_pitch, "const void*", ptr, "cl_uint", num_events_in_wait_list, "const cl_event*", event_wait_list, "cl_event*", event )
 #endif
 
+    cl_event profile_event = NULL;
+    cl_int result;
+
     KHR_ICD_VALIDATE_HANDLE_RETURN_ERROR(command_queue, CL_INVALID_COMMAND_QUEUE);
-    return command_queue->dispatch->clEnqueueWriteBufferRect(
+    result = command_queue->dispatch->clEnqueueWriteBufferRect(
         command_queue,
         buffer,
         blocking_read,
@@ -1230,7 +1251,8 @@ CL_TRACE_CALL ( clEnqueueWriteBufferRect, 14, "cl_command_queue", command_queue,
         ptr,
         num_events_in_wait_list,
         event_wait_list,
-        event);
+        khrIcdProfileEventPtr(event, &profile_event));
+    return khrIcdProfileEnqueued(result, command_queue, NULL, "clEnqueueWriteBufferRect", event, &profile_event);
 }
 
 CL_API_ENTRY cl_int CL_API_CALL
@@ -1249,8 +1271,11 @@ clEnqueueFillBuffer(cl_command_queue   command_queue,
 CL_TRACE_CALL ( clEnqueueFillBuffer, 9, "cl_command_queue", command_queue, "cl_mem", buffer, "const void*", pattern, "size_t", pattern_size, "size_t", offset, "size_t", cb, "cl_uint", num_events_in_wait_list, "const cl_event*", event_wait_list, "cl_event*", event  )
 #endif
 
+    cl_event profile_event = NULL;
+    cl_int result;
+
     KHR_ICD_VALIDATE_HANDLE_RETURN_ERROR(command_queue, CL_INVALID_COMMAND_QUEUE);
-    return command_queue->dispatch->clEnqueueFillBuffer(
+    result = command_queue->dispatch->clEnqueueFillBuffer(
         command_queue,
         buffer,
         pattern,
@@ -1259,7 +1284,8 @@ CL_TRACE_CALL ( clEnqueueFillBuffer, 9, "cl_command_queue", command_queue, "cl_m
         cb,
         num_events_in_wait_list,
         event_wait_list,
-        event);
+        khrIcdProfileEventPtr(event, &profile_event));
+    return khrIcdProfileEnqueued(result, command_queue, NULL, "clEnqueueFillBuffer", event, &profile_event);
 }
 
 CL_API_ENTRY cl_int CL_API_CALL
@@ -1278,8 +1304,11 @@ clEnqueueCopyBuffer(cl_command_queue    command_queue,
 CL_TRACE_CALL ( clEnqueueCopyBuffer, 9, "cl_command_queue", command_queue, "cl_mem", src_buffer, "cl_mem", dst_buffer, "size_t", src_offset, "size_t", dst_offset, "size_t", cb, "cl_uint", num_events_in_wait_list, "const cl_event*", event_wait_list, "cl_event*", event )
 #endif
 
+    cl_event profile_event = NULL;
+    cl_int result;
+
     KHR_ICD_VALIDATE_HANDLE_RETURN_ERROR(command_queue, CL_INVALID_COMMAND_QUEUE);
-    return command_queue->dispatch->clEnqueueCopyBuffer(
+    result = command_queue->dispatch->clEnqueueCopyBuffer(
         command_queue,
         src_buffer,
         dst_buffer,
@@ -1288,7 +1317,8 @@ CL_TRACE_CALL ( clEnqueueCopyBuffer, 9, "cl_command_queue", command_queue, "cl_m
         cb,
         num_events_in_wait_list,
         event_wait_list,
-        event);
+        khrIcdProfileEventPtr(event, &profile_event));
+    return khrIcdProfileEnqueued(result, command_queue, NULL, "clEnqueueCopyBuffer", event, &profile_event);
 }
 
 CL_API_ENTRY cl_int CL_API_CALL
@@ -1312,8 +1342,11 @@ clEnqueueCopyBufferRect(
 CL_TRACE_CALL ( clEnqueueCopyBufferRect, 13, "cl_command_queue", command_queue, "cl_mem", src_buffer, "cl_mem", dst_buffer, "const size_t*", src_origin, "const size_t*", dst_origin, "const size_t*", region, "size_t", src_row_pitch, "size_t", src_slice_pitch, "size_t", dst_row_pitch, "size_t", dst_slice_pitch, "cl_uint", num_events_in_wait_list, "const cl_event*", event_wait_list, "cl_event*", event )
 #endif
 
+    cl_event profile_event = NULL;
+    cl_int result;
+
     KHR_ICD_VALIDATE_HANDLE_RETURN_ERROR(command_queue, CL_INVALID_COMMAND_QUEUE);
-    return command_queue->dispatch->clEnqueueCopyBufferRect(
+    result = command_queue->dispatch->clEnqueueCopyBufferRect(
         command_queue,
         src_buffer,
         dst_buffer,
@@ -1326,7 +1359,8 @@ CL_TRACE_CALL ( clEnqueueCopyBufferRect, 13, "cl_command_queue", command_queue,
         dst_slice_pitch,
         num_events_in_wait_list,
         event_wait_list,
-        event);
+        khrIcdProfileEventPtr(event, &profile_event));
+    return khrIcdProfileEnqueued(result, command_queue, NULL, "clEnqueueCopyBufferRect", event, &profile_event);
 }
 
 CL_API_ENTRY cl_int CL_API_CALL
@@ -1347,8 +1381,11 @@ clEnqueueReadImage(cl_command_queue     command_queue,
 CL_TRACE_CALL ( clEnqueueReadImage, 11, "cl_command_queue", command_queue, "cl_mem", image, "cl_bool", blocking_read, "const size_t*", origin, "const size_t*", region, "size_t", row_pitch, "size_t", slice_pitch, "void*", ptr, "cl_uint", num_events_in_wait_list, "const cl_event*", event_wait_list, "cl_event*", event )
 #endif
 
+    cl_event profile_event = NULL;
+    cl_int result;
+
     KHR_ICD_VALIDATE_HANDLE_RETURN_ERROR(command_queue, CL_INVALID_COMMAND_QUEUE);
-    return command_queue->dispatch->clEnqueueReadImage(
+    result = command_queue->dispatch->clEnqueueReadImage(
         command_queue,
         image,
         blocking_read,
@@ -1359,7 +1396,8 @@ CL_TRACE_CALL ( clEnqueueReadImage, 11, "cl_command_queue", command_queue, "cl_m
         ptr,
         num_events_in_wait_list,
         event_wait_list,
-        event);
+        khrIcdProfileEventPtr(event, &profile_event));
+    return khrIcdProfileEnqueued(result, command_queue, NULL, "clEnqueueReadImage", event, &profile_event);
 }
 
 CL_API_ENTRY cl_int CL_API_CALL
@@ -1380,8 +1418,11 @@ clEnqueueWriteImage(cl_command_queue    command_queue,
 CL_TRACE_CALL ( clEnqueueWriteImage, 11, "cl_command_queue", command_queue, "cl_mem", image, "cl_bool", blocking_write, "const size_t*", origin, "const size_t*", region, "size_t", input_row_pitch, "size_t", input_slice_pitch, "const void*", ptr, "cl_uint", num_events_in_wait_list, "const cl_event*", event_wait_list, "cl_event*", event )
 #endif
 
+    cl_event profile_event = NULL;
+    cl_int result;
+
     KHR_ICD_VALIDATE_HANDLE_RETURN_ERROR(command_queue, CL_INVALID_COMMAND_QUEUE);
-    return command_queue->dispatch->clEnqueueWriteImage(
+    result = command_queue->dispatch->clEnqueueWriteImage(
         command_queue,
         image,
         blocking_write,
@@ -1392,7 +1433,8 @@ CL_TRACE_CALL ( clEnqueueWriteImage, 11, "cl_command_queue", command_queue, "cl_
         ptr,
         num_events_in_wait_list,
         event_wait_list,
-        event);
+        khrIcdProfileEventPtr(event, &profile_event));
+    return khrIcdProfileEnqueued(result, command_queue, NULL, "clEnqueueWriteImage", event, &profile_event);
 }
 
 CL_API_ENTRY cl_int CL_API_CALL
@@ -1410,8 +1452,11 @@ clEnqueueFillImage(cl_command_queue   command_queue,
 CL_TRACE_CALL ( clEnqueueFillImage, 8, "cl_command_queue", command_queue, "cl_mem", image, "const void*", fill_color, "const size_t*", origin, "const size_t*", region, "cl_uint", num_events_in_wait_list, "const cl_event*", event_wait_list, "cl_event*", event  )
 #endif
 
+    cl_event profile_event = NULL;
+    cl_int result;
+
     KHR_ICD_VALIDATE_HANDLE_RETURN_ERROR(command_queue, CL_INVALID_COMMAND_QUEUE);
-    return command_queue->dispatch->clEnqueueFillImage(
+    result = command_queue->dispatch->clEnqueueFillImage(
         command_queue,
         image,
         fill_color,
@@ -1419,7 +1464,8 @@ CL_TRACE_CALL ( clEnqueueFillImage, 8, "cl_command_queue", command_queue, "cl_me
         region,
         num_events_in_wait_list,
         event_wait_list,
-        event);
+        khrIcdProfileEventPtr(event, &profile_event));
+    return khrIcdProfileEnqueued(result, command_queue, NULL, "clEnqueueFillImage", event, &profile_event);
 }
 
 CL_API_ENTRY cl_int CL_API_CALL
@@ -1438,8 +1484,11 @@ clEnqueueCopyImage(cl_command_queue     command_queue,
 CL_TRACE_CALL ( clEnqueueCopyImage, 9, "cl_command_queue", command_queue, "cl_mem", src_image, "cl_mem", dst_image, "const size_t*", src_origin, "const size_t*", dst_origin, "const size_t*", region, "cl_uint", num_events_in_wait_list, "const cl_event*", event_wait_list, "cl_event*", event )
 #endif
 
+    cl_event profile_event = NULL;
+    cl_int result;
+
     KHR_ICD_VALIDATE_HANDLE_RETURN_ERROR(command_queue, CL_INVALID_COMMAND_QUEUE);
-    return command_queue->dispatch->clEnqueueCopyImage(
+    result = command_queue->dispatch->clEnqueueCopyImage(
         command_queue,
         src_image,
         dst_image,
@@ -1448,7 +1497,8 @@ CL_TRACE_CALL ( clEnqueueCopyImage, 9, "cl_command_queue", command_queue, "cl_me
         region,
         num_events_in_wait_list,
         event_wait_list,
-        event);
+        khrIcdProfileEventPtr(event, &profile_event));
+    return khrIcdProfileEnqueued(result, command_queue, NULL, "clEnqueueCopyImage", event, &profile_event);
 }
 
 CL_API_ENTRY cl_int CL_API_CALL
@@ -1467,8 +1517,11 @@ clEnqueueCopyImageToBuffer(cl_command_queue command_queue,
 CL_TRACE_CALL ( clEnqueueCopyImageToBuffer, 9, "cl_command_queue", command_queue, "cl_mem", src_image, "cl_mem", dst_buffer, "const size_t*", src_origin, "const size_t*", region, "size_t", dst_offset, "cl_uint", num_events_in_wait_list, "const cl_event*", event_wait_list, "cl_event*", event )
 #endif
 
+    cl_event profile_event = NULL;
+    cl_int result;
+
     KHR_ICD_VALIDATE_HANDLE_RETURN_ERROR(command_queue, CL_INVALID_COMMAND_QUEUE);
-    return command_queue->dispatch->clEnqueueCopyImageToBuffer(
+    result = command_queue->dispatch->clEnqueueCopyImageToBuffer(
         command_queue,
         src_image,
         dst_buffer,
@@ -1477,7 +1530,8 @@ CL_TRACE_CALL ( clEnqueueCopyImageToBuffer, 9, "cl_command_queue", command_queue
         dst_offset,
         num_events_in_wait_list,
         event_wait_list,
-        event);
+        khrIcdProfileEventPtr(event, &profile_event));
+    return khrIcdProfileEnqueued(result, command_queue, NULL, "clEnqueueCopyImageToBuffer", event, &profile_event);
 }
 
 CL_API_ENTRY cl_int CL_API_CALL
@@ -1496,8 +1550,11 @@ clEnqueueCopyBufferToImage(cl_command_queue command_queue,
 CL_TRACE_CALL ( clEnqueueCopyBufferToImage, 9, "cl_command_queue", command_queue, "cl_mem", src_buffer, "cl_mem", dst_image, "size_t", src_offset, "const size_t*", dst_origin, "const size_t*", region, "cl_uint", num_events_in_wait_list, "const cl_event*", event_wait_list, "cl_event*", event )
 #endif
 
+    cl_event profile_event = NULL;
+    cl_int result;
+
     KHR_ICD_VALIDATE_HANDLE_RETURN_ERROR(command_queue, CL_INVALID_COMMAND_QUEUE);
-    return command_queue->dispatch->clEnqueueCopyBufferToImage(
+    result = command_queue->dispatch->clEnqueueCopyBufferToImage(
         command_queue,
         src_buffer,
         dst_image,
@@ -1506,7 +1563,8 @@ CL_TRACE_CALL ( clEnqueueCopyBufferToImage, 9, "cl_command_queue", command_queue
         region,
         num_events_in_wait_list,
         event_wait_list,
-        event);
+        khrIcdProfileEventPtr(event, &profile_event));
+    return khrIcdProfileEnqueued(result, command_queue, NULL, "clEnqueueCopyBufferToImage", event, &profile_event);
 }
 
 CL_API_ENTRY void * CL_API_CALL
@@ -1639,8 +1697,11 @@ clEnqueueNDRangeKernel(cl_command_queue command_queue,
 CL_TRACE_CALL ( clEnqueueNDRangeKernel, 9, "cl_command_queue", command_queue, "cl_kernel", kernel, "cl_uint", work_dim, "const size_t*", global_work_offset, "const size_t*", global_work_size, "const size_t*", local_work_size, "cl_uint", num_events_in_wait_list, "const cl_event*", event_wait_list, "cl_event*", event )
 #endif
 
+    cl_event profile_event = NULL;
+    cl_int result;
+
     KHR_ICD_VALIDATE_HANDLE_RETURN_ERROR(command_queue, CL_INVALID_COMMAND_QUEUE);
-    return command_queue->dispatch->clEnqueueNDRangeKernel(
+    result = command_queue->dispatch->clEnqueueNDRangeKernel(
         command_queue,
         kernel,
         work_dim,
@@ -1649,7 +1710,8 @@ CL_TRACE_CALL ( clEnqueueNDRangeKernel, 9, "cl_command_queue", command_queue, "c
         local_work_size,
         num_events_in_wait_list,
         event_wait_list,
-        event);
+        khrIcdProfileEventPtr(event, &profile_event));
+    return khrIcdProfileEnqueued(result, command_queue, kernel, "clEnqueueNDRangeKernel", event, &profile_event);
 }
 
 CL_API_ENTRY cl_int CL_API_CALL
@@ -1664,13 +1726,17 @@ clEnqueueTask(cl_command_queue  command_queue,
 CL_TRACE_CALL ( clEnqueueTask, 5, "cl_command_queue", command_queue, "cl_kernel", kernel, "cl_uint", num_events_in_wait_list, "const cl_event*", event_wait_list, "cl_event*", event )
 #endif
 
+    cl_event profile_event = NULL;
+    cl_int result;
+
     KHR_ICD_VALIDATE_HANDLE_RETURN_ERROR(command_queue, CL_INVALID_COMMAND_QUEUE);
-    return command_queue->dispatch->clEnqueueTask(
+    result = command_queue->dispatch->clEnqueueTask(
         command_queue,
         kernel,
         num_events_in_wait_list,
         event_wait_list,
-        event);
+        khrIcdProfileEventPtr(event, &profile_event));
+    return khrIcdProfileEnqueued(result, command_queue, kernel, "clEnqueueTask", event, &profile_event);
 }
 
 CL_API_ENTRY cl_int CL_API_CALL
@@ -2001,6 +2067,119 @@ CL_TRACE_CALL ( clEnqueueBarrier, 1, "cl_command_queue", command_queue )
     return command_queue->dispatch->clEnqueueBarrier(command_queue);
 }
 
+// ICD-aware extension entry points exported by the loader itself.
+// parseCLAPI.py --entrypoints hashes this list into icd_entrypoints.h,
+// rerun it whenever an entry is added or removed.
+#define KHR_ICD_EXTENSION_ENTRYPOINTS(X) \
+    /* Are these core or ext?  This is unclear, but they appear to be */ \
+    /* independent from cl_khr_gl_sharing. */ \
+    X(clCreateFromGLBuffer) \
+    X(clCreateFromGLTexture) \
+    X(clCreateFromGLTexture2D) \
+    X(clCreateFromGLTexture3D) \
+    X(clCreateFromGLRenderbuffer) \
+    X(clGetGLObjectInfo) \
+    X(clGetGLTextureInfo) \
+    X(clEnqueueAcquireGLObjects) \
+    X(clEnqueueReleaseGLObjects) \
+    /* cl_khr_gl_sharing */ \
+    X(clGetGLContextInfoKHR) \
+    /* cl_khr_gl_event */ \
+    X(clCreateEventFromGLsyncKHR) \
+    /* cl_ext_device_fission */ \
+    X(clCreateSubDevicesEXT) \
+    X(clRetainDeviceEXT) \
+    X(clReleaseDeviceEXT) \
+    /* cl_khr_egl_image */ \
+    X(clCreateFromEGLImageKHR) \
+    X(clEnqueueAcquireEGLObjectsKHR) \
+    X(clEnqueueReleaseEGLObjectsKHR) \
+    /* cl_khr_egl_event */ \
+    X(clCreateEventFromEGLSyncKHR) \
+    /* cl_khr_sub_groups */ \
+    X(clGetKernelSubGroupInfoKHR)
+
+#include "icd_entrypoints.h"
+
+typedef struct
+{
+    const char *name;
+    void *address;
+} KHRicdEntryPoint;
+
+#define KHR_ICD_ENTRYPOINT(name) { #name, (void *)(size_t)&name }
+#define KHR_ICD_ENTRYPOINT_EMPTY { NULL, NULL }
+
+// perfect hash table generated from KHR_ICD_EXTENSION_ENTRYPOINTS
+static const KHRicdEntryPoint khrIcdEntryPoints[KHR_ICD_ENTRYPOINT_TABLE_SIZE] =
+{
+    KHR_ICD_ENTRYPOINT_TABLE
+};
+
+#undef KHR_ICD_ENTRYPOINT
+#undef KHR_ICD_ENTRYPOINT_EMPTY
+
+// FNV-1a, must match entryPointHash() in parseCLAPI.py
+static cl_uint khrIcdEntryPointHash(const char *name, cl_uint seed)
+{
+    cl_uint hash = 2166136261u ^ seed;
+    for (; *name; ++name)
+    {
+        hash ^= (unsigned char)*name;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// cache of names resolved through the vendor suffix walk.  the vendor list
+// is immutable once enumerated, so a result never needs to be invalidated.
+#define KHR_ICD_VENDOR_CACHE_SIZE 128
+
+typedef struct
+{
+    cl_uint hash;
+    char *name;
+    void *address;
+} KHRicdVendorCacheEntry;
+
+static KHRicdVendorCacheEntry khrIcdVendorCache[KHR_ICD_VENDOR_CACHE_SIZE];
+static pthread_mutex_t khrIcdVendorCacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+// returns the cache slot holding function_name, or the empty slot where it
+// should be inserted, or NULL once the cache is full
+static KHRicdVendorCacheEntry *khrIcdVendorCacheFind(const char *function_name, cl_uint hash)
+{
+    cl_uint i;
+    for (i = 0; i < KHR_ICD_VENDOR_CACHE_SIZE; ++i)
+    {
+        KHRicdVendorCacheEntry *entry = &khrIcdVendorCache[(hash + i) & (KHR_ICD_VENDOR_CACHE_SIZE - 1)];
+        if (!entry->name || (entry->hash == hash && !strcmp(entry->name, function_name) ) )
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void *khrIcdVendorGetExtensionFunctionAddress(const char *function_name, size_t function_name_length)
+{
+    KHRicdVendor* vendor = NULL;
+
+    for (vendor = khrIcdVendors; vendor; vendor = vendor->next)
+    {
+        size_t vendor_suffix_length = strlen(vendor->suffix);
+        if (vendor_suffix_length <= function_name_length && vendor_suffix_length > 0)
+        {
+            const char *function_suffix = function_name+function_name_length-vendor_suffix_length;
+            if (!strcmp(function_suffix, vendor->suffix) )
+            {
+                return vendor->clGetExtensionFunctionAddress(function_name);
+            }
+        }
+    }
+    return NULL;
+}
+
 CL_API_ENTRY void * CL_API_CALL
 clGetExtensionFunctionAddress(const char *function_name) CL_EXT_SUFFIX__VERSION_1_1_DEPRECATED
 {
@@ -2010,33 +2189,22 @@ CL_TRACE_CALL ( clGetExtensionFunctionAddress, 1, "const char*", function_name )
 #endif
 
     size_t function_name_length = strlen(function_name);
-    KHRicdVendor* vendor = NULL;
-
-    // make sure the ICD is initialized
-    khrIcdInitialize();
+    const KHRicdEntryPoint *entryPoint = NULL;
+    KHRicdVendorCacheEntry *cached = NULL;
+    cl_uint hash;
+    void *address = NULL;
+
+    // return any ICD-aware extensions, one hash and at most one strcmp
+    hash = khrIcdEntryPointHash(function_name, KHR_ICD_ENTRYPOINT_HASH_SEED);
+    entryPoint = &khrIcdEntryPoints[hash & (KHR_ICD_ENTRYPOINT_TABLE_SIZE - 1)];
+    if (entryPoint->name && !strcmp(function_name, entryPoint->name) )
+    {
+        return entryPoint->address;
+    }
 
-    // return any ICD-aware extensions
+#if defined(_WIN32)
     #define CL_COMMON_EXTENSION_ENTRYPOINT_ADD(name) if (!strcmp(function_name, #name) ) return (void *)(size_t)&name
 
-    // Are these core or ext?  This is unclear, but they appear to be
-    // independent from cl_khr_gl_sharing.
-    CL_COMMON_EXTENSION_ENTRYPOINT_ADD(clCreateFromGLBuffer);
-    CL_COMMON_EXTENSION_ENTRYPOINT_ADD(clCreateFromGLTexture);
-    CL_COMMON_EXTENSION_ENTRYPOINT_ADD(clCreateFromGLTexture2D);
-    CL_COMMON_EXTENSION_ENTRYPOINT_ADD(clCreateFromGLTexture3D);
-    CL_COMMON_EXTENSION_ENTRYPOINT_ADD(clCreateFromGLRenderbuffer);
-    CL_COMMON_EXTENSION_ENTRYPOINT_ADD(clGetGLObjectInfo);
-    CL_COMMON_EXTENSION_ENTRYPOINT_ADD(clGetGLTextureInfo);
-    CL_COMMON_EXTENSION_ENTRYPOINT_ADD(clEnqueueAcquireGLObjects);
-    CL_COMMON_EXTENSION_ENTRYPOINT_ADD(clEnqueueReleaseGLObjects);
-
-    // cl_khr_gl_sharing
-    CL_COMMON_EXTENSION_ENTRYPOINT_ADD(clGetGLContextInfoKHR);
-
-    // cl_khr_gl_event
-    CL_COMMON_EXTENSION_ENTRYPOINT_ADD(clCreateEventFromGLsyncKHR);
-
-#if defined(_WIN32)
     // cl_khr_d3d10_sharing
     CL_COMMON_EXTENSION_ENTRYPOINT_ADD(clGetDeviceIDsFromD3D10KHR);
     CL_COMMON_EXTENSION_ENTRYPOINT_ADD(clCreateFromD3D10BufferKHR);
@@ -2058,36 +2226,36 @@ CL_TRACE_CALL ( clGetExtensionFunctionAddress, 1, "const char*", function_name )
     CL_COMMON_EXTENSION_ENTRYPOINT_ADD(clEnqueueReleaseDX9MediaSurfacesKHR);
 #endif
 
-    // cl_ext_device_fission
-    CL_COMMON_EXTENSION_ENTRYPOINT_ADD(clCreateSubDevicesEXT);
-    CL_COMMON_EXTENSION_ENTRYPOINT_ADD(clRetainDeviceEXT);
-    CL_COMMON_EXTENSION_ENTRYPOINT_ADD(clReleaseDeviceEXT);
-
-    /* cl_khr_egl_image */
-    CL_COMMON_EXTENSION_ENTRYPOINT_ADD(clCreateFromEGLImageKHR);
-    CL_COMMON_EXTENSION_ENTRYPOINT_ADD(clEnqueueAcquireEGLObjectsKHR);
-    CL_COMMON_EXTENSION_ENTRYPOINT_ADD(clEnqueueReleaseEGLObjectsKHR);
+    // make sure the ICD is initialized
+    khrIcdInitialize();
 
-    /* cl_khr_egl_event */
-    CL_COMMON_EXTENSION_ENTRYPOINT_ADD(clCreateEventFromEGLSyncKHR);
+    // fall back to vendor extension detection, remembering the answer
+    pthread_mutex_lock(&khrIcdVendorCacheLock);
+    cached = khrIcdVendorCacheFind(function_name, hash);
+    if (cached && cached->name)
+    {
+        address = cached->address;
+        pthread_mutex_unlock(&khrIcdVendorCacheLock);
+        return address;
+    }
+    pthread_mutex_unlock(&khrIcdVendorCacheLock);
 
-    /* cl_khr_sub_groups */
-    CL_COMMON_EXTENSION_ENTRYPOINT_ADD(clGetKernelSubGroupInfoKHR);
+    address = khrIcdVendorGetExtensionFunctionAddress(function_name, function_name_length);
 
-    // fall back to vendor extension detection
-    for (vendor = khrIcdVendors; vendor; vendor = vendor->next)
+    pthread_mutex_lock(&khrIcdVendorCacheLock);
+    cached = khrIcdVendorCacheFind(function_name, hash);
+    if (cached && !cached->name)
     {
-        size_t vendor_suffix_length = strlen(vendor->suffix);
-        if (vendor_suffix_length <= function_name_length && vendor_suffix_length > 0)
+        cached->name = strdup(function_name);
+        if (cached->name)
         {
-            const char *function_suffix = function_name+function_name_length-vendor_suffix_length;
-            if (!strcmp(function_suffix, vendor->suffix) )
-            {
-                return vendor->clGetExtensionFunctionAddress(function_name);
-            }
+            cached->hash = hash;
+            cached->address = address;
         }
     }
-    return NULL;
+    pthread_mutex_unlock(&khrIcdVendorCacheLock);
+
+    return address;
 }
 
 // GL and other APIs
@@ -2922,11 +3090,13 @@ clCreateCommandQueueWithProperties(
 CL_TRACE_CALL ( clCreateCommandQueueWithProperties, 4, "cl_context", context, "cl_device_id", device, "const cl_queue_properties*", properties, "cl_int*", errcode_ret )
 #endif
 
+    cl_queue_properties profile_properties[32];
+
     KHR_ICD_VALIDATE_HANDLE_RETURN_HANDLE(context, CL_INVALID_CONTEXT);
     return context->dispatch->clCreateCommandQueueWithProperties(
         context,
         device,
-        properties,
+        khrIcdProfileQueuePropertiesList(properties, profile_properties, 32),
         errcode_ret);
 }
 
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Generated by parseCLAPI.py --entrypoints, do not edit.
+
+#ifndef _ICD_ENTRYPOINTS_H_
+#define _ICD_ENTRYPOINTS_H_
+
+#define KHR_ICD_ENTRYPOINT_HASH_SEED 0xeu
+#define KHR_ICD_ENTRYPOINT_TABLE_SIZE 64
+
+// expands to one KHR_ICD_ENTRYPOINT(name) or KHR_ICD_ENTRYPOINT_EMPTY per slot
+#define KHR_ICD_ENTRYPOINT_TABLE \
+    KHR_ICD_ENTRYPOINT(clCreateFromEGLImageKHR), \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT(clCreateFromGLTexture), \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT(clGetGLTextureInfo), \
+    KHR_ICD_ENTRYPOINT(clEnqueueAcquireGLObjects), \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT(clCreateEventFromGLsyncKHR), \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT(clCreateEventFromEGLSyncKHR), \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT(clCreateSubDevicesEXT), \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT(clGetGLContextInfoKHR), \
+    KHR_ICD_ENTRYPOINT(clReleaseDeviceEXT), \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT(clGetGLObjectInfo), \
+    KHR_ICD_ENTRYPOINT(clCreateFromGLTexture3D), \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT(clEnqueueReleaseGLObjects), \
+    KHR_ICD_ENTRYPOINT(clCreateFromGLBuffer), \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT(clCreateFromGLRenderbuffer), \
+    KHR_ICD_ENTRYPOINT(clEnqueueReleaseEGLObjectsKHR), \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT(clRetainDeviceEXT), \
+    KHR_ICD_ENTRYPOINT(clGetKernelSubGroupInfoKHR), \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT(clCreateFromGLTexture2D), \
+    KHR_ICD_ENTRYPOINT(clEnqueueAcquireEGLObjectsKHR), \
+    KHR_ICD_ENTRYPOINT_EMPTY, \
+    KHR_ICD_ENTRYPOINT_EMPTY
+
+#endif // _ICD_ENTRYPOINTS_H_
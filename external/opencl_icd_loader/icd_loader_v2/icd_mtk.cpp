@@ -20,17 +20,20 @@
 #include <string.h>
 #include <stdlib.h>
 #include <sys/types.h>
+#include <unistd.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <pthread.h>
+#include <log/log.h>
+#include <cutils/properties.h>
 
 static pthread_once_t initialized = PTHREAD_ONCE_INIT;
 
 #ifdef CL_TRACE
-    #include <log/log.h>
-    #include <cutils/properties.h>
-
     cl_bool sCLSystraceEnabled = false;
     cl_bool sCLTraceLevel = false;
+    cl_bool sCLBinaryTraceEnabled = false;
+    char sCLTraceDir[PROPERTY_VALUE_MAX] = "/data/local/tmp";
 #endif
 
 /*
@@ -54,16 +57,13 @@ void khrIcdOsVendorsEnumerate(void)
 #endif
 	};
 
-	int i;
-	int size = sizeof(libSearchList) / sizeof(libSearchList[0]);
+	khrIcdVendorsAdd(libSearchList, sizeof(libSearchList) / sizeof(libSearchList[0]));
 
-	for (i = 0; i < size; ++i)
-		khrIcdVendorAdd(libSearchList[i]);
+    initCLProfile();
 
 #ifdef CL_TRACE
     initCLTraceLevel();
 #endif
-
 }
 
 // go through the list of vendors only once
@@ -72,7 +72,55 @@ void khrIcdOsVendorsEnumerateOnce(void)
     pthread_once(&initialized, khrIcdOsVendorsEnumerate);
 }
 
+void initCLProfile(void)
+{
+    char value[PROPERTY_VALUE_MAX];
+    property_get( "debug.ocl.profile" , value, "0");
+
+    sCLProfileEnabled = atoi(value) != 0;
+    if(sCLProfileEnabled)
+        ALOGD("initCLProfile sCLProfileEnabled = %d\n", sCLProfileEnabled);
+}
+
 #ifdef CL_TRACE
+// binary trace files go to debug.ocl.trace.dir when set.  otherwise an app
+// writes them to its own data directory, /data/user/<user>/<package>, and
+// anything else (native tools run from the shell) to /data/local/tmp
+static void initCLTraceDir(void)
+{
+    char dir[PROPERTY_VALUE_MAX];
+    char name[128];
+    ssize_t length;
+    int fd;
+
+    if (property_get("debug.ocl.trace.dir", dir, NULL) > 0)
+    {
+        strcpy(sCLTraceDir, dir);
+        return;
+    }
+
+    fd = open("/proc/self/cmdline", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return;
+    }
+    length = read(fd, name, sizeof(name) - 1);
+    close(fd);
+    if (length <= 0)
+    {
+        return;
+    }
+    name[length] = '\0';
+    // "com.example:remote" runs in the data directory of com.example
+    name[strcspn(name, ":")] = '\0';
+
+    snprintf(dir, sizeof(dir), "/data/user/%u/%s", (unsigned int)(getuid() / 100000), name);
+    if (name[0] != '/' && !access(dir, W_OK))
+    {
+        strcpy(sCLTraceDir, dir);
+    }
+}
+
 void initCLTraceLevel()
 {
     char value[PROPERTY_VALUE_MAX];
@@ -86,6 +134,15 @@ void initCLTraceLevel()
         return;
     }
 
+    sCLBinaryTraceEnabled = !strcasecmp(value, "binary");
+    if(sCLBinaryTraceEnabled)
+    {
+        sCLTraceLevel = 0;
+        initCLTraceDir();
+        ALOGD("initCLTraceLevel sCLBinaryTraceEnabled = %d dir %s\n", sCLBinaryTraceEnabled, sCLTraceDir);
+        return;
+    }
+
     int propertyLevel = atoi(value);
     sCLTraceLevel = propertyLevel;
     ALOGD("initCLTraceLevel sCLTraceLevel = %d\n", sCLTraceLevel);
@@ -0,0 +1,467 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "icd.h"
+#include "icd_dispatch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <atomic>
+
+/*
+ *
+ * Command profiling (debug.ocl.profile=1)
+ *
+ * Queues are created with CL_QUEUE_PROFILING_ENABLE and every profiled
+ * enqueue gets an event (the caller's, retained, or a private one).  A
+ * CL_COMPLETE callback reads the CL_PROFILING_COMMAND_* timestamps and adds
+ * them to per-queue and per-kernel counters.  Counters live in fixed tables
+ * claimed with compare-and-swap and are only ever updated with atomic adds,
+ * so completion callbacks from any driver thread never take a lock.
+ *
+ */
+
+cl_bool sCLProfileEnabled = CL_FALSE;
+
+#define KHR_ICD_PROFILE_SLOTS       128
+#define KHR_ICD_PROFILE_BUCKETS     32      // log2 of the latency in ns
+#define KHR_ICD_PROFILE_NAME_SIZE   64
+
+typedef struct
+{
+    // 0 while the slot is free; queue handle or name hash once claimed
+    std::atomic<uint64_t> key;
+    // set once name has been written
+    std::atomic<int> ready;
+    char name[KHR_ICD_PROFILE_NAME_SIZE];
+
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> failed;
+    std::atomic<uint64_t> waitNs;       // QUEUED -> START
+    std::atomic<uint64_t> execNs;       // START -> END
+    std::atomic<uint64_t> maxExecNs;
+    std::atomic<int64_t> depth;         // enqueued but not completed
+    std::atomic<int64_t> maxDepth;
+    std::atomic<uint32_t> histogram[KHR_ICD_PROFILE_BUCKETS];  // of execNs
+} KHRicdProfileStats;
+
+static KHRicdProfileStats khrIcdQueueStats[KHR_ICD_PROFILE_SLOTS];
+static KHRicdProfileStats khrIcdKernelStats[KHR_ICD_PROFILE_SLOTS];
+
+typedef struct
+{
+    KHRicdProfileStats *queueStats;
+    // retained until the command completes, NULL for non-kernel commands
+    cl_kernel kernel;
+    const char *command;
+} KHRicdProfileCommand;
+
+// slot keys besides 0 (free) that no queue handle or name hash takes
+#define KHR_ICD_PROFILE_KEY_RETIRED     (~0ull)         // queue released
+#define KHR_ICD_PROFILE_KEY_CLAIMING    (~0ull - 1)     // being reset
+
+static uint64_t khrIcdProfileHash(const char *name)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (; *name; ++name)
+    {
+        hash ^= (unsigned char)*name;
+        hash *= 1099511628211ull;
+    }
+    return hash && hash < KHR_ICD_PROFILE_KEY_CLAIMING ? hash : 1;
+}
+
+static void khrIcdProfileStatsReset(KHRicdProfileStats *stats, const char *name)
+{
+    cl_uint bucket;
+
+    stats->count.store(0, std::memory_order_relaxed);
+    stats->failed.store(0, std::memory_order_relaxed);
+    stats->waitNs.store(0, std::memory_order_relaxed);
+    stats->execNs.store(0, std::memory_order_relaxed);
+    stats->maxExecNs.store(0, std::memory_order_relaxed);
+    stats->depth.store(0, std::memory_order_relaxed);
+    stats->maxDepth.store(0, std::memory_order_relaxed);
+    for (bucket = 0; bucket < KHR_ICD_PROFILE_BUCKETS; ++bucket)
+    {
+        stats->histogram[bucket].store(0, std::memory_order_relaxed);
+    }
+    memset(stats->name, 0, sizeof(stats->name) );
+    strncpy(stats->name, name, KHR_ICD_PROFILE_NAME_SIZE - 1);
+    stats->ready.store(1, std::memory_order_release);
+}
+
+// find or claim the slot for key, NULL when the table is full.  slots are
+// probed linearly from key; a released queue leaves its slot retired rather
+// than free so the probe chains through it stay intact, and the slot is
+// reclaimed once no command of that queue is in flight any more
+static KHRicdProfileStats *khrIcdProfileStatsGet(KHRicdProfileStats *table, uint64_t key, const char *name)
+{
+    for (;;)
+    {
+        KHRicdProfileStats *reusable = NULL;
+        uint64_t reusableKey = 0;
+        cl_bool claiming = CL_FALSE;
+        cl_uint i;
+
+        for (i = 0; i < KHR_ICD_PROFILE_SLOTS; ++i)
+        {
+            KHRicdProfileStats *stats = &table[(key + i) % KHR_ICD_PROFILE_SLOTS];
+            uint64_t current = stats->key.load(std::memory_order_acquire);
+
+            if (current == key)
+            {
+                return stats;
+            }
+            if (current == KHR_ICD_PROFILE_KEY_CLAIMING)
+            {
+                // may be key itself being claimed, look again once it is
+                claiming = CL_TRUE;
+                break;
+            }
+            if (current == KHR_ICD_PROFILE_KEY_RETIRED && !reusable &&
+                !stats->depth.load(std::memory_order_acquire) )
+            {
+                reusable = stats;
+                reusableKey = current;
+            }
+            if (current == 0)
+            {
+                if (!reusable)
+                {
+                    reusable = stats;
+                    reusableKey = current;
+                }
+                break;
+            }
+        }
+        if (claiming)
+        {
+            continue;
+        }
+        if (!reusable)
+        {
+            return NULL;
+        }
+        if (reusable->key.compare_exchange_strong(reusableKey, KHR_ICD_PROFILE_KEY_CLAIMING, std::memory_order_acq_rel) )
+        {
+            khrIcdProfileStatsReset(reusable, name);
+            reusable->key.store(key, std::memory_order_release);
+            return reusable;
+        }
+        // another thread took the slot first, it may have been for key
+    }
+}
+
+static KHRicdProfileStats *khrIcdProfileQueueStats(cl_command_queue queue)
+{
+    char name[KHR_ICD_PROFILE_NAME_SIZE];
+
+    snprintf(name, sizeof(name), "queue %p", (void *)queue);
+    return khrIcdProfileStatsGet(khrIcdQueueStats, (uint64_t)(uintptr_t)queue, name);
+}
+
+static void khrIcdProfileAtomicMax(std::atomic<uint64_t> &value, uint64_t sample)
+{
+    uint64_t current = value.load(std::memory_order_relaxed);
+    while (current < sample && !value.compare_exchange_weak(current, sample, std::memory_order_relaxed) );
+}
+
+static void khrIcdProfileAtomicMax(std::atomic<int64_t> &value, int64_t sample)
+{
+    int64_t current = value.load(std::memory_order_relaxed);
+    while (current < sample && !value.compare_exchange_weak(current, sample, std::memory_order_relaxed) );
+}
+
+static void khrIcdProfileRecord(KHRicdProfileStats *stats, cl_ulong queued, cl_ulong start, cl_ulong end)
+{
+    uint64_t exec = end > start ? end - start : 0;
+    cl_uint bucket = 0;
+
+    if (!stats)
+    {
+        return;
+    }
+    while (bucket < KHR_ICD_PROFILE_BUCKETS - 1 && (exec >> (bucket + 1) ) )
+    {
+        ++bucket;
+    }
+    stats->count.fetch_add(1, std::memory_order_relaxed);
+    stats->waitNs.fetch_add(start > queued ? start - queued : 0, std::memory_order_relaxed);
+    stats->execNs.fetch_add(exec, std::memory_order_relaxed);
+    stats->histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+    khrIcdProfileAtomicMax(stats->maxExecNs, exec);
+}
+
+static void CL_CALLBACK khrIcdProfileEventComplete(cl_event event, cl_int status, void *user_data)
+{
+    KHRicdProfileCommand *command = (KHRicdProfileCommand *)user_data;
+    KHRicdProfileStats *kernelStats = NULL;
+    cl_ulong queued = 0, start = 0, end = 0;
+    char name[KHR_ICD_PROFILE_NAME_SIZE] = "<unknown>";
+    cl_int result;
+
+    if (command->kernel)
+    {
+        command->kernel->dispatch->clGetKernelInfo(command->kernel, CL_KERNEL_FUNCTION_NAME,
+            sizeof(name), name, NULL);
+        name[KHR_ICD_PROFILE_NAME_SIZE - 1] = '\0';
+        command->kernel->dispatch->clReleaseKernel(command->kernel);
+    }
+    else
+    {
+        strncpy(name, command->command, KHR_ICD_PROFILE_NAME_SIZE - 1);
+    }
+    kernelStats = khrIcdProfileStatsGet(khrIcdKernelStats, khrIcdProfileHash(name), name);
+
+    result = event->dispatch->clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_QUEUED, sizeof(queued), &queued, NULL);
+    if (CL_SUCCESS == result)
+    {
+        result = event->dispatch->clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+    }
+    if (CL_SUCCESS == result)
+    {
+        result = event->dispatch->clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+    }
+
+    if (CL_COMPLETE == status && CL_SUCCESS == result)
+    {
+        khrIcdProfileRecord(command->queueStats, queued, start, end);
+        khrIcdProfileRecord(kernelStats, queued, start, end);
+    }
+    else
+    {
+        if (command->queueStats)
+        {
+            command->queueStats->failed.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (kernelStats)
+        {
+            kernelStats->failed.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (command->queueStats)
+    {
+        command->queueStats->depth.fetch_sub(1, std::memory_order_relaxed);
+    }
+    event->dispatch->clReleaseEvent(event);
+    free(command);
+}
+
+cl_event *khrIcdProfileEventPtr(cl_event *event, cl_event *localEvent)
+{
+    if (!sCLProfileEnabled || event)
+    {
+        return event;
+    }
+    return localEvent;
+}
+
+cl_int khrIcdProfileEnqueued(
+    cl_int result,
+    cl_command_queue queue,
+    cl_kernel kernel,
+    const char *commandName,
+    cl_event *event,
+    cl_event *localEvent)
+{
+    KHRicdProfileCommand *command = NULL;
+    cl_event profiled = NULL;
+
+    if (!sCLProfileEnabled || CL_SUCCESS != result)
+    {
+        return result;
+    }
+
+    profiled = event ? *event : *localEvent;
+    if (!profiled)
+    {
+        return result;
+    }
+    // the callback releases one reference, the caller keeps its own
+    if (event)
+    {
+        profiled->dispatch->clRetainEvent(profiled);
+    }
+
+    command = (KHRicdProfileCommand *)malloc(sizeof(*command) );
+    if (!command)
+    {
+        profiled->dispatch->clReleaseEvent(profiled);
+        return result;
+    }
+    command->queueStats = khrIcdProfileQueueStats(queue);
+    command->kernel = kernel;
+    command->command = commandName;
+    if (kernel)
+    {
+        kernel->dispatch->clRetainKernel(kernel);
+    }
+    if (command->queueStats)
+    {
+        khrIcdProfileAtomicMax(command->queueStats->maxDepth,
+            command->queueStats->depth.fetch_add(1, std::memory_order_relaxed) + 1);
+    }
+
+    if (CL_SUCCESS != profiled->dispatch->clSetEventCallback(profiled, CL_COMPLETE, khrIcdProfileEventComplete, command) )
+    {
+        if (command->queueStats)
+        {
+            command->queueStats->depth.fetch_sub(1, std::memory_order_relaxed);
+        }
+        if (kernel)
+        {
+            kernel->dispatch->clReleaseKernel(kernel);
+        }
+        profiled->dispatch->clReleaseEvent(profiled);
+        free(command);
+    }
+    return result;
+}
+
+cl_bool khrIcdProfileQueueLastReference(cl_command_queue queue)
+{
+    cl_uint references = 0;
+
+    if (!sCLProfileEnabled)
+    {
+        return CL_FALSE;
+    }
+    return CL_SUCCESS == queue->dispatch->clGetCommandQueueInfo(queue, CL_QUEUE_REFERENCE_COUNT,
+        sizeof(references), &references, NULL) && 1 == references;
+}
+
+cl_int khrIcdProfileQueueReleased(cl_int result, cl_command_queue queue, cl_bool lastReference)
+{
+    uint64_t key = (uint64_t)(uintptr_t)queue;
+    cl_uint i;
+
+    if (!lastReference || CL_SUCCESS != result)
+    {
+        return result;
+    }
+
+    // the handle may come back for a new queue, which must start from zero;
+    // callbacks still in flight keep counting into the retired slot
+    for (i = 0; i < KHR_ICD_PROFILE_SLOTS; ++i)
+    {
+        KHRicdProfileStats *stats = &khrIcdQueueStats[(key + i) % KHR_ICD_PROFILE_SLOTS];
+        uint64_t current = stats->key.load(std::memory_order_acquire);
+
+        if (current == key)
+        {
+            stats->ready.store(0, std::memory_order_relaxed);
+            stats->key.store(KHR_ICD_PROFILE_KEY_RETIRED, std::memory_order_release);
+            break;
+        }
+        if (current == 0)
+        {
+            break;
+        }
+    }
+    return result;
+}
+
+cl_command_queue_properties khrIcdProfileQueueProperties(cl_command_queue_properties properties)
+{
+    return sCLProfileEnabled ? (properties | CL_QUEUE_PROFILING_ENABLE) : properties;
+}
+
+const cl_queue_properties *khrIcdProfileQueuePropertiesList(
+    const cl_queue_properties *properties,
+    cl_queue_properties *storage,
+    size_t storageCount)
+{
+    size_t i = 0;
+    cl_bool found = CL_FALSE;
+
+    if (!sCLProfileEnabled)
+    {
+        return properties;
+    }
+
+    for (; properties && properties[i]; i += 2)
+    {
+        // leave room for the appended pair and the terminator
+        if (i + 4 >= storageCount)
+        {
+            return properties;
+        }
+        storage[i] = properties[i];
+        storage[i + 1] = properties[i + 1];
+        if (CL_QUEUE_PROPERTIES == properties[i])
+        {
+            storage[i + 1] |= CL_QUEUE_PROFILING_ENABLE;
+            found = CL_TRUE;
+        }
+    }
+    if (!found)
+    {
+        storage[i++] = CL_QUEUE_PROPERTIES;
+        storage[i++] = CL_QUEUE_PROFILING_ENABLE;
+    }
+    storage[i] = 0;
+    return storage;
+}
+
+static void khrIcdProfileDumpTable(int fd, const char *title, KHRicdProfileStats *table)
+{
+    cl_uint i, bucket;
+
+    dprintf(fd, "%s\n", title);
+    for (i = 0; i < KHR_ICD_PROFILE_SLOTS; ++i)
+    {
+        KHRicdProfileStats *stats = &table[i];
+        uint64_t count;
+
+        if (!stats->ready.load(std::memory_order_acquire) )
+        {
+            continue;
+        }
+        count = stats->count.load(std::memory_order_relaxed);
+        dprintf(fd, "  %-40s count %llu failed %llu avg wait %llu ns avg exec %llu ns max exec %llu ns",
+            stats->name,
+            (unsigned long long)count,
+            (unsigned long long)stats->failed.load(std::memory_order_relaxed),
+            (unsigned long long)(count ? stats->waitNs.load(std::memory_order_relaxed) / count : 0),
+            (unsigned long long)(count ? stats->execNs.load(std::memory_order_relaxed) / count : 0),
+            (unsigned long long)stats->maxExecNs.load(std::memory_order_relaxed) );
+        if (table == khrIcdQueueStats)
+        {
+            dprintf(fd, " depth %lld max depth %lld",
+                (long long)stats->depth.load(std::memory_order_relaxed),
+                (long long)stats->maxDepth.load(std::memory_order_relaxed) );
+        }
+        dprintf(fd, "\n    exec histogram (ns >= 2^n):");
+        for (bucket = 0; bucket < KHR_ICD_PROFILE_BUCKETS; ++bucket)
+        {
+            uint32_t samples = stats->histogram[bucket].load(std::memory_order_relaxed);
+            if (samples)
+            {
+                dprintf(fd, " [%u] %u", bucket, samples);
+            }
+        }
+        dprintf(fd, "\n");
+    }
+}
+
+extern "C" void khrIcdProfileDump(int fd)
+{
+    khrIcdProfileDumpTable(fd, "OpenCL command queues:", khrIcdQueueStats);
+    khrIcdProfileDumpTable(fd, "OpenCL kernels and commands:", khrIcdKernelStats);
+}
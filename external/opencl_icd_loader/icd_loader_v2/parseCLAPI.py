@@ -1,3 +1,5 @@
+import sys
+
 def main():
 
 	# Phase1 : parse api function prototype from "icd_dispatch.cpp" to "trace.in"
@@ -130,4 +132,101 @@ def main():
 	rclFile.close()
 	wicdFile.close()
 
-main()
+# FNV-1a over the entry point name, perturbed by seed; must match
+# khrIcdEntryPointHash() in icd_dispatch.cpp and clTraceFuncId() in clTrace.h
+def entryPointHash(name, seed):
+	h = (2166136261 ^ seed) & 0xffffffff
+	for c in name:
+		h ^= ord(c)
+		h = (h * 16777619) & 0xffffffff
+	return h
+
+# Generate "icd_entrypoints.h", a collision free hash table over every name
+# listed in KHR_ICD_EXTENSION_ENTRYPOINTS in "icd_dispatch.cpp"
+def genEntryPoints():
+	names = []
+	inList = False
+	for line in open( "icd_dispatch.cpp", "r" ):
+		line = line.strip()
+		if line.startswith("#define KHR_ICD_EXTENSION_ENTRYPOINTS("):
+			inList = True
+			continue
+		if not inList:
+			continue
+		if line.startswith("X(") and line.find(")") != -1:
+			names.append(line[2:line.find(")")])
+		if not line.endswith("\\"):
+			break
+
+	size = 1
+	while size < len(names) * 2:
+		size *= 2
+
+	# search for the first seed which maps every name to its own slot
+	seed = 0
+	while True:
+		slots = [None] * size
+		for name in names:
+			slot = entryPointHash(name, seed) & (size - 1)
+			if slots[slot] is not None:
+				break
+			slots[slot] = name
+		else:
+			break
+		seed += 1
+
+	wFile = open( "icd_entrypoints.h", "w" )
+	# reuse the license header of the dispatch source
+	wFile.write(open( "icd_dispatch.cpp", "r" ).read().split("*/", 1)[0] + "*/\n\n")
+	wFile.write("// Generated by parseCLAPI.py --entrypoints, do not edit.\n\n")
+	wFile.write("#ifndef _ICD_ENTRYPOINTS_H_\n#define _ICD_ENTRYPOINTS_H_\n\n")
+	wFile.write("#define KHR_ICD_ENTRYPOINT_HASH_SEED 0x%xu\n" % seed)
+	wFile.write("#define KHR_ICD_ENTRYPOINT_TABLE_SIZE %d\n\n" % size)
+	wFile.write("// expands to one KHR_ICD_ENTRYPOINT(name) or KHR_ICD_ENTRYPOINT_EMPTY per slot\n")
+	wFile.write("#define KHR_ICD_ENTRYPOINT_TABLE \\\n")
+	for i in range(size):
+		if slots[i] is None:
+			wFile.write("    KHR_ICD_ENTRYPOINT_EMPTY")
+		else:
+			wFile.write("    KHR_ICD_ENTRYPOINT(%s)" % slots[i])
+		wFile.write(", \\\n" if i != size - 1 else "\n")
+	wFile.write("\n#endif // _ICD_ENTRYPOINTS_H_\n")
+	wFile.close()
+
+	print( "entry points: ", len(names), " table size: ", size, " seed: ", seed )
+
+# Decode binary trace files written with debug.ocl.trace=binary, the layout
+# must match CLTraceRecord in clTrace.h
+def decodeTrace(paths):
+	import re
+	import struct
+
+	maxArgs = 14
+	recordFormat = "<IIQQII%dQ" % maxArgs
+	recordSize = struct.calcsize(recordFormat)
+
+	# map clTraceFuncId() back to the API name and its argument types
+	apis = {}
+	for line in open( "icd_dispatch.cpp", "r" ):
+		m = re.match(r"CL_TRACE_CALL\s*\(\s*(\w+)\s*,\s*\d+(.*)\)", line.strip())
+		if m:
+			apis[entryPointHash(m.group(1), 0)] = (m.group(1), re.findall(r'"([^"]*)"', m.group(2)))
+
+	for path in paths:
+		data = open(path, "rb").read()
+		for offset in range(0, len(data) - recordSize + 1, recordSize):
+			funcId, tid, timestamp, duration, numArgs, reserved, *args = struct.unpack_from(recordFormat, data, offset)
+			name, types = apis.get(funcId, ("<0x%08x>" % funcId, []))
+			argList = []
+			for i in range(numArgs):
+				argType = types[i] if i < len(types) else "?"
+				argList.append("(%s) 0x%x" % (argType, args[i]))
+			print("%d.%09d %5d %s( %s ) %d ns" % (timestamp // 1000000000, timestamp % 1000000000,
+				tid, name, ", ".join(argList), duration))
+
+if len(sys.argv) > 1 and sys.argv[1] == "--entrypoints":
+	genEntryPoints()
+elif len(sys.argv) > 2 and sys.argv[1] == "--decode":
+	decodeTrace(sys.argv[2:])
+else:
+	main()
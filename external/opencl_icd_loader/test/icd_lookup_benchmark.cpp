@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <benchmark/benchmark.h>
+
+#include "icd.h"
+#include "icd_stub_vendor.h"
+
+namespace {
+
+// Loader-exported entry points, looked up by GL/EGL interop code
+const char* const kLoaderEntryPoints[] = {
+    "clCreateFromGLBuffer",
+    "clCreateFromEGLImageKHR",
+    "clGetGLContextInfoKHR",
+    "clEnqueueAcquireEGLObjectsKHR",
+    "clCreateSubDevicesEXT",
+    "clGetKernelSubGroupInfoKHR",
+};
+
+#define COUNT_OF(array) (sizeof(array) / sizeof((array)[0]))
+
+// The suffix walk clGetExtensionFunctionAddress made for every vendor name
+// before results were cached
+void* vendorSuffixWalk(const char* function_name) {
+    size_t function_name_length = strlen(function_name);
+    for (KHRicdVendor* vendor = khrIcdVendors; vendor; vendor = vendor->next) {
+        size_t suffix_length = strlen(vendor->suffix);
+        if (suffix_length > 0 && suffix_length <= function_name_length &&
+            !strcmp(function_name + function_name_length - suffix_length, vendor->suffix)) {
+            return vendor->clGetExtensionFunctionAddress(function_name);
+        }
+    }
+    return NULL;
+}
+
+void BM_LoaderEntryPoint(benchmark::State& state) {
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+            clGetExtensionFunctionAddress(kLoaderEntryPoints[i++ % COUNT_OF(kLoaderEntryPoints)]));
+    }
+}
+BENCHMARK(BM_LoaderEntryPoint);
+
+void BM_VendorEntryPoint(benchmark::State& state) {
+    unsigned int i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(clGetExtensionFunctionAddress(
+            stubVendorExtensionName(i++ % STUB_VENDOR_EXTENSION_COUNT)));
+    }
+    state.counters["vendor_calls"] = stubVendorLookupCount();
+}
+BENCHMARK(BM_VendorEntryPoint);
+
+void BM_VendorEntryPointUncached(benchmark::State& state) {
+    unsigned int i = 0;
+    khrIcdInitialize();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+            vendorSuffixWalk(stubVendorExtensionName(i++ % STUB_VENDOR_EXTENSION_COUNT)));
+    }
+}
+BENCHMARK(BM_VendorEntryPointUncached);
+
+void BM_UnknownName(benchmark::State& state) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(clGetExtensionFunctionAddress("clNoSuchExtension" STUB_VENDOR_SUFFIX));
+    }
+}
+BENCHMARK(BM_UnknownName);
+
+void BM_UnknownNameUncached(benchmark::State& state) {
+    khrIcdInitialize();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(vendorSuffixWalk("clNoSuchExtension" STUB_VENDOR_SUFFIX));
+    }
+}
+BENCHMARK(BM_UnknownNameUncached);
+
+}  // namespace
+
+BENCHMARK_MAIN();
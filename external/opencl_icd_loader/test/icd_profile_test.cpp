@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "icd.h"
+#include "icd_stub_vendor.h"
+
+namespace {
+
+// One line of khrIcdProfileDump
+struct Stats {
+    bool found = false;
+    unsigned long long count = 0, failed = 0, waitNs = 0, execNs = 0, maxExecNs = 0;
+    long long depth = 0, maxDepth = 0;
+};
+
+std::string dump() {
+    FILE* file = tmpfile();
+    std::string text;
+    char buffer[4096];
+    size_t length;
+
+    khrIcdProfileDump(fileno(file));
+    rewind(file);
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) text.append(buffer, length);
+    fclose(file);
+    return text;
+}
+
+Stats statsOf(const std::string& name, const std::string& text = dump()) {
+    Stats stats;
+    size_t pos = text.find("  " + name + " ");
+
+    if (pos == std::string::npos) return stats;
+    stats.found = true;
+    sscanf(text.c_str() + pos + 2 + name.size(),
+           " count %llu failed %llu avg wait %llu ns avg exec %llu ns max exec %llu ns depth %lld max depth %lld",
+           &stats.count, &stats.failed, &stats.waitNs, &stats.execNs, &stats.maxExecNs, &stats.depth,
+           &stats.maxDepth);
+    return stats;
+}
+
+std::string queueName(cl_command_queue queue) {
+    char name[64];
+    snprintf(name, sizeof(name), "queue %p", (void*)queue);
+    return name;
+}
+
+}  // namespace
+
+class IcdProfileTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        sCLProfileEnabled = CL_TRUE;
+        context_ = stubVendorContext();
+    }
+
+    void TearDown() override {
+        stubVendorCompleteCommands(~0u, CL_COMPLETE, 0, 0);
+        EXPECT_EQ(0u, stubVendorLiveEvents());
+        sCLProfileEnabled = CL_FALSE;
+    }
+
+    cl_command_queue createQueue() {
+        cl_int error = CL_INVALID_VALUE;
+        cl_command_queue queue = clCreateCommandQueue(context_, NULL, 0, &error);
+        EXPECT_EQ(CL_SUCCESS, error);
+        return queue;
+    }
+
+    cl_int enqueueKernel(cl_command_queue queue, cl_kernel kernel, cl_event* event = NULL) {
+        size_t size = 64;
+        return clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &size, NULL, 0, NULL, event);
+    }
+
+    cl_context context_;
+};
+
+TEST_F(IcdProfileTest, QueuesAreCreatedWithProfiling) {
+    cl_command_queue_properties properties = 0;
+    cl_command_queue queue = createQueue();
+    ASSERT_EQ(CL_SUCCESS, clGetCommandQueueInfo(queue, CL_QUEUE_PROPERTIES, sizeof(properties),
+                                                &properties, NULL));
+    EXPECT_TRUE(properties & CL_QUEUE_PROFILING_ENABLE);
+    clReleaseCommandQueue(queue);
+
+    const cl_queue_properties list[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE, 0};
+    cl_int error = CL_INVALID_VALUE;
+    queue = clCreateCommandQueueWithProperties(context_, NULL, list, &error);
+    ASSERT_EQ(CL_SUCCESS, error);
+    ASSERT_EQ(CL_SUCCESS, clGetCommandQueueInfo(queue, CL_QUEUE_PROPERTIES, sizeof(properties),
+                                                &properties, NULL));
+    EXPECT_EQ(CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE | CL_QUEUE_PROFILING_ENABLE, properties);
+    clReleaseCommandQueue(queue);
+}
+
+TEST_F(IcdProfileTest, KernelTimesAreRecorded) {
+    cl_command_queue queue = createQueue();
+    cl_kernel kernel = stubVendorCreateKernel("timed_kernel");
+
+    for (int i = 0; i < 3; i++) ASSERT_EQ(CL_SUCCESS, enqueueKernel(queue, kernel));
+    // the loader holds the kernel until each command completes
+    EXPECT_EQ(4u, stubVendorKernelReferences(kernel));
+    EXPECT_EQ(3u, stubVendorCompleteCommands(3, CL_COMPLETE, 2000, 5000));
+    EXPECT_EQ(1u, stubVendorKernelReferences(kernel));
+
+    Stats stats = statsOf("timed_kernel");
+    ASSERT_TRUE(stats.found);
+    EXPECT_EQ(3u, stats.count);
+    EXPECT_EQ(0u, stats.failed);
+    EXPECT_EQ(2000u, stats.waitNs);
+    EXPECT_EQ(5000u, stats.execNs);
+    EXPECT_EQ(5000u, stats.maxExecNs);
+
+    stats = statsOf(queueName(queue));
+    ASSERT_TRUE(stats.found);
+    EXPECT_EQ(3u, stats.count);
+    EXPECT_EQ(0, stats.depth);
+    EXPECT_EQ(3, stats.maxDepth);
+
+    clReleaseKernel(kernel);
+    clReleaseCommandQueue(queue);
+}
+
+TEST_F(IcdProfileTest, TransfersAreKeyedByCommand) {
+    cl_command_queue queue = createQueue();
+    char data[16];
+
+    ASSERT_EQ(CL_SUCCESS, clEnqueueReadBuffer(queue, NULL, CL_FALSE, 0, sizeof(data), data, 0, NULL, NULL));
+    stubVendorCompleteCommands(1, CL_COMPLETE, 0, 100);
+    Stats stats = statsOf("clEnqueueReadBuffer");
+    ASSERT_TRUE(stats.found);
+    EXPECT_GE(stats.count, 1u);
+    clReleaseCommandQueue(queue);
+}
+
+TEST_F(IcdProfileTest, CallerKeepsItsEvent) {
+    cl_command_queue queue = createQueue();
+    cl_kernel kernel = stubVendorCreateKernel("event_kernel");
+    cl_event event = NULL;
+
+    ASSERT_EQ(CL_SUCCESS, enqueueKernel(queue, kernel, &event));
+    ASSERT_NE(nullptr, event);
+    // the stub's, the caller's and the profiling callback's
+    EXPECT_EQ(3u, stubVendorEventReferences(event));
+    stubVendorCompleteCommands(1, CL_COMPLETE, 0, 100);
+    EXPECT_EQ(1u, stubVendorEventReferences(event));
+    clReleaseEvent(event);
+
+    clReleaseKernel(kernel);
+    clReleaseCommandQueue(queue);
+}
+
+TEST_F(IcdProfileTest, FailedCommandsAreCounted) {
+    cl_command_queue queue = createQueue();
+    cl_kernel kernel = stubVendorCreateKernel("failing_kernel");
+
+    ASSERT_EQ(CL_SUCCESS, enqueueKernel(queue, kernel));
+    stubVendorCompleteCommands(1, CL_OUT_OF_RESOURCES, 0, 100);
+    Stats stats = statsOf("failing_kernel");
+    EXPECT_EQ(0u, stats.count);
+    EXPECT_EQ(1u, stats.failed);
+    EXPECT_EQ(1u, stubVendorKernelReferences(kernel));
+
+    clReleaseKernel(kernel);
+    clReleaseCommandQueue(queue);
+}
+
+TEST_F(IcdProfileTest, ReleasedQueueIsForgotten) {
+    cl_command_queue queue = createQueue();
+    cl_kernel kernel = stubVendorCreateKernel("recycled_kernel");
+
+    ASSERT_EQ(CL_SUCCESS, enqueueKernel(queue, kernel));
+    stubVendorCompleteCommands(1, CL_COMPLETE, 0, 100);
+    ASSERT_EQ(1u, statsOf(queueName(queue)).count);
+
+    // a retained queue is still alive
+    clRetainCommandQueue(queue);
+    clReleaseCommandQueue(queue);
+    EXPECT_TRUE(statsOf(queueName(queue)).found);
+
+    clReleaseCommandQueue(queue);
+    EXPECT_FALSE(statsOf(queueName(queue)).found);
+
+    // the vendor hands the same handle to the next queue
+    stubVendorReuseQueue(queue);
+    cl_command_queue reused = createQueue();
+    ASSERT_EQ(queue, reused);
+    ASSERT_EQ(CL_SUCCESS, enqueueKernel(reused, kernel));
+    stubVendorCompleteCommands(1, CL_COMPLETE, 0, 100);
+    Stats stats = statsOf(queueName(reused));
+    EXPECT_EQ(1u, stats.count);
+    EXPECT_EQ(1, stats.maxDepth);
+
+    clReleaseKernel(kernel);
+    clReleaseCommandQueue(reused);
+}
+
+TEST_F(IcdProfileTest, ReleasedQueuesDoNotFillTheTable) {
+    cl_kernel kernel = stubVendorCreateKernel("churn_kernel");
+
+    // far more queues over time than the table has slots, 100 at a time
+    for (int round = 0; round < 10; round++) {
+        std::vector<cl_command_queue> queues;
+        for (int i = 0; i < 100; i++) {
+            queues.push_back(createQueue());
+            ASSERT_EQ(CL_SUCCESS, enqueueKernel(queues.back(), kernel));
+        }
+        stubVendorCompleteCommands(~0u, CL_COMPLETE, 0, 100);
+        std::string text = dump();
+        for (cl_command_queue queue : queues) {
+            ASSERT_EQ(1u, statsOf(queueName(queue), text).count) << "round " << round;
+        }
+        for (cl_command_queue queue : queues) clReleaseCommandQueue(queue);
+    }
+
+    clReleaseKernel(kernel);
+}
+
+TEST_F(IcdProfileTest, QueueReleasedWithCommandsInFlight) {
+    cl_command_queue queue = createQueue();
+    cl_kernel kernel = stubVendorCreateKernel("inflight_kernel");
+
+    ASSERT_EQ(CL_SUCCESS, enqueueKernel(queue, kernel));
+    clReleaseCommandQueue(queue);
+
+    // the retired slot is still counting, a queue on the same handle must
+    // not pick it up
+    stubVendorReuseQueue(queue);
+    cl_command_queue reused = createQueue();
+    ASSERT_EQ(queue, reused);
+    stubVendorCompleteCommands(1, CL_COMPLETE, 0, 100);
+    EXPECT_FALSE(statsOf(queueName(reused)).found);
+
+    clReleaseKernel(kernel);
+    clReleaseCommandQueue(reused);
+}
+
+TEST_F(IcdProfileTest, DisabledLeavesCommandsAlone) {
+    sCLProfileEnabled = CL_FALSE;
+    cl_command_queue queue = createQueue();
+    cl_kernel kernel = stubVendorCreateKernel("unprofiled_kernel");
+
+    ASSERT_EQ(CL_SUCCESS, enqueueKernel(queue, kernel));
+    EXPECT_EQ(1u, stubVendorKernelReferences(kernel));
+    stubVendorCompleteCommands(1, CL_COMPLETE, 0, 100);
+    EXPECT_FALSE(statsOf("unprofiled_kernel").found);
+
+    clReleaseKernel(kernel);
+    clReleaseCommandQueue(queue);
+}
@@ -0,0 +1,570 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "icd.h"
+#include "icd_dispatch.h"
+#include "icd_stub_vendor.h"
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <atomic>
+
+#define STUB_LIBRARY_NAME "libOpenCL_stub.so"
+
+static pthread_once_t initialized = PTHREAD_ONCE_INIT;
+static KHRicdVendorDispatch stubDispatch;
+static struct _cl_platform_id stubPlatform = { &stubDispatch };
+static int stubLibrary;
+
+static char stubExtensionNames[STUB_VENDOR_EXTENSION_COUNT][32];
+static std::atomic<unsigned int> stubLookups(0);
+
+const char *stubVendorExtensionName(unsigned int i)
+{
+    return stubExtensionNames[i];
+}
+
+unsigned int stubVendorLookupCount(void)
+{
+    return stubLookups.load();
+}
+
+static void stubExtensionFunction(void)
+{
+}
+
+static cl_int CL_API_CALL stubIcdGetPlatformIDs(
+    cl_uint num_entries,
+    cl_platform_id *platforms,
+    cl_uint *num_platforms)
+{
+    if (num_entries && platforms)
+    {
+        platforms[0] = &stubPlatform;
+    }
+    if (num_platforms)
+    {
+        *num_platforms = 1;
+    }
+    return CL_SUCCESS;
+}
+
+static cl_int CL_API_CALL stubGetPlatformInfo(
+    cl_platform_id platform,
+    cl_platform_info param_name,
+    size_t param_value_size,
+    void *param_value,
+    size_t *param_value_size_ret)
+{
+    (void)platform;
+    if (CL_PLATFORM_ICD_SUFFIX_KHR != param_name)
+    {
+        return CL_INVALID_VALUE;
+    }
+    if (param_value_size_ret)
+    {
+        *param_value_size_ret = sizeof(STUB_VENDOR_SUFFIX);
+    }
+    if (param_value)
+    {
+        if (param_value_size < sizeof(STUB_VENDOR_SUFFIX))
+        {
+            return CL_INVALID_VALUE;
+        }
+        memcpy(param_value, STUB_VENDOR_SUFFIX, sizeof(STUB_VENDOR_SUFFIX));
+    }
+    return CL_SUCCESS;
+}
+
+// a driver resolves its extensions with a strcmp walk, as the stub does
+static void * CL_API_CALL stubGetExtensionFunctionAddress(const char *function_name)
+{
+    unsigned int i;
+
+    stubLookups.fetch_add(1);
+    if (!strcmp(function_name, "clIcdGetPlatformIDsKHR"))
+    {
+        return (void *)(size_t)&stubIcdGetPlatformIDs;
+    }
+    for (i = 0; i < STUB_VENDOR_EXTENSION_COUNT; ++i)
+    {
+        if (!strcmp(function_name, stubExtensionNames[i]))
+        {
+            return (void *)(size_t)&stubExtensionFunction;
+        }
+    }
+    return NULL;
+}
+
+/*
+ *
+ * Queues, kernels and events
+ *
+ */
+
+#define STUB_QUEUE_POOL_SIZE 1024
+
+typedef struct
+{
+    struct _cl_command_queue base;
+    cl_uint references;
+    cl_command_queue_properties properties;
+} StubQueue;
+
+typedef struct
+{
+    struct _cl_kernel base;
+    cl_uint references;
+    char name[64];
+} StubKernel;
+
+typedef struct
+{
+    void (CL_CALLBACK *notify)(cl_event, cl_int, void *);
+    void *userData;
+} StubEventCallback;
+
+typedef struct StubEventRec
+{
+    struct _cl_event base;
+    cl_uint references;
+    StubQueue *queue;
+    cl_int status;
+    cl_ulong queued, start, end;
+    StubEventCallback callbacks[4];
+    cl_uint callbackCount;
+    struct StubEventRec *next;      // pending commands
+} StubEvent;
+
+static struct _cl_context stubContext = { &stubDispatch };
+static StubQueue stubQueues[STUB_QUEUE_POOL_SIZE];
+static unsigned int stubQueueNext;
+static StubQueue *stubQueueReused;
+static StubEvent *stubPendingHead;
+static StubEvent *stubPendingTail;
+static unsigned int stubLiveEvents;
+static cl_ulong stubClockNs = 1000;
+
+static void stubReleaseEventInternal(StubEvent *event)
+{
+    if (--event->references == 0)
+    {
+        delete event;
+        stubLiveEvents--;
+    }
+}
+
+static cl_command_queue stubCreateQueue(cl_command_queue_properties properties, cl_int *errcode_ret)
+{
+    StubQueue *queue = NULL;
+    unsigned int i;
+
+    if (stubQueueReused && !stubQueueReused->references)
+    {
+        queue = stubQueueReused;
+    }
+    // hand out every pool entry in turn, so handles differ between queues
+    for (i = 0; !queue && i < STUB_QUEUE_POOL_SIZE; ++i)
+    {
+        StubQueue *candidate = &stubQueues[stubQueueNext++ % STUB_QUEUE_POOL_SIZE];
+        if (!candidate->references)
+        {
+            queue = candidate;
+        }
+    }
+    stubQueueReused = NULL;
+    if (!queue)
+    {
+        if (errcode_ret)
+        {
+            *errcode_ret = CL_OUT_OF_HOST_MEMORY;
+        }
+        return NULL;
+    }
+    queue->base.dispatch = &stubDispatch;
+    queue->references = 1;
+    queue->properties = properties;
+    if (errcode_ret)
+    {
+        *errcode_ret = CL_SUCCESS;
+    }
+    return &queue->base;
+}
+
+static cl_command_queue CL_API_CALL stubCreateCommandQueue(
+    cl_context context,
+    cl_device_id device,
+    cl_command_queue_properties properties,
+    cl_int *errcode_ret)
+{
+    (void)context;
+    (void)device;
+    return stubCreateQueue(properties, errcode_ret);
+}
+
+static cl_command_queue CL_API_CALL stubCreateCommandQueueWithProperties(
+    cl_context context,
+    cl_device_id device,
+    const cl_queue_properties *properties,
+    cl_int *errcode_ret)
+{
+    cl_command_queue_properties queueProperties = 0;
+
+    (void)context;
+    (void)device;
+    for (; properties && properties[0]; properties += 2)
+    {
+        if (CL_QUEUE_PROPERTIES == properties[0])
+        {
+            queueProperties = properties[1];
+        }
+    }
+    return stubCreateQueue(queueProperties, errcode_ret);
+}
+
+static cl_int CL_API_CALL stubRetainCommandQueue(cl_command_queue command_queue)
+{
+    ((StubQueue *)command_queue)->references++;
+    return CL_SUCCESS;
+}
+
+static cl_int CL_API_CALL stubReleaseCommandQueue(cl_command_queue command_queue)
+{
+    ((StubQueue *)command_queue)->references--;
+    return CL_SUCCESS;
+}
+
+static cl_int CL_API_CALL stubGetCommandQueueInfo(
+    cl_command_queue command_queue,
+    cl_command_queue_info param_name,
+    size_t param_value_size,
+    void *param_value,
+    size_t *param_value_size_ret)
+{
+    StubQueue *queue = (StubQueue *)command_queue;
+
+    (void)param_value_size_ret;
+    if (CL_QUEUE_REFERENCE_COUNT == param_name && param_value_size == sizeof(cl_uint))
+    {
+        *(cl_uint *)param_value = queue->references;
+        return CL_SUCCESS;
+    }
+    if (CL_QUEUE_PROPERTIES == param_name && param_value_size == sizeof(cl_command_queue_properties))
+    {
+        *(cl_command_queue_properties *)param_value = queue->properties;
+        return CL_SUCCESS;
+    }
+    return CL_INVALID_VALUE;
+}
+
+static cl_int CL_API_CALL stubRetainKernel(cl_kernel kernel)
+{
+    ((StubKernel *)kernel)->references++;
+    return CL_SUCCESS;
+}
+
+static cl_int CL_API_CALL stubReleaseKernel(cl_kernel kernel)
+{
+    StubKernel *stubKernel = (StubKernel *)kernel;
+
+    if (--stubKernel->references == 0)
+    {
+        delete stubKernel;
+    }
+    return CL_SUCCESS;
+}
+
+static cl_int CL_API_CALL stubGetKernelInfo(
+    cl_kernel kernel,
+    cl_kernel_info param_name,
+    size_t param_value_size,
+    void *param_value,
+    size_t *param_value_size_ret)
+{
+    StubKernel *stubKernel = (StubKernel *)kernel;
+
+    (void)param_value_size_ret;
+    if (CL_KERNEL_FUNCTION_NAME != param_name || param_value_size <= strlen(stubKernel->name))
+    {
+        return CL_INVALID_VALUE;
+    }
+    strcpy((char *)param_value, stubKernel->name);
+    return CL_SUCCESS;
+}
+
+// queue a command, the stub keeps one reference on its event until it
+// completes and the caller gets another one if it asked for the event
+static cl_int stubEnqueue(cl_command_queue command_queue, cl_event *event)
+{
+    StubEvent *stubEvent = new StubEvent();
+
+    stubLiveEvents++;
+    stubEvent->base.dispatch = &stubDispatch;
+    stubEvent->references = 1;
+    stubEvent->queue = (StubQueue *)command_queue;
+    stubEvent->status = CL_QUEUED;
+    stubEvent->queued = stubClockNs;
+    if (stubPendingTail)
+    {
+        stubPendingTail->next = stubEvent;
+    }
+    else
+    {
+        stubPendingHead = stubEvent;
+    }
+    stubPendingTail = stubEvent;
+    if (event)
+    {
+        stubEvent->references++;
+        *event = &stubEvent->base;
+    }
+    return CL_SUCCESS;
+}
+
+static cl_int CL_API_CALL stubEnqueueNDRangeKernel(
+    cl_command_queue command_queue,
+    cl_kernel kernel,
+    cl_uint work_dim,
+    const size_t *global_work_offset,
+    const size_t *global_work_size,
+    const size_t *local_work_size,
+    cl_uint num_events_in_wait_list,
+    const cl_event *event_wait_list,
+    cl_event *event)
+{
+    (void)kernel;
+    (void)work_dim;
+    (void)global_work_offset;
+    (void)global_work_size;
+    (void)local_work_size;
+    (void)num_events_in_wait_list;
+    (void)event_wait_list;
+    return stubEnqueue(command_queue, event);
+}
+
+static cl_int CL_API_CALL stubEnqueueReadBuffer(
+    cl_command_queue command_queue,
+    cl_mem buffer,
+    cl_bool blocking_read,
+    size_t offset,
+    size_t cb,
+    void *ptr,
+    cl_uint num_events_in_wait_list,
+    const cl_event *event_wait_list,
+    cl_event *event)
+{
+    (void)buffer;
+    (void)blocking_read;
+    (void)offset;
+    (void)cb;
+    (void)ptr;
+    (void)num_events_in_wait_list;
+    (void)event_wait_list;
+    return stubEnqueue(command_queue, event);
+}
+
+static cl_int CL_API_CALL stubRetainEvent(cl_event event)
+{
+    ((StubEvent *)event)->references++;
+    return CL_SUCCESS;
+}
+
+static cl_int CL_API_CALL stubReleaseEvent(cl_event event)
+{
+    stubReleaseEventInternal((StubEvent *)event);
+    return CL_SUCCESS;
+}
+
+static cl_int CL_API_CALL stubSetEventCallback(
+    cl_event event,
+    cl_int command_exec_callback_type,
+    void (CL_CALLBACK *pfn_notify)(cl_event, cl_int, void *),
+    void *user_data)
+{
+    StubEvent *stubEvent = (StubEvent *)event;
+
+    if (CL_COMPLETE != command_exec_callback_type || stubEvent->callbackCount == 4)
+    {
+        return CL_INVALID_VALUE;
+    }
+    stubEvent->callbacks[stubEvent->callbackCount].notify = pfn_notify;
+    stubEvent->callbacks[stubEvent->callbackCount].userData = user_data;
+    stubEvent->callbackCount++;
+    return CL_SUCCESS;
+}
+
+static cl_int CL_API_CALL stubGetEventProfilingInfo(
+    cl_event event,
+    cl_profiling_info param_name,
+    size_t param_value_size,
+    void *param_value,
+    size_t *param_value_size_ret)
+{
+    StubEvent *stubEvent = (StubEvent *)event;
+    cl_ulong value;
+
+    (void)param_value_size_ret;
+    if (!(stubEvent->queue->properties & CL_QUEUE_PROFILING_ENABLE) || stubEvent->status != CL_COMPLETE)
+    {
+        return CL_PROFILING_INFO_NOT_AVAILABLE;
+    }
+    switch (param_name)
+    {
+    case CL_PROFILING_COMMAND_QUEUED:
+        value = stubEvent->queued;
+        break;
+    case CL_PROFILING_COMMAND_START:
+        value = stubEvent->start;
+        break;
+    case CL_PROFILING_COMMAND_END:
+        value = stubEvent->end;
+        break;
+    default:
+        return CL_INVALID_VALUE;
+    }
+    if (param_value_size != sizeof(value))
+    {
+        return CL_INVALID_VALUE;
+    }
+    memcpy(param_value, &value, sizeof(value));
+    return CL_SUCCESS;
+}
+
+cl_context stubVendorContext(void)
+{
+    khrIcdOsVendorsEnumerateOnce();
+    return &stubContext;
+}
+
+cl_kernel stubVendorCreateKernel(const char *name)
+{
+    StubKernel *kernel = new StubKernel();
+
+    kernel->base.dispatch = &stubDispatch;
+    kernel->references = 1;
+    strncpy(kernel->name, name, sizeof(kernel->name) - 1);
+    return &kernel->base;
+}
+
+cl_uint stubVendorKernelReferences(cl_kernel kernel)
+{
+    return ((StubKernel *)kernel)->references;
+}
+
+void stubVendorReuseQueue(cl_command_queue queue)
+{
+    stubQueueReused = (StubQueue *)queue;
+}
+
+unsigned int stubVendorCompleteCommands(unsigned int count, cl_int status, cl_ulong waitNs, cl_ulong execNs)
+{
+    unsigned int completed = 0;
+
+    while (completed < count && stubPendingHead)
+    {
+        StubEvent *event = stubPendingHead;
+        cl_uint i;
+
+        stubPendingHead = event->next;
+        if (!stubPendingHead)
+        {
+            stubPendingTail = NULL;
+        }
+        event->start = event->queued + waitNs;
+        event->end = event->start + execNs;
+        event->status = status < 0 ? status : CL_COMPLETE;
+        stubClockNs = event->end;
+        for (i = 0; i < event->callbackCount; ++i)
+        {
+            event->callbacks[i].notify(&event->base, event->status, event->callbacks[i].userData);
+        }
+        stubReleaseEventInternal(event);
+        completed++;
+    }
+    return completed;
+}
+
+unsigned int stubVendorLiveEvents(void)
+{
+    return stubLiveEvents;
+}
+
+cl_uint stubVendorEventReferences(cl_event event)
+{
+    return ((StubEvent *)event)->references;
+}
+
+/*
+ *
+ * OS layer
+ *
+ */
+
+static void khrIcdOsVendorsEnumerate(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < STUB_VENDOR_EXTENSION_COUNT; ++i)
+    {
+        snprintf(stubExtensionNames[i], sizeof(stubExtensionNames[i]), "clStubExtension%u" STUB_VENDOR_SUFFIX, i);
+    }
+    stubDispatch.clGetPlatformInfo = stubGetPlatformInfo;
+    stubDispatch.clCreateCommandQueue = stubCreateCommandQueue;
+    stubDispatch.clCreateCommandQueueWithProperties = stubCreateCommandQueueWithProperties;
+    stubDispatch.clRetainCommandQueue = stubRetainCommandQueue;
+    stubDispatch.clReleaseCommandQueue = stubReleaseCommandQueue;
+    stubDispatch.clGetCommandQueueInfo = stubGetCommandQueueInfo;
+    stubDispatch.clRetainKernel = stubRetainKernel;
+    stubDispatch.clReleaseKernel = stubReleaseKernel;
+    stubDispatch.clGetKernelInfo = stubGetKernelInfo;
+    stubDispatch.clEnqueueNDRangeKernel = stubEnqueueNDRangeKernel;
+    stubDispatch.clEnqueueReadBuffer = stubEnqueueReadBuffer;
+    stubDispatch.clRetainEvent = stubRetainEvent;
+    stubDispatch.clReleaseEvent = stubReleaseEvent;
+    stubDispatch.clSetEventCallback = stubSetEventCallback;
+    stubDispatch.clGetEventProfilingInfo = stubGetEventProfilingInfo;
+    khrIcdVendorAdd(STUB_LIBRARY_NAME);
+    stubLookups.store(0);
+}
+
+void khrIcdOsVendorsEnumerateOnce(void)
+{
+    pthread_once(&initialized, khrIcdOsVendorsEnumerate);
+}
+
+void *khrIcdOsLibraryLoad(const char *libraryName)
+{
+    return strcmp(libraryName, STUB_LIBRARY_NAME) ? NULL : &stubLibrary;
+}
+
+void *khrIcdOsLibraryGetFunctionAddress(void *library, const char *functionName)
+{
+    if (library != &stubLibrary || strcmp(functionName, "clGetExtensionFunctionAddress"))
+    {
+        return NULL;
+    }
+    return (void *)(size_t)&stubGetExtensionFunctionAddress;
+}
+
+void khrIcdOsLibraryUnload(void *library)
+{
+    (void)library;
+}
+
+// profiling is switched on by the tests through sCLProfileEnabled
+void initCLProfile(void)
+{
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ICD_STUB_VENDOR_H_
+#define _ICD_STUB_VENDOR_H_
+
+#include <CL/cl.h>
+
+/*
+ * Host replacement for icd_mtk.cpp: the loader enumerates a single stub
+ * vendor linked into the test binary instead of dlopen'ing GPU drivers.
+ */
+
+// suffix of the stub platform
+#define STUB_VENDOR_SUFFIX "MTK"
+
+// extension entry points the stub vendor exports, all ending in the suffix
+#define STUB_VENDOR_EXTENSION_COUNT 48
+
+// name of stub extension i, valid until the process exits
+const char *stubVendorExtensionName(unsigned int i);
+
+// number of clGetExtensionFunctionAddress calls that reached the vendor
+unsigned int stubVendorLookupCount(void);
+
+// context whose queues, kernels and events come from the stub vendor.
+// the stub is single threaded: commands complete only in
+// stubVendorCompleteCommands, on the calling thread
+cl_context stubVendorContext(void);
+
+// kernel named name, with one reference owned by the caller
+cl_kernel stubVendorCreateKernel(const char *name);
+cl_uint stubVendorKernelReferences(cl_kernel kernel);
+
+// let the next created queue reuse the handle of released queue, as a
+// driver recycling its allocations would
+void stubVendorReuseQueue(cl_command_queue queue);
+
+// complete the count oldest pending commands with status: each one waits
+// waitNs in the queue and runs for execNs.  returns the number completed
+unsigned int stubVendorCompleteCommands(unsigned int count, cl_int status, cl_ulong waitNs, cl_ulong execNs);
+
+// events not destroyed yet, and the references held on one of them
+unsigned int stubVendorLiveEvents(void);
+cl_uint stubVendorEventReferences(cl_event event);
+
+#endif
@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host test of vendor enumeration: the OS layer here stands in for
+ * icd_mtk.cpp with a search list of fake libraries, each exposing one
+ * platform whose query takes as long as a GPU driver initializing.
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "icd.h"
+#include "icd_dispatch.h"
+
+namespace {
+
+// how long each library takes to answer clIcdGetPlatformIDsKHR
+constexpr int kProbeDelayMs = 100;
+
+struct FakeLibrary {
+    const char* suffix;
+    KHRicdVendorDispatch dispatch;
+    struct _cl_platform_id platform;
+    std::atomic<int> references;
+};
+
+// libProbeA2.so is another path to libProbeA.so, libMissing.so does not exist
+FakeLibrary gLibraries[] = {
+    {"A", {}, {}, {0}},
+    {"B", {}, {}, {0}},
+    {"C", {}, {}, {0}},
+};
+
+const char* const kSearchList[] = {
+    "libProbeA.so", "libMissing.so", "libProbeB.so", "libProbeA2.so", "libProbeC.so",
+};
+
+std::atomic<int> gLoads(0);
+std::atomic<int> gProbing(0);
+std::atomic<int> gMaxProbing(0);
+pthread_once_t gInitialized = PTHREAD_ONCE_INIT;
+
+FakeLibrary* libraryOf(cl_platform_id platform) {
+    for (FakeLibrary& library : gLibraries) {
+        if (&library.platform == platform) return &library;
+    }
+    return NULL;
+}
+
+template <int N>
+cl_int CL_API_CALL fakeIcdGetPlatformIDs(cl_uint num_entries, cl_platform_id* platforms,
+                                         cl_uint* num_platforms) {
+    int probing = ++gProbing;
+    int max = gMaxProbing.load();
+
+    while (probing > max && !gMaxProbing.compare_exchange_weak(max, probing)) {
+    }
+    if (!platforms) usleep(kProbeDelayMs * 1000);
+    gProbing--;
+
+    if (num_entries && platforms) platforms[0] = &gLibraries[N].platform;
+    if (num_platforms) *num_platforms = 1;
+    return CL_SUCCESS;
+}
+
+template <int N>
+void* CL_API_CALL fakeGetExtensionFunctionAddress(const char* function_name) {
+    if (strcmp(function_name, "clIcdGetPlatformIDsKHR")) return NULL;
+    return (void*)(size_t)&fakeIcdGetPlatformIDs<N>;
+}
+
+cl_int CL_API_CALL fakeGetPlatformInfo(cl_platform_id platform, cl_platform_info param_name,
+                                       size_t param_value_size, void* param_value,
+                                       size_t* param_value_size_ret) {
+    const char* suffix = libraryOf(platform)->suffix;
+    size_t size = strlen(suffix) + 1;
+
+    if (CL_PLATFORM_ICD_SUFFIX_KHR != param_name) return CL_INVALID_VALUE;
+    if (param_value_size_ret) *param_value_size_ret = size;
+    if (param_value) {
+        if (param_value_size < size) return CL_INVALID_VALUE;
+        memcpy(param_value, suffix, size);
+    }
+    return CL_SUCCESS;
+}
+
+void enumerate(void) {
+    for (FakeLibrary& library : gLibraries) {
+        library.dispatch.clGetPlatformInfo = fakeGetPlatformInfo;
+        library.platform.dispatch = &library.dispatch;
+    }
+    khrIcdVendorsAdd(kSearchList, sizeof(kSearchList) / sizeof(kSearchList[0]));
+}
+
+std::string suffixOf(cl_platform_id platform) {
+    char suffix[16] = {};
+    EXPECT_EQ(CL_SUCCESS, clGetPlatformInfo(platform, CL_PLATFORM_ICD_SUFFIX_KHR,
+                                            sizeof(suffix), suffix, NULL));
+    return suffix;
+}
+
+}  // namespace
+
+/*
+ *
+ * OS layer
+ *
+ */
+
+void khrIcdOsVendorsEnumerateOnce(void) {
+    pthread_once(&gInitialized, enumerate);
+}
+
+void* khrIcdOsLibraryLoad(const char* libraryName) {
+    int i;
+
+    gLoads++;
+    if (!strcmp(libraryName, "libProbeA.so") || !strcmp(libraryName, "libProbeA2.so")) {
+        i = 0;
+    } else if (!strcmp(libraryName, "libProbeB.so")) {
+        i = 1;
+    } else if (!strcmp(libraryName, "libProbeC.so")) {
+        i = 2;
+    } else {
+        return NULL;
+    }
+    gLibraries[i].references++;
+    return &gLibraries[i];
+}
+
+void* khrIcdOsLibraryGetFunctionAddress(void* library, const char* functionName) {
+    if (strcmp(functionName, "clGetExtensionFunctionAddress")) return NULL;
+    if (library == &gLibraries[0]) return (void*)(size_t)&fakeGetExtensionFunctionAddress<0>;
+    if (library == &gLibraries[1]) return (void*)(size_t)&fakeGetExtensionFunctionAddress<1>;
+    if (library == &gLibraries[2]) return (void*)(size_t)&fakeGetExtensionFunctionAddress<2>;
+    return NULL;
+}
+
+void khrIcdOsLibraryUnload(void* library) {
+    ((FakeLibrary*)library)->references--;
+}
+
+void initCLProfile(void) {
+}
+
+// runs first: nothing has asked for a platform yet
+TEST(IcdVendorProbeTest, LoaderOnlyCallsOpenNoVendor) {
+    cl_uint count = 0;
+
+    EXPECT_NE(nullptr, clGetExtensionFunctionAddress("clGetGLContextInfoKHR"));
+    EXPECT_EQ(CL_INVALID_VALUE, clGetPlatformIDs(0, NULL, NULL));
+    EXPECT_EQ(CL_INVALID_VALUE, clGetPlatformIDs(0, (cl_platform_id*)&count, &count));
+    EXPECT_EQ(0, gLoads.load());
+}
+
+TEST(IcdVendorProbeTest, LibrariesAreProbedInParallel) {
+    cl_uint count = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_EQ(CL_SUCCESS, clGetPlatformIDs(0, NULL, &count));
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+
+    EXPECT_EQ(3u, count);
+    // four libraries to probe, one after the other that is 400 ms
+    EXPECT_GE(gMaxProbing.load(), 2);
+    EXPECT_LT(elapsed, 3 * kProbeDelayMs);
+}
+
+TEST(IcdVendorProbeTest, PlatformsKeepSearchListOrder) {
+    cl_platform_id platforms[4] = {};
+    cl_uint count = 0;
+
+    ASSERT_EQ(CL_SUCCESS, clGetPlatformIDs(4, platforms, &count));
+    ASSERT_EQ(3u, count);
+    EXPECT_EQ("A", suffixOf(platforms[0]));
+    EXPECT_EQ("B", suffixOf(platforms[1]));
+    EXPECT_EQ("C", suffixOf(platforms[2]));
+}
+
+TEST(IcdVendorProbeTest, OnlyVendorsKeepLibraryReferences) {
+    khrIcdInitialize();
+
+    // one reference per platform, the one libProbeA2.so took is dropped again
+    for (const FakeLibrary& library : gLibraries) {
+        EXPECT_EQ(1, library.references.load()) << library.suffix;
+    }
+}
@@ -102,6 +102,29 @@ struct caliData
     int8_t status;
 };
 /*---------------------------------------------------------------------------*/
+/* calibration samples, one array per axis */
+typedef struct {
+    int         num;
+    long long   *time;
+    float       *x;
+    float       *y;
+    float       *z;
+    unsigned char *diverse;     /* DIVERSE_* flags set by the check */
+} HwmSamples;
+/*---------------------------------------------------------------------------*/
+/* running mean/min/max and sum of squared deviations (Welford) */
+typedef struct {
+    int         num;
+    HwmData     mean;
+    HwmData     min;
+    HwmData     max;
+    HwmData     m2;
+} HwmStats;
+/*---------------------------------------------------------------------------*/
+extern int hwm_samples_alloc(HwmSamples *smp, int count);
+extern void hwm_samples_free(HwmSamples *smp);
+extern int gsensor_read_samples(int fd, int period, int count, HwmSamples *smp, HwmStats *st);
+extern int gyroscope_read_samples(int fd, int period, int count, HwmSamples *smp, HwmStats *st);
 extern int gsensor_calibration(int fd, int period, int count, int tolerance, HwmData *cali);
 extern int gsensor_write_nvram(HwmData *dat);
 extern int gsensor_read_nvram(HwmData *dat);
@@ -301,10 +301,61 @@ int gsensor_init(int fd)
     return 0;
 }
 
+/*---------------------------------------------------------------------------*/
+/* parse the "%x %x %x" text of a READ_SENSORDATA ioctl without sscanf */
+static int libhwm_parse_hex3(const char *buf, int len, int val[3])
+{
+	const char *p = buf, *end = buf + len;
+	int idx;
+
+	for(idx = 0; idx < 3; idx++)
+	{
+		unsigned int v = 0;
+		int neg = 0, digits = 0;
+
+		while(p < end && (*p == ' ' || *p == '\t' || *p == '\n'))
+		{
+			p++;
+		}
+		if(p < end && (*p == '-' || *p == '+'))
+		{
+			neg = (*p++ == '-');
+		}
+		if(p + 2 < end && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+		{
+			p += 2;
+		}
+		for(; p < end; p++, digits++)
+		{
+			unsigned int c = (unsigned char)*p;
+
+			if(c - '0' < 10)
+			{
+				c -= '0';
+			}
+			else if((c | 0x20) - 'a' < 6)
+			{
+				c = (c | 0x20) - 'a' + 10;
+			}
+			else
+			{
+				break;
+			}
+			v = (v << 4) | c;
+		}
+		if(!digits)
+		{
+			return -EINVAL;
+		}
+		val[idx] = neg ? -(int)v : (int)v;
+	}
+	return 0;
+}
+/*---------------------------------------------------------------------------*/
 int gsensor_read(int fd, HwmData *dat)
 {
 	int err;
-	int x, y, z;
+	int val[3];
 	char buf[64];
 	if(fd < 0)
 	{
@@ -316,16 +367,16 @@ int gsensor_read(int fd, HwmData *dat)
 		HWMLOGE("read err: %d %d (%s)\n", fd, err, strerror(errno));
 		return err;
 	}
-	else if(3 != sscanf(buf, "%x %x %x", &x, &y, &z))
+	else if(0 != libhwm_parse_hex3(buf, strnlen(buf, sizeof(buf)), val))
 	{
 		HWMLOGE("parsing error\n");
 		return -EINVAL;
 	}
 	else
 	{
-		dat->x = (float)(x) / 1000;
-		dat->y = (float)(y) / 1000;
-		dat->z = (float)(z) / 1000;
+		dat->x = (float)(val[0]) / 1000;
+		dat->y = (float)(val[1]) / 1000;
+		dat->z = (float)(val[2]) / 1000;
 		return 0;
 	}
 }
@@ -546,156 +597,197 @@ long libhwm_current_ms(void)
 }
 
 /*---------------------------------------------------------------------------*/
-//
-//      Accelerometer Implementation
-//
-/*---------------------------------------------------------------------------*/
-typedef struct {
-    long long time;
-    HwmData dat;
-} AccItem;
-
-/*---------------------------------------------------------------------------*/
-int gsensor_update_nvram(HwmData *dat)
+int hwm_samples_alloc(HwmSamples *smp, int count)
 {
-	int err;
-	HwmData old, cur;
+	char *blk;
 
-	if(0 != (err = gsensor_read_nvram(&old)))
+	memset(smp, 0, sizeof(*smp));
+	if(count <= 0)
 	{
-		return err;
+		return -EINVAL;
 	}
-
-	cur.x = old.x + dat->x;
-	cur.y = old.y + dat->y;
-	cur.z = old.z + dat->z;
-
-	if(0 != (err = gsensor_write_nvram(&cur)))
+	/* one block: times first so every array stays naturally aligned */
+	blk = calloc(count, sizeof(long long) + 3*sizeof(float) + sizeof(unsigned char));
+	if(NULL == blk)
 	{
-		return err;
+		return -ENOMEM;
 	}
-
+	smp->time = (long long*)blk;
+	smp->x = (float*)(smp->time + count);
+	smp->y = smp->x + count;
+	smp->z = smp->y + count;
+	smp->diverse = (unsigned char*)(smp->z + count);
 	return 0;
 }
 /*---------------------------------------------------------------------------*/
-int gsensor_reset_nvram()
+void hwm_samples_free(HwmSamples *smp)
 {
-	int err;
-	HwmData cur;
+	free(smp->time);
+	memset(smp, 0, sizeof(*smp));
+}
+/*---------------------------------------------------------------------------*/
+static void hwm_stats_update(HwmStats *st, float x, float y, float z)
+{
+	float dx, dy, dz;
+	int n = ++st->num;
 
-	cur.x = cur.y = cur.z = 0.0;
-	if(0 != (err = gsensor_write_nvram(&cur)))
+	if(n == 1)
 	{
-		return err;
+		st->mean.x = st->min.x = st->max.x = x;
+		st->mean.y = st->min.y = st->max.y = y;
+		st->mean.z = st->min.z = st->max.z = z;
+		st->m2.x = st->m2.y = st->m2.z = 0;
+		return;
 	}
 
-	return 0;
+	dx = x - st->mean.x;
+	dy = y - st->mean.y;
+	dz = z - st->mean.z;
+	st->mean.x += dx / n;
+	st->mean.y += dy / n;
+	st->mean.z += dz / n;
+	st->m2.x += dx * (x - st->mean.x);
+	st->m2.y += dy * (y - st->mean.y);
+	st->m2.z += dz * (z - st->mean.z);
+	st->min.x = fminf(st->min.x, x);
+	st->min.y = fminf(st->min.y, y);
+	st->min.z = fminf(st->min.z, z);
+	st->max.x = fmaxf(st->max.x, x);
+	st->max.y = fmaxf(st->max.y, y);
+	st->max.z = fmaxf(st->max.z, z);
 }
-/*----------------------------------------------------------------------------*/
-int checkAccelerometerData(AccItem *list, int num, HwmData *avg, int tolerance)
+/*---------------------------------------------------------------------------*/
+/*
+ * Read count samples, one every period ms, folding each one into the running
+ * statistics while waiting for the next.  The wait is an absolute deadline so
+ * the ioctl time is not added to every period, and there is no wait after
+ * the last sample.
+ */
+static int hwm_read_samples(int fd, int (*read_fn)(int, HwmData*), int period, int count,
+                            HwmSamples *smp, HwmStats *st)
 {
-	float maxdiff = (LIBHWM_GRAVITY_EARTH*tolerance)/100.0;
-	HwmData min, max;
-	char  chkstr[1024];
-	float diffx, diffy, diffz, varx = 0, vary = 0, varz = 0;
-	int idx;
-	int diverse = 0, curdiv;
+	struct timespec next, now;
+	HwmData dat;
+	int err;
 
-	min.x = min.y = min.z = +100*LIBHWM_GRAVITY_EARTH;
-	max.x = max.y = max.z = -100*LIBHWM_GRAVITY_EARTH;
-	HWMLOGD("----------------------------------------------------------------\n");
-	HWMLOGD("                         Calibration Data                       \n");
-	HWMLOGD("----------------------------------------------------------------\n");
-	HWMLOGD("maxdiff = %+9.4f\n", maxdiff);
-	HWMLOGD("average = %+9.4f, %+9.4f %+9.4f\n", avg->x, avg->y, avg->z);
-	HWMLOGD("----------------------------------------------------------------\n");
-	for(idx = 0; idx < num; idx++)
+	memset(st, 0, sizeof(*st));
+	smp->num = 0;
+	if(fd < 0)
 	{
-		if(max.x < list[idx].dat.x)
-		{
-			max.x = list[idx].dat.x;
-		}
+		return -EINVAL;
+	}
 
-		if(max.y < list[idx].dat.y)
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while(smp->num < count)
+	{
+		if(0 != (err = read_fn(fd, &dat)))
 		{
-			max.y = list[idx].dat.y;
+			HWMLOGE("read data fail: %d\n", err);
+			return err;
 		}
-
-		if(max.z < list[idx].dat.z)
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		smp->time[smp->num] = now.tv_sec*1000000000LL + now.tv_nsec;
+		smp->x[smp->num] = dat.x;
+		smp->y[smp->num] = dat.y;
+		smp->z[smp->num] = dat.z;
+		hwm_stats_update(st, dat.x, dat.y, dat.z);
+
+		if(++smp->num >= count)
 		{
-			max.z = list[idx].dat.z;
+			break;
 		}
 
-		if(min.x > list[idx].dat.x)
+		next.tv_sec += period / 1000;
+		next.tv_nsec += (period % 1000) * 1000000;
+		if(next.tv_nsec >= 1000000000)
 		{
-			min.x = list[idx].dat.x;
+			next.tv_sec++;
+			next.tv_nsec -= 1000000000;
 		}
-
-		if(min.y > list[idx].dat.y)
+		/* fell behind, restart the cadence from now */
+		if(next.tv_sec < now.tv_sec || (next.tv_sec == now.tv_sec && next.tv_nsec < now.tv_nsec))
 		{
-			min.y = list[idx].dat.y;
+			next = now;
 		}
-
-		if(min.z > list[idx].dat.z)
+		while(EINTR == (err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL)))
+			;
+		if(err)
 		{
-			min.z = list[idx].dat.z;
+			HWMLOGE("clock_nanosleep: %s\n", strerror(err));
+			return -err;
 		}
+	}
+	return 0;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Flag every sample further than maxdiff from the mean and print the summary.
+ * unit scales the printed deviations (1g for the accelerometer).  The flag
+ * pass is branch free over the axis arrays so the compiler can vectorize it;
+ * only flagged samples are logged.
+ */
+static int hwm_check_samples(HwmSamples *smp, HwmStats *st, float maxdiff, float unit)
+{
+	const float mx = st->mean.x, my = st->mean.y, mz = st->mean.z;
+	const float maxdiff2 = maxdiff*maxdiff;
+	const int num = smp->num;
+	float stdx, stdy, stdz;
+	int idx, diverse = 0;
 
-		diffx = list[idx].dat.x - avg->x;
-		diffy = list[idx].dat.y - avg->y;
-		diffz = list[idx].dat.z - avg->z;
-		varx += diffx * diffx;
-		vary += diffy * diffy;
-		varz += diffz * diffz;
-
-		curdiv = 0;
-		if(ABS(diffx) > maxdiff)
-		{
-			curdiv |= DIVERSE_X;
-		}
+	if(num <= 0)
+	{
+		return -EINVAL;
+	}
 
-		if(ABS(diffy) > maxdiff)
-		{
-			curdiv |= DIVERSE_Y;
-		}
+	HWMLOGD("----------------------------------------------------------------\n");
+	HWMLOGD("                         Calibration Data                       \n");
+	HWMLOGD("----------------------------------------------------------------\n");
+	HWMLOGD("maxdiff = %+9.4f\n", maxdiff);
+	HWMLOGD("average = %+9.4f, %+9.4f %+9.4f\n", mx, my, mz);
+	HWMLOGD("----------------------------------------------------------------\n");
 
-		if(ABS(diffz) > maxdiff)
-		{
-			curdiv |= DIVERSE_Z;
-		}
+	for(idx = 0; idx < num; idx++)
+	{
+		float dx = smp->x[idx] - mx;
+		float dy = smp->y[idx] - my;
+		float dz = smp->z[idx] - mz;
+		int curdiv = ((fabsf(dx) > maxdiff) ? DIVERSE_X : 0) |
+		             ((fabsf(dy) > maxdiff) ? DIVERSE_Y : 0) |
+		             ((fabsf(dz) > maxdiff) ? DIVERSE_Z : 0) |
+		             ((dx*dx + dy*dy + dz*dz > maxdiff2) ? DIVERSE_XYZ : 0);
 
-		if((diffx*diffx + diffy*diffy + diffz*diffz) > maxdiff*maxdiff)
-		{
-			curdiv |= DIVERSE_XYZ;
-		}
+		smp->diverse[idx] = curdiv;
 		diverse |= curdiv;
+	}
 
-		if (curdiv)
-		{
-			snprintf(chkstr, sizeof(chkstr), "=> UNSTABLE: 0x%04X, %+9.4f(%+5.2f), %+9.4f(%+5.2f), %+9.4f(%+5.2f), %+9.4f(%+5.2f)",
-				curdiv, diffx, diffx/LIBHWM_GRAVITY_EARTH, diffy, diffy/LIBHWM_GRAVITY_EARTH, diffz, diffz/LIBHWM_GRAVITY_EARTH,
-				sqrt(diffx*diffx + diffy*diffy + diffz*diffz), sqrt(diffx*diffx + diffy*diffy + diffz*diffz)/LIBHWM_GRAVITY_EARTH);
-		}
-		else
+	for(idx = 0; diverse && idx < num; idx++)
+	{
+		float dx, dy, dz, dist;
+
+		if(!smp->diverse[idx])
 		{
-			snprintf(chkstr, sizeof(chkstr), " ");
+			continue;
 		}
-
-		HWMLOGD("[%8lld] (%+9.4f, %+9.4f, %+9.4f) %s\n", list[idx].time/1000000,
-		list[idx].dat.x, list[idx].dat.y, list[idx].dat.z, chkstr);
+		dx = smp->x[idx] - mx;
+		dy = smp->y[idx] - my;
+		dz = smp->z[idx] - mz;
+		dist = sqrtf(dx*dx + dy*dy + dz*dz);
+		HWMLOGD("[%8lld] (%+9.4f, %+9.4f, %+9.4f) => UNSTABLE: 0x%04X, %+9.4f(%+5.2f), %+9.4f(%+5.2f), %+9.4f(%+5.2f), %+9.4f(%+5.2f)\n",
+			smp->time[idx]/1000000, smp->x[idx], smp->y[idx], smp->z[idx], smp->diverse[idx],
+			dx, dx/unit, dy, dy/unit, dz, dz/unit, dist, dist/unit);
 	}
 
-	varx = sqrt(varx/num);
-	vary = sqrt(vary/num);
-	varz = sqrt(varz/num);
+	stdx = sqrtf(st->m2.x/num);
+	stdy = sqrtf(st->m2.y/num);
+	stdz = sqrtf(st->m2.z/num);
 
 	HWMLOGD("----------------------------------------------------------------\n");
 	HWMLOGD("X-Axis: min/avg/max = (%+9.4f, %+9.4f, %+9.4f), diverse = %+9.4f ~ %+9.4f, std = %9.4f\n",
-			min.x, avg->x, max.x, (min.x-avg->x)/LIBHWM_GRAVITY_EARTH, (max.x-avg->x)/LIBHWM_GRAVITY_EARTH, varx);
+			st->min.x, mx, st->max.x, (st->min.x-mx)/unit, (st->max.x-mx)/unit, stdx);
 	HWMLOGD("Y-Axis: min/avg/max = (%+9.4f, %+9.4f, %+9.4f), diverse = %+9.4f ~ %+9.4f, std = %9.4f\n",
-			min.y, avg->y, max.y, (min.y-avg->y)/LIBHWM_GRAVITY_EARTH, (max.y-avg->y)/LIBHWM_GRAVITY_EARTH, vary);
+			st->min.y, my, st->max.y, (st->min.y-my)/unit, (st->max.y-my)/unit, stdy);
 	HWMLOGD("Z-Axis: min/avg/max = (%+9.4f, %+9.4f, %+9.4f), diverse = %+9.4f ~ %+9.4f, std = %9.4f\n",
-			min.z, avg->z, max.z, (min.z-avg->z)/LIBHWM_GRAVITY_EARTH, (max.z-avg->z)/LIBHWM_GRAVITY_EARTH, varz);
+			st->min.z, mz, st->max.z, (st->min.z-mz)/unit, (st->max.z-mz)/unit, stdz);
 	HWMLOGD("----------------------------------------------------------------\n");
 	if(diverse)
 	{
@@ -705,51 +797,81 @@ int checkAccelerometerData(AccItem *list, int num, HwmData *avg, int tolerance)
 	return 0;
 }
 /*---------------------------------------------------------------------------*/
+//
+//      Accelerometer Implementation
+//
+/*---------------------------------------------------------------------------*/
+int gsensor_read_samples(int fd, int period, int count, HwmSamples *smp, HwmStats *st)
+{
+	return hwm_read_samples(fd, gsensor_read, period, count, smp, st);
+}
+
+/*---------------------------------------------------------------------------*/
+int gsensor_update_nvram(HwmData *dat)
+{
+	int err;
+	HwmData old, cur;
+
+	if(0 != (err = gsensor_read_nvram(&old)))
+	{
+		return err;
+	}
+
+	cur.x = old.x + dat->x;
+	cur.y = old.y + dat->y;
+	cur.z = old.z + dat->z;
+
+	if(0 != (err = gsensor_write_nvram(&cur)))
+	{
+		return err;
+	}
+
+	return 0;
+}
+/*---------------------------------------------------------------------------*/
+int gsensor_reset_nvram()
+{
+	int err;
+	HwmData cur;
+
+	cur.x = cur.y = cur.z = 0.0;
+	if(0 != (err = gsensor_write_nvram(&cur)))
+	{
+		return err;
+	}
+
+	return 0;
+}
+/*----------------------------------------------------------------------------*/
+int checkAccelerometerData(HwmSamples *smp, HwmStats *st, int tolerance)
+{
+	return hwm_check_samples(smp, st, (LIBHWM_GRAVITY_EARTH*tolerance)/100.0, LIBHWM_GRAVITY_EARTH);
+}
+/*---------------------------------------------------------------------------*/
 //Parse event and return event type
 /*---------------------------------------------------------------------------*/
 int gsensor_poll_data(int fd, int period, int count)
 {
-	int64_t nt;
-	struct timespec time;
-    int err, num = 0;
-	AccItem *item = NULL;
-	HwmData avg, dat;
+	HwmSamples smp;
+	HwmStats st;
+	int err;
 
-	avg.x = avg.y = avg.z = 0.0;
 	if(fd < 0)
 	{
 		return -EINVAL;
 	}
-	if(NULL == (item = calloc(count, sizeof(*item))))
+	if(0 != (err = hwm_samples_alloc(&smp, count)))
 	{
-		return -ENOMEM;
+		return err;
 	}
 
-	while(0 == (err = gsensor_read(fd, &dat)))
+	err = gsensor_read_samples(fd, period, count, &smp, &st);
+	if(smp.num)
 	{
-		clock_gettime(CLOCK_MONOTONIC, &time);
-		nt = time.tv_sec*1000000000LL+time.tv_nsec;
-		item[num].dat.x = dat.x;
-		item[num].dat.y = dat.y;
-		item[num].dat.z = dat.z;
-		item[num].time = nt;
-		avg.x += dat.x;
-		avg.y += dat.y;
-		avg.z += dat.z;
-
-		if(++num >= count)
-		{
-			break;
-		}
-		libhwm_wait_delay(period);
+		checkAccelerometerData(&smp, &st, 0.0);
 	}
 
-	avg.x /= count;
-	avg.y /= count;
-	avg.z /= count;
-	checkAccelerometerData(item, count, &avg, 0.0);
-
-	free(item);
+	hwm_samples_free(&smp);
 	return err;
 }
 
@@ -782,64 +904,34 @@ int calculateStandardCalibration(HwmData *avg, HwmData *cali)
 /*---------------------------------------------------------------------------*/
 int gsensor_calibration(int fd, int period, int count, int tolerance, HwmData *cali)
 {
-    int err = 0, num = 0;
-	AccItem *item = NULL;
-	HwmData avg, dat;
-	int64_t nt;
-    struct timespec time;
+	HwmSamples smp;
+	HwmStats st;
+	int err;
 
-	avg.x = avg.y = avg.z = 0.0;
 	if(fd < 0)
 	{
 		return -EINVAL;
 	}
-	if(NULL == (item = calloc(count, sizeof(*item))))
+	if(0 != (err = hwm_samples_alloc(&smp, count)))
 	{
-		return -ENOMEM;
+		return err;
 	}
 
-	while(num < count)
+	if(0 != (err = gsensor_read_samples(fd, period, count, &smp, &st)))
 	{
-		/* read the next event */
-		err = gsensor_read(fd, &dat);
-
-		if(err)
-		{
-			HWMLOGE("read data fail: %d\n", err);
-			goto exit;
-		}
-		else
-		{
-			clock_gettime(CLOCK_MONOTONIC, &time);
-			nt = time.tv_sec*1000000000LL+time.tv_nsec;
-			item[num].dat.x = dat.x;
-			item[num].dat.y = dat.y;
-			item[num].dat.z = dat.z;
-			item[num].time = nt;
-			avg.x += item[num].dat.x;
-			avg.y += item[num].dat.y;
-			avg.z += item[num].dat.z;
-		}
-
-		num++;
-		libhwm_wait_delay(period);
+		goto exit;
 	}
 
-	/*calculate average*/
-	avg.x /= count;
-	avg.y /= count;
-	avg.z /= count;
-
-	if(0 != (err = checkAccelerometerData(item, count, &avg, tolerance)))
+	if(0 != (err = checkAccelerometerData(&smp, &st, tolerance)))
 	{
 		HWMLOGE("check accelerometer fail\n");
 	}
-	else if(0 != (err = calculateStandardCalibration(&avg, cali)))
+	else if(0 != (err = calculateStandardCalibration(&st.mean, cali)))
 	{
 		HWMLOGE("calculate standard calibration fail\n");
 	}
 	exit:
-	free(item);
+	hwm_samples_free(&smp);
 	return err;
 }
 /*---------------------------------------------------------------------------*/
@@ -1078,7 +1170,7 @@ int gyroscope_init(int fd)
 int gyroscope_read(int fd, HwmData *dat)
 {
 	int err;
-	int x, y, z;
+	int val[3];
 	char buf[64];
 	if(fd < 0)
 	{
@@ -1090,16 +1182,16 @@ int gyroscope_read(int fd, HwmData *dat)
 		HWMLOGE("read err: %d %d (%s)\n", fd, err, strerror(errno));
 		return err;
 	}
-	else if(3 != sscanf(buf, "%x %x %x", &x, &y, &z))
+	else if(0 != libhwm_parse_hex3(buf, strnlen(buf, sizeof(buf)), val))
 	{
 		HWMLOGE("parsing error\n");
 		return -EINVAL;
 	}
 	else
 	{
-		dat->x = (float)(x);
-		dat->y = (float)(y);
-		dat->z = (float)(z);
+		dat->x = (float)(val[0]);
+		dat->y = (float)(val[1]);
+		dat->z = (float)(val[2]);
 		return 0;
 	}
 }
@@ -1284,182 +1376,50 @@ int gyroscope_write_nvram(HwmData *dat)
 }
 
 /*----------------------------------------------------------------------------*/
-int checkGyroscopeData(AccItem *list, int num, HwmData *avg, int tolerance)
+int gyroscope_read_samples(int fd, int period, int count, HwmSamples *smp, HwmStats *st)
 {
-	float maxdiff = tolerance;
-	HwmData min, max;
-	char  chkstr[1024];
-	float diffx, diffy, diffz, varx = 0, vary = 0, varz = 0;
-	int idx;
-	int diverse = 0, curdiv;
-
-	min.x = min.y = min.z = +10*tolerance;
-	max.x = max.y = max.z = -10*tolerance;
-	HWMLOGD("----------------------------------------------------------------\n");
-	HWMLOGD("                         Calibration Data                       \n");
-	HWMLOGD("----------------------------------------------------------------\n");
-	HWMLOGD("maxdiff = %+9.4f\n", maxdiff);
-	HWMLOGD("average = %+9.4f, %+9.4f %+9.4f\n", avg->x, avg->y, avg->z);
-	HWMLOGD("----------------------------------------------------------------\n");
-	for(idx = 0; idx < num; idx++)
-	{
-		if(max.x < list[idx].dat.x)
-		{
-			max.x = list[idx].dat.x;
-		}
-
-		if(max.y < list[idx].dat.y)
-		{
-			max.y = list[idx].dat.y;
-		}
-
-		if(max.z < list[idx].dat.z)
-		{
-			max.z = list[idx].dat.z;
-		}
-
-		if(min.x > list[idx].dat.x)
-		{
-			min.x = list[idx].dat.x;
-		}
-
-		if(min.y > list[idx].dat.y)
-		{
-			min.y = list[idx].dat.y;
-		}
-
-		if(min.z > list[idx].dat.z)
-		{
-			min.z = list[idx].dat.z;
-		}
-
-		diffx = list[idx].dat.x - avg->x;
-		diffy = list[idx].dat.y - avg->y;
-		diffz = list[idx].dat.z - avg->z;
-		varx += diffx * diffx;
-		vary += diffy * diffy;
-		varz += diffz * diffz;
-
-		curdiv = 0;
-		if(ABS(diffx) > maxdiff)
-		{
-			curdiv |= DIVERSE_X;
-		}
-
-		if(ABS(diffy) > maxdiff)
-		{
-			curdiv |= DIVERSE_Y;
-		}
-
-		if(ABS(diffz) > maxdiff)
-		{
-			curdiv |= DIVERSE_Z;
-		}
-
-		if((diffx*diffx + diffy*diffy + diffz*diffz) > maxdiff*maxdiff)
-		{
-			curdiv |= DIVERSE_XYZ;
-		}
-		diverse |= curdiv;
-
-		if (curdiv)
-		{
-			snprintf(chkstr, sizeof(chkstr), "=> UNSTABLE: 0x%04X, %+9.4f(%+5.2f), %+9.4f(%+5.2f), %+9.4f(%+5.2f), %+9.4f(%+5.2f)",
-				curdiv, diffx, diffx, diffy, diffy, diffz, diffz, sqrt(diffx*diffx + diffy*diffy + diffz*diffz), sqrt(diffx*diffx + diffy*diffy + diffz*diffz));
-		}
-		else
-		{
-			snprintf(chkstr, sizeof(chkstr), " ");
-		}
-
-		HWMLOGD("[%8lld] (%+9.4f, %+9.4f, %+9.4f) %s\n", list[idx].time/1000000,
-		list[idx].dat.x, list[idx].dat.y, list[idx].dat.z, chkstr);
-	}
-
-	varx = sqrt(varx/num);
-	vary = sqrt(vary/num);
-	varz = sqrt(varz/num);
-
-	HWMLOGD("----------------------------------------------------------------\n");
-	HWMLOGD("X-Axis: min/avg/max = (%+9.4f, %+9.4f, %+9.4f), diverse = %+9.4f ~ %+9.4f, std = %9.4f\n",
-			min.x, avg->x, max.x, (min.x-avg->x), (max.x-avg->x), varx);
-	HWMLOGD("Y-Axis: min/avg/max = (%+9.4f, %+9.4f, %+9.4f), diverse = %+9.4f ~ %+9.4f, std = %9.4f\n",
-			min.y, avg->y, max.y, (min.y-avg->y), (max.y-avg->y), vary);
-	HWMLOGD("Z-Axis: min/avg/max = (%+9.4f, %+9.4f, %+9.4f), diverse = %+9.4f ~ %+9.4f, std = %9.4f\n",
-			min.z, avg->z, max.z, (min.z-avg->z), (max.z-avg->z), varz);
-	HWMLOGD("----------------------------------------------------------------\n");
-	if(diverse)
-	{
-		return -EINVAL;
-	}
-
-	return 0;
+	return hwm_read_samples(fd, gyroscope_read, period, count, smp, st);
+}
+/*----------------------------------------------------------------------------*/
+int checkGyroscopeData(HwmSamples *smp, HwmStats *st, int tolerance)
+{
+	return hwm_check_samples(smp, st, tolerance, 1.0f);
 }
 
 
 /*---------------------------------------------------------------------------*/
 int gyroscope_calibration(int fd, int period, int count, int tolerance, HwmData *cali)
 {
-    int err = 0, num = 0;
-	AccItem *item = NULL;
-	HwmData avg, dat;
-	int64_t nt;
-    struct timespec time;
+	HwmSamples smp;
+	HwmStats st;
+	int err;
 
-	avg.x = avg.y = avg.z = 0.0;
 	if(fd < 0)
 	{
 		return -EINVAL;
 	}
-	if(NULL == (item = calloc(count, sizeof(*item))))
+	if(0 != (err = hwm_samples_alloc(&smp, count)))
 	{
-		return -ENOMEM;
+		return err;
 	}
 
-	while(num < count)
+	if(0 != (err = gyroscope_read_samples(fd, period, count, &smp, &st)))
 	{
-		/* read the next event */
-		err = gyroscope_read(fd, &dat);
-
-		if(err)
-		{
-			HWMLOGE("read data fail: %d\n", err);
-			goto exit;
-		}
-		else
-		{
-			clock_gettime(CLOCK_MONOTONIC, &time);
-			nt = time.tv_sec*1000000000LL+time.tv_nsec;
-			item[num].dat.x = dat.x;
-			item[num].dat.y = dat.y;
-			item[num].dat.z = dat.z;
-			item[num].time = nt;
-			avg.x += item[num].dat.x;
-			avg.y += item[num].dat.y;
-			avg.z += item[num].dat.z;
-		}
-
-		num++;
-		libhwm_wait_delay(period);
+		goto exit;
 	}
 
-	/*calculate average*/
-	avg.x /= count;
-	avg.y /= count;
-	avg.z /= count;
-
-	if(0 != (err = checkGyroscopeData(item, count, &avg, tolerance)))
+	if(0 != (err = checkGyroscopeData(&smp, &st, tolerance)))
 	{
 		HWMLOGE("check accelerometer fail\n");
 	}
 	else
 	{
-		cali->x = -avg.x;
-		cali->y = -avg.y;
-		cali->z = -avg.z;
+		cali->x = -st.mean.x;
+		cali->y = -st.mean.y;
+		cali->z = -st.mean.z;
 	}
 	exit:
-	free(item);
+	hwm_samples_free(&smp);
 	return err;
 }
 /*---------------------------------------------------------------------------*/
@@ -22,3 +22,20 @@ LOCAL_INIT_RC := init.thermal.rc
 LOCAL_SHARED_LIBRARIES := libcutils libc libifcutils_mtk libdl liblog
 
 include $(BUILD_EXECUTABLE)
+
+# rild threshold and query path against a fake rild-oem socket
+include $(CLEAR_VARS)
+LOCAL_MODULE := thermal_rild_test
+LOCAL_PROPRIETARY_MODULE := true
+LOCAL_MODULE_OWNER := mtk
+LOCAL_MODULE_TAGS := optional
+LOCAL_GTEST := false
+LOCAL_SRC_FILES := test/thermal_rild_test.c
+LOCAL_C_INCLUDES = \
+    $(LOCAL_PATH)/ \
+    hardware/libhardware_legacy/include \
+    hardware/libhardware/include \
+    vendor/mediatek/opensource/hardware/ccci/include \
+    vendor/mediatek/opensource/system/netdagent/include
+LOCAL_SHARED_LIBRARIES := libcutils libc libifcutils_mtk libdl liblog
+include $(BUILD_NATIVE_TEST)
@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test of the modem threshold and query path of the thermal daemon
+ * against a fake rild-oem: every connection the daemon opens is one end of
+ * a socketpair, the test holds the other end, reads the requests and
+ * answers them, then runs the daemon's epoll loop to deliver the answers.
+ */
+
+#include <stdio.h>
+
+#define MTK_THERMAL_PA_VIA_ATCMD
+static char test_thre_path[64];
+#define MD_TP_THRE_PATH test_thre_path
+
+#define main thermal_main
+#include "../thermal.c"
+#undef main
+
+#define TEST_MAX_PEERS 64
+
+static int peers[TEST_MAX_PEERS];
+static int peer_count;
+static int rild_down;
+static int thre_file = -1;
+static int failures;
+
+#define EXPECT(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: expect %s failed\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+int socket_local_client(const char *name, int namespaceId, int type)
+{
+    int sv[2];
+
+    (void) namespaceId;
+    if (rild_down || strcmp(name, "rild-oem") || peer_count == TEST_MAX_PEERS) {
+        errno = ECONNREFUSED;
+        return -1;
+    }
+    if (socketpair(AF_UNIX, type, 0, sv))
+        return -1;
+    peers[peer_count++] = sv[1];
+    return sv[0];
+}
+
+/* read one request of the count, length, string framing into buf */
+static int read_request(int peer, char *buf, size_t size)
+{
+    int count, len;
+
+    if (read(peer, &count, sizeof(count)) != sizeof(count) ||
+        read(peer, &len, sizeof(len)) != sizeof(len) || len <= 0 || (size_t) len > size)
+        return -1;
+    if (read(peer, buf, len) != len)
+        return -1;
+    buf[len - 1] = '\0';
+    return 0;
+}
+
+static void write_thresholds(const char *text)
+{
+    EXPECT(ftruncate(thre_file, 0) == 0);
+    EXPECT(pwrite(thre_file, text, strlen(text), 0) == (ssize_t) strlen(text));
+}
+
+/*
+ * run one md_tp period and return the peers of its connections, the
+ * threshold requests first and the query last
+ */
+static int run_period(int *first)
+{
+    *first = peer_count;
+    md_tp_timer_handler(&md_tp_timer, EPOLLIN);
+    return peer_count - *first;
+}
+
+static void dispatch_pending(void)
+{
+    while (thermal_loop_dispatch(50) > 0)
+        ;
+}
+
+/* the request on peer is THERMAL,<slot>,0,<sensor>,<threshold> */
+static void expect_threshold_request(int peer, int sensor, int threshold)
+{
+    char buf[128], expected[64];
+
+    snprintf(expected, sizeof(expected), "THERMAL,0,0,%d,%d\n", sensor, threshold);
+    EXPECT(read_request(peer, buf, sizeof(buf)) == 0);
+    EXPECT(strcmp(buf, expected) == 0);
+}
+
+static void expect_query_request(int peer)
+{
+    char buf[128];
+
+    EXPECT(read_request(peer, buf, sizeof(buf)) == 0);
+    EXPECT(strcmp(buf, "THERMAL,0,-1\n") == 0);
+}
+
+static void test_unchanged_sends_only_query(void)
+{
+    int first;
+
+    write_thresholds("85,85,85,");
+    EXPECT(run_period(&first) == 1);
+    expect_query_request(peers[first]);
+}
+
+static void test_threshold_committed_on_ok(void)
+{
+    int first;
+
+    /* the node lists sensor 1 first */
+    write_thresholds("85,90,85,");
+    EXPECT(run_period(&first) == 2);
+    expect_threshold_request(peers[first], 0, 90);
+    expect_query_request(peers[first + 1]);
+    EXPECT(md_tp_thresholds[0] == 85);
+
+    EXPECT(write(peers[first], "OK", 3) == 3);
+    dispatch_pending();
+    EXPECT(md_tp_thresholds[0] == 90);
+    EXPECT(rild_watch[0].fd < 0);
+
+    EXPECT(run_period(&first) == 1);
+    expect_query_request(peers[first]);
+}
+
+static void test_rejected_threshold_is_retried(void)
+{
+    int first;
+
+    write_thresholds("95,90,85,");
+    EXPECT(run_period(&first) == 2);
+    expect_threshold_request(peers[first], 1, 95);
+    EXPECT(write(peers[first], "ERROR", 6) == 6);
+    dispatch_pending();
+    EXPECT(md_tp_thresholds[1] == 85);
+    EXPECT(rild_watch[1].fd < 0);
+
+    /* a connection closed without an answer is not an OK either */
+    EXPECT(run_period(&first) == 2);
+    expect_threshold_request(peers[first], 1, 95);
+    close(peers[first]);
+    dispatch_pending();
+    EXPECT(md_tp_thresholds[1] == 85);
+
+    EXPECT(run_period(&first) == 2);
+    expect_threshold_request(peers[first], 1, 95);
+    EXPECT(write(peers[first], "OK", 3) == 3);
+    dispatch_pending();
+    EXPECT(md_tp_thresholds[1] == 95);
+}
+
+static void test_unanswered_threshold_is_resent(void)
+{
+    int first;
+
+    write_thresholds("95,90,80,");
+    EXPECT(run_period(&first) == 2);
+    expect_threshold_request(peers[first], 2, 80);
+
+    /* rild never answers, the value goes back but may have been applied */
+    write_thresholds("95,90,85,");
+    EXPECT(run_period(&first) == 2);
+    expect_threshold_request(peers[first], 2, 85);
+    EXPECT(write(peers[first], "OK", 3) == 3);
+    dispatch_pending();
+    EXPECT(md_tp_thresholds[2] == 85);
+    EXPECT(rild_watch[2].fd < 0);
+}
+
+static void test_rild_down(void)
+{
+    int first;
+
+    write_thresholds("95,90,70,");
+    rild_down = 1;
+    EXPECT(run_period(&first) == 0);
+    EXPECT(md_tp_thresholds[2] == 85);
+
+    rild_down = 0;
+    EXPECT(run_period(&first) == 2);
+    expect_threshold_request(peers[first], 2, 70);
+    EXPECT(write(peers[first], "OK", 3) == 3);
+    dispatch_pending();
+    EXPECT(md_tp_thresholds[2] == 70);
+}
+
+/*
+ * the period timer and a hangup of the previous query connection arrive in
+ * one batch: the timer reopens the query watch, the hangup must not close
+ * the new connection
+ */
+static void test_stale_event_after_reopen(void)
+{
+    struct timespec now;
+    int first, old_query;
+
+    EXPECT(run_period(&first) == 1);
+    old_query = peers[first];
+    expect_query_request(old_query);
+    dispatch_pending();
+    EXPECT(rild_watch[RILD_QUERY].fd >= 0);
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    tm_timer_arm(md_tp_timer.fd, &now, 0);
+    usleep(10000);
+    close(old_query);
+
+    first = peer_count;
+    EXPECT(thermal_loop_dispatch(1000) == 2);
+    EXPECT(peer_count == first + 1);
+    EXPECT(rild_watch[RILD_QUERY].fd >= 0);
+    expect_query_request(peers[first]);
+
+    /* and it still delivers URCs */
+    EXPECT(write(peers[first], "URC,0,50", 9) == 9);
+    dispatch_pending();
+    EXPECT(rild_watch[RILD_QUERY].fd >= 0);
+}
+
+int main(void)
+{
+    const char *tmpdir = getenv("TMPDIR");
+    int i;
+
+    snprintf(test_thre_path, sizeof(test_thre_path), "%s/thermal_thre_XXXXXX",
+             tmpdir ? tmpdir : "/tmp");
+    thre_file = mkstemp(test_thre_path);
+    if (thre_file < 0 || thermal_loop_init()) {
+        fprintf(stderr, "thermal_rild_test: setup failed: %s\n", strerror(errno));
+        return 1;
+    }
+    /* periods are driven by the test */
+    tm_timer_arm(md_tp_timer.fd, NULL, 0);
+
+    test_unchanged_sends_only_query();
+    test_threshold_committed_on_ok();
+    test_rejected_threshold_is_retried();
+    test_unanswered_threshold_is_resent();
+    test_rild_down();
+    test_stale_event_after_reopen();
+
+    for (i = 0; i < peer_count; i++)
+        close(peers[i]);
+    unlink(test_thre_path);
+
+    if (failures) {
+        fprintf(stderr, "thermal_rild_test: %d failures\n", failures);
+        return 1;
+    }
+    printf("thermal_rild_test: OK\n");
+    return 0;
+}
@@ -23,6 +23,11 @@
 #include <sys/file.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <fcntl.h>
+#include <stdint.h>
 #include <log/log.h>
 #include <log/log.h>
 #include <ifcutils/ifc.h>
@@ -261,38 +266,147 @@ static void exe_cmd(int wifi_ifc, int level)
 	}
 }
 #endif /* NEVER */
+/*
+ * Everything runs on one epoll loop: SIGIO from the thermal drivers arrives
+ * through a signalfd, throttle cadences are timerfds and rild connections are
+ * non-blocking sockets.  A watch is the epoll cookie for one fd.
+ */
+struct tm_watch {
+	int fd;
+	void (*handler)(struct tm_watch *w, uint32_t events);
+	int opcode; /* rild: opcode of the expected response */
+};
+
+static int tm_epoll_fd = -1;
+
+/* events of the batch being dispatched, see tm_watch_close */
+static struct epoll_event *tm_events;
+static int tm_event_count;
+
+static int tm_watch_add(struct tm_watch *w, uint32_t events)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = w;
+	if (epoll_ctl(tm_epoll_fd, EPOLL_CTL_ADD, w->fd, &ev) == -1) {
+		TM_INFO_LOG("fail to watch fd %d: %s\n", w->fd, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Events of the current batch still queued for w belong to the fd closed
+ * here; drop them so a watch reopened in the same batch never sees them.
+ */
+static void tm_watch_close(struct tm_watch *w)
+{
+	int i;
+
+	if (w->fd < 0)
+		return;
+	epoll_ctl(tm_epoll_fd, EPOLL_CTL_DEL, w->fd, NULL);
+	close(w->fd);
+	w->fd = -1;
+	for (i = 0; i < tm_event_count; i++) {
+		if (tm_events[i].data.ptr == w)
+			tm_events[i].data.ptr = NULL;
+	}
+}
+
+/* arm a timerfd to expire at an absolute CLOCK_MONOTONIC time, NULL disarms */
+static int tm_timer_arm(int tfd, const struct timespec *at, int interval)
+{
+	struct itimerspec it;
+
+	memset(&it, 0, sizeof(it));
+	if (at) {
+		it.it_value = *at;
+		it.it_interval.tv_sec = interval;
+	}
+	if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &it, NULL) == -1) {
+		TM_INFO_LOG("fail to timerfd_settime %d: %s\n", tfd, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static int tm_timer_create(struct tm_watch *w, void (*handler)(struct tm_watch *, uint32_t))
+{
+	w->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (w->fd < 0) {
+		TM_INFO_LOG("fail to timerfd_create: %s\n", strerror(errno));
+		return -1;
+	}
+	w->handler = handler;
+	return tm_watch_add(w, EPOLLIN);
+}
+
+static uint64_t tm_timer_expirations(int tfd)
+{
+	uint64_t n = 0;
+
+	if (read(tfd, &n, sizeof(n)) != sizeof(n))
+		return 0;
+	return n;
+}
+
+/*
+ * sysfs/procfs nodes stay open and are re-read with pread.  A node whose
+ * interface went away fails the read and is reopened on the next check.
+ */
+static int read_node(const char *path, int *fd, char *buf, int size)
+{
+	int len;
+
+	if (*fd < 0) {
+		*fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (*fd < 0) {
+			if (errno != ENOENT)
+				TM_INFO_LOG("Can't open %s: %s", path, strerror(errno));
+			return -1;
+		}
+	}
+
+	len = pread(*fd, buf, size - 1, 0);
+	if (len < 0) {
+		TM_INFO_LOG("Can't read %s: %s", path, strerror(errno));
+		close(*fd);
+		*fd = -1;
+		return -1;
+	}
+	buf[len] = '\0';
+	return len;
+}
+
+static int IFC_FD[IFC_NUM] = { -1, -1, -1 };
+#if defined(MD_UL_DR_THROTTLE)
+static int MD_IFC_FD[MD_IFC_NUM] = { -1, -1, -1, -1 };
+#endif
+
 #define UNUSED(x)    if(x){}
 static void set_wifi_throttle(int level)
 {
 	int i = 0;
         UNUSED(level);
 	for ( i=0; i<IFC_NUM; i++) {
-		TM_DBG_LOG("checking %s", IFC_PATH[i]);
-		if (0 == access(IFC_PATH[i], R_OK)) {
-			char buf[80];
-			int fd = open(IFC_PATH[i], O_RDONLY);
-			if (fd < 0) {
-				TM_INFO_LOG("Can't open %s: %s", IFC_PATH[i], strerror(errno));
-				continue;
-			}
+		char buf[80];
 
-			int len = read(fd, buf, sizeof(buf) - 1);
-			if (len < 0) {
-				TM_INFO_LOG("Can't read %s: %s", IFC_PATH[i], strerror(errno));
-                close(fd);
-				continue;
-			}
-			close(fd);
-			if(!strncmp (buf, "up", 2)) {
-				//ifc_set_throttle(IFC_NAME[i], level * ONE_MBITS_PER_SEC, level * ONE_MBITS_PER_SEC);
-				//mark for CTS fail ifc_set_throttle(IFC_NAME[i], level, level);    //[star] unit: Kbytes
-
-				#ifdef NEVER
-			 	exe_cmd(i, level);
-				#endif /* NEVER */
-			} else
-				TM_DBG_LOG("%s is down!", IFC_NAME[i]);
-		}
+		TM_DBG_LOG("checking %s", IFC_PATH[i]);
+		if (read_node(IFC_PATH[i], &IFC_FD[i], buf, sizeof(buf)) < 0)
+			continue;
+
+		if(!strncmp (buf, "up", 2)) {
+			//ifc_set_throttle(IFC_NAME[i], level * ONE_MBITS_PER_SEC, level * ONE_MBITS_PER_SEC);
+			//mark for CTS fail ifc_set_throttle(IFC_NAME[i], level, level);    //[star] unit: Kbytes
+
+			#ifdef NEVER
+			exe_cmd(i, level);
+			#endif /* NEVER */
+		} else
+			TM_DBG_LOG("%s is down!", IFC_NAME[i]);
 	}
 }
 
@@ -307,91 +421,71 @@ static void set_md_ul_throttle(int level)
 	TM_DBG_LOG("set_md_ul_throttle %d\n", level);
 
 	for ( i=0; i<MD_IFC_NUM; i++) {
-		TM_DBG_LOG("checking %s", MD_IFC_PATH[i]);
-		if (0 == access(MD_IFC_PATH[i], R_OK)) {
-			char buf[80];
-			int fd = open(MD_IFC_PATH[i], O_RDONLY);
-			if (fd < 0) {
-				TM_INFO_LOG("Can't open %s: %s", MD_IFC_PATH[i], strerror(errno));
-				continue;
-			}
+		char buf[80];
 
-			int len = read(fd, buf, sizeof(buf) - 1);
-			if (len < 0) {
-				TM_INFO_LOG("Can't read %s: %s", MD_IFC_PATH[i], strerror(errno));
-				close(fd);
-				continue;
-			}
-			close(fd);
+		TM_DBG_LOG("checking %s", MD_IFC_PATH[i]);
+		if (read_node(MD_IFC_PATH[i], &MD_IFC_FD[i], buf, sizeof(buf)) < 0)
+			continue;
 #if 0
-			if(!strncmp (buf, "up", 2)) {
-				ifc_set_throttle(MD_IFC_NAME[i], -1, level);
-
-				#ifdef NEVER
-			 	exe_cmd(i, level);
-				#endif /* NEVER */
-			} else
-				TM_DBG_LOG("%s is down!", MD_IFC_NAME[i]);
+		if(!strncmp (buf, "up", 2)) {
+			ifc_set_throttle(MD_IFC_NAME[i], -1, level);
+
+			#ifdef NEVER
+			exe_cmd(i, level);
+			#endif /* NEVER */
+		} else
+			TM_DBG_LOG("%s is down!", MD_IFC_NAME[i]);
 #else
-			if(!strncmp (buf, "down", 4)) {
-			    TM_DBG_LOG("%s is down!", MD_IFC_NAME[i]);
-			} else {
+		if(!strncmp (buf, "down", 4)) {
+		    TM_DBG_LOG("%s is down!", MD_IFC_NAME[i]);
+		} else {
                 //mark for CTS fail ifc_set_throttle(MD_IFC_NAME[i], -1, level);
 
-				#ifdef NEVER
-			 	exe_cmd(i, level);
-				#endif /* NEVER */
-			}
-#endif
+			#ifdef NEVER
+			exe_cmd(i, level);
+			#endif /* NEVER */
 		}
+#endif
 	}
 }
 
-static timer_t base_timer;
-static timer_t level_timer;
+/*
+ * Discontinuous UL throttle: every 10s window is unlimited for level seconds
+ * and limited for the rest.  One timerfd alternates between the two phases on
+ * absolute deadlines, so the windows do not drift.
+ */
+static struct tm_watch dul_timer = { .fd = -1 };
+static struct timespec dul_deadline;
 static int level_timeout = 10;
+static int dul_limited = 0;
 
-void timer_thread(union sigval v)
+static void dul_timer_handler(struct tm_watch *w, uint32_t events)
 {
-    TM_DBG_LOG("timer_thread function! %d\n", v.sival_int);
+    struct timespec now;
 
-    if (v.sival_int == 111)
-    {
-        // unlimit
-        set_md_ul_throttle(-1);
+    (void) events;
 
-        // restart base_timer
-        {
-            struct itimerspec it;
-            it.it_interval.tv_sec = 10;
-            it.it_interval.tv_nsec = 0;
-            it.it_value.tv_sec = 10;
-            it.it_value.tv_nsec = 0;
-
-            if (timer_settime(base_timer, 0, &it, NULL) == -1)
-            {
-                TM_INFO_LOG("fail to timer_settime base_timer\n");
-            }
-        }
-        // restart level_timer
-        {
-            struct itimerspec it;
-            it.it_interval.tv_sec = 10;
-            it.it_interval.tv_nsec = 0;
-            it.it_value.tv_sec = level_timeout;
-            it.it_value.tv_nsec = 0;
-
-            if (timer_settime(level_timer, 0, &it, NULL) == -1)
-            {
-                TM_INFO_LOG("fail to timer_settime base_timer\n");
-            }
-        }
+    tm_timer_expirations(w->fd);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (now.tv_sec - dul_deadline.tv_sec >= 10) {
+        // the loop was held up for a whole window, restart the window from now
+        dul_deadline = now;
+        dul_limited = 1;
     }
-    else if (v.sival_int == 222)
-    {
+
+    if (dul_limited) {
+        // unlimit
+        set_md_ul_throttle(-1);
+        dul_limited = 0;
+        dul_deadline.tv_sec += level_timeout;
+    } else {
         // limit
         set_md_ul_throttle(1);
+        dul_limited = 1;
+        dul_deadline.tv_sec += 10 - level_timeout;
     }
+
+    tm_timer_arm(w->fd, &dul_deadline, 0);
 }
 
 static int reset_timers(void)
@@ -401,105 +495,25 @@ static int reset_timers(void)
     // unlimit
     set_md_ul_throttle(-1);
 
-    // restart base_timer
-    {
-        struct itimerspec it;
-        it.it_interval.tv_sec = 10;
-        it.it_interval.tv_nsec = 0;
-        it.it_value.tv_sec = 10;
-        it.it_value.tv_nsec = 0;
-
-        if (timer_settime(base_timer, 0, &it, NULL) == -1)
-        {
-            TM_INFO_LOG("fail to timer_settime base_timer\n");
-            return -1;
-        }
-    }
-    // restart level_timer
-    {
-        struct itimerspec it;
-        it.it_interval.tv_sec = 10;
-        it.it_interval.tv_nsec = 0;
-        it.it_value.tv_sec = level_timeout;
-        it.it_value.tv_nsec = 0;
-
-        if (timer_settime(level_timer, 0, &it, NULL) == -1)
-        {
-            TM_INFO_LOG("fail to timer_settime base_timer\n");
-            return -1;
-        }
-    }
+    // start a new window now
+    dul_limited = 0;
+    clock_gettime(CLOCK_MONOTONIC, &dul_deadline);
+    dul_deadline.tv_sec += level_timeout;
 
-    return 0;
+    if (dul_timer.fd < 0)
+        return -1;
+    return tm_timer_arm(dul_timer.fd, &dul_deadline, 0);
 }
 
 static int stop_timers(void)
 {
     TM_DBG_LOG("stop_timers\n");
 
-    // restart base_timer
-    {
-        struct itimerspec it;
-        it.it_interval.tv_sec = 0;
-        it.it_interval.tv_nsec = 0;
-        it.it_value.tv_sec = 0;
-        it.it_value.tv_nsec = 0;
-
-        if (timer_settime(base_timer, 0, &it, NULL) == -1)
-        {
-            TM_INFO_LOG("fail to timer_settime base_timer\n");
-            return -1;
-        }
-    }
-    // restart level_timer
-    {
-        struct itimerspec it;
-        it.it_interval.tv_sec = 0;
-        it.it_interval.tv_nsec = 0;
-        it.it_value.tv_sec = 0;
-        it.it_value.tv_nsec = 0;
-
-        if (timer_settime(level_timer, 0, &it, NULL) == -1)
-        {
-            TM_INFO_LOG("fail to timer_settime base_timer\n");
-            return -1;
-        }
-    }
-
-    return 0;
-}
-#if 0
-static int thermal_create_timers(void)
-{
-    struct sigevent evp;
-
-    TM_DBG_LOG("thermal_create_timers\n");
-
-    memset(&evp, 0, sizeof(struct sigevent));
-    evp.sigev_value.sival_int = 111;
-    evp.sigev_notify = SIGEV_THREAD;
-    evp.sigev_notify_function = timer_thread;
-
-    if (timer_create(CLOCK_REALTIME, &evp, &base_timer) == -1)
-    {
-        TM_INFO_LOG("fail to create base_timer\n");
-        return -1;
-    }
-
-    memset(&evp, 0, sizeof(struct sigevent));
-    evp.sigev_value.sival_int = 222;
-    evp.sigev_notify = SIGEV_THREAD;
-    evp.sigev_notify_function = timer_thread;
-
-    if (timer_create(CLOCK_REALTIME, &evp, &level_timer) == -1)
-    {
-        TM_INFO_LOG("fail to create level_timer\n");
+    if (dul_timer.fd < 0)
         return -1;
-    }
-
-    return 0;
+    return tm_timer_arm(dul_timer.fd, NULL, 0);
 }
-#endif
+
 static void set_md_dul_throttle(int level) // level 1~10, 1: unlimit for 1s and zero for 9s, ..., 10: unlimit
 {
     TM_DBG_LOG("set_md_dul_throttle %d\n", level);
@@ -516,15 +530,6 @@ static void set_md_dul_throttle(int level) // level 1~10, 1: unlimit for 1s and
     }
     else
         TM_INFO_LOG("invalid level %d, ignored\n", level);
-    // if 10 set unlimit and stop timer
-
-    // if timer not created, create timer
-
-    // if timer created, reset timer
-
-    // unlimit ul, and start timer for level s
-
-    // when times out, limit ul to 1kbps, and start timer for 10 - level s
 }
 #endif
 
@@ -606,10 +611,9 @@ static int load_thm_api(int idx, bool start)
 #endif/*TP_CHGPOLICY_SUPPORT*/
 
 
-static void signal_handler(int signo, siginfo_t *si, void *uc)
+/* SIGIO from the thermal drivers, read from the signalfd */
+static void signal_handler(const struct signalfd_siginfo *si)
 {
-    (void) uc;
-
     static int cur_thro = 0;
     #if defined(MD_UL_DR_THROTTLE)
     static int md_cur_thro = 0;
@@ -629,13 +633,13 @@ static void signal_handler(int signo, siginfo_t *si, void *uc)
     #endif /*TP_CHGPOLICY_SUPPORT*/
 
 
-    TM_INFO_LOG("signal_handler signo=%d  si->si_errno=%d, si->si_code=0x%x\n", signo , si->si_errno , si->si_code);
+    TM_INFO_LOG("signal_handler signo=%d  si->si_errno=%d, si->si_code=0x%x\n", si->ssi_signo , si->ssi_errno , si->ssi_code);
 
-    int set_thro = si->si_code;
-    int err = si->si_errno;
+    int set_thro = si->ssi_code;
+    int err = si->ssi_errno;
 
 
-	switch(si->si_signo) {
+	switch(si->ssi_signo) {
 		case SIGIO:
 			if (cur_thro != set_thro && err == 0) {
                 TM_DBG_LOG("set_wifi_throttle cur=%d set=%d\n", cur_thro, set_thro);
@@ -687,6 +691,18 @@ static void signal_handler(int signo, siginfo_t *si, void *uc)
 	}
 }
 
+static void signalfd_handler(struct tm_watch *w, uint32_t events)
+{
+	struct signalfd_siginfo si[8];
+	int len, i;
+	(void) events;
+
+	while ((len = read(w->fd, si, sizeof(si))) > 0) {
+		for (i = 0; i < len / (int) sizeof(si[0]); i++)
+			signal_handler(&si[i]);
+	}
+}
+
 #if defined(MTK_THERMAL_PA_VIA_ATCMD)
 
 static void handle_pipe(int sig) {
@@ -751,6 +767,8 @@ static int RildConnect(void)
 	sock = socket_local_client("rild-oem", ANDROID_SOCKET_NAMESPACE_RESERVED, SOCK_STREAM);
 	if(sock < 0)
 		TM_DBG_LOG("RildConnect %s\n", strerror(errno));
+	else
+		fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
 
 	return sock;
 }
@@ -814,49 +832,68 @@ failed:
 	return ret;
 }
 
-/* throttle level 0: MD on; throttle level 1: MD off */
-static int set_md_toggle_throttle(int level)
+static struct tm_watch md_toggle_timer = { .fd = -1 };
+static int md_toggle_state = -1; /* state not yet delivered to rild */
+
+static int md_toggle_send(void)
 {
 	int ret = -1;
 	int socket;
-	static int state;
 
-	/* MD state is reversed throttle state  */
-	if (0 == level)
-		state = 1;
-	else
-		state = 0;
-
-	{
-		socket = RildConnect();
-		TM_DBG_LOG("socket %d\n", socket);
-		while (socket == -1) {
-				sleep(5);
-				socket = RildConnect();
-				TM_DBG_LOG("socket %d\n", socket);
-		}
+	socket = RildConnect();
+	TM_DBG_LOG("socket %d\n", socket);
+	if (socket == -1) {
+		/* rild is not up, retry from the loop instead of sleeping in it */
+		struct timespec at;
+
+		clock_gettime(CLOCK_MONOTONIC, &at);
+		at.tv_sec += 5;
+		if (md_toggle_timer.fd >= 0)
+			tm_timer_arm(md_toggle_timer.fd, &at, 0);
+		return 0;
 	}
 
-	ret = MdToggle(socket, state);
+	ret = MdToggle(socket, md_toggle_state);
 
-	TM_DBG_LOG("%s state: %d ret: %d \n", __FUNCTION__, level, ret);
+	TM_DBG_LOG("%s state: %d ret: %d \n", __FUNCTION__, md_toggle_state, ret);
 
 	RildDisconnect(socket);
 
 /* MD_TOGGLE_SUPPORT_C2K start*/
 	if((isC2kSupport() == 1) && (sendRpcRequest != NULL)) {
-                ret = RilRPC_send(RIL_REQUEST_SET_MODEM_THERMAL, state);
+                ret = RilRPC_send(RIL_REQUEST_SET_MODEM_THERMAL, md_toggle_state);
 
                 if (ret != 0) {
                         TM_INFO_LOG("%s: RilRPC_send ret =%d \n", __FUNCTION__, ret);
-                        return ret;
                 }
 	}
 /* MD_TOGGLE_SUPPORT_C2K end*/
 
+	md_toggle_state = -1;
 	return ret;
 }
 
+static void md_toggle_timer_handler(struct tm_watch *w, uint32_t events)
+{
+	(void) events;
+
+	tm_timer_expirations(w->fd);
+	if (md_toggle_state != -1)
+		md_toggle_send();
+}
+
+/* throttle level 0: MD on; throttle level 1: MD off */
+static int set_md_toggle_throttle(int level)
+{
+	/* MD state is reversed throttle state  */
+	if (0 == level)
+		md_toggle_state = 1;
+	else
+		md_toggle_state = 0;
+
+	return md_toggle_send();
+}
+
 #endif
 
 static int queryMdThermalInfo(int sock, int slotId, int opcode)
@@ -1089,6 +1126,8 @@ static int connectToRild(int *solt_id)
     sock = socket_local_client("rild-oem", ANDROID_SOCKET_NAMESPACE_RESERVED, SOCK_STREAM);
     if(sock < 0)
         TM_DBG_LOG("connectToRild %s\n", strerror(errno));
+    else
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
 #if 0
 	char telephony_mode[] = "0", first_md[] = "0";
 
@@ -1154,217 +1193,204 @@ static int disconnectRild(int sock)
 }
 
 
-#if defined(THERMAL_MD_TP)
-static int new_md_tp_flow(void)
-{
-    int count = 0;
-	int socket;
-	int i = 0;
-	static int thresholds[3] = { 85, 85, 85 };
-	static int new_thresholds[3] = { 85, 85, 85 };
-
-	sleep(60);
-
-	signal(SIGPIPE, handle_pipe);
-
-    // 1. get new configuration about new trip points and sensing period
-
-    // 1.1 connect to ril ==> need to reopen every time
-#if 0
-    {
-        socket = connectToRild(NULL);
-        TM_INFO_LOG("socket %d\n", socket);
-        while (socket == -1) {
-            sleep(5);
-            socket = connectToRild(NULL);
-            TM_INFO_LOG("socket %d\n", socket);
-        }
-    }
+#define MD_TP_PERIOD 5
+#ifndef MD_TP_THRE_PATH
+#define MD_TP_THRE_PATH "/proc/driver/thermal/mdm_mdinfoex_thre"
 #endif
 
-#if 0
-    // read thresholds
-    {
-        if (0 == access("/proc/mtk_mdm_txpwr/mdinfoex_thre", R_OK)) {
-            char buf[80];
-			int fd = open("/proc/mtk_mdm_txpwr/mdinfoex_thre", O_RDONLY);
-			if (fd < 0) {
-				TM_INFO_LOG("Can't open mdinfoex_thre: %s", strerror(errno));
-			}
+/*
+ * One rild connection per request, slots 0..2 set the thresholds and are
+ * closed once answered, the query slot stays open for URCs until the next
+ * period.
+ */
+#define RILD_QUERY 3
+static struct tm_watch rild_watch[RILD_QUERY + 1] = {
+	{ .fd = -1 }, { .fd = -1 }, { .fd = -1 }, { .fd = -1 }
+};
+static struct tm_watch md_tp_timer = { .fd = -1 };
 
-			int len = read(fd, buf, sizeof(buf) - 1);
-			if (len < 0) {
-				TM_INFO_LOG("Can't read mdinfoex_thre: %s", strerror(errno));
-			}
-			close(fd);
-			if (3 == sscanf(buf, "%d,%d,%d,", &thresholds[1], &thresholds[0], &thresholds[2]))
-			else
-				TM_DBG_LOG("%s\n", buf);
-        }
-    }
+/*
+ * thresholds rild has accepted, and the ones sent on rild_watch[0..2]; a
+ * value is only committed once rild answers it, anything else is resent
+ * next period
+ */
+static int md_tp_thresholds[3] = { 85, 85, 85 };
+static int md_tp_pending[3] = { 85, 85, 85 };
 
-    // 2. set threshold first, must check OK
-    // TODO: fix this to read from configuration
-    for (; i<3; i++)
-    {
-        {
-            socket = connectToRild(NULL);
-            TM_DBG_LOG("socket %d\n", socket);
-            while (socket == -1) {
-                sleep(5);
-                socket = connectToRild(NULL);
-                TM_DBG_LOG("socket %d\n", socket);
-            }
-        }
-        setMdTpThreshold(socket, 0, i, thresholds[i]);
+static void rild_handler(struct tm_watch *w, uint32_t events)
+{
+	int slot = (int) (w - rild_watch);
+
+	if (slot != RILD_QUERY) {
+		if (!(events & (EPOLLIN | EPOLLHUP | EPOLLRDHUP | EPOLLERR)))
+			return;
+		/* an OK answer is a non-empty reply other than ERROR */
+		if ((events & EPOLLIN) && recvMdThermalInfo(w->fd, 0, w->opcode) > 0) {
+			md_tp_thresholds[slot] = md_tp_pending[slot];
+			TM_DBG_LOG("threshold %d set to %d\n", slot, md_tp_thresholds[slot]);
+		} else {
+			TM_INFO_LOG("set threshold %d to %d failed, retry next period\n", slot,
+			            md_tp_pending[slot]);
+		}
+		tm_watch_close(w);
+		return;
+	}
 
-        if (0 > recvMdThermalInfo(socket, 0, 0))
-            TM_DBG_LOG("set threshold failed %d\n", i);
+	if (events & EPOLLIN)
+		recvMdThermalInfo(w->fd, 0, w->opcode);
+	if (events & (EPOLLHUP | EPOLLRDHUP | EPOLLERR))
+		tm_watch_close(w);
+}
 
-        disconnectRild(socket);
-    }
-#endif
+static int rild_open(struct tm_watch *w, int opcode)
+{
+	tm_watch_close(w);
+
+	w->fd = connectToRild(NULL);
+	TM_DBG_LOG("socket %d\n", w->fd);
+	if (w->fd < 0)
+		return -1;
+
+	w->handler = rild_handler;
+	w->opcode = opcode;
+	if (tm_watch_add(w, EPOLLIN | EPOLLRDHUP)) {
+		disconnectRild(w->fd);
+		w->fd = -1;
+		return -1;
+	}
+	return 0;
+}
 
-    // 3. enter infinite loop
-    while (1)
-    {
-        // read thresholds
-        {
-            if (0 == access("/proc/driver/thermal/mdm_mdinfoex_thre", R_OK)) {
-                char buf[80];
-    			int fd = open("/proc/driver/thermal/mdm_mdinfoex_thre", O_RDONLY);
-    			if (fd < 0) {
-    				TM_INFO_LOG("Can't open mdinfoex_thre: %s", strerror(errno));
-    			} else {
-	                buf[79] = (char) 0x0;
-	    			int len = read(fd, buf, sizeof(buf) - 1);
-	    			if (len < 0) {
-	    				TM_INFO_LOG("Can't read mdinfoex_thre: %s", strerror(errno));
-	    			}
-	    			close(fd);
-	    			if (3 == sscanf(buf, "%d,%d,%d,", &new_thresholds[1], &new_thresholds[0], &new_thresholds[2]))
-	    			    TM_DBG_LOG("new thresholds: %d,%d,%d\n", new_thresholds[0], new_thresholds[1], new_thresholds[2]);
-	    			else
-	    				TM_DBG_LOG("%s\n", buf);
-                }
-            }
-        }
+static void md_tp_timer_handler(struct tm_watch *w, uint32_t events)
+{
+	static int count = 0;
+#if defined(THERMAL_MD_TP)
+	static int new_thresholds[3] = { 85, 85, 85 };
+	static int thre_fd = -1;
+	char buf[80];
+	int i;
+#endif
+	(void) events;
 
-        // 2. set threshold first, must check OK
-        for (i=0 ; i<3; i++)
-        {
-            if (new_thresholds[i] == thresholds[i]);
-            else
-            {
+	tm_timer_expirations(w->fd);
 
-                thresholds[i] = new_thresholds[i];
+#if defined(THERMAL_MD_TP)
+	// read thresholds
+	if (read_node(MD_TP_THRE_PATH, &thre_fd, buf, sizeof(buf)) >= 0) {
+		if (3 == sscanf(buf, "%d,%d,%d,", &new_thresholds[1], &new_thresholds[0], &new_thresholds[2]))
+			TM_DBG_LOG("new thresholds: %d,%d,%d\n", new_thresholds[0], new_thresholds[1], new_thresholds[2]);
+		else
+			TM_DBG_LOG("%s\n", buf);
+	}
 
-                {
-                    socket = connectToRild(NULL);
-                    TM_DBG_LOG("socket %d\n", socket);
-                    while (socket == -1) {
-                        sleep(5);
-                        socket = connectToRild(NULL);
-                        TM_INFO_LOG("socket %d\n", socket);
-                    }
-                }
-                setMdTpThreshold(socket, 0, i, thresholds[i]);
+	// send thresholds rild has not accepted yet.  a request still unanswered
+	// from the last period is dropped and the current value sent instead,
+	// even if it is the accepted one: rild may have applied the dropped one
+	for (i = 0; i < 3; i++) {
+		if (new_thresholds[i] == md_tp_thresholds[i] && rild_watch[i].fd < 0)
+			continue;
+		if (rild_open(&rild_watch[i], 0))
+			continue;
+		md_tp_pending[i] = new_thresholds[i];
+		if (setMdTpThreshold(rild_watch[i].fd, 0, i, new_thresholds[i]))
+			tm_watch_close(&rild_watch[i]);
+	}
+#endif
 
-                if (0 > recvMdThermalInfo(socket, 0, 0))
-                    TM_DBG_LOG("set threshold failed %d\n", i);
+	count++;
+	TM_DBG_LOG("count %d\n", count);
 
-                disconnectRild(socket);
-            }
-        }
+	// query THERMAL status, the response and URCs arrive on rild_handler
+	if (rild_open(&rild_watch[RILD_QUERY], -1))
+		return;
+	if (queryMdThermalInfo(rild_watch[RILD_QUERY].fd, 0, -1) < 0)
+		tm_watch_close(&rild_watch[RILD_QUERY]);
+}
 
-        count++;
-        TM_DBG_LOG("count %d\n", count);
+#endif
 
-        {
-            socket = connectToRild(NULL);
-            TM_DBG_LOG("socket %d\n", socket);
-            while (socket == -1) {
-                sleep(5);
-                socket = connectToRild(NULL);
-                TM_INFO_LOG("socket %d\n", socket);
-            }
-        }
+static struct tm_watch sig_watch = { .fd = -1 };
 
-        // 4. query THERMAL status
-        // For RF temp & all
-        queryMdThermalInfo(socket, 0, -1);
+/* must run before the pid is published, SIGIO would kill us otherwise */
+static int thermal_loop_init(void)
+{
+	sigset_t mask;
 
-        // 5. recv immediate response
-        recvMdThermalInfo(socket, 0, -1);
+	tm_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (tm_epoll_fd < 0) {
+		TM_INFO_LOG("fail to epoll_create1: %s\n", strerror(errno));
+		return -1;
+	}
 
-#if 0   // only needs to close socket before send...
-        disconnectRild(socket);
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGIO);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+	sig_watch.fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (sig_watch.fd < 0) {
+		TM_INFO_LOG("fail to signalfd: %s\n", strerror(errno));
+		return -1;
+	}
+	sig_watch.handler = signalfd_handler;
+	if (tm_watch_add(&sig_watch, EPOLLIN))
+		return -1;
 
-        // 6. select for interval
-        {
-            socket = connectToRild(NULL);
-            TM_INFO_LOG("socket %d\n", socket);
-            while (socket == -1) {
-                sleep(5);
-                socket = connectToRild(NULL);
-                TM_INFO_LOG("socket %d\n", socket);
-            }
-        }
+#if defined(MD_UL_DR_THROTTLE)
+	tm_timer_create(&dul_timer, dul_timer_handler);
 #endif
 
-        {
-            int ret = 0;
-            fd_set rfds;
-            struct timeval timeout;
-
-            timeout.tv_sec = 5;
-            timeout.tv_usec = 0;
+#if defined(MTK_THERMAL_PA_VIA_ATCMD)
+	signal(SIGPIPE, handle_pipe);
+#ifdef MD_TOGGLE_SUPPORT
+	tm_timer_create(&md_toggle_timer, md_toggle_timer_handler);
+#endif
+	if (0 == tm_timer_create(&md_tp_timer, md_tp_timer_handler)) {
+		struct timespec at;
 
-            TM_DBG_LOG("waiting for URC, count %d timeout %ld\n", count, timeout.tv_sec);
+		// first query after 60s, then every MD_TP_PERIOD
+		clock_gettime(CLOCK_MONOTONIC, &at);
+		at.tv_sec += 60;
+		tm_timer_arm(md_tp_timer.fd, &at, MD_TP_PERIOD);
+	}
+#endif
 
-            FD_ZERO(&rfds);
-            FD_SET(socket, &rfds);
+	return 0;
+}
 
-            ret = select(socket + 1, &rfds, NULL, NULL, &timeout);
-            if (ret < 0)
-            {
-                if (errno == EINTR) {
-	                TM_INFO_LOG("Fail to select. error (%d)\n", errno);
-                    sleep(5);
-	                disconnectRild(socket);
-	                continue;
-                }
-                disconnectRild(socket);
-                TM_INFO_LOG("Fail to select. error (%d), disconnectRild(socket)\n", errno);
-                return -1; // TODO: maybe need to redo allover again
-            }
+/* wait up to timeout ms and dispatch one batch of events */
+static int thermal_loop_dispatch(int timeout)
+{
+	struct epoll_event events[8];
+	int i, n;
 
-            if (ret == 0) // timesout
-            {
-                sleep(5);
-                disconnectRild(socket);
-                continue;
-            }
+	n = epoll_wait(tm_epoll_fd, events, sizeof(events) / sizeof(events[0]), timeout);
+	if (n < 0)
+		return errno == EINTR ? 0 : -1;
 
-            if (FD_ISSET(socket, &rfds))
-            {
-                recvMdThermalInfo(socket, 0, -1);
-            }
+	tm_events = events;
+	tm_event_count = n;
+	for (i = 0; i < n; i++) {
+		struct tm_watch *w = events[i].data.ptr;
 
-            disconnectRild(socket);
-        }
-    }
+		/* closed by an earlier handler of this batch */
+		if (w)
+			w->handler(w, events[i].events);
+	}
+	tm_events = NULL;
+	tm_event_count = 0;
+	return n;
+}
 
-    // 7. close // need to disconnect everytime
-#if 0
-    disconnectRild(socket);
-#endif
+static void thermal_loop_run(void)
+{
+	TM_INFO_LOG("Enter event loop");
 
-    return 0;
+	while (1) {
+		if (thermal_loop_dispatch(-1) < 0) {
+			TM_INFO_LOG("epoll_wait: %s\n", strerror(errno));
+			break;
+		}
+	}
 }
-#endif
-
-#endif
 
 int main(int argc, char *argv[])
 {
@@ -1409,25 +1435,14 @@ int main(int argc, char *argv[])
 		int pid = getpid();
 		int ret = 0;
 		char pid_string[32] = {0};
-		struct sigaction act;
-
-#if defined(MTK_THERMAL_PA_VIA_ATCMD)
-#if !defined(THERMAL_MD_TP)
-		int count = 0;
-		int socket;
-#endif
-#endif
 
 		TM_INFO_LOG("START+++++++++ %d", getpid());
 
-		/* Create signal handler */
-		memset(&act, 0, sizeof(act));
-		act.sa_flags = SA_SIGINFO;
-		//act.sa_handler = signal_handler;
-		act.sa_sigaction = signal_handler;
-		sigemptyset(&act.sa_mask);
-
-		sigaction(SIGIO, &act, NULL);
+		/* Route SIGIO and the throttle timers to the event loop */
+		if (thermal_loop_init()) {
+			TM_INFO_LOG("fail to set up event loop\n");
+			return -1;
+		}
 
 		sprintf(pid_string, "%d", pid);
 
@@ -1510,91 +1525,9 @@ int main(int argc, char *argv[])
 		}
 #endif /* NEVER */
 
-#if defined(MTK_THERMAL_PA_VIA_ATCMD)
-
-#if defined(THERMAL_MD_TP)
-        new_md_tp_flow();
-
-
-#else
-
-
-        sleep(60);
-
-		TM_INFO_LOG("Enter infinite loop\n");
-
-		signal(SIGPIPE, handle_pipe);
-
-
-		while(1)
-		{
-            count++;
-
-            TM_DBG_LOG("count %d\n", count);
-
-            sleep(5); // delay 5s
-
-            // connect to rild...
-            socket = connectToRild(NULL);
-            while (socket == -1) {
-                sleep(1);
-                socket = connectToRild(NULL);
-                TM_DBG_LOG("socket %d\n", socket);
-            }
-
-			{
-			    // For RF temp & all
-                queryMdThermalInfo(socket, 0, -1);
-
-                recvMdThermalInfo(socket, 0, -1);
-			}
-
-			disconnectRild(socket);
-
-#if 0
-			// connect to rild...
-			socket = connectToRild(NULL);
-            while (socket == -1) {
-                sleep(1);
-                socket = connectToRild(NULL);
-                TM_INFO_LOG("socket %d\n", socket);
-            }
-
-			// For AUX ADC
-            queryMdThermalInfo(socket, 0, 0);
-
-            recvMdThermalInfo(socket, 0, 0);
-
-            disconnectRild(socket);
-
-            // connect to rild...
-            socket = connectToRild(NULL);
-            while (socket == -1) {
-                sleep(1);
-                socket = connectToRild(NULL);
-                TM_INFO_LOG("socket %d\n", socket);
-            }
-
-			// For PoP DRAM
-            queryMdThermalInfo(socket, 0, 1);
-
-            recvMdThermalInfo(socket, 0, 1);
-
-            disconnectRild(socket);
-#endif
-		}
-#endif
+		thermal_loop_run();
 
 		TM_INFO_LOG("END-----------\n");
-#else
- 		TM_INFO_LOG("Enter infinite loop");
-
-		while(1) {
-			sleep(100);
-		}
-
-		TM_INFO_LOG("END-----------");
-#endif
 	}
 
 	return 0;
@@ -25,7 +25,10 @@
 #include <stdlib.h>
 #include <sys/mman.h>
 #include <stdint.h>
+#include <limits.h>
 #include <pthread.h>
+#include <sched.h>
+#include <time.h>
 #include "hardware/ccci_intf.h"
 #include "ccci_lib_platform.h"
 #include "ccci_lib.h"
@@ -33,6 +36,23 @@
 /*=================  debug option setting ============================*/
 /* #define CCB_POLL_LOG_EN */
 
+/* orders the page accesses against the index updates MD sees */
+#if defined(__aarch64__) || defined(__arm__)
+#define CCB_MB()        asm volatile("dmb ish":::"memory")
+#define CCB_CPU_RELAX() asm volatile("yield":::"memory")
+#elif defined(__i386__) || defined(__x86_64__)
+#define CCB_MB()        __sync_synchronize()
+#define CCB_CPU_RELAX() asm volatile("pause":::"memory")
+#else
+#define CCB_MB()        __sync_synchronize()
+#define CCB_CPU_RELAX() asm volatile("":::"memory")
+#endif
+
+/* busy poll backoff: cpu relax, then sched_yield(), then sleeps doubling up to the max */
+#define CCB_SPIN_RELAX_ROUNDS   64
+#define CCB_SPIN_YIELD_ROUNDS   (CCB_SPIN_RELAX_ROUNDS + 16)
+#define CCB_SPIN_SLEEP_MAX_US   200
+
 //----------------debug log define-----------------//
 #define LOGV(...) do{ __android_log_print(ANDROID_LOG_VERBOSE, "ccci_lib", __VA_ARGS__); }while(0)
 
@@ -52,8 +72,6 @@
 #define SEC_IMG_AUTH_SIZE	0x100
 #define SEC_IMG_AUTH_ALIGN	0x1000
 
-#define W_BUF_SIZE		(1024*4)
-
 typedef union {
 	struct {
 		unsigned int magic;	/* always IMG_MAGIC */
@@ -82,110 +100,237 @@ static const char *mdimg_node[2] = {
 	"/dev/block/platform/bootdevice/by-name/md3img"
 };
 
-/*return 0 if image is found, and return negative value if not*/
-int find_image_from_pt_internal(int which_md_fd, char *img_name, int *offset, int *img_size)
+/*
+ * Image index of an mdimg partition: the header list is walked once per process and
+ * find/restore look images up there instead of scanning the partition every time.
+ */
+#define IMG_INDEX_MAX		32
+
+struct img_index_entry {
+	char name[IMG_NAME_SIZE];
+	int offset;	/* image data, after the header */
+	int size;
+	uint64_t hdr_checksum;	/* of the whole image header */
+};
+
+struct img_index {
+	int valid;
+	int status;	/* 0 if the list end was reached, else the error the walk stopped on */
+	int num;
+	char partition_path[PARTITION_PATH_LEN];
+	struct img_index_entry entry[IMG_INDEX_MAX];
+};
+
+static struct img_index img_index[2];
+static pthread_mutex_t img_index_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Restored images get a stamp file next to them. The image is skipped on the next
+ * restore if its index entry, the build, a sample of its data in the partition and
+ * the restored file are still the ones the stamp was written for. The sample is
+ * IMG_SAMPLE_NUM blocks spread over the image, first and last included: a modem
+ * flashed again with the same size and header under the same build still differs
+ * there, and reading them costs far less than copying the image.
+ */
+#define IMG_STAMP_MAGIC		0x53544D50
+#define IMG_STAMP_SUFFIX	".stamp"
+#define R_BUF_SIZE		(1024*1024)
+#define IMG_SAMPLE_NUM		16
+#define IMG_SAMPLE_SIZE		4096
+
+struct img_stamp {
+	unsigned int magic;
+	int offset;
+	int size;
+	unsigned int reserved;
+	uint64_t hdr_checksum;
+	uint64_t build_checksum;
+	uint64_t data_checksum;
+	uint64_t dst_ino;
+	int64_t dst_mtime_sec;
+	int64_t dst_mtime_nsec;
+	char partition_path[PARTITION_PATH_LEN];
+};
+
+/* change check of image headers and builds, not a cryptographic hash */
+static uint64_t img_checksum(uint64_t sum, const unsigned char *data, int len)
+{
+	uint64_t word;
+	int i = 0;
+
+	for (; i + 8 <= len; i += 8) {
+		memcpy(&word, data + i, sizeof(word));
+		sum = (sum ^ word) * 0x100000001b3ULL;
+	}
+	for (; i < len; i++)
+		sum = (sum ^ data[i]) * 0x100000001b3ULL;
+	return sum;
+}
+
+static int read_hdr_at(int fd, prt_img_hdr_t *p_hdr, int offset)
+{
+	int load_size = pread(fd, (char *)p_hdr, sizeof(prt_img_hdr_t), (off_t)offset);
+
+	if (load_size != sizeof(prt_img_hdr_t))
+		return load_size < 0 ? -errno : load_size;
+	return sizeof(prt_img_hdr_t);
+}
+
+/* walk the header list of a partition into idx, return idx->status */
+static int img_index_build(int fd, struct img_index *idx)
 {
 	prt_img_hdr_t *p_hdr = NULL;
-	int ret, curr_img_size, load_size, sec_padding_size = 0;
-	int fd = which_md_fd;
+	int ret, curr_img_size, load_size, offset = 0, sec_padding_size = 0;
 
+	idx->num = 0;
 	p_hdr = (prt_img_hdr_t *)malloc(sizeof(prt_img_hdr_t));
 	if (p_hdr == NULL) {
 		LOGE("alloc memory for hdr fail\n");
 		ret = -4;
-		goto find_exit;
+		goto build_exit;
 	}
 	memset(p_hdr, 0, sizeof(prt_img_hdr_t));
-	*offset = 0;
 
 	do {
-		load_size = read(fd, (char *)p_hdr, sizeof(prt_img_hdr_t));
+		load_size = read_hdr_at(fd, p_hdr, offset);
 		if (load_size != sizeof(prt_img_hdr_t)) {
 			LOGE("load hdr fail(%d)\n", load_size);
 			ret = -5;
-			goto find_exit;
+			goto build_exit;
 		}
 		if (p_hdr->info.magic!=IMG_MAGIC) {
-			*offset += sec_padding_size;
-			lseek(fd, (off_t)(*offset), SEEK_SET);
-			load_size = read(fd, (char *)p_hdr, sizeof(prt_img_hdr_t));
+			offset += sec_padding_size;
+			load_size = read_hdr_at(fd, p_hdr, offset);
 			if (load_size != sizeof(prt_img_hdr_t)) {
 				LOGE("load hdr fail again(%d)\n", load_size);
 				ret = -5;
-				goto find_exit;
+				goto build_exit;
 			}
 			if (p_hdr->info.magic!=IMG_MAGIC) {
-				LOGE("invalid magic(%x) at 0x%x, ref(%x)\n", p_hdr->info.magic, *offset, IMG_MAGIC);
+				LOGE("invalid magic(%x) at 0x%x, ref(%x)\n", p_hdr->info.magic, offset, IMG_MAGIC);
 				ret = -6;
-				goto find_exit;
+				goto build_exit;
 			}
 		}
 
-		if (strcmp(img_name, p_hdr->info.name) == 0) {
-			*offset += sizeof(prt_img_hdr_t);
-			*img_size = p_hdr->info.dsize;
-			LOGI("find image %s, offset 0x%x, size 0x%x\n", img_name, *offset, *img_size);
-			ret = 0;
-			break;
+		if (idx->num < IMG_INDEX_MAX) {
+			snprintf(idx->entry[idx->num].name, IMG_NAME_SIZE, "%.*s", IMG_NAME_SIZE - 1, p_hdr->info.name);
+			idx->entry[idx->num].offset = offset + sizeof(prt_img_hdr_t);
+			idx->entry[idx->num].size = p_hdr->info.dsize;
+			idx->entry[idx->num].hdr_checksum = img_checksum(0xcbf29ce484222325ULL, p_hdr->data,
+				sizeof(p_hdr->data));
+			idx->num++;
+		} else {
+			LOGW("image %s not indexed, more than %d images\n", p_hdr->info.name, IMG_INDEX_MAX);
 		}
+
 		if (p_hdr->info.img_list_end == 0) {
 			if (p_hdr->info.align_size != 0)
 				curr_img_size = (p_hdr->info.dsize + p_hdr->info.align_size - 1) &
 					(~(p_hdr->info.align_size -1));
 			else {
 				curr_img_size = p_hdr->info.dsize;
-				LOGI("image %s align size is 0!\n", img_name);
+				LOGI("image %s align size is 0!\n", p_hdr->info.name);
 			}
 			if (p_hdr->info.hdr_size != 0)
 				curr_img_size = p_hdr->info.hdr_size + curr_img_size;
 			else
 				curr_img_size = IMG_HDR_SIZE + curr_img_size;
-			*offset += curr_img_size;
+			offset += curr_img_size;
 			sec_padding_size = ((curr_img_size + SEC_IMG_AUTH_ALIGN - 1) & (~(SEC_IMG_AUTH_ALIGN -1)))
 				- curr_img_size + SEC_IMG_AUTH_SIZE;
-			LOGI("next image offset is 0x%x, sec_padding 0x%x\n", *offset, sec_padding_size);
-
-			ret = lseek(fd, (off_t)(*offset), SEEK_SET);
-			if (ret < 0) {
-				LOGE("lseek err! offset 0x%x, errno %d", *offset, errno);
-				break;
-			}
+			LOGI("next image offset is 0x%x, sec_padding 0x%x\n", offset, sec_padding_size);
 		} else {
-			ret = -7;
+			ret = 0;
 			break;
 		}
 	} while(1);
 
-find_exit:
+build_exit:
 	if (p_hdr) {
 		free(p_hdr);
 		p_hdr = NULL;
 	}
+	idx->status = ret;
+	return ret;
+}
+
+static int img_index_lookup(struct img_index *idx, char *img_name, int *offset, int *img_size,
+	uint64_t *hdr_checksum)
+{
+	int i;
+
+	for (i = 0; i < idx->num; i++) {
+		if (strcmp(img_name, idx->entry[i].name) == 0) {
+			*offset = idx->entry[i].offset;
+			*img_size = idx->entry[i].size;
+			if (hdr_checksum)
+				*hdr_checksum = idx->entry[i].hdr_checksum;
+			LOGI("find image %s, offset 0x%x, size 0x%x\n", img_name, *offset, *img_size);
+			return 0;
+		}
+	}
+	return idx->status ? idx->status : -7;
+}
 
+/*return 0 if image is found, and return negative value if not*/
+int find_image_from_pt_internal(int which_md_fd, char *img_name, int *offset, int *img_size)
+{
+	struct img_index *idx;
+	int ret;
+
+	idx = (struct img_index *)malloc(sizeof(struct img_index));
+	if (idx == NULL) {
+		LOGE("alloc memory for index fail\n");
+		return -4;
+	}
+	*offset = 0;
+	img_index_build(which_md_fd, idx);
+	ret = img_index_lookup(idx, img_name, offset, img_size, NULL);
+	free(idx);
 	return ret;
 }
 
-/*return which md if image is found,0:md1,1:md3, and return negative value if not*/
-int find_image_from_pt(char *img_name, int *offset, int *img_size)
+/* look img_name up in the index of partition which_md, built on first use */
+static int img_index_find(int which_md, char *img_name, int *offset, int *img_size, uint64_t *hdr_checksum)
 {
-	int fd = -1, ret = -1, i = 0;
+	struct img_index *idx = &img_index[which_md];
 	char partition_path[PARTITION_PATH_LEN];
 	char buf[PROPERTY_VALUE_MAX] ={ 0 };
+	int fd, ret;
 
-        AB_image_get(buf);
+	AB_image_get(buf);
+	snprintf(partition_path, PARTITION_PATH_LEN, "%s%s", mdimg_node[which_md], buf);
 
-	for(i = 0; i < 2; i++) {
-		snprintf(partition_path, PARTITION_PATH_LEN, "%s%s", mdimg_node[i], buf);
-		fd = open(partition_path, O_RDONLY);
+	pthread_mutex_lock(&img_index_lock);
+	if (!idx->valid || strcmp(idx->partition_path, partition_path) != 0) {
+		fd = open(partition_path, O_RDONLY | O_CLOEXEC);
 		if (fd < 0) {
 			LOGE("open md1img node %s fail! errno = %d\n", partition_path, errno);
-			continue;
+			pthread_mutex_unlock(&img_index_lock);
+			return -2;
 		}
-		ret = find_image_from_pt_internal(fd, img_name, offset, img_size);
+		img_index_build(fd, idx);
 		close(fd);
-		if(ret != 0) {
-			LOGE("not found img:%s in the %s image\n", img_name, partition_path);
-		}else {
+		snprintf(idx->partition_path, PARTITION_PATH_LEN, "%s", partition_path);
+		idx->valid = 1;
+		LOGI("indexed %d images of %s, status %d\n", idx->num, partition_path, idx->status);
+	}
+	ret = img_index_lookup(idx, img_name, offset, img_size, hdr_checksum);
+	pthread_mutex_unlock(&img_index_lock);
+
+	if (ret != 0)
+		LOGE("not found img:%s in the %s image\n", img_name, partition_path);
+	return ret;
+}
+
+static int img_find(char *img_name, int *offset, int *img_size, uint64_t *hdr_checksum)
+{
+	int ret = -1, i = 0;
+
+	for(i = 0; i < 2; i++) {
+		ret = img_index_find(i, img_name, offset, img_size, hdr_checksum);
+		if (ret == 0) {
 			ret = i;
 			break;
 		}
@@ -193,38 +338,125 @@ int find_image_from_pt(char *img_name, int *offset, int *img_size)
 	return ret;
 }
 
+/*return which md if image is found,0:md1,1:md3, and return negative value if not*/
+int find_image_from_pt(char *img_name, int *offset, int *img_size)
+{
+	return img_find(img_name, offset, img_size, NULL);
+}
+
 static int read_image_from_pt_internal(int which_md_fd, char *img_name, char *buf, int offset, int read_len)
 {
-	int fd = which_md_fd;
-	int ret = -1;
+	int ret = pread(which_md_fd, buf, read_len, (off_t)offset);
 
-	ret = lseek(fd, offset, SEEK_SET);
-	if (ret < 0) {
-		LOGE("lseek mdimg fail! offset = %d, errno = %d\n", offset, errno);
-		return ret;
-	}
-	ret = read(fd, buf, read_len);
 	if (ret < 0)
 		LOGE("read img %s return %d, errno = %d\n", img_name, ret, errno);
-
 	return ret;
 }
 
+static int img_stamp_load(char *restore_path, struct img_stamp *stamp)
+{
+	char stamp_path[PATH_MAX];
+	int fd, ret;
+
+	snprintf(stamp_path, sizeof(stamp_path), "%s%s", restore_path, IMG_STAMP_SUFFIX);
+	fd = open(stamp_path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	ret = read(fd, stamp, sizeof(*stamp));
+	close(fd);
+	if (ret != sizeof(*stamp) || stamp->magic != IMG_STAMP_MAGIC)
+		return -1;
+	stamp->partition_path[PARTITION_PATH_LEN - 1] = '\0';
+	return 0;
+}
+
+static void img_stamp_save(char *restore_path, struct img_stamp *stamp)
+{
+	char stamp_path[PATH_MAX];
+	int fd;
+
+	snprintf(stamp_path, sizeof(stamp_path), "%s%s", restore_path, IMG_STAMP_SUFFIX);
+	fd = open(stamp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0664);
+	if (fd < 0) {
+		LOGW("create %s fail, errno %d\n", stamp_path, errno);
+		return;
+	}
+	if (write(fd, stamp, sizeof(*stamp)) != sizeof(*stamp)) {
+		LOGW("write %s fail, errno %d\n", stamp_path, errno);
+		close(fd);
+		unlink(stamp_path);
+		return;
+	}
+	close(fd);
+}
+
+static void img_stamp_remove(char *restore_path)
+{
+	char stamp_path[PATH_MAX];
+
+	snprintf(stamp_path, sizeof(stamp_path), "%s%s", restore_path, IMG_STAMP_SUFFIX);
+	unlink(stamp_path);
+}
+
+/* checksum of IMG_SAMPLE_NUM blocks of the image, or of all of it if it is smaller */
+static int img_sample_checksum(int fd, char *img_name, int offset, int img_size, uint64_t *sum)
+{
+	unsigned char data[IMG_SAMPLE_SIZE];
+	int64_t pos;
+	int i, len, num = IMG_SAMPLE_NUM;
+
+	*sum = 0xcbf29ce484222325ULL;
+	if (img_size <= IMG_SAMPLE_NUM * IMG_SAMPLE_SIZE)
+		num = (img_size + IMG_SAMPLE_SIZE - 1) / IMG_SAMPLE_SIZE;
+	for (i = 0; i < num; i++) {
+		if (num == IMG_SAMPLE_NUM)
+			pos = (int64_t)(img_size - IMG_SAMPLE_SIZE) * i / (IMG_SAMPLE_NUM - 1);
+		else
+			pos = (int64_t)i * IMG_SAMPLE_SIZE;
+		len = img_size - pos < IMG_SAMPLE_SIZE ? img_size - pos : IMG_SAMPLE_SIZE;
+		if (read_image_from_pt_internal(fd, img_name, (char *)data, offset + pos, len) != len)
+			return -1;
+		*sum = img_checksum(*sum, data, len);
+	}
+	return 0;
+}
+
+/* the restored copy is the one stamp was written for, and still as it was written */
+static int img_stamp_match(char *restore_path, struct img_stamp *stamp)
+{
+	struct img_stamp old_stamp;
+	struct stat st;
+
+	if (img_stamp_load(restore_path, &old_stamp) != 0 || stat(restore_path, &st) != 0)
+		return 0;
+	return old_stamp.offset == stamp->offset && old_stamp.size == stamp->size &&
+		old_stamp.hdr_checksum == stamp->hdr_checksum &&
+		old_stamp.build_checksum == stamp->build_checksum &&
+		old_stamp.data_checksum == stamp->data_checksum &&
+		strcmp(old_stamp.partition_path, stamp->partition_path) == 0 &&
+		st.st_size == stamp->size && old_stamp.dst_ino == (uint64_t)st.st_ino &&
+		old_stamp.dst_mtime_sec == (int64_t)st.st_mtim.tv_sec &&
+		old_stamp.dst_mtime_nsec == (int64_t)st.st_mtim.tv_nsec;
+}
+
 /*return restored image size on success, and return negative value if not*/
 int restore_image_from_pt(char *img_name, char *restore_path)
 {
 	int ret = 0, fd, r_len, rr_len, offset, img_size = 0;
-	int w_count, w_len = 0, which_md = -1, which_md_fd = -1;
-	char buff[W_BUF_SIZE];
+	int w_count, w_len = 0, which_md = -1, which_md_fd = -1, sampled;
+	char *buff;
 	char partition_path[PARTITION_PATH_LEN];
 	char buf[PROPERTY_VALUE_MAX] ={ 0 };
+	struct img_stamp stamp;
+	struct stat st;
+	uint64_t hdr_checksum = 0;
 
 	if (img_name == NULL || restore_path == NULL) {
 		LOGE("invalid arg for restore_image_from_pt\n");
 		return -1;
 	}
 
-	which_md = find_image_from_pt(img_name, &offset, &img_size);
+	which_md = img_find(img_name, &offset, &img_size, &hdr_checksum);
 	if (which_md < 0) {
 		LOGE("not find %s in partition\n", img_name);
 		return -1;
@@ -235,25 +467,54 @@ int restore_image_from_pt(char *img_name, char *restore_path)
 	}
 	LOGI("img %s (size 0x%x) is at 0x%x in partition\n", img_name, img_size, offset);
 
-	fd = creat(restore_path, 0664);
-	if (fd < 0) {
-		LOGE("create %s fail, errno %d\n", restore_path, errno);
-		return -2;
-	}
-
         AB_image_get(buf);
 
 	snprintf(partition_path, PARTITION_PATH_LEN, "%s%s", mdimg_node[which_md], buf);
-	which_md_fd = open(partition_path, O_RDONLY);
+
+	memset(&stamp, 0, sizeof(stamp));
+	stamp.magic = IMG_STAMP_MAGIC;
+	stamp.offset = offset;
+	stamp.size = img_size;
+	stamp.hdr_checksum = hdr_checksum;
+	snprintf(stamp.partition_path, PARTITION_PATH_LEN, "%s", partition_path);
+	memset(buf, 0, sizeof(buf));
+	build_id_get(buf);
+	stamp.build_checksum = img_checksum(0xcbf29ce484222325ULL, (unsigned char *)buf, strlen(buf));
+
+	which_md_fd = open(partition_path, O_RDONLY | O_CLOEXEC);
 	if (which_md_fd < 0) {
 		LOGE("open md1img node %s fail! errno = %d\n", partition_path, errno);
 		return -2;
 	}
 	LOGI("md %s (md id:%d)\n", partition_path, which_md);
+	sampled = img_sample_checksum(which_md_fd, img_name, offset, img_size, &stamp.data_checksum) == 0;
+	if (sampled && img_stamp_match(restore_path, &stamp)) {
+		LOGI("restore %s to %s skipped, unchanged\n", img_name, restore_path);
+		close(which_md_fd);
+		return img_size;
+	}
+	img_stamp_remove(restore_path);
+	posix_fadvise(which_md_fd, offset, img_size, POSIX_FADV_SEQUENTIAL);
+	posix_fadvise(which_md_fd, offset, img_size, POSIX_FADV_WILLNEED);
+
+	buff = (char *)malloc(R_BUF_SIZE);
+	if (buff == NULL) {
+		LOGE("alloc memory for restore fail\n");
+		close(which_md_fd);
+		return -2;
+	}
+
+	fd = creat(restore_path, 0664);
+	if (fd < 0) {
+		LOGE("create %s fail, errno %d\n", restore_path, errno);
+		free(buff);
+		close(which_md_fd);
+		return -2;
+	}
 
 	for (w_count = 0; w_count < img_size;) {
-		if (img_size - w_count > W_BUF_SIZE)
-			r_len = W_BUF_SIZE;
+		if (img_size - w_count > R_BUF_SIZE)
+			r_len = R_BUF_SIZE;
 		else
 			r_len = img_size - w_count;
 		rr_len = read_image_from_pt_internal(which_md_fd, img_name, buff, offset + w_count, r_len);
@@ -278,11 +539,80 @@ int restore_image_from_pt(char *img_name, char *restore_path)
 	}
 	LOGI("restore %s to %s done, return %d\n", img_name, restore_path, ret);
 
+	// the stamp must not get to disk before the data it describes
+	if (sampled && w_count == img_size && fsync(fd) == 0 && fstat(fd, &st) == 0) {
+		stamp.dst_ino = st.st_ino;
+		stamp.dst_mtime_sec = st.st_mtim.tv_sec;
+		stamp.dst_mtime_nsec = st.st_mtim.tv_nsec;
+		img_stamp_save(restore_path, &stamp);
+	}
+
+	free(buff);
 	close(fd);
 	close(which_md_fd);
 	return ret;
 }
 
+struct restore_job {
+	char *img_name;
+	char *restore_path;
+	int ret;
+};
+
+static void *restore_image_thread(void *arg)
+{
+	struct restore_job *job = (struct restore_job *)arg;
+
+	job->ret = restore_image_from_pt(job->img_name, job->restore_path);
+	return NULL;
+}
+
+/*
+ * restore num images at once, one thread each; ret[i] is what restore_image_from_pt()
+ * returns for image i
+ * return value: 0 if all images were restored, else the number of failed ones
+ */
+int restore_images_from_pt(char *img_name[], char *restore_path[], int ret[], int num)
+{
+	struct restore_job *job;
+	pthread_t *thread;
+	int *started;
+	int i, failed = 0;
+
+	job = (struct restore_job *)calloc(num, sizeof(struct restore_job));
+	thread = (pthread_t *)calloc(num, sizeof(pthread_t));
+	started = (int *)calloc(num, sizeof(int));
+	if (job == NULL || thread == NULL || started == NULL) {
+		LOGE("alloc memory for %d restore jobs fail\n", num);
+		free(job);
+		free(thread);
+		free(started);
+		return num;
+	}
+
+	for (i = 0; i < num; i++) {
+		job[i].img_name = img_name[i];
+		job[i].restore_path = restore_path[i];
+		// a thread which cannot be started is run right here
+		if (pthread_create(&thread[i], NULL, restore_image_thread, &job[i]) == 0)
+			started[i] = 1;
+		else
+			restore_image_thread(&job[i]);
+	}
+	for (i = 0; i < num; i++) {
+		if (started[i])
+			pthread_join(thread[i], NULL);
+		ret[i] = job[i].ret;
+		if (ret[i] < 0)
+			failed++;
+	}
+
+	free(job);
+	free(thread);
+	free(started);
+	return failed;
+}
+
 static int parse_info(char raw_data[], int raw_size, char name[], char val[], int size)
 {
     int i, j=0;
@@ -835,6 +1165,12 @@ static inline struct page_header *ccci_ccb_get_page(struct buffer_header *buff_h
     return  (struct page_header *)ptr;
 }
 
+/* data bytes a page holds, page_size counts its page_header too */
+static inline unsigned int ccci_ccb_page_payload(struct buffer_header *buff_h)
+{
+    return buff_h->page_size - sizeof(struct page_header);
+}
+
 /*
  * buffer ID is private to each user, and numbered from 0
  * return value: =NULL: error; !=NULL: valid address to write data
@@ -910,7 +1246,7 @@ int ccci_ccb_write_done(unsigned int buffer_id, unsigned char *address, unsigned
             user->user_id, buffer_id, buff->ul_header->guard_band, buff->ul_header->guard_band_e);
         return -EINVAL;
     }
-    if (length > buff->ul_header->page_size) {
+    if (length > ccci_ccb_page_payload(buff->ul_header)) {
         LOGE("write_done of user%d buffer%d: invalid length=%d\n", user->user_id, buffer_id, length);
         return -EINVAL;
     }
@@ -934,7 +1270,7 @@ int ccci_ccb_write_done(unsigned int buffer_id, unsigned char *address, unsigned
     page->valid_length = length;
 
     // flush data before updating write pointer
-    asm volatile("dmb ish":::"memory");
+    CCB_MB();
 #if DEBUG_MSG_ON
     //add in debug start
     debug_it.buffer_id = buffer_id;
@@ -978,17 +1314,12 @@ static inline unsigned int ccci_ccb_read_available(struct ccci_ccb_control_buff
     return available;
 }
 
-/*
- * input is bitmask of all buffer slots which this user has
- * return value: <0: error; >0: bitmask of availbe buffer slots; =0: nothing new
- */
-int ccci_ccb_poll(unsigned int bitmask) {
-    int ret = 0, available = 0;
+/* bitmask of the buffer slots in bitmask which have DL pages to read */
+static int ccci_ccb_poll_available(unsigned int bitmask)
+{
+    int available = 0;
     unsigned int i;
     struct ccci_ccb_control_buff *buff;
-retry:
-    if (!user)
-        return -EFAULT;
 
     for (i = 0; i < user->buffer_num; i++) {
         if (bitmask & (1 << i)) {
@@ -1026,6 +1357,20 @@ retry:
     LOGD("poll on user%d available=%d, bitmask=%x\n", user->user_id, available, bitmask);
     #endif
 
+    return available;
+}
+
+/*
+ * input is bitmask of all buffer slots which this user has
+ * return value: <0: error; >0: bitmask of availbe buffer slots; =0: nothing new
+ */
+int ccci_ccb_poll(unsigned int bitmask) {
+    int ret = 0, available = 0;
+retry:
+    if (!user)
+        return -EFAULT;
+
+    available = ccci_ccb_poll_available(bitmask);
     if (!available) {
         ret = ioctl(user->fd, CCCI_IOC_SMEM_RX_POLL, &bitmask);
         if (ret < 0) {
@@ -1137,6 +1482,266 @@ int ccci_ccb_read_flush(unsigned int buffer_id)
     return 0;
 }
 
+/************ batched CCB API, several pages per call **********/
+static inline unsigned int ccci_ccb_next_index(unsigned int index, unsigned int page_num)
+{
+    return index + 1 >= page_num ? 0 : index + 1;
+}
+
+static struct ccci_ccb_control_buff *ccci_ccb_get_buff(unsigned int buffer_id)
+{
+    if (!user || buffer_id >= user->buffer_num)
+        return NULL;
+    return user->buffers + buffer_id;
+}
+
+/* page number of a UL data address handed out by write_alloc, -1 if it is none */
+static int ccci_ccb_ul_page_index(struct ccci_ccb_control_buff *buff, unsigned char *address)
+{
+    unsigned char *first = buff->ul_pages->buffer;
+    unsigned long offset;
+
+    if (address < first)
+        return -1;
+    offset = address - first;
+    if (offset % buff->ul_header->page_size || offset / buff->ul_header->page_size >= buff->ul_page_num)
+        return -1;
+    return offset / buff->ul_header->page_size;
+}
+
+/*
+ * reserve up to count UL pages at once, the index is published once for all of them
+ * return value: <0: error; >=0: number of pages put into address[]
+ */
+int ccci_ccb_write_alloc_batch(unsigned int buffer_id, unsigned char **address, unsigned int count)
+{
+    struct ccci_ccb_control_buff *buff;
+    struct page_header *page;
+    unsigned int available, alloc, free_index, i;
+
+    buff = ccci_ccb_get_buff(buffer_id);
+    if (!buff)
+        return -EINVAL;
+    if (buff->ul_header->guard_band != HEADER_MAGIC_AFTER || buff->ul_header->guard_band_e != TAIL_MAGIC_AFTER) {
+        LOGE("write_alloc_batch of user%d buffer%d: MD not ready on UL, pattern=0x%0x, pattern_e=0x%x\n",
+            user->user_id, buffer_id, buff->ul_header->guard_band, buff->ul_header->guard_band_e);
+        return -EINVAL;
+    }
+
+    alloc = buff->ul_header->allocate_index;
+    free_index = buff->ul_header->free_index;
+    if (alloc >= free_index)
+        available = buff->ul_page_num - alloc + free_index - 1;
+    else
+        available = free_index - alloc - 1;
+    if (count > available)
+        count = available;
+
+    for (i = 0; i < count; i++) {
+        page = ccci_ccb_get_page(buff->ul_header, buff->ul_pages, alloc);
+        page->page_status = PAGE_STATUS_ALLOC;
+        address[i] = page->buffer;
+        alloc = ccci_ccb_next_index(alloc, buff->ul_page_num);
+    }
+    buff->ul_header->allocate_index = alloc;
+#if DEBUG_MSG_ON
+    LOGD("write alloc batch of user%d buffer%d alloc=%d free=%d, count=%u", user->user_id, buffer_id,
+        alloc, free_index, count);
+#endif
+    return count;
+}
+
+/*
+ * complete count pages from write_alloc/write_alloc_batch in any order, then move the write
+ * index over all pages done behind one barrier and notify MD once
+ */
+int ccci_ccb_write_done_batch(unsigned int buffer_id, unsigned char **address, const unsigned int *length,
+    unsigned int count)
+{
+    struct ccci_ccb_control_buff *buff;
+    struct page_header *page;
+    struct ccci_ccb_config *config;
+    unsigned int data, i, write, done = 0;
+    int index;
+
+    buff = ccci_ccb_get_buff(buffer_id);
+    if (!buff)
+        return -EINVAL;
+    if (buff->ul_header->guard_band != HEADER_MAGIC_AFTER || buff->ul_header->guard_band_e != TAIL_MAGIC_AFTER) {
+        LOGE("write_done_batch of user%d buffer%d: MD not ready on UL, pattern=0x%0x, pattern=0x%x\n",
+            user->user_id, buffer_id, buff->ul_header->guard_band, buff->ul_header->guard_band_e);
+        return -EINVAL;
+    }
+
+    // check all pages first, so a bad entry leaves none of them done
+    for (i = 0; i < count; i++) {
+        index = ccci_ccb_ul_page_index(buff, address[i]);
+        if (index < 0 || length[i] > ccci_ccb_page_payload(buff->ul_header)) {
+            LOGE("write done batch of user%d buffer%d: invalid page %u, address=%p, length=%d\n",
+                user->user_id, buffer_id, i, address[i], length[i]);
+            return -EINVAL;
+        }
+        page = ccci_ccb_get_page(buff->ul_header, buff->ul_pages, index);
+        if (page->page_status != PAGE_STATUS_ALLOC) {
+            LOGE("write done batch of user%d buffer%d: invalid page%d, address=%p, status=%d\n",
+                user->user_id, buffer_id, index, address[i], page->page_status);
+            return -EINVAL;
+        }
+    }
+    for (i = 0; i < count; i++) {
+        page = ccci_ccb_get_page(buff->ul_header, buff->ul_pages, ccci_ccb_ul_page_index(buff, address[i]));
+        page->valid_length = length[i];
+        page->page_status = PAGE_STATUS_WRITE_DONE;
+    }
+
+    // flush data of all pages before updating write pointer
+    CCB_MB();
+    write = buff->ul_header->write_index;
+    while (write != buff->ul_header->allocate_index) {
+        page = ccci_ccb_get_page(buff->ul_header, buff->ul_pages, write);
+        if (page->page_status != PAGE_STATUS_WRITE_DONE)
+            break;
+        write = ccci_ccb_next_index(write, buff->ul_page_num);
+        done++;
+    }
+    buff->ul_header->write_index = write;
+
+    #ifdef CCB_POLL_LOG_EN
+    LOGD("write done batch of user%d buffer%d: count=%u, published=%u, write=%d, alloc=%d, free=%d\n",
+        user->user_id, buffer_id, count, done, write, buff->ul_header->allocate_index, buff->ul_header->free_index);
+    #endif
+    if (!done)
+        return 0;
+
+    // send tx notify
+    config = ccci_ccb_query_config(user->user_id, buffer_id);
+    data = config->core_id;
+    return ioctl(user->fd, CCCI_IOC_SMEM_TX_NOTIFY, &data);
+}
+
+/*
+ * take up to count DL pages at once, in order; they are given back with read_done_batch
+ * return value: <0: error, -EAGAIN if nothing new; >0: number of pages
+ */
+int ccci_ccb_read_get_batch(unsigned int buffer_id, unsigned char **address, unsigned int *length, unsigned int count)
+{
+    struct ccci_ccb_control_buff *buff;
+    struct page_header *page;
+    unsigned int available, read, i;
+
+    buff = ccci_ccb_get_buff(buffer_id);
+    if (!buff)
+        return -EINVAL;
+    if (buff->dl_header->guard_band_e != TAIL_MAGIC_AFTER) {
+        LOGE("read get batch of user%d buffer%d: MD not ready on DL, pattern=0x%0x, pattern_e=0x%x\n",
+            user->user_id, buffer_id, buff->dl_header->guard_band, buff->dl_header->guard_band_e);
+        return -EINVAL;
+    }
+
+    available = ccci_ccb_read_available(buff);
+    if (!available)
+        return -EAGAIN;
+    if (count > available)
+        count = available;
+    // pages are read after the write index which published them
+    CCB_MB();
+
+    read = buff->dl_header->read_index;
+    for (i = 0; i < count; i++) {
+        page = ccci_ccb_get_page(buff->dl_header, buff->dl_pages, read);
+        if (page->page_status != PAGE_STATUS_WRITE_DONE) {
+            LOGE("read get batch of user%d buffer%d: invalid status=%d, read=%d\n", user->user_id, buffer_id,
+                page->page_status, read);
+            break;
+        }
+        address[i] = page->buffer;
+        length[i] = page->valid_length;
+        read = ccci_ccb_next_index(read, buff->dl_page_num);
+    }
+    if (!i)
+        return -EFAULT;
+    buff->dl_header->read_index = read;
+
+    #ifdef CCB_POLL_LOG_EN
+    LOGD("read get batch of user%d buffer%d: count=%u, read=%d\n", user->user_id, buffer_id, i, read);
+    #endif
+    return i;
+}
+
+/* give count pages, oldest first, back to MD with a single free index update */
+int ccci_ccb_read_done_batch(unsigned int buffer_id, unsigned int count)
+{
+    struct ccci_ccb_control_buff *buff;
+    unsigned int outstanding, free_index;
+
+    buff = ccci_ccb_get_buff(buffer_id);
+    if (!buff)
+        return -EINVAL;
+    if (buff->dl_header->guard_band_e != TAIL_MAGIC_AFTER) {
+        LOGE("read done batch of user%d buffer%d: MD not ready on DL, pattern=0x%0x, pattern_e=0x%x\n",
+            user->user_id, buffer_id, buff->dl_header->guard_band, buff->dl_header->guard_band_e);
+        return -EINVAL;
+    }
+
+    free_index = buff->dl_header->free_index;
+    outstanding = (buff->dl_header->read_index + buff->dl_page_num - free_index) % buff->dl_page_num;
+    if (count > outstanding) {
+        LOGE("read done batch of user%d buffer%d: invalid count=%u, read=%d, free=%d\n", user->user_id, buffer_id,
+                count, buff->dl_header->read_index, free_index);
+        return -EFAULT;
+    }
+
+    // finish reading the pages before MD may reuse them
+    CCB_MB();
+    buff->dl_header->free_index = (free_index + count) % buff->dl_page_num;
+    return 0;
+}
+
+/*
+ * ccci_ccb_poll() which checks the DL indexes itself for up to spin_us before sleeping in
+ * the driver, backing off from cpu relax to sched_yield() to short sleeps meanwhile
+ * return value: same as ccci_ccb_poll()
+ */
+int ccci_ccb_poll_busy(unsigned int bitmask, unsigned int spin_us)
+{
+    struct timespec start, now, delay;
+    unsigned long long elapsed;
+    unsigned int round = 0, sleep_us;
+    int available;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (1) {
+        if (!user)
+            return -EFAULT;
+        available = ccci_ccb_poll_available(bitmask);
+        if (available)
+            return available;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed = (now.tv_sec - start.tv_sec) * 1000000ULL + now.tv_nsec / 1000 - start.tv_nsec / 1000;
+        if (elapsed >= spin_us)
+            break;
+
+        if (round < CCB_SPIN_RELAX_ROUNDS) {
+            CCB_CPU_RELAX();
+        } else if (round < CCB_SPIN_YIELD_ROUNDS) {
+            sched_yield();
+        } else {
+            sleep_us = round - CCB_SPIN_YIELD_ROUNDS < 8 ? 1U << (round - CCB_SPIN_YIELD_ROUNDS) : CCB_SPIN_SLEEP_MAX_US;
+            if (sleep_us > CCB_SPIN_SLEEP_MAX_US)
+                sleep_us = CCB_SPIN_SLEEP_MAX_US;
+            if (sleep_us > spin_us - elapsed)
+                sleep_us = spin_us - elapsed;
+            delay.tv_sec = 0;
+            delay.tv_nsec = sleep_us * 1000L;
+            nanosleep(&delay, NULL);
+        }
+        round++;
+    }
+
+    return ccci_ccb_poll(bitmask);
+}
+
 int ccci_get_ccb_support( CCCI_USER usr_id, CCCI_MD md_id)
 {
 	struct stat buf;
@@ -646,6 +646,12 @@ int ccci_ccb_query_status();
 int ccci_ccb_unregister();
 unsigned char *ccci_ccb_write_alloc(unsigned int buffer_id);
 int ccci_ccb_write_done(unsigned int buffer_id, unsigned char *address, unsigned int length);
+int ccci_ccb_write_alloc_batch(unsigned int buffer_id, unsigned char **address, unsigned int count);
+int ccci_ccb_write_done_batch(unsigned int buffer_id, unsigned char **address, const unsigned int *length,
+    unsigned int count);
+int ccci_ccb_read_get_batch(unsigned int buffer_id, unsigned char **address, unsigned int *length, unsigned int count);
+int ccci_ccb_read_done_batch(unsigned int buffer_id, unsigned int count);
+int ccci_ccb_poll_busy(unsigned int bitmask, unsigned int spin_us);
 int ccci_smem_get(CCCI_MD md_id, CCCI_USER user_id, unsigned char **address, unsigned int *length);
 int ccci_smem_put(int fd, unsigned char *address, unsigned int length);
 int ccci_ccb_get_config(CCCI_MD md_id, CCCI_USER user_id, unsigned int buffer_id, struct ccci_ccb_size *config);
@@ -690,6 +696,7 @@ extern "C" {
 #endif
 int restore_image_from_pt(char *img_name, char *restore_path);
 int find_image_from_pt(char *img_name, int *offset, int *img_size);
+int restore_images_from_pt(char *img_name[], char *restore_path[], int ret[], int num);
 #ifdef __cplusplus
 }
 #endif
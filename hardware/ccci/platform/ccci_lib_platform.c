@@ -22,6 +22,7 @@
 
 
 #define AB_PROPERTY_NAME        "ro.boot.slot_suffix"
+#define BUILD_ID_PROPERTY_NAME  "ro.build.fingerprint"
 
 void AB_image_get(char *buf)
 {
@@ -29,6 +30,13 @@ void AB_image_get(char *buf)
         buf[0] = 0;
 }
 
+/* changes with every system update, so with every image flashed by one */
+void build_id_get(char *buf)
+{
+    if (property_get(BUILD_ID_PROPERTY_NAME, buf, NULL) == 0)
+        buf[0] = 0;
+}
+
 int query_prj_cfg_setting_platform(char name[], char val[], int size)
 {
     char prop_value[PROPERTY_VALUE_MAX] = {0};
@@ -34,3 +34,4 @@
 
 int query_prj_cfg_setting_platform(char name[], char val[], int size);
 void AB_image_get(char *buf);
+void build_id_get(char *buf);
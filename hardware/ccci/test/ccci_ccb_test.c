@@ -0,0 +1,325 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host test of the batched CCB API. The shared memory MD and the driver set up is
+ * emulated in an anonymous mapping: buffer_header pairs in the control area followed
+ * by the DL and UL page_header pages, and the ioctls of the CCB device are answered
+ * here. MD side producers and consumers run as threads on the same layout.
+ */
+
+#include <sys/ioctl.h>
+
+static int test_ioctl(int fd, unsigned long request, void *arg);
+#define ioctl(fd, request, arg) test_ioctl(fd, request, (void *)(arg))
+
+#include "../ccci_lib.c"
+
+#define TEST_BUFFER_NUM     2
+#define TEST_PAGE_SIZE      256
+#define TEST_PAGE_NUM       8
+#define TEST_BUFF_SIZE      (TEST_PAGE_SIZE * TEST_PAGE_NUM)
+#define TEST_STREAM_PAGES   20000
+
+static int tx_notify_count;
+static int rx_poll_count;
+static int failures;
+
+#define EXPECT(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: expect %s failed\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+static int test_ioctl(__attribute__((unused))int fd, unsigned long request, __attribute__((unused))void *arg)
+{
+    if (request == CCCI_IOC_SMEM_TX_NOTIFY) {
+        tx_notify_count++;
+        return 0;
+    }
+    if (request == CCCI_IOC_SMEM_RX_POLL) {
+        rx_poll_count++;
+        errno = ENODEV;
+        return -1;
+    }
+    errno = ENOTTY;
+    return -1;
+}
+
+static unsigned char *test_mem;
+static size_t test_mem_len;
+static struct ccci_ccb_config test_ports[TEST_BUFFER_NUM];
+
+static void test_setup(void)
+{
+    struct buffer_header *header;
+    unsigned char *data;
+    unsigned int i;
+
+    test_mem_len = sizeof(struct buffer_header) * 2 * TEST_BUFFER_NUM + TEST_BUFF_SIZE * 2 * TEST_BUFFER_NUM;
+    test_mem = mmap(NULL, test_mem_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (test_mem == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+
+    for (i = 0; i < TEST_BUFFER_NUM; i++) {
+        test_ports[i].user_id = 0;
+        test_ports[i].core_id = P_CORE;
+        test_ports[i].dl_page_size = test_ports[i].ul_page_size = TEST_PAGE_SIZE;
+        test_ports[i].dl_buff_size = test_ports[i].ul_buff_size = TEST_BUFF_SIZE;
+    }
+    ccci_ccb_ports = test_ports;
+    ccb_info_len = TEST_BUFFER_NUM;
+
+    user = calloc(1, sizeof(struct ccci_ccb_control_user));
+    user->user_id = USR_SMEM_CCB_DHL;
+    user->buffer_num = TEST_BUFFER_NUM;
+    user->buffers = calloc(TEST_BUFFER_NUM, sizeof(struct ccci_ccb_control_buff));
+    user->fd = user->ctrl_fd = -1;
+
+    header = (struct buffer_header *)test_mem;
+    data = test_mem + sizeof(struct buffer_header) * 2 * TEST_BUFFER_NUM;
+    for (i = 0; i < TEST_BUFFER_NUM; i++) {
+        struct ccci_ccb_control_buff *buff = user->buffers + i;
+
+        buff->dl_header = header++;
+        buff->ul_header = header++;
+        buff->dl_header->guard_band = buff->ul_header->guard_band = HEADER_MAGIC_AFTER;
+        buff->dl_header->guard_band_e = buff->ul_header->guard_band_e = TAIL_MAGIC_AFTER;
+        buff->dl_header->page_size = buff->ul_header->page_size = TEST_PAGE_SIZE;
+        buff->dl_header->data_buffer_size = buff->ul_header->data_buffer_size = TEST_BUFF_SIZE;
+        buff->dl_page_num = buff->ul_page_num = TEST_PAGE_NUM;
+        buff->dl_pages = (struct page_header *)data;
+        data += TEST_BUFF_SIZE;
+        buff->ul_pages = (struct page_header *)data;
+        data += TEST_BUFF_SIZE;
+    }
+}
+
+static void test_teardown(void)
+{
+    free(user->buffers);
+    free(user);
+    user = NULL;
+    ccci_ccb_ports = NULL;
+    ccb_info_len = 0;
+    munmap(test_mem, test_mem_len);
+}
+
+/* MD side: publish one DL page */
+static int md_dl_put(struct ccci_ccb_control_buff *buff, unsigned int seq)
+{
+    struct buffer_header *h = buff->dl_header;
+    struct page_header *page;
+    unsigned int write = __atomic_load_n(&h->write_index, __ATOMIC_RELAXED);
+    unsigned int next = ccci_ccb_next_index(write, TEST_PAGE_NUM);
+
+    if (next == __atomic_load_n(&h->free_index, __ATOMIC_ACQUIRE))
+        return 0;
+    page = ccci_ccb_get_page(h, buff->dl_pages, write);
+    memcpy(page->buffer, &seq, sizeof(seq));
+    page->valid_length = sizeof(seq);
+    page->page_status = PAGE_STATUS_WRITE_DONE;
+    __atomic_store_n(&h->write_index, next, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static void test_write_batch(void)
+{
+    struct ccci_ccb_control_buff *buff = user->buffers;
+    unsigned char *addr[TEST_PAGE_NUM], *swap[2];
+    unsigned int len[TEST_PAGE_NUM];
+    unsigned char bogus;
+    int n;
+
+    tx_notify_count = 0;
+    n = ccci_ccb_write_alloc_batch(0, addr, 4);
+    EXPECT(n == 4);
+    EXPECT(buff->ul_header->allocate_index == 4);
+    EXPECT(buff->ul_header->write_index == 0);
+
+    // pages done out of order are not published until the gap is closed
+    len[0] = len[1] = 16;
+    swap[0] = addr[2];
+    swap[1] = addr[3];
+    EXPECT(ccci_ccb_write_done_batch(0, swap, len, 2) == 0);
+    EXPECT(buff->ul_header->write_index == 0);
+    EXPECT(tx_notify_count == 0);
+    EXPECT(ccci_ccb_write_done_batch(0, addr, len, 2) == 0);
+    EXPECT(buff->ul_header->write_index == 4);
+    EXPECT(tx_notify_count == 1);
+
+    // a page already done, or an address not at a page start, fails the whole batch
+    EXPECT(ccci_ccb_write_done_batch(0, addr, len, 1) == -EINVAL);
+    n = ccci_ccb_write_alloc_batch(0, addr, 1);
+    EXPECT(n == 1);
+    swap[0] = addr[0];
+    swap[1] = addr[0] + 1;
+    EXPECT(ccci_ccb_write_done_batch(0, swap, len, 2) == -EINVAL);
+    swap[1] = &bogus;
+    EXPECT(ccci_ccb_write_done_batch(0, swap, len, 2) == -EINVAL);
+    // page_size includes the page header
+    len[0] = TEST_PAGE_SIZE - sizeof(struct page_header) + 1;
+    EXPECT(ccci_ccb_write_done_batch(0, swap, len, 1) == -EINVAL);
+    EXPECT(buff->ul_header->write_index == 4);
+    len[0] = TEST_PAGE_SIZE - sizeof(struct page_header);
+    EXPECT(ccci_ccb_write_done_batch(0, swap, len, 1) == 0);
+    EXPECT(buff->ul_header->write_index == 5);
+    EXPECT(tx_notify_count == 2);
+
+    // MD has freed nothing yet: one page is always kept free
+    n = ccci_ccb_write_alloc_batch(0, addr, TEST_PAGE_NUM);
+    EXPECT(n == 2);
+    EXPECT(ccci_ccb_write_alloc_batch(0, addr + n, 1) == 0);
+    buff->ul_header->free_index = 5;
+    n = ccci_ccb_write_alloc_batch(0, addr, TEST_PAGE_NUM);
+    EXPECT(n == 5);
+    EXPECT(buff->ul_header->allocate_index == 4);
+
+    // the single page API interoperates with the batched one
+    EXPECT(ccci_ccb_write_alloc(0) == NULL);
+    EXPECT(ccci_ccb_write_alloc_batch(TEST_BUFFER_NUM, addr, 1) == -EINVAL);
+}
+
+static void test_read_batch(void)
+{
+    struct ccci_ccb_control_buff *buff = user->buffers + 1;
+    unsigned char *addr[TEST_PAGE_NUM];
+    unsigned int len[TEST_PAGE_NUM], seq;
+    int i, n;
+
+    EXPECT(ccci_ccb_read_get_batch(1, addr, len, TEST_PAGE_NUM) == -EAGAIN);
+    for (i = 0; i < 5; i++)
+        EXPECT(md_dl_put(buff, i) == 1);
+
+    n = ccci_ccb_read_get_batch(1, addr, len, 3);
+    EXPECT(n == 3);
+    n += ccci_ccb_read_get_batch(1, addr + n, len + n, TEST_PAGE_NUM);
+    EXPECT(n == 5);
+    for (i = 0; i < n; i++) {
+        memcpy(&seq, addr[i], sizeof(seq));
+        EXPECT(seq == (unsigned int)i);
+        EXPECT(len[i] == sizeof(seq));
+    }
+    EXPECT(buff->dl_header->read_index == 5);
+
+    EXPECT(ccci_ccb_read_done_batch(1, 6) == -EFAULT);
+    EXPECT(ccci_ccb_read_done_batch(1, 2) == 0);
+    EXPECT(buff->dl_header->free_index == 2);
+    EXPECT(ccci_ccb_read_done_batch(1, 3) == 0);
+    EXPECT(buff->dl_header->free_index == 5);
+    EXPECT(ccci_ccb_read_done_batch(1, 1) == -EFAULT);
+
+    // wrap around
+    for (i = 0; i < TEST_PAGE_NUM - 1; i++)
+        EXPECT(md_dl_put(buff, 100 + i) == 1);
+    EXPECT(md_dl_put(buff, 0) == 0);
+    n = ccci_ccb_read_get_batch(1, addr, len, TEST_PAGE_NUM);
+    EXPECT(n == TEST_PAGE_NUM - 1);
+    memcpy(&seq, addr[n - 1], sizeof(seq));
+    EXPECT(seq == 100 + TEST_PAGE_NUM - 2);
+    EXPECT(ccci_ccb_read_done_batch(1, n) == 0);
+    EXPECT(buff->dl_header->free_index == buff->dl_header->read_index);
+}
+
+static void *md_stream_thread(void *arg)
+{
+    struct ccci_ccb_control_buff *buff = arg;
+    unsigned int seq = 0;
+
+    while (seq < TEST_STREAM_PAGES) {
+        if (md_dl_put(buff, seq))
+            seq++;
+        else
+            sched_yield();
+    }
+    return NULL;
+}
+
+static void *md_delayed_thread(void *arg)
+{
+    usleep(2000);
+    md_dl_put(arg, 0);
+    return NULL;
+}
+
+static void test_stream(void)
+{
+    pthread_t thread;
+    unsigned char *addr[TEST_PAGE_NUM];
+    unsigned int len[TEST_PAGE_NUM], seq, expect = 0;
+    int i, n, mask;
+
+    pthread_create(&thread, NULL, md_stream_thread, user->buffers);
+    while (expect < TEST_STREAM_PAGES) {
+        mask = ccci_ccb_poll_busy(1 << 0, 1000000);
+        EXPECT(mask == 1);
+        if (mask != 1)
+            break;
+        n = ccci_ccb_read_get_batch(0, addr, len, TEST_PAGE_NUM);
+        EXPECT(n > 0);
+        for (i = 0; i < n; i++) {
+            memcpy(&seq, addr[i], sizeof(seq));
+            if (seq != expect) {
+                EXPECT(seq == expect);
+                break;
+            }
+            expect++;
+        }
+        EXPECT(ccci_ccb_read_done_batch(0, n) == 0);
+    }
+    pthread_join(thread, NULL);
+    EXPECT(expect == TEST_STREAM_PAGES);
+}
+
+static void test_poll_busy(void)
+{
+    pthread_t thread;
+    unsigned char *addr;
+    unsigned int len;
+
+    rx_poll_count = 0;
+    // nothing comes: the driver poll is used once the spin time is over
+    EXPECT(ccci_ccb_poll_busy(1 << 1, 500) == -2);
+    EXPECT(rx_poll_count == 1);
+
+    // a page coming within the spin time is seen without the driver
+    pthread_create(&thread, NULL, md_delayed_thread, user->buffers + 1);
+    EXPECT(ccci_ccb_poll_busy(1 << 1, 1000000) == (1 << 1));
+    pthread_join(thread, NULL);
+    EXPECT(rx_poll_count == 1);
+    EXPECT(ccci_ccb_read_get_batch(1, &addr, &len, 1) == 1);
+    EXPECT(ccci_ccb_read_done_batch(1, 1) == 0);
+}
+
+int main(void)
+{
+    test_setup();
+    test_write_batch();
+    test_read_batch();
+    test_stream();
+    test_poll_busy();
+    test_teardown();
+
+    if (failures) {
+        fprintf(stderr, "ccci_ccb_test: %d failures\n", failures);
+        return 1;
+    }
+    printf("ccci_ccb_test: OK\n");
+    return 0;
+}
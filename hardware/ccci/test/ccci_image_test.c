@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host test of the mdimg image index and restore. A file stands in for the md1img
+ * partition, laid out like the real one: image headers, data aligned to align_size,
+ * and for some images the sec auth padding before the next header. The time of a
+ * full restore and of the restore of unchanged images is printed, as ccci_mdinit
+ * sees it on boot.
+ */
+
+#include "../ccci_lib.c"
+
+#define TEST_IMG_NUM    3
+
+static char test_dir[64];
+static char test_partition[sizeof(test_dir) + 8];
+static char test_md3_partition[sizeof(test_dir) + 8];
+
+static const char *test_img_name[TEST_IMG_NUM] = { "md1rom", "md1dsp", "md1drdi" };
+static const int test_img_size[TEST_IMG_NUM] = { 24 * 1024 * 1024 + 5, 3 * 1024 * 1024, 1024 * 1024 + 77 };
+static const int test_img_padding[TEST_IMG_NUM] = { 1, 0, 1 };
+static int test_img_offset[TEST_IMG_NUM];
+static int failures;
+
+#define EXPECT(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: expect %s failed\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+static void fill(unsigned char *data, int len, unsigned int seed)
+{
+    int i;
+
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = seed >> 16;
+    }
+}
+
+static void make_header(prt_img_hdr_t *hdr, int i)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->info.magic = IMG_MAGIC;
+    hdr->info.dsize = test_img_size[i];
+    snprintf(hdr->info.name, IMG_NAME_SIZE, "%s", test_img_name[i]);
+    hdr->info.ext_magic = EXT_MAGIC;
+    hdr->info.hdr_size = IMG_HDR_SIZE;
+    hdr->info.align_size = 16;
+    hdr->info.img_list_end = (i == TEST_IMG_NUM - 1);
+}
+
+static void make_partition(void)
+{
+    prt_img_hdr_t hdr;
+    unsigned char *data;
+    int fd, i, offset = 0, curr_img_size;
+
+    fd = open(test_partition, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(test_partition);
+        exit(1);
+    }
+    for (i = 0; i < TEST_IMG_NUM; i++) {
+        make_header(&hdr, i);
+        pwrite(fd, &hdr, sizeof(hdr), offset);
+
+        data = malloc(test_img_size[i]);
+        fill(data, test_img_size[i], i + 1);
+        test_img_offset[i] = offset + IMG_HDR_SIZE;
+        pwrite(fd, data, test_img_size[i], test_img_offset[i]);
+        free(data);
+
+        curr_img_size = IMG_HDR_SIZE + ((test_img_size[i] + 15) & ~15);
+        offset += curr_img_size;
+        if (test_img_padding[i])
+            offset += ((curr_img_size + SEC_IMG_AUTH_ALIGN - 1) & ~(SEC_IMG_AUTH_ALIGN - 1))
+                - curr_img_size + SEC_IMG_AUTH_SIZE;
+    }
+    close(fd);
+}
+
+static int same_as_image(const char *path, int i)
+{
+    unsigned char *expect, *data;
+    int fd, len, ret;
+
+    expect = malloc(test_img_size[i]);
+    data = malloc(test_img_size[i] + 1);
+    fd = open(test_partition, O_RDONLY);
+    pread(fd, expect, test_img_size[i], test_img_offset[i]);
+    close(fd);
+    fd = open(path, O_RDONLY);
+    len = fd < 0 ? -1 : read(fd, data, test_img_size[i] + 1);
+    if (fd >= 0)
+        close(fd);
+    ret = len == test_img_size[i] && memcmp(expect, data, len) == 0;
+    free(expect);
+    free(data);
+    return ret;
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void test_find(void)
+{
+    int i, offset, size;
+
+    for (i = 0; i < TEST_IMG_NUM; i++) {
+        EXPECT(find_image_from_pt((char *)test_img_name[i], &offset, &size) == 0);
+        EXPECT(offset == test_img_offset[i]);
+        EXPECT(size == test_img_size[i]);
+    }
+    EXPECT(find_image_from_pt("md1none", &offset, &size) < 0);
+
+    i = open(test_partition, O_RDONLY);
+    EXPECT(find_image_from_pt_internal(i, "md1drdi", &offset, &size) == 0);
+    EXPECT(offset == test_img_offset[2]);
+    close(i);
+}
+
+static void test_restore(void)
+{
+    char path[TEST_IMG_NUM][sizeof(test_dir) + 16];
+    char *name[TEST_IMG_NUM], *restore_path[TEST_IMG_NUM];
+    int ret[TEST_IMG_NUM], i, fd;
+    struct stat st0, st1;
+    unsigned char patch[16], *data;
+    prt_img_hdr_t hdr;
+    double t0, t1, t2;
+
+    for (i = 0; i < TEST_IMG_NUM; i++) {
+        snprintf(path[i], sizeof(path[i]), "%s/%s.img", test_dir, test_img_name[i]);
+        name[i] = (char *)test_img_name[i];
+        restore_path[i] = path[i];
+    }
+
+    t0 = now_ms();
+    EXPECT(restore_images_from_pt(name, restore_path, ret, TEST_IMG_NUM) == 0);
+    t1 = now_ms();
+    for (i = 0; i < TEST_IMG_NUM; i++) {
+        EXPECT(ret[i] == test_img_size[i]);
+        EXPECT(same_as_image(path[i], i));
+    }
+
+    // nothing changed: the restored files are kept as they are
+    stat(path[0], &st0);
+    t2 = now_ms();
+    EXPECT(restore_images_from_pt(name, restore_path, ret, TEST_IMG_NUM) == 0);
+    printf("restore %d images: %.1f ms, unchanged: %.1f ms\n", TEST_IMG_NUM, t1 - t0, now_ms() - t2);
+    stat(path[0], &st1);
+    EXPECT(st0.st_ino == st1.st_ino && st0.st_mtim.tv_nsec == st1.st_mtim.tv_nsec &&
+        st0.st_mtim.tv_sec == st1.st_mtim.tv_sec);
+    for (i = 0; i < TEST_IMG_NUM; i++)
+        EXPECT(ret[i] == test_img_size[i]);
+
+    // image flashed again with the same size and header under the same build
+    data = malloc(test_img_size[0]);
+    fill(data, test_img_size[0], 42);
+    fd = open(test_partition, O_WRONLY);
+    pwrite(fd, data, test_img_size[0], test_img_offset[0]);
+    close(fd);
+    free(data);
+    img_index[0].valid = 0;
+    EXPECT(restore_image_from_pt(name[0], path[0]) == test_img_size[0]);
+    EXPECT(same_as_image(path[0], 0));
+
+    // image flashed in place with a new header, seen on the next boot's index
+    fill(patch, sizeof(patch), 99);
+    make_header(&hdr, 1);
+    hdr.info.maddr = 0x1000;
+    fd = open(test_partition, O_WRONLY);
+    pwrite(fd, patch, sizeof(patch), test_img_offset[1] + 4096);
+    pwrite(fd, &hdr, sizeof(hdr), test_img_offset[1] - IMG_HDR_SIZE);
+    close(fd);
+    img_index[0].valid = 0;
+    EXPECT(restore_image_from_pt(name[1], path[1]) == test_img_size[1]);
+    EXPECT(same_as_image(path[1], 1));
+
+    // restored file changed behind the stamp
+    fd = open(path[2], O_WRONLY);
+    pwrite(fd, patch, sizeof(patch), 100);
+    close(fd);
+    EXPECT(!same_as_image(path[2], 2));
+    EXPECT(restore_image_from_pt(name[2], path[2]) == test_img_size[2]);
+    EXPECT(same_as_image(path[2], 2));
+
+    // restored file lost
+    unlink(path[0]);
+    EXPECT(restore_image_from_pt(name[0], path[0]) == test_img_size[0]);
+    EXPECT(same_as_image(path[0], 0));
+
+    EXPECT(restore_image_from_pt("md1none", path[0]) < 0);
+}
+
+int main(void)
+{
+    const char *tmpdir = getenv("TMPDIR");
+    char cmd[sizeof(test_dir) + 8];
+
+    snprintf(test_dir, sizeof(test_dir), "%s/ccci_image_XXXXXX", tmpdir ? tmpdir : "/tmp");
+    if (mkdtemp(test_dir) == NULL) {
+        fprintf(stderr, "ccci_image_test: no scratch directory\n");
+        return 1;
+    }
+    snprintf(test_partition, sizeof(test_partition), "%s/md1img", test_dir);
+    snprintf(test_md3_partition, sizeof(test_md3_partition), "%s/md3img", test_dir);
+    make_partition();
+    mdimg_node[0] = test_partition;
+    mdimg_node[1] = test_md3_partition;
+
+    test_find();
+    test_restore();
+
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", test_dir);
+    system(cmd);
+    if (failures) {
+        fprintf(stderr, "ccci_image_test: %d failures\n", failures);
+        return 1;
+    }
+    printf("ccci_image_test: OK\n");
+    return 0;
+}
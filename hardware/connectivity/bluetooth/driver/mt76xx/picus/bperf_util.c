@@ -1197,13 +1197,13 @@ void bperf_notify_data(const uint8_t *buf, const unsigned int buf_len)
             _bperf_mem_record_event(bperf_event_voice, buf, buf_len);
         }
         /* Nordic Voice Search, Turnkey */
-        else if ( buf[3] == 0x00 && buf[8] == 0x1b && buf[9] == 0x1d && buf[10] == 0x00 )
+        else if ( buf_len > 10 && buf[3] == 0x00 && buf[8] == 0x1b && buf[9] == 0x1d && buf[10] == 0x00 )
         {
             bperf_global_voble_codec = 1;
             _bperf_mem_record_event(bperf_event_voice, buf, buf_len);
         }
         /* Nordic Voice Search, Huitong */
-        else if ( buf[3] == 0x00 && buf[8] == 0x1b && buf[9] == 0x23 && buf[10] == 0x00 )
+        else if ( buf_len > 10 && buf[3] == 0x00 && buf[8] == 0x1b && buf[9] == 0x23 && buf[10] == 0x00 )
         {
             bperf_global_voble_codec = 1;
             _bperf_mem_record_event(bperf_event_voice, buf, buf_len);
@@ -1254,12 +1254,12 @@ void bperf_notify_data(const uint8_t *buf, const unsigned int buf_len)
             _bperf_mem_record_event(bperf_event_hogp_cursor, buf, buf_len);
         }
         /* A2DP Sink */
-        else if ( buf[8] == 0x80 && buf[9] == 0x60 )
+        else if ( buf_len > 9 && buf[8] == 0x80 && buf[9] == 0x60 )
         {
             _bperf_mem_record_event(bperf_event_a2dp, buf, buf_len);
-            if ( buf[20] == 0x00 ) /* SCMS-T */
+            if ( buf_len > 24 && buf[20] == 0x00 ) /* SCMS-T */
                 bperf_global_bitpool = buf[24];
-            else
+            else if ( buf_len > 23 && buf[20] != 0x00 )
                 bperf_global_bitpool = buf[23];
         }
         /* A2DP Src */
@@ -19,16 +19,16 @@
 #include "async_fd_watcher.h"
 
 #include <fcntl.h>
-#include <sys/select.h>
+#include <inttypes.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 
 #include <algorithm>
 #include <atomic>
-#include <condition_variable>
 #include <map>
 #include <mutex>
 #include <thread>
-#include <vector>
 
 #include <log/log.h>
 
@@ -36,17 +36,27 @@ static const int INVALID_FD = -1;
 
 static const int BT_RT_PRIORITY = 1;
 
+// Ready fds returned by one epoll_wait; the HAL watches at most two.
+static const int MAX_EPOLL_EVENTS = 8;
+
 namespace android {
 namespace hardware {
 namespace bluetooth {
 namespace async {
 
 int AsyncFdWatcher::WatchFdForNonBlockingReads(
-    int file_descriptor, const ReadCallback& on_read_fd_ready_callback) {
+    int file_descriptor, const ReadCallback& on_read_fd_ready_callback,
+    bool edge_triggered) {
   // Add file descriptor and callback
   {
     std::unique_lock<std::mutex> guard(internal_mutex_);
-    watched_fds_[file_descriptor] = on_read_fd_ready_callback;
+    bool watched = watched_fds_.count(file_descriptor) != 0;
+    WatchedFd& watched_fd = watched_fds_[file_descriptor];
+    watched_fd.fd = file_descriptor;
+    watched_fd.edge_triggered = edge_triggered;
+    watched_fd.callback = on_read_fd_ready_callback;
+    // Before the thread starts, tryStartThread() adds it with the others.
+    if (epoll_fd_ != INVALID_FD && addToEpoll(&watched_fd, watched)) return -1;
   }
 
   // Start the thread if not started yet
@@ -60,34 +70,82 @@ int AsyncFdWatcher::ConfigureTimeout(
   {
     std::unique_lock<std::mutex> guard(timeout_mutex_);
     timeout_cb_ = on_timeout_callback;
-    timeout_ms_ = timeout;
   }
 
+  return SetTimeout(timeout);
+}
+
+int AsyncFdWatcher::SetTimeout(const std::chrono::milliseconds timeout) {
+  timeout_ms_ = timeout.count();
   notifyThread();
   return 0;
 }
 
 void AsyncFdWatcher::StopWatchingFileDescriptors() { stopThread(); }
 
+AsyncFdWatcherStats AsyncFdWatcher::GetStats() const {
+  AsyncFdWatcherStats stats;
+  stats.wakeups = wakeups_;
+  stats.timeouts = timeouts_;
+  stats.read_callbacks = read_callbacks_;
+  stats.dispatch_us_total = dispatch_us_total_;
+  stats.dispatch_us_max = dispatch_us_max_;
+  return stats;
+}
+
 AsyncFdWatcher::AsyncFdWatcher()
-    : notification_listen_fd_(INVALID_FD),
-      notification_write_fd_(INVALID_FD),
+    : epoll_fd_(INVALID_FD),
+      notification_fd_(INVALID_FD),
       timeout_cb_(nullptr),
-      timeout_ms_(std::chrono::milliseconds(0)) {}
+      timeout_ms_(0) {}
 
 AsyncFdWatcher::~AsyncFdWatcher() {}
 
+int AsyncFdWatcher::addToEpoll(WatchedFd* watched_fd, bool modify) {
+  struct epoll_event event = {};
+  event.events = EPOLLIN;
+  if (watched_fd->edge_triggered) event.events |= EPOLLET;
+  event.data.ptr = watched_fd;
+  if (epoll_ctl(epoll_fd_, modify ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+                watched_fd->fd, &event)) {
+    ALOGE("%s unable to watch fd %d, error %s", __func__, watched_fd->fd,
+          strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
 // Make sure to call this with at least one file descriptor ready to be
 // watched upon or the thread routine will return immediately
 int AsyncFdWatcher::tryStartThread() {
   if (std::atomic_exchange(&running_, true)) return 0;
 
-  // Set up the communication channel
-  int pipe_fds[2] = {INVALID_FD};
-  if (pipe2(pipe_fds, O_NONBLOCK)) return -1;
+  wakeups_ = 0;
+  timeouts_ = 0;
+  read_callbacks_ = 0;
+  dispatch_us_total_ = 0;
+  dispatch_us_max_ = 0;
+
+  {
+    std::unique_lock<std::mutex> guard(internal_mutex_);
+
+    // Set up the communication channel
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ == INVALID_FD) return -1;
+    notification_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (notification_fd_ == INVALID_FD) return -1;
 
-  notification_listen_fd_ = pipe_fds[0];
-  notification_write_fd_ = pipe_fds[1];
+    // data.ptr nullptr is the notification fd.
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, notification_fd_, &event))
+      return -1;
+
+    for (auto& it : watched_fds_) {
+      if (addToEpoll(&it.second, false)) return -1;
+    }
+  }
 
   thread_ = std::thread([this]() { ThreadRoutine(); });
   if (!thread_.joinable()) return -1;
@@ -106,6 +164,10 @@ int AsyncFdWatcher::stopThread() {
   {
     std::unique_lock<std::mutex> guard(internal_mutex_);
     watched_fds_.clear();
+    close(epoll_fd_);
+    close(notification_fd_);
+    epoll_fd_ = INVALID_FD;
+    notification_fd_ = INVALID_FD;
   }
 
   {
@@ -113,15 +175,18 @@ int AsyncFdWatcher::stopThread() {
     timeout_cb_ = nullptr;
   }
 
-  close(notification_listen_fd_);
-  close(notification_write_fd_);
+  ALOGD("%s wakeups %" PRIu64 ", read callbacks %" PRIu64
+        ", timeouts %" PRIu64 ", dispatch max %" PRIu64 " us",
+        __func__, wakeups_.load(), read_callbacks_.load(), timeouts_.load(),
+        dispatch_us_max_.load());
 
   return 0;
 }
 
 int AsyncFdWatcher::notifyThread() {
-  uint8_t buffer[] = {0};
-  if (TEMP_FAILURE_RETRY(write(notification_write_fd_, &buffer, 1)) < 0) {
+  uint64_t value = 1;
+  if (notification_fd_ == INVALID_FD ||
+      TEMP_FAILURE_RETRY(write(notification_fd_, &value, sizeof(value))) < 0) {
     return -1;
   }
   return 0;
@@ -136,27 +201,14 @@ void AsyncFdWatcher::ThreadRoutine() {
           getpid(), gettid(), strerror(errno));
   }
 
+  struct epoll_event events[MAX_EPOLL_EVENTS];
   while (running_) {
-    fd_set read_fds;
-    FD_ZERO(&read_fds);
-    FD_SET(notification_listen_fd_, &read_fds);
-    int max_read_fd = INVALID_FD;
-    for (auto& it : watched_fds_) {
-      FD_SET(it.first, &read_fds);
-      max_read_fd = std::max(max_read_fd, it.first);
-    }
-
-    struct timeval timeout;
-    struct timeval* timeout_ptr = NULL;
-    if (timeout_ms_ > std::chrono::milliseconds(0)) {
-      timeout.tv_sec = timeout_ms_.count() / 1000;
-      timeout.tv_usec = (timeout_ms_.count() % 1000) * 1000;
-      timeout_ptr = &timeout;
-    }
+    // The timeout restarts on every wakeup, as it did with select().
+    int64_t timeout_ms = timeout_ms_;
+    int timeout = timeout_ms > 0 ? static_cast<int>(timeout_ms) : -1;
 
     // Wait until there is data available to read on some FD.
-    int nfds = std::max(notification_listen_fd_, max_read_fd);
-    int retval = select(nfds + 1, &read_fds, NULL, NULL, timeout_ptr);
+    int retval = epoll_wait(epoll_fd_, events, MAX_EPOLL_EVENTS, timeout);
 
     // There was some error.
     if (retval < 0) continue;
@@ -167,31 +219,42 @@ void AsyncFdWatcher::ThreadRoutine() {
       TimeoutCallback saved_cb;
       {
         std::unique_lock<std::mutex> guard(timeout_mutex_);
-        if (timeout_ms_ > std::chrono::milliseconds(0))
+        if (timeout_ms_ > 0)
           saved_cb = timeout_cb_;
       }
-      if (saved_cb != nullptr)
+      if (saved_cb != nullptr) {
+        timeouts_++;
         saved_cb();
+      }
       continue;
     }
 
-    // Read data from the notification FD.
-    if (FD_ISSET(notification_listen_fd_, &read_fds)) {
-      char buffer[] = {0};
-      TEMP_FAILURE_RETRY(read(notification_listen_fd_, buffer, 1));
-      continue;
-    }
+    wakeups_++;
+    auto dispatch_start = std::chrono::steady_clock::now();
 
-    // Invoke the data ready callbacks if appropriate.
+    // Invoke the data ready callbacks of every ready FD.
     {
       // Hold the mutex to make sure that the callbacks are still valid.
       std::unique_lock<std::mutex> guard(internal_mutex_);
-      for (auto& it : watched_fds_) {
-        if (FD_ISSET(it.first, &read_fds)) {
-        it.second(it.first);
+      for (int i = 0; i < retval && running_; i++) {
+        WatchedFd* watched_fd = static_cast<WatchedFd*>(events[i].data.ptr);
+        if (watched_fd == nullptr) {
+          // Read data from the notification FD.
+          uint64_t value;
+          TEMP_FAILURE_RETRY(read(notification_fd_, &value, sizeof(value)));
+          continue;
         }
+        read_callbacks_++;
+        watched_fd->callback(watched_fd->fd);
       }
     }
+
+    uint64_t dispatch_us =
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - dispatch_start)
+            .count();
+    dispatch_us_total_ += dispatch_us;
+    if (dispatch_us > dispatch_us_max_) dispatch_us_max_ = dispatch_us;
   }
 }
 
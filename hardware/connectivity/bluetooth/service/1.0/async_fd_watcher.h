@@ -16,6 +16,9 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <map>
 #include <mutex>
 #include <thread>
@@ -28,24 +31,48 @@ namespace async {
 using ReadCallback = std::function<void(int)>;
 using TimeoutCallback = std::function<void(void)>;
 
+// Counters of the watching thread, since it was last started.
+struct AsyncFdWatcherStats {
+  uint64_t wakeups;            // returns from epoll_wait with ready fds
+  uint64_t timeouts;           // timeout callbacks invoked
+  uint64_t read_callbacks;     // read callbacks invoked
+  uint64_t dispatch_us_total;  // time spent in read callbacks
+  uint64_t dispatch_us_max;    // longest dispatch of a single wakeup
+};
+
 class AsyncFdWatcher {
  public:
   AsyncFdWatcher();
   ~AsyncFdWatcher();
 
+  // With edge_triggered the callback is only invoked again once new data
+  // arrives, so it must read until EAGAIN.
   int WatchFdForNonBlockingReads(int file_descriptor,
-                                 const ReadCallback& on_read_fd_ready_callback);
+                                 const ReadCallback& on_read_fd_ready_callback,
+                                 bool edge_triggered = false);
   int ConfigureTimeout(const std::chrono::milliseconds timeout,
                        const TimeoutCallback& on_timeout_callback);
+  // Changes the timeout of the callback set by ConfigureTimeout() and restarts
+  // it, without taking a lock. A zero timeout disables it.
+  int SetTimeout(const std::chrono::milliseconds timeout);
   void StopWatchingFileDescriptors();
 
+  AsyncFdWatcherStats GetStats() const;
+
  private:
   AsyncFdWatcher(const AsyncFdWatcher&) = delete;
   AsyncFdWatcher& operator=(const AsyncFdWatcher&) = delete;
 
+  struct WatchedFd {
+    int fd;
+    bool edge_triggered;
+    ReadCallback callback;
+  };
+
   int tryStartThread();
   int stopThread();
   int notifyThread();
+  int addToEpoll(WatchedFd* watched_fd, bool modify);
   void ThreadRoutine();
 
   std::atomic_bool running_{false};
@@ -53,11 +80,17 @@ class AsyncFdWatcher {
   std::mutex internal_mutex_;
   std::mutex timeout_mutex_;
 
-  std::map<int, ReadCallback> watched_fds_;
-  int notification_listen_fd_;
-  int notification_write_fd_;
+  std::map<int, WatchedFd> watched_fds_;
+  int epoll_fd_;
+  int notification_fd_;
   TimeoutCallback timeout_cb_;
-  std::chrono::milliseconds timeout_ms_;
+  std::atomic<int64_t> timeout_ms_;
+
+  std::atomic<uint64_t> wakeups_{0};
+  std::atomic<uint64_t> timeouts_{0};
+  std::atomic<uint64_t> read_callbacks_{0};
+  std::atomic<uint64_t> dispatch_us_total_{0};
+  std::atomic<uint64_t> dispatch_us_max_{0};
 };
 
 
@@ -22,8 +22,6 @@
 #include <fcntl.h>
 #include <unistd.h>
 
-#include <thread>
-
 #include <log/log.h>
 
 #include "mediatek/hci_hal_debugger.h"
@@ -53,7 +51,8 @@ size_t H4Protocol::Send(uint8_t type, const uint8_t* data, size_t length) {
 }
 
 void H4Protocol::OnPacketReady() {
-  switch (hci_packet_type_) {
+  HciPacketType packet_type = hci_packetizer_.GetPacketType();
+  switch (packet_type) {
     case HCI_PACKET_TYPE_EVENT:
       event_cb_(hci_packetizer_.GetPacket());
       break;
@@ -68,71 +67,23 @@ void H4Protocol::OnPacketReady() {
       BtHciDebugger::GetInstance()->TriggerFirmwareAssert(kInvalidEventData);
 #endif
       LOG_ALWAYS_FATAL("%s: Unimplemented packet type %d", __func__,
-                       static_cast<int>(hci_packet_type_));
+                       static_cast<int>(packet_type));
   }
 #if defined(MTK_BT_HAL_H4_DEBUG) && (TRUE == MTK_BT_HAL_H4_DEBUG)
   const uint8_t* data = hci_packetizer_.GetPacket().data();
   size_t length = hci_packetizer_.GetPacket().size();
   BtHciDebugger::GetInstance()->Archive(
-      PacketDirectionType::kRx, hci_packet_type_, data, length);
+      PacketDirectionType::kRx, packet_type, data, length);
   BtHciDebugger::GetInstance()->Dump(PacketDirectionType::kRx,
-      hci_packet_type_, data, length);
+      packet_type, data, length);
   BtHciDebugBulletin::GetInstance()->Check(
       PacketDirectionType::kRx, data);
 #endif
-  // Get ready for the next type byte.
-  hci_packet_type_ = HCI_PACKET_TYPE_UNKNOWN;
 }
 
 void H4Protocol::OnDataReady(int fd) {
-  if (hci_packet_type_ == HCI_PACKET_TYPE_UNKNOWN) {
-    uint8_t buffer[1] = {0};
-    ssize_t bytes_read(0);
-    do {
-      bytes_read = TEMP_FAILURE_RETRY(read(fd, buffer, 1));
-      if (bytes_read != 1) {
-        if (bytes_read == 0) {
-#if defined(MTK_BT_HAL_H4_DEBUG) && (TRUE == MTK_BT_HAL_H4_DEBUG)
-          BtHciDebugger::GetInstance()->TriggerFirmwareAssert(
-              kInvalidEventData);
-#endif
-          LOG_ALWAYS_FATAL("%s: Unexpected EOF reading the packet type!",
-              __func__);
-        } else if (bytes_read < 0) {
-#if defined(MTK_BT_HAL_H4_DEBUG) && (TRUE == MTK_BT_HAL_H4_DEBUG)
-          BtHciDebugger::GetInstance()->TriggerFirmwareAssert(
-              kInvalidEventData);
-#endif
-          // MTK BT driver anticipates BT service try again when EAGAIN reported
-          if (EAGAIN == errno) {
-            std::this_thread::yield();
-            continue;
-          }
-          LOG_ALWAYS_FATAL("%s: Read packet type error: %s", __func__,
-              strerror(errno));
-        } else {
-#if defined(MTK_BT_HAL_H4_DEBUG) && (TRUE == MTK_BT_HAL_H4_DEBUG)
-          BtHciDebugger::GetInstance()->TriggerFirmwareAssert(
-              kInvalidEventData);
-#endif
-          LOG_ALWAYS_FATAL("%s: More bytes read than expected (%u)!", __func__,
-              static_cast<unsigned int>(bytes_read));
-        }
-      }
-    } while ((bytes_read < 0) && (EAGAIN == errno));
-    hci_packet_type_ = static_cast<HciPacketType>(buffer[0]);
-    if (hci_packet_type_ != HCI_PACKET_TYPE_ACL_DATA &&
-        hci_packet_type_ != HCI_PACKET_TYPE_SCO_DATA &&
-        hci_packet_type_ != HCI_PACKET_TYPE_EVENT) {
-#if defined(MTK_BT_HAL_H4_DEBUG) && (TRUE == MTK_BT_HAL_H4_DEBUG)
-        BtHciDebugger::GetInstance()->TriggerFirmwareAssert(kInvalidEventData);
-#endif
-      LOG_ALWAYS_FATAL("%s: Unimplemented packet type %d", __func__,
-                       static_cast<int>(hci_packet_type_));
-    }
-  } else {
-    hci_packetizer_.OnDataReady(fd, hci_packet_type_);
-  }
+  // The packetizer reads the type byte of each packet along with it.
+  hci_packetizer_.OnDataReady(fd, HCI_PACKET_TYPE_UNKNOWN);
 }
 
 }  // namespace hci
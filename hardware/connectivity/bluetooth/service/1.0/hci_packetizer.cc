@@ -23,8 +23,6 @@
 #include <fcntl.h>
 #include <unistd.h>
 
-#include <thread>
-
 #include <log/log.h>
 
 namespace {
@@ -53,69 +51,66 @@ const hidl_vec<uint8_t>& HciPacketizer::GetPacket() const {
   return packet_;
 }
 
-void HciPacketizer::OnDataReady(int fd, HciPacketType packet_type) {
-  switch (state_) {
-    case HCI_PREAMBLE: {
-      ssize_t bytes_read(0);
-      do {
-        bytes_read = TEMP_FAILURE_RETRY(
-            read(fd, preamble_ + bytes_read_,
-                 preamble_size_for_type[packet_type] - bytes_read_));
-        if (bytes_read <= 0) {
-          LOG_ALWAYS_FATAL_IF((bytes_read == 0),
-                              "%s: Unexpected EOF reading the header!", __func__);
-          // MTK BT driver anticipates BT service try again when EAGAIN reported
-          if (EAGAIN == errno) {
-            std::this_thread::yield();
-            continue;
-          }
-          LOG_ALWAYS_FATAL("%s: Read header error: %s", __func__,
-                           strerror(errno));
-        }
-      } while ((bytes_read < 0) && (EAGAIN == errno));
-      bytes_read_ += bytes_read;
-      if (bytes_read_ == preamble_size_for_type[packet_type]) {
-        size_t packet_length =
-            HciGetPacketLengthForType(packet_type, preamble_);
-        packet_.resize(preamble_size_for_type[packet_type] + packet_length);
-        memcpy(packet_.data(), preamble_, preamble_size_for_type[packet_type]);
-        bytes_remaining_ = packet_length;
-        state_ = HCI_PAYLOAD;
-        bytes_read_ = 0;
-      }
-      break;
-    }
+HciPacketType HciPacketizer::GetPacketType() const {
+  return packet_type_;
+}
 
-    case HCI_PAYLOAD: {
-      ssize_t bytes_read(0);
-      do {
-        bytes_read = TEMP_FAILURE_RETRY(read(
-            fd,
-            packet_.data() + preamble_size_for_type[packet_type] + bytes_read_,
-            bytes_remaining_));
-        if (bytes_read <= 0) {
-          LOG_ALWAYS_FATAL_IF((bytes_read == 0),
-                              "%s: Unexpected EOF reading the payload!",
-                              __func__);
-          // MTK BT driver anticipates BT service try again when EAGAIN reported
-          if (EAGAIN == errno) {
-            std::this_thread::yield();
-            continue;
-          }
-          LOG_ALWAYS_FATAL("%s: Read payload error: %s", __func__,
-                           strerror(errno));
-        }
-      } while ((bytes_read < 0) && (EAGAIN == errno));
-      bytes_remaining_ -= bytes_read;
-      bytes_read_ += bytes_read;
-      if (bytes_remaining_ == 0) {
-        packet_ready_cb_();
-        state_ = HCI_PREAMBLE;
-        bytes_read_ = 0;
-      }
-      break;
+size_t HciPacketizer::ParsePacket(const uint8_t* data, size_t length,
+                                  HciPacketType packet_type) {
+  size_t type_size = 0;
+  if (packet_type == HCI_PACKET_TYPE_UNKNOWN) {
+    if (length < 1) return 0;
+    packet_type = static_cast<HciPacketType>(data[0]);
+    type_size = 1;
+    if (packet_type < HCI_PACKET_TYPE_COMMAND ||
+        packet_type > HCI_PACKET_TYPE_EVENT) {
+      // Let the owner report it, there is no way to find the next packet.
+      packet_type_ = packet_type;
+      return type_size;
     }
   }
+  size_t preamble_size = preamble_size_for_type[packet_type];
+  if (length < type_size + preamble_size) return 0;
+  size_t packet_length = preamble_size +
+      HciGetPacketLengthForType(packet_type, data + type_size);
+  if (length < type_size + packet_length) return 0;
+  packet_type_ = packet_type;
+  return type_size + packet_length;
+}
+
+void HciPacketizer::OnDataReady(int fd, HciPacketType packet_type) {
+  // Keep a partial packet at the end from running out of room.
+  if (rx_head_ > 0 && kRxBufferSize - rx_tail_ < HCI_PACKET_SIZE_MAX) {
+    memmove(rx_buffer_.data(), rx_buffer_.data() + rx_head_,
+            rx_tail_ - rx_head_);
+    rx_tail_ -= rx_head_;
+    rx_head_ = 0;
+  }
+
+  ssize_t bytes_read = TEMP_FAILURE_RETRY(
+      read(fd, rx_buffer_.data() + rx_tail_, kRxBufferSize - rx_tail_));
+  if (bytes_read <= 0) {
+    LOG_ALWAYS_FATAL_IF((bytes_read == 0), "%s: Unexpected EOF reading!",
+                        __func__);
+    // MTK BT driver reports EAGAIN when it has nothing after all; wait for
+    // the watcher to wake us up again instead of spinning here.
+    if (EAGAIN == errno) return;
+    LOG_ALWAYS_FATAL("%s: Read error: %s", __func__, strerror(errno));
+  }
+  rx_tail_ += bytes_read;
+
+  while (rx_head_ < rx_tail_) {
+    const uint8_t* data = rx_buffer_.data() + rx_head_;
+    size_t length = ParsePacket(data, rx_tail_ - rx_head_, packet_type);
+    if (length == 0) break;
+    size_t type_size = packet_type == HCI_PACKET_TYPE_UNKNOWN ? 1 : 0;
+    packet_.setToExternal(const_cast<uint8_t*>(data) + type_size,
+                          length - type_size);
+    rx_head_ += length;
+    packet_ready_cb_();
+  }
+  packet_.setToExternal(nullptr, 0);
+  if (rx_head_ == rx_tail_) rx_head_ = rx_tail_ = 0;
 }
 
 }  // namespace hci
@@ -17,6 +17,7 @@
 #pragma once
 
 #include <functional>
+#include <vector>
 
 #include <hidl/HidlSupport.h>
 
@@ -30,21 +31,34 @@ namespace hci {
 using ::android::hardware::hidl_vec;
 using HciPacketReadyCallback = std::function<void(void)>;
 
+// Largest packet: ACL preamble plus a 16 bit payload length, and its H4 type.
+const size_t HCI_PACKET_SIZE_MAX = 1 + HCI_ACL_PREAMBLE_SIZE + 0xFFFF;
+
+// Reads whatever the fd has into a receive buffer and hands out every complete
+// packet in it, so one wakeup costs one read() however many packets arrived.
+// Packets are passed in place: GetPacket() is only valid within the callback.
 class HciPacketizer {
  public:
   HciPacketizer(HciPacketReadyCallback packet_cb)
-      : packet_ready_cb_(packet_cb){};
+      : packet_ready_cb_(packet_cb), rx_buffer_(kRxBufferSize){};
+  // With HCI_PACKET_TYPE_UNKNOWN every packet starts with its H4 type byte.
   void OnDataReady(int fd, HciPacketType packet_type);
   const hidl_vec<uint8_t>& GetPacket() const;
+  HciPacketType GetPacketType() const;
 
  protected:
-  enum State { HCI_PREAMBLE, HCI_PAYLOAD };
-  State state_{HCI_PREAMBLE};
-  uint8_t preamble_[HCI_PREAMBLE_SIZE_MAX];
-  hidl_vec<uint8_t> packet_;
-  size_t bytes_remaining_{0};
-  size_t bytes_read_{0};
+  static const size_t kRxBufferSize = 2 * HCI_PACKET_SIZE_MAX;
+
+  // Length of the packet at the start of data, 0 if it is not complete yet.
+  size_t ParsePacket(const uint8_t* data, size_t length,
+                     HciPacketType packet_type);
+
   HciPacketReadyCallback packet_ready_cb_;
+  std::vector<uint8_t> rx_buffer_;
+  size_t rx_head_{0};
+  size_t rx_tail_{0};
+  hidl_vec<uint8_t> packet_;
+  HciPacketType packet_type_{HCI_PACKET_TYPE_UNKNOWN};
 };
 
 }  // namespace hci
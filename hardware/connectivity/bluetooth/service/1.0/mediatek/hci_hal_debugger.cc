@@ -22,15 +22,14 @@
 
 #include <cutils/properties.h>
 #include <inttypes.h>
-#include <sys/time.h>
 #include <time.h>
 #include <utils/Log.h>
 
-#include <climits>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cstdio>
 #include <cstring>
-#include <mutex>
 #include <thread>
 #include <vector>
 
@@ -54,69 +53,120 @@ std::string PacketDirTypeToString(PacketDirectionType type) {
 
 constexpr int kMaxDumpPacketDataLength(16);
 struct BtHciDebugPacket {
-  PacketDirectionType dir_type;
-  uint8_t packet_type;
-  std::vector<uint8_t> data;
+  uint64_t timestamp_ns;  // CLOCK_MONOTONIC
   uint16_t data_length;
-  std::string time_tag;
+  uint8_t packet_type;
+  uint8_t dump_length;
+  uint8_t data[kMaxDumpPacketDataLength];
+};
+
+// Packets of one direction. TX is archived from every hwbinder thread that
+// sends and from the vendor library, so a writer claims its slot by bumping
+// count_ and marks the slot with a sequence: odd while the slot is written,
+// even once packet n is in it. A reader keeps a slot only if it saw the same
+// finished sequence before and after copying it. A writer that finds its slot
+// busy or already holding a newer packet drops its packet.
+constexpr uint32_t kCircularSize(32);  // power of two, so count_ may wrap
+class alignas(64) BtHciPacketRing {
+ public:
+  BtHciPacketRing() : slots_(), count_(0) {}
+
+  void Archive(uint8_t type, const uint8_t* data, uint16_t data_length) {
+    uint32_t n = count_.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = slots_[n % kCircularSize];
+    uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+    if ((seq & 1) || static_cast<int32_t>(Written(n) - seq) <= 0 ||
+        !slot.seq.compare_exchange_strong(seq, Written(n) - 1,
+            std::memory_order_acquire)) {
+      return;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    BtHciDebugPacket& packet = slot.packet;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    packet.timestamp_ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    packet.data_length = data_length;
+    packet.packet_type = type;
+    packet.dump_length = (data_length < kMaxDumpPacketDataLength)
+        ? data_length : kMaxDumpPacketDataLength;
+    std::memcpy(packet.data, data, packet.dump_length);
+    slot.seq.store(Written(n), std::memory_order_release);
+  }
+
+  // Copies the archived packets, oldest first, and returns how many.
+  size_t Snapshot(BtHciDebugPacket* packets) const {
+    uint32_t end = count_.load(std::memory_order_acquire);
+    uint32_t num = std::min(end, kCircularSize);
+    size_t valid = 0;
+    for (uint32_t n = end - num; n != end; n++) {
+      const Slot& slot = slots_[n % kCircularSize];
+      uint32_t seq = slot.seq.load(std::memory_order_acquire);
+      std::memcpy(&packets[valid], &slot.packet, sizeof(BtHciDebugPacket));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (seq == Written(n) &&
+          slot.seq.load(std::memory_order_relaxed) == seq) {
+        valid++;
+      }
+    }
+    // Writers take their timestamps after claiming a slot, so claim order
+    // and time order may differ by a few packets.
+    std::stable_sort(packets, packets + valid,
+        [](const BtHciDebugPacket& a, const BtHciDebugPacket& b) {
+          return a.timestamp_ns < b.timestamp_ns;
+        });
+    return valid;
+  }
+
+ private:
+  struct Slot {
+    std::atomic<uint32_t> seq;  // 0 until the first packet
+    BtHciDebugPacket packet;
+  };
+
+  static uint32_t Written(uint32_t n) { return 2 * n + 2; }
+
+  Slot slots_[kCircularSize];
+  std::atomic<uint32_t> count_;
 };
 
-constexpr int kCircularSize(30);
 class BtHciDebuggerImpl {
  public:
   BtHciDebuggerImpl() :
-      head_index_(0),
-      count_(0),
       is_bt_hal_debug_on_(false),
       is_coredump_set_(false),
-      lib_interface_(nullptr) {
-    packets_info_.resize(kCircularSize);
-  }
+      lib_interface_(nullptr) {}
   ~BtHciDebuggerImpl() = default;
 
   void Archive(PacketDirectionType dir_type,
       uint8_t type,
       const uint8_t* data,
       uint16_t data_length) {
-    // Adding mutex synchronization here may drag down TX/RX a bit
-    // If it is with concern, it is could be removed and replaced
-    // two separate TX/RX packets_info_ circular array to archive
-    // packets data in the respective TX/RX thread
-    std::lock_guard<std::mutex> lock(packets_mutex_);
-    head_index_ = count_ % kCircularSize;
-    uint16_t dump_len = (data_length < kMaxDumpPacketDataLength)
-        ? data_length : kMaxDumpPacketDataLength;
-    BtHciDebugPacket packet = {
-        dir_type,
-        type,
-        std::vector<uint8_t>(data, data + dump_len),
-        data_length,
-        GetLogTimeTag()
-    };
-    packets_info_[head_index_] = packet;
+    // Runs on every TX/RX packet: no lock, allocation or time formatting
+    // here, only a copy into the ring of the packet's direction.
+    rings_[dir_type == kTx ? kTx : kRx].Archive(type, data, data_length);
 #if defined(MTK_BT_HAL_SELF_DEBUG) && (TRUE == MTK_BT_HAL_SELF_DEBUG)
-    ALOGW("%s: head_index_: %d, count_: %d", __func__, head_index_, count_);
-    ALOGW("%s: %s, time:%s, packet type: %u, data len: %u, data: %s",
-        __func__,
-        PacketDirTypeToString(packet.dir_type).c_str(),
-        packet.time_tag.c_str(),
-        packet.packet_type,
-        packet.data_length,
-        DataArrayToString<uint8_t>(
-            packet.data.data(), packet.data.size()).c_str());
+    ALOGW("%s: %s, packet type: %u, data len: %u", __func__,
+        PacketDirTypeToString(dir_type).c_str(), type, data_length);
 #endif
-    if (INT_MAX == (count_ + 1)) {
-      count_ = 0;
-    }
-    count_++;
   }
 
   void OnNotify() const {
-    for (int i = head_index_; i < kCircularSize; i++) {
-      LogArchivedData(packets_info_[i]);
-    }
-    for (int i = 0; i < head_index_; i++) {
-      LogArchivedData(packets_info_[i]);
+    BtHciDebugPacket tx[kCircularSize], rx[kCircularSize];
+    size_t tx_count = rings_[kTx].Snapshot(tx);
+    size_t rx_count = rings_[kRx].Snapshot(rx);
+
+    // Log both directions merged in time order.
+    struct timespec mono, real;
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    clock_gettime(CLOCK_REALTIME, &real);
+    size_t i = 0, j = 0;
+    while (i < tx_count || j < rx_count) {
+      if (j == rx_count ||
+          (i < tx_count && tx[i].timestamp_ns <= rx[j].timestamp_ns)) {
+        LogArchivedData(kTx, tx[i++], mono, real);
+      } else {
+        LogArchivedData(kRx, rx[j++], mono, real);
+      }
     }
   }
 
@@ -170,55 +220,44 @@ class BtHciDebuggerImpl {
   }
 
  private:
-  void LogArchivedData(const BtHciDebugPacket& packet) const {
+  void LogArchivedData(PacketDirectionType dir_type,
+      const BtHciDebugPacket& packet,
+      const struct timespec& mono,
+      const struct timespec& real) const {
     ALOGW("%s: %s, time:%s, packet type: %u, data len: %u, data: %s",
         __func__,
-        PacketDirTypeToString(packet.dir_type).c_str(),
-        packet.time_tag.c_str(),
+        PacketDirTypeToString(dir_type).c_str(),
+        GetLogTimeTag(packet.timestamp_ns, mono, real).c_str(),
         packet.packet_type,
         packet.data_length,
         DataArrayToString<uint8_t>(
-            packet.data.data(), packet.data.size()).c_str());
-  }
-
-  size_t GetTimeofDayInMicroSec(void) const {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return static_cast<size_t>(tv.tv_usec);
+            packet.data, packet.dump_length).c_str());
   }
 
-  std::string GetLogTimeTag() const {
+  // Wall clock time of a CLOCK_MONOTONIC timestamp, given both clocks now.
+  std::string GetLogTimeTag(uint64_t timestamp_ns,
+      const struct timespec& mono, const struct timespec& real) const {
     char curtime[64] = {0};
-    struct tm* tmp = NULL;
-    time_t lt;
-    /* get current time */
-    lt = time(NULL);
-    tmp = localtime(&lt);
-    if (tmp == NULL){
+    struct tm tm_time;
+    uint64_t mono_ns = mono.tv_sec * 1000000000ULL + mono.tv_nsec;
+    uint64_t real_ns = real.tv_sec * 1000000000ULL + real.tv_nsec;
+    uint64_t packet_ns = real_ns - (mono_ns - timestamp_ns);
+    time_t lt = static_cast<time_t>(packet_ns / 1000000000ULL);
+    if (localtime_r(&lt, &tm_time) == NULL) {
       ALOGE("%s: log time is NULL ", __func__);
       return curtime;
     }
-    strftime(curtime, sizeof(curtime), "%m-%d %H:%M:%S", tmp);
-#if defined(MTK_BT_HAL_SELF_DEBUG) && (TRUE == MTK_BT_HAL_SELF_DEBUG)
-    ALOGW("%s: log time : %s.", __func__, curtime);
-#endif
+    strftime(curtime, sizeof(curtime), "%m-%d %H:%M:%S", &tm_time);
     size_t str_len = strlen(curtime);
     std::snprintf(curtime + str_len,
         sizeof(curtime) - str_len,
-        ".%06zu", GetTimeofDayInMicroSec());
-#if defined(MTK_BT_HAL_SELF_DEBUG) && (TRUE == MTK_BT_HAL_SELF_DEBUG)
-    ALOGW("%s: log time with ms suffix: %s.", __func__, curtime);
-#endif
+        ".%06d", static_cast<int>(packet_ns % 1000000000ULL / 1000));
     return std::string(curtime);
   }
 
-  std::vector<BtHciDebugPacket> packets_info_;
-  int head_index_;
-  int count_;
+  BtHciPacketRing rings_[2];  // indexed by PacketDirectionType
   bool is_bt_hal_debug_on_;
 
-  std::mutex packets_mutex_;
-
   // MTK controller core dump trigger mechanism
   bool is_coredump_set_;
   const bt_vendor_interface_t* lib_interface_;
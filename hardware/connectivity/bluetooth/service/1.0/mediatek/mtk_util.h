@@ -61,7 +61,7 @@ template <typename T>
 std::unique_ptr<T> Singleton<T>::instance_ = nullptr;
 
 #if __GLIBC__
-pid_t gettid() {
+inline pid_t gettid() {
   return syscall(SYS_gettid);
 }
 #endif
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "mtk.hal.bt-async-fd-watcher-unittest"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <gtest/gtest.h>
+#include <log/log.h>
+
+#include "async_fd_watcher.h"
+
+namespace {
+
+using android::hardware::bluetooth::async::AsyncFdWatcher;
+using android::hardware::bluetooth::async::AsyncFdWatcherStats;
+
+constexpr int kTestWaitingTimeInMs = 500;
+
+class AsyncFdWatcherTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_EQ(0, pipe2(pipe_a_, O_NONBLOCK));
+    ASSERT_EQ(0, pipe2(pipe_b_, O_NONBLOCK));
+  }
+
+  void TearDown() override {
+    watcher_.StopWatchingFileDescriptors();
+    close(pipe_a_[0]);
+    close(pipe_a_[1]);
+    close(pipe_b_[0]);
+    close(pipe_b_[1]);
+  }
+
+  // Waits until count reaches expected or the test waiting time passes.
+  static bool WaitFor(const std::atomic_int& count, int expected) {
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(kTestWaitingTimeInMs);
+    while (count < expected) {
+      if (std::chrono::steady_clock::now() > deadline) return false;
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+  }
+
+  AsyncFdWatcher watcher_;
+  int pipe_a_[2];
+  int pipe_b_[2];
+};
+
+TEST_F(AsyncFdWatcherTest, ReadCallbacksOfAllReadyFds) {
+  std::atomic_int bytes_a{0}, bytes_b{0};
+  auto drain = [](std::atomic_int* bytes) {
+    return [bytes](int fd) {
+      char buffer[16];
+      ssize_t ret;
+      while ((ret = read(fd, buffer, sizeof(buffer))) > 0) *bytes += ret;
+    };
+  };
+  ASSERT_EQ(0, watcher_.WatchFdForNonBlockingReads(pipe_a_[0], drain(&bytes_a)));
+  ASSERT_EQ(0, watcher_.WatchFdForNonBlockingReads(pipe_b_[0], drain(&bytes_b)));
+
+  ASSERT_EQ(3, write(pipe_a_[1], "abc", 3));
+  ASSERT_EQ(2, write(pipe_b_[1], "de", 2));
+  EXPECT_TRUE(WaitFor(bytes_a, 3));
+  EXPECT_TRUE(WaitFor(bytes_b, 2));
+
+  AsyncFdWatcherStats stats = watcher_.GetStats();
+  EXPECT_GE(stats.read_callbacks, 2u);
+  EXPECT_GE(stats.wakeups, 1u);
+  EXPECT_LE(stats.wakeups, stats.read_callbacks + 1);
+}
+
+TEST_F(AsyncFdWatcherTest, EdgeTriggeredOnlyOnNewData) {
+  std::atomic_int calls{0};
+  // Reads a single byte, so data is left behind on every call.
+  ASSERT_EQ(0, watcher_.WatchFdForNonBlockingReads(
+                   pipe_a_[0],
+                   [&calls](int fd) {
+                     char c;
+                     read(fd, &c, 1);
+                     calls++;
+                   },
+                   true));
+
+  ASSERT_EQ(4, write(pipe_a_[1], "abcd", 4));
+  EXPECT_TRUE(WaitFor(calls, 1));
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(1, calls);
+
+  ASSERT_EQ(1, write(pipe_a_[1], "e", 1));
+  EXPECT_TRUE(WaitFor(calls, 2));
+}
+
+TEST_F(AsyncFdWatcherTest, SetTimeoutRestartsAndStops) {
+  std::atomic_int timeouts{0};
+  ASSERT_EQ(0, watcher_.WatchFdForNonBlockingReads(pipe_a_[0], [](int) {}));
+  watcher_.ConfigureTimeout(std::chrono::milliseconds(0),
+                            [&timeouts]() { timeouts++; });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(0, timeouts);
+
+  watcher_.SetTimeout(std::chrono::milliseconds(10));
+  EXPECT_TRUE(WaitFor(timeouts, 1));
+
+  watcher_.SetTimeout(std::chrono::milliseconds(0));
+  int stopped = timeouts;
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_LE(timeouts, stopped + 1);
+  EXPECT_GE(watcher_.GetStats().timeouts, 1u);
+}
+
+}  // namespace
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "mtk.bt.debugger-benchmark"
+
+#include <sys/time.h>
+#include <time.h>
+
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <log/log.h>
+
+#include "hci_hal_debugger.h"
+
+using vendor::mediatek::bluetooth::hal::BtHciDebugger;
+using vendor::mediatek::bluetooth::hal::PacketDirectionType;
+
+namespace {
+
+// The archive as it was: one mutex for both directions, a vector copy and a
+// formatted wall clock time tag per packet.
+class LegacyArchive {
+ public:
+  LegacyArchive() { packets_info_.resize(kCircularSize); }
+
+  void Archive(PacketDirectionType dir_type, uint8_t type, const uint8_t* data,
+               uint16_t data_length) {
+    std::lock_guard<std::mutex> lock(packets_mutex_);
+    head_index_ = count_ % kCircularSize;
+    uint16_t dump_len = (data_length < kMaxDumpPacketDataLength)
+        ? data_length : kMaxDumpPacketDataLength;
+    Packet packet = {dir_type, type,
+                     std::vector<uint8_t>(data, data + dump_len), data_length,
+                     GetLogTimeTag()};
+    packets_info_[head_index_] = packet;
+    if (INT_MAX == (count_ + 1)) {
+      count_ = 0;
+    }
+    count_++;
+  }
+
+ private:
+  static constexpr int kMaxDumpPacketDataLength = 16;
+  static constexpr int kCircularSize = 30;
+
+  struct Packet {
+    PacketDirectionType dir_type;
+    uint8_t packet_type;
+    std::vector<uint8_t> data;
+    uint16_t data_length;
+    std::string time_tag;
+  };
+
+  std::string GetLogTimeTag() const {
+    char curtime[64] = {0};
+    time_t lt = time(NULL);
+    struct tm* tmp = localtime(&lt);
+    if (tmp == NULL) return curtime;
+    strftime(curtime, sizeof(curtime), "%m-%d %H:%M:%S", tmp);
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    size_t str_len = strlen(curtime);
+    std::snprintf(curtime + str_len, sizeof(curtime) - str_len, ".%06zu",
+                  static_cast<size_t>(tv.tv_usec));
+    return std::string(curtime);
+  }
+
+  std::vector<Packet> packets_info_;
+  int head_index_{0};
+  int count_{0};
+  std::mutex packets_mutex_;
+};
+
+// An ACL packet as archived by the H4 TX and RX paths.
+const uint8_t kPacket[] = {0x03, 0x20, 0x1B, 0x00, 0x17, 0x00, 0x04, 0x00,
+                           0x1B, 0x2A, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05,
+                           0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D,
+                           0x0E, 0x0F, 0x10, 0x11, 0x12, 0x13, 0x14};
+
+// With two threads, thread 0 archives TX and thread 1 RX, as the HAL does.
+PacketDirectionType Direction(const benchmark::State& state) {
+  return state.thread_index() == 0 ? vendor::mediatek::bluetooth::hal::kTx
+                                   : vendor::mediatek::bluetooth::hal::kRx;
+}
+
+void BM_Archive(benchmark::State& state) {
+  BtHciDebugger* debugger = BtHciDebugger::GetInstance();
+  PacketDirectionType dir = Direction(state);
+  for (auto _ : state) {
+    debugger->Archive(dir, 0x02, kPacket, sizeof(kPacket));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+LegacyArchive* legacy_archive = new LegacyArchive();
+
+void BM_LegacyArchive(benchmark::State& state) {
+  PacketDirectionType dir = Direction(state);
+  for (auto _ : state) {
+    legacy_archive->Archive(dir, 0x02, kPacket, sizeof(kPacket));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+}  // namespace
+
+BENCHMARK(BM_Archive)->Threads(1)->Threads(2);
+BENCHMARK(BM_LegacyArchive)->Threads(1)->Threads(2);
+
+BENCHMARK_MAIN();
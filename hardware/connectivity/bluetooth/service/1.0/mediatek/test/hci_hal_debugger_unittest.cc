@@ -19,6 +19,8 @@
 #define LOG_TAG "mtk.bt.logtool-unittest"
 
 #include <memory>
+#include <thread>
+#include <vector>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
@@ -166,6 +168,52 @@ TEST_F(HalH4DebuggerTest, TriggerCoreDump) {
   EXPECT_TRUE(BtHciDebugger::GetInstance()->TriggerFirmwareAssert(kCommandTimedout));
 }
 
+TEST_F(HalH4DebuggerTest, ArchiveFromTxAndRxThreads) {
+  const int kPacketCount(10000);
+  const uint8_t kAclData[] = {0x03, 0x20, 0x05, 0x00, 0x01, 0x00, 0x04, 0x00,
+                              0x1B, 0x2A, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05,
+                              0x06, 0x07, 0x08};
+  auto archive = [&kAclData](PacketDirectionType dir) {
+    for (int i = 0; i < kPacketCount; i++) {
+      BtHciDebugger::GetInstance()->Archive(dir, 0x02, kAclData,
+          (i % sizeof(kAclData)) + 1);
+    }
+  };
+  std::thread tx(archive, kTx);
+  std::thread rx(archive, kRx);
+  // Dumping while both directions archive must not block or tear them.
+  for (int i = 0; i < 10; i++) {
+    BtHciDebugger::GetInstance()->OnNotify();
+  }
+  tx.join();
+  rx.join();
+  BtHciDebugger::GetInstance()->OnNotify();
+}
+
+TEST_F(HalH4DebuggerTest, ArchiveTxFromSeveralThreads) {
+  const int kThreadCount(5);
+  const int kPacketCount(10000);
+  const uint8_t kCommand[] = {0x03, 0x0C, 0x00};
+  auto archive = [&kCommand]() {
+    for (int i = 0; i < kPacketCount; i++) {
+      BtHciDebugger::GetInstance()->Archive(kTx, 0x01, kCommand,
+          sizeof(kCommand));
+    }
+  };
+  // As many senders as the HIDL service has hwbinder threads.
+  std::vector<std::thread> tx;
+  for (int i = 0; i < kThreadCount; i++) {
+    tx.emplace_back(archive);
+  }
+  for (int i = 0; i < 10; i++) {
+    BtHciDebugger::GetInstance()->OnNotify();
+  }
+  for (auto& thread : tx) {
+    thread.join();
+  }
+  BtHciDebugger::GetInstance()->OnNotify();
+}
+
 }  // namespace hal
 }  // namespace bluetooth
 }  // namespace mediatek
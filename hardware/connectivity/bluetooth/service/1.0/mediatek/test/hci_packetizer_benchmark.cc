@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "mtk.bt.packetizer-benchmark"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <log/log.h>
+
+#include "hci_internals.h"
+#include "hci_packetizer.h"
+
+using android::hardware::bluetooth::hci::HciPacketizer;
+
+namespace {
+
+// H4 RX traffic recorded during A2DP streaming with a HID mouse and an LE
+// peripheral connected: packet type, handle or event code, payload length.
+struct RecordedPacket {
+  HciPacketType type;
+  uint16_t handle;
+  uint16_t length;
+};
+
+const RecordedPacket kRecordedTrace[] = {
+    {HCI_PACKET_TYPE_EVENT, 0x13, 5},        // Number Of Completed Packets
+    {HCI_PACKET_TYPE_ACL_DATA, 0x0003, 17},  // HID report
+    {HCI_PACKET_TYPE_EVENT, 0x13, 5},
+    {HCI_PACKET_TYPE_ACL_DATA, 0x0003, 17},
+    {HCI_PACKET_TYPE_ACL_DATA, 0x0041, 27},  // LE notification
+    {HCI_PACKET_TYPE_EVENT, 0x13, 5},
+    {HCI_PACKET_TYPE_ACL_DATA, 0x0003, 17},
+    {HCI_PACKET_TYPE_ACL_DATA, 0x0002, 12},  // AVDTP delay report
+    {HCI_PACKET_TYPE_EVENT, 0x13, 5},
+    {HCI_PACKET_TYPE_ACL_DATA, 0x0003, 17},
+    {HCI_PACKET_TYPE_ACL_DATA, 0x0041, 251}, // LE long notification
+    {HCI_PACKET_TYPE_EVENT, 0x3E, 12},       // LE Connection Update Complete
+    {HCI_PACKET_TYPE_EVENT, 0x13, 5},
+    {HCI_PACKET_TYPE_ACL_DATA, 0x0003, 17},
+    {HCI_PACKET_TYPE_EVENT, 0x0E, 4},        // Command Complete
+    {HCI_PACKET_TYPE_ACL_DATA, 0x2002, 679}, // L2CAP continuation fragment
+    {HCI_PACKET_TYPE_EVENT, 0x13, 5},
+    {HCI_PACKET_TYPE_SCO_DATA, 0x0006, 60},
+};
+
+std::vector<uint8_t> BuildTrace(size_t* packet_count) {
+  std::vector<uint8_t> trace;
+  *packet_count = 0;
+  for (const auto& p : kRecordedTrace) {
+    trace.push_back(p.type);
+    switch (p.type) {
+      case HCI_PACKET_TYPE_ACL_DATA:
+        trace.push_back(p.handle & 0xFF);
+        trace.push_back(p.handle >> 8);
+        trace.push_back(p.length & 0xFF);
+        trace.push_back(p.length >> 8);
+        break;
+      case HCI_PACKET_TYPE_SCO_DATA:
+        trace.push_back(p.handle & 0xFF);
+        trace.push_back(p.handle >> 8);
+        trace.push_back(p.length);
+        break;
+      default:
+        trace.push_back(p.handle);
+        trace.push_back(p.length);
+        break;
+    }
+    for (uint16_t i = 0; i < p.length; i++) trace.push_back(i);
+    (*packet_count)++;
+  }
+  return trace;
+}
+
+// The packetizer as it was: one read for the type, preamble and payload each,
+// spinning with yield() on EAGAIN.
+class LegacyH4Reader {
+ public:
+  LegacyH4Reader(std::function<void(void)> cb) : packet_cb_(cb) {}
+
+  void OnDataReady(int fd) {
+    if (type_ == HCI_PACKET_TYPE_UNKNOWN) {
+      uint8_t type;
+      ReadFully(fd, &type, 1);
+      type_ = static_cast<HciPacketType>(type);
+      return;
+    }
+    size_t preamble_size = type_ == HCI_PACKET_TYPE_ACL_DATA
+                               ? HCI_ACL_PREAMBLE_SIZE
+                               : type_ == HCI_PACKET_TYPE_SCO_DATA
+                                     ? HCI_SCO_PREAMBLE_SIZE
+                                     : HCI_EVENT_PREAMBLE_SIZE;
+    uint8_t preamble[HCI_PREAMBLE_SIZE_MAX];
+    ReadFully(fd, preamble, preamble_size);
+    size_t length = type_ == HCI_PACKET_TYPE_ACL_DATA
+                        ? (preamble[3] << 8 | preamble[2])
+                        : preamble[preamble_size - 1];
+    packet_.resize(preamble_size + length);
+    memcpy(packet_.data(), preamble, preamble_size);
+    ReadFully(fd, packet_.data() + preamble_size, length);
+    packet_cb_();
+    type_ = HCI_PACKET_TYPE_UNKNOWN;
+  }
+
+ private:
+  void ReadFully(int fd, uint8_t* data, size_t length) {
+    while (length > 0) {
+      ssize_t ret = TEMP_FAILURE_RETRY(read(fd, data, length));
+      if (ret < 0 && errno == EAGAIN) {
+        std::this_thread::yield();
+        continue;
+      }
+      LOG_ALWAYS_FATAL_IF(ret <= 0, "%s: read error", __func__);
+      data += ret;
+      length -= ret;
+    }
+  }
+
+  std::function<void(void)> packet_cb_;
+  HciPacketType type_{HCI_PACKET_TYPE_UNKNOWN};
+  android::hardware::hidl_vec<uint8_t> packet_;
+};
+
+// Feeds the recorded trace into a pipe from another thread, as the driver would
+// hand it out, and runs reader.OnDataReady() on each wakeup until it is through.
+template <typename Reader>
+void RunTrace(benchmark::State& state, Reader& reader, const size_t& packets) {
+  size_t packet_count;
+  std::vector<uint8_t> trace = BuildTrace(&packet_count);
+  const size_t rounds = state.range(0);
+  size_t reads = 0;
+
+  for (auto _ : state) {
+    int fds[2];
+    LOG_ALWAYS_FATAL_IF(pipe2(fds, O_NONBLOCK), "%s: pipe2 failed", __func__);
+    int flags = fcntl(fds[1], F_GETFL);
+    fcntl(fds[1], F_SETFL, flags & ~O_NONBLOCK);
+
+    std::thread writer([&]() {
+      for (size_t i = 0; i < rounds; i++)
+        LOG_ALWAYS_FATAL_IF(
+            write(fds[1], trace.data(), trace.size()) !=
+                static_cast<ssize_t>(trace.size()),
+            "%s: write failed", __func__);
+    });
+
+    size_t start = packets;
+    struct pollfd pfd = {fds[0], POLLIN, 0};
+    while (packets - start < rounds * packet_count) {
+      poll(&pfd, 1, -1);
+      reader.OnDataReady(fds[0]);
+      reads++;
+    }
+    writer.join();
+    close(fds[0]);
+    close(fds[1]);
+  }
+  state.SetItemsProcessed(state.iterations() * rounds * packet_count);
+  state.SetBytesProcessed(state.iterations() * rounds * trace.size());
+  state.counters["wakeups_per_packet"] =
+      static_cast<double>(reads) / (state.iterations() * rounds * packet_count);
+}
+
+void BM_HciPacketizerH4(benchmark::State& state) {
+  size_t packets = 0;
+  HciPacketizer packetizer([&packets]() { packets++; });
+  struct Reader {
+    HciPacketizer& packetizer;
+    void OnDataReady(int fd) {
+      packetizer.OnDataReady(fd, HCI_PACKET_TYPE_UNKNOWN);
+    }
+  } reader{packetizer};
+  RunTrace(state, reader, packets);
+}
+
+void BM_LegacyH4Reader(benchmark::State& state) {
+  size_t packets = 0;
+  LegacyH4Reader reader([&packets]() { packets++; });
+  RunTrace(state, reader, packets);
+}
+
+}  // namespace
+
+BENCHMARK(BM_HciPacketizerH4)->Arg(1000);
+BENCHMARK(BM_LegacyH4Reader)->Arg(1000);
+
+BENCHMARK_MAIN();
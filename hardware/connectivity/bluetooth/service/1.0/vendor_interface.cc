@@ -271,6 +271,9 @@ bool VendorInterface::Open(InitializeCompleteCallback initialize_complete_cb,
 
   // Initially, the power management is off.
   lpm_wake_deasserted = true;
+  // The timer is started by Send() and stopped by OnTimeout().
+  fd_watcher_.ConfigureTimeout(std::chrono::milliseconds(0),
+                               [this]() { OnTimeout(); });
 
 #if defined(MTK_BT_HAL_H4_DEBUG) && (TRUE == MTK_BT_HAL_H4_DEBUG)
   if (fd_list[0] != INVALID_FD) {
@@ -327,8 +330,7 @@ size_t VendorInterface::Send(uint8_t type, const uint8_t* data, size_t length) {
 
   if (lpm_wake_deasserted == true) {
     // Restart the timer.
-    fd_watcher_.ConfigureTimeout(std::chrono::milliseconds(lpm_timeout_ms),
-                                 [this]() { OnTimeout(); });
+    fd_watcher_.SetTimeout(std::chrono::milliseconds(lpm_timeout_ms));
     // Assert wake.
     lpm_wake_deasserted = false;
     bt_vendor_lpm_wake_state_t wakeState = BT_VND_LPM_WAKE_ASSERT;
@@ -361,8 +363,7 @@ void VendorInterface::OnFirmwareConfigured(uint8_t result) {
   lib_interface_->op(BT_VND_OP_LPM_SET_MODE, &mode);
 
   ALOGD("%s Calling StartLowPowerWatchdog()", __func__);
-  fd_watcher_.ConfigureTimeout(std::chrono::milliseconds(lpm_timeout_ms),
-                               [this]() { OnTimeout(); });
+  fd_watcher_.SetTimeout(std::chrono::milliseconds(lpm_timeout_ms));
 }
 
 void VendorInterface::OnTimeout() {
@@ -371,9 +372,7 @@ void VendorInterface::OnTimeout() {
     lpm_wake_deasserted = true;
     bt_vendor_lpm_wake_state_t wakeState = BT_VND_LPM_WAKE_DEASSERT;
     lib_interface_->op(BT_VND_OP_LPM_WAKE_SET_STATE, &wakeState);
-    fd_watcher_.ConfigureTimeout(std::chrono::seconds(0), []() {
-      ALOGE("Zero timeout! Should never happen.");
-    });
+    fd_watcher_.SetTimeout(std::chrono::milliseconds(0));
   }
   recent_activity_flag = false;
 }
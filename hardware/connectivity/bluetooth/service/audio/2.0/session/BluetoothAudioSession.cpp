@@ -18,6 +18,9 @@
 
 #include "BluetoothAudioSession.h"
 
+#include <algorithm>
+#include <chrono>
+
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
 
@@ -43,15 +46,75 @@ AudioConfiguration BluetoothAudioSession::invalidSoftwareAudioConfiguration =
 AudioConfiguration BluetoothAudioSession::invalidOffloadAudioConfiguration = {};
 
 static constexpr int kFmqSendTimeoutMs = 1000;  // 1000 ms timeout for sending
-static constexpr int kWritePollMs = 1;          // polled non-blocking interval
+// Wait for NOT_FULL when the PCM rate is unknown
+static constexpr int kWritePollMs = 1;
+// Shortest wait for NOT_FULL at a known PCM rate
+static constexpr int kWriteWaitMinMs = 1;
 
 static inline timespec timespec_convert_from_hal(const TimeSpec& TS) {
   return {.tv_sec = static_cast<long>(TS.tvSec),
           .tv_nsec = static_cast<long>(TS.tvNSec)};
 }
 
+// PCM bytes per second of a software session, 0 if not a valid configuration
+static uint32_t PcmBytesPerSecond(const PcmParameters& pcm_config) {
+  uint32_t rate, bytes_per_sample, channels;
+  switch (pcm_config.sampleRate) {
+    case SampleRate::RATE_16000:
+      rate = 16000;
+      break;
+    case SampleRate::RATE_24000:
+      rate = 24000;
+      break;
+    case SampleRate::RATE_44100:
+      rate = 44100;
+      break;
+    case SampleRate::RATE_48000:
+      rate = 48000;
+      break;
+    case SampleRate::RATE_88200:
+      rate = 88200;
+      break;
+    case SampleRate::RATE_96000:
+      rate = 96000;
+      break;
+    case SampleRate::RATE_176400:
+      rate = 176400;
+      break;
+    case SampleRate::RATE_192000:
+      rate = 192000;
+      break;
+    default:
+      return 0;
+  }
+  switch (pcm_config.bitsPerSample) {
+    case BitsPerSample::BITS_16:
+      bytes_per_sample = 2;
+      break;
+    case BitsPerSample::BITS_24:
+      bytes_per_sample = 3;
+      break;
+    case BitsPerSample::BITS_32:
+      bytes_per_sample = 4;
+      break;
+    default:
+      return 0;
+  }
+  switch (pcm_config.channelMode) {
+    case ChannelMode::MONO:
+      channels = 1;
+      break;
+    case ChannelMode::STEREO:
+      channels = 2;
+      break;
+    default:
+      return 0;
+  }
+  return rate * bytes_per_sample * channels;
+}
+
 BluetoothAudioSession::BluetoothAudioSession(const SessionType& session_type)
-    : session_type_(session_type), stack_iface_(nullptr), mDataMQ(nullptr) {
+    : session_type_(session_type), stack_iface_(nullptr), data_path_(nullptr) {
   invalidSoftwareAudioConfiguration.pcmConfig(kInvalidPcmParameters);
   invalidOffloadAudioConfiguration.codecConfig(kInvalidCodecConfiguration);
 }
@@ -79,6 +142,7 @@ void BluetoothAudioSession::OnSessionStarted(
              : kInvalidSoftwareAudioConfiguration);
   } else {
     stack_iface_ = stack_iface;
+    ResetStats();
     LOG(INFO) << __func__ << " - SessionType=" << toString(session_type_)
               << ", AudioConfiguration=" << toString(audio_config);
     ReportSessionStatus();
@@ -98,6 +162,14 @@ void BluetoothAudioSession::OnSessionEnded() {
                        : kInvalidSoftwareAudioConfiguration);
   stack_iface_ = nullptr;
   UpdateDataPath(nullptr);
+  BluetoothAudioSessionStats stats = GetStats();
+  LOG(INFO) << __func__ << " - SessionType=" << toString(session_type_)
+            << " writes=" << stats.write_count
+            << ", bytes=" << stats.write_bytes
+            << ", underruns=" << stats.underruns
+            << ", overruns=" << stats.overruns
+            << ", waits=" << stats.waits
+            << ", max latency=" << stats.latency_ns_max / 1000 << " us";
 }
 
 // invoking the registered session_changed_cb_
@@ -145,26 +217,53 @@ void BluetoothAudioSession::ReportControlStatus(
 // @return: true if the Bluetooth stack has started the specified session
 bool BluetoothAudioSession::IsSessionReady() {
   std::lock_guard<std::recursive_mutex> guard(mutex_);
+  std::shared_ptr<DataPath> data_path = std::atomic_load(&data_path_);
   bool dataMQ_valid =
       (session_type_ == SessionType::A2DP_HARDWARE_OFFLOAD_DATAPATH ||
-       (mDataMQ != nullptr && mDataMQ->isValid()));
+       (data_path != nullptr && data_path->mDataMQ->isValid()));
   return stack_iface_ != nullptr && dataMQ_valid;
 }
 
+BluetoothAudioSession::DataPath::~DataPath() {
+  if (mEfGroup != nullptr) {
+    EventFlag::deleteEventFlag(&mEfGroup);
+  }
+}
+
 bool BluetoothAudioSession::UpdateDataPath(const DataMQ::Descriptor* dataMQ) {
-  if (dataMQ == nullptr) {
-    // usecase of reset by nullptr
-    mDataMQ = nullptr;
-    return true;
+  std::shared_ptr<DataPath> tempDataPath;
+  bool valid = true;
+  if (dataMQ != nullptr) {
+    tempDataPath = std::make_shared<DataPath>();
+    tempDataPath->mDataMQ.reset(new DataMQ(*dataMQ));
+    if (!tempDataPath->mDataMQ || !tempDataPath->mDataMQ->isValid()) {
+      tempDataPath = nullptr;
+      valid = false;
+    } else if (tempDataPath->mDataMQ->getEventFlagWord() != nullptr &&
+               EventFlag::createEventFlag(
+                   tempDataPath->mDataMQ->getEventFlagWord(),
+                   &tempDataPath->mEfGroup) != ::android::OK) {
+      // still usable by polling
+      LOG(WARNING) << __func__ << " - SessionType=" << toString(session_type_)
+                   << " failed creating EventFlag";
+      tempDataPath->mEfGroup = nullptr;
+    }
+    if (tempDataPath != nullptr &&
+        audio_config_.getDiscriminator() ==
+            AudioConfiguration::hidl_discriminator::pcmConfig) {
+      tempDataPath->mBytesPerSec =
+          PcmBytesPerSecond(audio_config_.pcmConfig());
+    }
   }
-  std::unique_ptr<DataMQ> tempDataMQ;
-  tempDataMQ.reset(new DataMQ(*dataMQ));
-  if (!tempDataMQ || !tempDataMQ->isValid()) {
-    mDataMQ = nullptr;
-    return false;
+  // usecase of reset by nullptr as well
+  std::shared_ptr<DataPath> oldDataPath =
+      std::atomic_exchange(&data_path_, tempDataPath);
+  if (oldDataPath != nullptr && oldDataPath->mEfGroup != nullptr) {
+    // A writer waiting on the old FMQ notices it was replaced
+    oldDataPath->mEfGroup->wake(
+        static_cast<uint32_t>(DataMQFlagBits::NOT_FULL));
   }
-  mDataMQ = std::move(tempDataMQ);
-  return true;
+  return valid;
 }
 
 bool BluetoothAudioSession::UpdateAudioConfig(
@@ -366,36 +465,107 @@ void BluetoothAudioSession::UpdateTracksMetadata(
 size_t BluetoothAudioSession::OutWritePcmData(const void* buffer,
                                               size_t bytes) {
   if (buffer == nullptr || !bytes) return 0;
+  // No lock: the reference keeps this FMQ valid even if the session ends.
+  std::shared_ptr<DataPath> data_path = std::atomic_load(&data_path_);
+  if (data_path == nullptr) return 0;
+  DataMQ* dataMQ = data_path->mDataMQ.get();
+  EventFlag* efGroup = data_path->mEfGroup;
+
+  auto start = std::chrono::steady_clock::now();
+  auto deadline = start + std::chrono::milliseconds(kFmqSendTimeoutMs);
   size_t totalWritten = 0;
-  int ms_timeout = kFmqSendTimeoutMs;
+  if (dataMQ->availableToWrite() == dataMQ->getQuantumCount()) {
+    ++underruns_;
+  }
   do {
-    std::unique_lock<std::recursive_mutex> lock(mutex_);
-    if (!IsSessionReady()) break;
-    size_t availableToWrite = mDataMQ->availableToWrite();
+    size_t availableToWrite = dataMQ->availableToWrite();
     if (availableToWrite) {
       if (availableToWrite > (bytes - totalWritten)) {
         availableToWrite = bytes - totalWritten;
       }
 
-      if (!mDataMQ->write(static_cast<const uint8_t*>(buffer) + totalWritten,
-                          availableToWrite)) {
+      if (!dataMQ->write(static_cast<const uint8_t*>(buffer) + totalWritten,
+                         availableToWrite)) {
         ALOGE("FMQ datapath writting %zu/%zu failed", totalWritten, bytes);
-        return totalWritten;
+        break;
       }
       totalWritten += availableToWrite;
-    } else if (ms_timeout >= kWritePollMs) {
-      lock.unlock();
-      usleep(kWritePollMs * 1000);
-      ms_timeout -= kWritePollMs;
-    } else {
+      if (efGroup != nullptr) {
+        efGroup->wake(static_cast<uint32_t>(DataMQFlagBits::NOT_EMPTY));
+      }
+      continue;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) {
       ALOGD("data %zu/%zu overflow %d ms", totalWritten, bytes,
-            (kFmqSendTimeoutMs - ms_timeout));
-      return totalWritten;
+            kFmqSendTimeoutMs);
+      ++overruns_;
+      break;
+    }
+    if (std::atomic_load(&data_path_) != data_path) break;  // session ended
+    // The reader drains the FMQ at the stream rate, and the Bluetooth stack's
+    // reader does not wake NOT_FULL: wait until about half of the room still
+    // missing for the rest of the data, at most a full FMQ, can have been
+    // taken, so that the FMQ is refilled before the reader runs dry. A reader
+    // which wakes NOT_FULL ends the wait earlier.
+    int64_t wait_ns = kWritePollMs * 1000000LL;
+    if (data_path->mBytesPerSec) {
+      uint64_t deficit =
+          std::min<uint64_t>(bytes - totalWritten, dataMQ->getQuantumCount());
+      wait_ns = std::max<int64_t>(
+          deficit / 2 * 1000000000ULL / data_path->mBytesPerSec,
+          kWriteWaitMinMs * 1000000LL);
+    }
+    wait_ns = std::min<int64_t>(
+        wait_ns, std::chrono::nanoseconds(deadline - now).count());
+    ++waits_;
+    if (efGroup != nullptr) {
+      uint32_t efState = 0;
+      efGroup->wait(static_cast<uint32_t>(DataMQFlagBits::NOT_FULL), &efState,
+                    wait_ns);
+    } else {
+      usleep(wait_ns / 1000);
     }
   } while (totalWritten < bytes);
+
+  uint64_t latency_ns = std::chrono::nanoseconds(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+  ++write_count_;
+  write_bytes_ += totalWritten;
+  latency_ns_total_ += latency_ns;
+  uint64_t latency_ns_max = latency_ns_max_;
+  while (latency_ns > latency_ns_max &&
+         !latency_ns_max_.compare_exchange_weak(latency_ns_max, latency_ns)) {
+  }
   return totalWritten;
 }
 
+// The control function is to get the data path counters of this session
+BluetoothAudioSessionStats BluetoothAudioSession::GetStats() const {
+  BluetoothAudioSessionStats stats;
+  stats.write_count = write_count_;
+  stats.write_bytes = write_bytes_;
+  stats.underruns = underruns_;
+  stats.overruns = overruns_;
+  stats.waits = waits_;
+  stats.latency_ns_total = latency_ns_total_;
+  stats.latency_ns_max = latency_ns_max_;
+  return stats;
+}
+
+// The counters start over with every session
+void BluetoothAudioSession::ResetStats() {
+  write_count_ = 0;
+  write_bytes_ = 0;
+  underruns_ = 0;
+  overruns_ = 0;
+  waits_ = 0;
+  latency_ns_total_ = 0;
+  latency_ns_max_ = 0;
+}
+
 std::unique_ptr<BluetoothAudioSessionInstance>
     BluetoothAudioSessionInstance::instance_ptr =
         std::unique_ptr<BluetoothAudioSessionInstance>(
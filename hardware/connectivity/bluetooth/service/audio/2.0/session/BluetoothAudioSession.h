@@ -16,10 +16,12 @@
 
 #pragma once
 
+#include <atomic>
 #include <mutex>
 #include <unordered_map>
 
 #include <android/hardware/bluetooth/audio/2.0/IBluetoothAudioPort.h>
+#include <fmq/EventFlag.h>
 #include <fmq/MessageQueue.h>
 #include <hardware/audio.h>
 #include <hidl/MQDescriptor.h>
@@ -29,6 +31,7 @@ namespace bluetooth {
 namespace audio {
 
 using ::android::sp;
+using ::android::hardware::EventFlag;
 using ::android::hardware::kSynchronizedReadWrite;
 using ::android::hardware::MessageQueue;
 using ::android::hardware::bluetooth::audio::V2_0::AudioConfiguration;
@@ -45,6 +48,27 @@ using BluetoothAudioStatus =
 
 using DataMQ = MessageQueue<uint8_t, kSynchronizedReadWrite>;
 
+// EventFlag bits of the data path FMQ: the writer wakes NOT_EMPTY after each
+// write, and a reader may wake NOT_FULL after each read so that a writer
+// waiting for room resumes at once. The Bluetooth stack's reader does not, so
+// without it the writer waits for as long as the stream rate needs to drain
+// what is left to write.
+enum class DataMQFlagBits : uint32_t {
+  NOT_EMPTY = 1 << 0,
+  NOT_FULL = 1 << 1,
+};
+
+// Counters of the data path of a session
+struct BluetoothAudioSessionStats {
+  uint64_t write_count;       // OutWritePcmData calls with data
+  uint64_t write_bytes;       // bytes written into the FMQ
+  uint64_t underruns;         // writes that found the FMQ drained
+  uint64_t overruns;          // writes that timed out before all data fit
+  uint64_t waits;             // waits for room in the FMQ
+  uint64_t latency_ns_total;  // time spent in OutWritePcmData
+  uint64_t latency_ns_max;
+};
+
 static constexpr uint16_t kObserversCookieSize = 0x0010;  // 0x0000 ~ 0x000f
 constexpr uint16_t kObserversCookieUndefined =
     (static_cast<uint16_t>(SessionType::UNKNOWN) << 8 & 0xff00);
@@ -86,8 +110,16 @@ class BluetoothAudioSession {
 
   // audio control path to use for both software and offloading
   sp<IBluetoothAudioPort> stack_iface_;
-  // audio data path (FMQ) for software encoding
-  std::unique_ptr<DataMQ> mDataMQ;
+  // audio data path (FMQ) for software encoding. It is swapped atomically,
+  // so OutWritePcmData takes a reference without taking mutex_ and keeps the
+  // FMQ alive while it waits on it.
+  struct DataPath {
+    std::unique_ptr<DataMQ> mDataMQ;
+    EventFlag* mEfGroup = nullptr;
+    uint32_t mBytesPerSec = 0;  // PCM rate of the session, 0 if unknown
+    ~DataPath();
+  };
+  std::shared_ptr<DataPath> data_path_;
   // audio data configuration for both software and offloading
   AudioConfiguration audio_config_;
 
@@ -98,7 +130,16 @@ class BluetoothAudioSession {
   std::unordered_map<uint16_t, std::shared_ptr<struct PortStatusCallbacks>>
       observers_;
 
+  std::atomic<uint64_t> write_count_{0};
+  std::atomic<uint64_t> write_bytes_{0};
+  std::atomic<uint64_t> underruns_{0};
+  std::atomic<uint64_t> overruns_{0};
+  std::atomic<uint64_t> waits_{0};
+  std::atomic<uint64_t> latency_ns_total_{0};
+  std::atomic<uint64_t> latency_ns_max_{0};
+
   bool UpdateDataPath(const DataMQ::Descriptor* dataMQ);
+  void ResetStats();
   bool UpdateAudioConfig(const AudioConfiguration& audio_config);
   // invoking the registered session_changed_cb_
   void ReportSessionStatus();
@@ -151,9 +192,13 @@ class BluetoothAudioSession {
                                timespec* data_position);
   void UpdateTracksMetadata(const struct source_metadata* source_metadata);
 
-  // The control function writes stream to FMQ
+  // The control function writes stream to FMQ. It blocks until all data is
+  // written, the session ends or kFmqSendTimeoutMs passes.
   size_t OutWritePcmData(const void* buffer, size_t bytes);
 
+  // The control function is to get the data path counters of this session
+  BluetoothAudioSessionStats GetStats() const;
+
   static constexpr PcmParameters kInvalidPcmParameters = {
       .sampleRate = SampleRate::RATE_UNKNOWN,
       .bitsPerSample = BitsPerSample::BITS_UNKNOWN,
@@ -136,6 +136,16 @@ class BluetoothAudioSessionControl {
     }
     return 0;
   }
+
+  // The control API gets the data path counters of the session
+  static BluetoothAudioSessionStats GetStats(const SessionType& session_type) {
+    std::shared_ptr<BluetoothAudioSession> session_ptr =
+        BluetoothAudioSessionInstance::GetSessionInstance(session_type);
+    if (session_ptr != nullptr) {
+      return session_ptr->GetStats();
+    }
+    return {};
+  }
 };
 
 }  // namespace audio
@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BTAudioSessionTest"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "BluetoothAudioSession.h"
+
+namespace android {
+namespace bluetooth {
+namespace audio {
+namespace {
+
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+using ::android::hardware::audio::common::V5_0::SourceMetadata;
+
+constexpr size_t kDataMqSize = 4096;
+// what the Bluetooth stack takes per 10 ms at 44.1kHz, 16 bits, stereo
+constexpr size_t kBytesPer10Ms = 44100 * 2 * 2 / 100;
+
+// Stands in for the Bluetooth stack side of the session
+class FakeAudioPort : public IBluetoothAudioPort {
+ public:
+  Return<void> startStream() override { return Void(); }
+  Return<void> suspendStream() override { return Void(); }
+  Return<void> stopStream() override { return Void(); }
+  Return<void> getPresentationPosition(
+      getPresentationPosition_cb _hidl_cb) override {
+    _hidl_cb(BluetoothAudioStatus::FAILURE, 0, 0, {});
+    return Void();
+  }
+  Return<void> updateMetadata(const SourceMetadata&) override {
+    return Void();
+  }
+};
+
+// Drives both ends: the session writes into an FMQ this test reads, as the
+// Bluetooth stack would.
+class BluetoothAudioSessionTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    reader_mq_.reset(new DataMQ(kDataMqSize, /* EventFlag */ true));
+    ASSERT_TRUE(reader_mq_->isValid());
+    ASSERT_EQ(::android::OK,
+              EventFlag::createEventFlag(reader_mq_->getEventFlagWord(),
+                                         &reader_ef_));
+    session_ = std::make_shared<BluetoothAudioSession>(
+        SessionType::A2DP_SOFTWARE_ENCODING_DATAPATH);
+    AudioConfiguration audio_config = {};
+    audio_config.pcmConfig({.sampleRate = SampleRate::RATE_44100,
+                            .bitsPerSample = BitsPerSample::BITS_16,
+                            .channelMode = ChannelMode::STEREO});
+    session_->OnSessionStarted(new FakeAudioPort(), reader_mq_->getDesc(),
+                               audio_config);
+    ASSERT_TRUE(session_->IsSessionReady());
+  }
+
+  void TearDown() override {
+    session_->OnSessionEnded();
+    EventFlag::deleteEventFlag(&reader_ef_);
+  }
+
+  // Reads up to bytes, and wakes a writer waiting for room
+  size_t Read(uint8_t* data, size_t bytes) {
+    size_t available = std::min(bytes, reader_mq_->availableToRead());
+    if (available && reader_mq_->read(data, available)) {
+      reader_ef_->wake(static_cast<uint32_t>(DataMQFlagBits::NOT_FULL));
+      return available;
+    }
+    return 0;
+  }
+
+  static std::vector<uint8_t> Pattern(size_t bytes) {
+    std::vector<uint8_t> data(bytes);
+    for (size_t i = 0; i < bytes; i++) data[i] = i * 7;
+    return data;
+  }
+
+  std::unique_ptr<DataMQ> reader_mq_;
+  EventFlag* reader_ef_ = nullptr;
+  std::shared_ptr<BluetoothAudioSession> session_;
+};
+
+TEST_F(BluetoothAudioSessionTest, WriteWakesNotEmpty) {
+  std::vector<uint8_t> data = Pattern(1000);
+  EXPECT_EQ(data.size(), session_->OutWritePcmData(data.data(), data.size()));
+
+  uint32_t efState = 0;
+  reader_ef_->wait(static_cast<uint32_t>(DataMQFlagBits::NOT_EMPTY), &efState,
+                   1000000 /* 1 ms */);
+  EXPECT_TRUE(efState & static_cast<uint32_t>(DataMQFlagBits::NOT_EMPTY));
+
+  std::vector<uint8_t> read(data.size());
+  EXPECT_EQ(data.size(), Read(read.data(), read.size()));
+  EXPECT_EQ(data, read);
+}
+
+TEST_F(BluetoothAudioSessionTest, BlockingWriteFollowsReader) {
+  std::vector<uint8_t> data = Pattern(kDataMqSize * 8);
+  std::vector<uint8_t> read(data.size());
+  std::thread reader([this, &read]() {
+    size_t total = 0;
+    while (total < read.size()) {
+      // wakes of writes already read are merged, wait only when drained
+      if (!reader_mq_->availableToRead()) {
+        uint32_t efState = 0;
+        reader_ef_->wait(static_cast<uint32_t>(DataMQFlagBits::NOT_EMPTY),
+                         &efState, 100000000 /* 100 ms */);
+      }
+      total += Read(read.data() + total, 1024);
+    }
+  });
+  EXPECT_EQ(data.size(), session_->OutWritePcmData(data.data(), data.size()));
+  reader.join();
+  EXPECT_EQ(data, read);
+
+  BluetoothAudioSessionStats stats = session_->GetStats();
+  EXPECT_EQ(1u, stats.write_count);
+  EXPECT_EQ(data.size(), stats.write_bytes);
+  EXPECT_EQ(0u, stats.overruns);
+  EXPECT_GE(stats.latency_ns_total, stats.latency_ns_max);
+}
+
+// The Bluetooth stack reads at the stream rate and does not wake NOT_FULL:
+// the writer waits about once per read, not once per kWritePollMs
+TEST_F(BluetoothAudioSessionTest, WriteFollowsReaderWithoutWake) {
+  std::vector<uint8_t> data = Pattern(kDataMqSize * 4);
+  std::vector<uint8_t> read(data.size());
+  std::thread reader([this, &read]() {
+    size_t total = 0;
+    while (total < read.size()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      size_t bytes = std::min(kBytesPer10Ms, reader_mq_->availableToRead());
+      if (bytes && reader_mq_->read(read.data() + total, bytes)) total += bytes;
+    }
+  });
+  EXPECT_EQ(data.size(), session_->OutWritePcmData(data.data(), data.size()));
+  reader.join();
+  EXPECT_EQ(data, read);
+
+  // about 70 ms of data behind the first FMQ full
+  BluetoothAudioSessionStats stats = session_->GetStats();
+  EXPECT_EQ(0u, stats.overruns);
+  EXPECT_GE(stats.waits, 2u);
+  EXPECT_LE(stats.waits, 20u);
+}
+
+TEST_F(BluetoothAudioSessionTest, WriteTimesOutWithoutReader) {
+  std::vector<uint8_t> data = Pattern(kDataMqSize + 100);
+  EXPECT_EQ(kDataMqSize, session_->OutWritePcmData(data.data(), data.size()));
+  BluetoothAudioSessionStats stats = session_->GetStats();
+  EXPECT_EQ(1u, stats.overruns);
+  EXPECT_EQ(1u, stats.underruns);
+}
+
+TEST_F(BluetoothAudioSessionTest, StatsStartOverWithSession) {
+  std::vector<uint8_t> data = Pattern(kDataMqSize + 100);
+  EXPECT_EQ(kDataMqSize, session_->OutWritePcmData(data.data(), data.size()));
+  session_->OnSessionEnded();
+
+  AudioConfiguration audio_config = {};
+  audio_config.pcmConfig({.sampleRate = SampleRate::RATE_44100,
+                          .bitsPerSample = BitsPerSample::BITS_16,
+                          .channelMode = ChannelMode::STEREO});
+  session_->OnSessionStarted(new FakeAudioPort(), reader_mq_->getDesc(),
+                             audio_config);
+  ASSERT_TRUE(session_->IsSessionReady());
+  BluetoothAudioSessionStats stats = session_->GetStats();
+  EXPECT_EQ(0u, stats.write_count);
+  EXPECT_EQ(0u, stats.write_bytes);
+  EXPECT_EQ(0u, stats.overruns);
+  EXPECT_EQ(0u, stats.waits);
+  EXPECT_EQ(0u, stats.latency_ns_max);
+}
+
+TEST_F(BluetoothAudioSessionTest, SessionEndReleasesWriter) {
+  std::vector<uint8_t> data = Pattern(kDataMqSize * 2);
+  auto start = std::chrono::steady_clock::now();
+  std::thread writer([this, &data]() {
+    EXPECT_EQ(kDataMqSize,
+              session_->OutWritePcmData(data.data(), data.size()));
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  session_->OnSessionEnded();
+  writer.join();
+  EXPECT_LT(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(500));
+  EXPECT_FALSE(session_->IsSessionReady());
+  EXPECT_EQ(0u, session_->OutWritePcmData(data.data(), data.size()));
+}
+
+}  // namespace
+}  // namespace audio
+}  // namespace bluetooth
+}  // namespace android
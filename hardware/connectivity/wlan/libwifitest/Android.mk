@@ -2,7 +2,8 @@ LOCAL_PATH:= $(call my-dir)
 include $(CLEAR_VARS)
 
 LOCAL_SHARED_LIBRARIES := libcutils libnvram liblog
-LOCAL_SRC_FILES := libwifitest.c
+LOCAL_SRC_FILES := libwifitest.c \
+ libwifitest_sweep.c
 
 LOCAL_C_INCLUDES := \
  vendor/mediatek/opensource/external/nvram/libnvram \
@@ -20,6 +21,29 @@ LOCAL_MODULE_OWNER := mtk
 LOCAL_MODULE_TAGS := optional
 include $(BUILD_SHARED_LIBRARY)
 
+# Sweep sequencer against a stub WIFI_TEST_set/get backend
+include $(CLEAR_VARS)
+LOCAL_MODULE := libwifitest_sweep_tests
+LOCAL_PROPRIETARY_MODULE := true
+LOCAL_MODULE_OWNER := mtk
+LOCAL_MODULE_TAGS := optional
+LOCAL_CFLAGS += -Wall -Werror
+LOCAL_SHARED_LIBRARIES := liblog
+LOCAL_SRC_FILES := \
+ libwifitest_sweep.c \
+ test/libwifitest_sweep_test.cpp
+include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := libwifitest_sweep_tests
+LOCAL_MODULE_TAGS := optional
+LOCAL_CFLAGS += -Wall -Werror
+LOCAL_SHARED_LIBRARIES := liblog
+LOCAL_SRC_FILES := \
+ libwifitest_sweep.c \
+ test/libwifitest_sweep_test.cpp
+include $(BUILD_HOST_NATIVE_TEST)
+
 BUILD_TEST_APP = false
 
 ifeq ($(BUILD_TEST_APP),true)
@@ -112,7 +112,6 @@ static const char DRIVER_MODULE_ARG[]   = WIFI_DRIVER_MODULE_ARG;
 #define OID_CUSTOM_MCR_RW                               0xFFA0c801
 
 /* command mask */
-#define TEST_FUNC_IDX_MASK              BITS(0,7)
 #define TEST_SET_CMD_OFFSET_MASK        BITS(16,31)
 #define TEST_SET_CMD_OFFSET             16
 
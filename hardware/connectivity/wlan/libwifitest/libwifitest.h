@@ -297,6 +297,9 @@ typedef struct _PARAM_MTK_WIFI_CHANNEL_T {
 #define BITS(m,n)       (~(BIT(m)-1) & ((BIT(n) - 1) | BIT(n)))
 #endif /* BIT */
 
+/* function index part of a RF_AT_FUNCID_* command */
+#define TEST_FUNC_IDX_MASK              BITS(0,7)
+
 /* RF Test Properties */
 #define RF_AT_PARAM_RATE_MCS_MASK   BIT(31)
 #define RF_AT_PARAM_RATE_MASK       BITS(0,7)
@@ -398,4 +401,46 @@ bool WIFI_TEST_Set_PrimaryChannel_Bandwidth(int ChannelNo , ENUM_WIFI_BANDWIDTH
 int WIFI_TEST_set(uint32_t u4FuncIndex, uint32_t u4FuncData, uint32_t *pu4FuncIndex, uint32_t *pu4FuncData);
 int WIFI_TEST_get(uint32_t u4FuncIndex, uint32_t u4FuncData, uint32_t *pu4FuncIndex, uint32_t *pu4FuncData);
 
+/* Sweep sequencer
+ * -------------------------------------------------------------------------- */
+#define WIFI_TEST_SWEEP_MAX_CONFIG          8
+#define WIFI_TEST_SWEEP_POLL_INTERVAL_MS    20
+
+typedef enum _ENUM_WIFI_TEST_SWEEP_ACTION {
+    WIFI_TEST_SWEEP_ACTION_NONE = 0,    /* configure only */
+    WIFI_TEST_SWEEP_ACTION_TX,
+    WIFI_TEST_SWEEP_ACTION_RX
+} ENUM_WIFI_TEST_SWEEP_ACTION;
+
+/* One RF_AT_FUNCID_* set command */
+typedef struct _WIFI_TEST_SWEEP_CONFIG_T {
+    uint32_t u4FuncIndex;
+    uint32_t u4FuncData;
+} WIFI_TEST_SWEEP_CONFIG_T, *P_WIFI_TEST_SWEEP_CONFIG_T;
+
+typedef struct _WIFI_TEST_SWEEP_STEP_T {
+    uint32_t u4ConfigNum;
+    WIFI_TEST_SWEEP_CONFIG_T arConfig[WIFI_TEST_SWEEP_MAX_CONFIG];
+    ENUM_WIFI_TEST_SWEEP_ACTION eAction;
+    uint32_t u4TargetFrames;    /* ends the step early once counted, 0 for none */
+    uint32_t u4DwellMs;         /* longest time to transmit/receive */
+} WIFI_TEST_SWEEP_STEP_T, *P_WIFI_TEST_SWEEP_STEP_T;
+
+typedef struct _WIFI_TEST_SWEEP_RESULT_T {
+    int32_t i4Status;           /* 0, or the result of the failed command */
+    uint32_t u4FailedFuncIndex;
+    uint32_t u4TxCount;         /* counters over the step */
+    uint32_t u4TxGoodCount;
+    uint32_t u4RxGoodCount;
+    uint32_t u4RxErrorCount;
+    int32_t i4Rssi;             /* average RSSI in dBm, RX steps only */
+    uint32_t u4ElapsedMs;
+    uint16_t u2SetCount;        /* set commands issued to the driver */
+    uint16_t u2PollCount;       /* counter samples taken */
+} WIFI_TEST_SWEEP_RESULT_T, *P_WIFI_TEST_SWEEP_RESULT_T;
+
+/* WIFI_TEST_RunSweep : Run the steps in order, one result per step. Returns the number of failed steps, or -1 on bad arguments */
+int WIFI_TEST_RunSweep(const WIFI_TEST_SWEEP_STEP_T *prSteps, uint32_t u4StepNum,
+    uint32_t u4PollIntervalMs, WIFI_TEST_SWEEP_RESULT_T *prResults);
+
 #endif /* __LIBWIFITEST_H__ */
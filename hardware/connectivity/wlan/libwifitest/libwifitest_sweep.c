@@ -0,0 +1,345 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Sweep sequencer: runs a whole RF test plan through WIFI_TEST_set/get
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <log/log.h>
+
+#include "libwifitest.h"
+
+extern bool fgDebugMode;
+
+/* Last value set for a function, as the driver holds it */
+typedef struct _WIFI_TEST_SWEEP_CACHE_T {
+    bool fgValid;
+    uint32_t u4FuncIndex;
+    uint32_t u4FuncData;
+} WIFI_TEST_SWEEP_CACHE_T, *P_WIFI_TEST_SWEEP_CACHE_T;
+
+#define WIFI_TEST_SWEEP_CACHE_SIZE      (RF_AT_FUNCID_SET_J_MODE_SETTING + 1)
+
+/*----------------------------------------------------------------------------*/
+/*!
+ * @brief Whether a set function only stores a TX/RX parameter in the driver,
+ *        so that setting the value it already holds again does nothing.
+ *        Functions that act on the RF (shutdowns, compensation, calibration
+ *        and measurement modes) are always sent.
+ */
+/*----------------------------------------------------------------------------*/
+static bool
+wifi_sweep_is_parameter(
+    uint32_t u4FuncIndex
+    )
+{
+    switch(u4FuncIndex & TEST_FUNC_IDX_MASK) {
+    case RF_AT_FUNCID_POWER:
+    case RF_AT_FUNCID_RATE:
+    case RF_AT_FUNCID_PREAMBLE:
+    case RF_AT_FUNCID_ANTENNA:
+    case RF_AT_FUNCID_PKTLEN:
+    case RF_AT_FUNCID_PKTCNT:
+    case RF_AT_FUNCID_PKTINTERVAL:
+    case RF_AT_FUNCID_TXOPLIMIT:
+    case RF_AT_FUNCID_ACKPOLICY:
+    case RF_AT_FUNCID_PKTCONTENT:
+    case RF_AT_FUNCID_RETRYLIMIT:
+    case RF_AT_FUNCID_QUEUE:
+    case RF_AT_FUNCID_BANDWIDTH:
+    case RF_AT_FUNCID_GI:
+    case RF_AT_FUNCID_STBC:
+    case RF_AT_FUNCID_CHNL_FREQ:
+    case RF_AT_FUNCID_RIFS:
+    case RF_AT_FUNCID_SET_CHANNEL_BANDWIDTH:
+    case RF_AT_FUNCID_SET_DATA_BANDWIDTH:
+    case RF_AT_FUNCID_SET_PRI_SETTING:
+    case RF_AT_FUNCID_SET_TX_ENCODE_MODE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static uint32_t
+wifi_sweep_now_ms(
+    void
+    )
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+/*----------------------------------------------------------------------------*/
+/*!
+ * @brief Issues a set command, unless it would set a parameter to the value
+ *        the driver already holds
+ *
+ * @return 0 on success, else the WIFI_TEST_set() result, also recorded in
+ *         prResult
+ */
+/*----------------------------------------------------------------------------*/
+static int
+wifi_sweep_set(
+    P_WIFI_TEST_SWEEP_CACHE_T prCache,
+    uint32_t u4FuncIndex,
+    uint32_t u4FuncData,
+    P_WIFI_TEST_SWEEP_RESULT_T prResult
+    )
+{
+    P_WIFI_TEST_SWEEP_CACHE_T prEntry = NULL;
+    uint32_t u4Idx = u4FuncIndex & TEST_FUNC_IDX_MASK;
+    int retval;
+
+    if(wifi_sweep_is_parameter(u4FuncIndex)) {
+        prEntry = &prCache[u4Idx];
+        if(prEntry->fgValid && prEntry->u4FuncIndex == u4FuncIndex &&
+                prEntry->u4FuncData == u4FuncData) {
+            return 0;
+        }
+    }
+
+    retval = WIFI_TEST_set(u4FuncIndex, u4FuncData, NULL, NULL);
+    prResult->u2SetCount++;
+
+    if(retval != 0) {
+        prResult->i4Status = retval;
+        prResult->u4FailedFuncIndex = u4FuncIndex;
+        if(prEntry) {
+            prEntry->fgValid = false;
+        }
+        return retval;
+    }
+
+    if(u4Idx == RF_AT_FUNCID_CHNL_FREQ) {
+        /* the driver may reload per channel settings */
+        memset(prCache, 0, sizeof(WIFI_TEST_SWEEP_CACHE_T) * WIFI_TEST_SWEEP_CACHE_SIZE);
+    }
+    if(prEntry) {
+        prEntry->fgValid = true;
+        prEntry->u4FuncIndex = u4FuncIndex;
+        prEntry->u4FuncData = u4FuncData;
+    }
+    else if(u4Idx == RF_AT_FUNCID_COMMAND && u4FuncData == RF_AT_COMMAND_RESET) {
+        /* back to driver defaults */
+        memset(prCache, 0, sizeof(WIFI_TEST_SWEEP_CACHE_T) * WIFI_TEST_SWEEP_CACHE_SIZE);
+    }
+
+    return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*!
+ * @brief Reads the frame counters of a TX (sent, acked) or RX (good, error)
+ *        step
+ */
+/*----------------------------------------------------------------------------*/
+static int
+wifi_sweep_read_counters(
+    ENUM_WIFI_TEST_SWEEP_ACTION eAction,
+    uint32_t au4Count[2],
+    P_WIFI_TEST_SWEEP_RESULT_T prResult
+    )
+{
+    uint32_t u4FuncIndex[2];
+    int i, retval;
+
+    if(eAction == WIFI_TEST_SWEEP_ACTION_TX) {
+        u4FuncIndex[0] = RF_AT_FUNCID_TXED_COUNT;
+        u4FuncIndex[1] = RF_AT_FUNCID_TXOK_COUNT;
+    }
+    else {
+        u4FuncIndex[0] = RF_AT_FUNCID_RXOK_COUNT;
+        u4FuncIndex[1] = RF_AT_FUNCID_RXERROR_COUNT;
+    }
+
+    prResult->u2PollCount++;
+    for(i = 0; i < 2; i++) {
+        retval = WIFI_TEST_get(u4FuncIndex[i], 0, NULL, &au4Count[i]);
+        if(retval != 0) {
+            if(prResult->i4Status == 0) {
+                prResult->i4Status = retval;
+                prResult->u4FailedFuncIndex = u4FuncIndex[i];
+            }
+            return retval;
+        }
+    }
+
+    return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*!
+ * @brief Runs one step: its set commands back to back, then TX or RX with the
+ *        counters sampled every u4PollIntervalMs until u4TargetFrames are
+ *        counted or u4DwellMs is over
+ */
+/*----------------------------------------------------------------------------*/
+static void
+wifi_sweep_run_step(
+    const WIFI_TEST_SWEEP_STEP_T *prStep,
+    uint32_t u4PollIntervalMs,
+    P_WIFI_TEST_SWEEP_CACHE_T prCache,
+    P_WIFI_TEST_SWEEP_RESULT_T prResult
+    )
+{
+    uint32_t au4Base[2], au4Count[2];
+    uint32_t u4Start, u4ActionStart, u4Now, u4Frames;
+    uint32_t i, u4Tick;
+    uint32_t u4Result;
+
+    memset(prResult, 0, sizeof(*prResult));
+    u4Start = wifi_sweep_now_ms();
+
+    for(i = 0; i < prStep->u4ConfigNum && i < WIFI_TEST_SWEEP_MAX_CONFIG; i++) {
+        if(wifi_sweep_set(prCache, prStep->arConfig[i].u4FuncIndex,
+                    prStep->arConfig[i].u4FuncData, prResult) != 0) {
+            goto done;
+        }
+    }
+
+    if(prStep->eAction == WIFI_TEST_SWEEP_ACTION_NONE) {
+        goto done;
+    }
+
+    /* RX counters run on across tests, so count from here */
+    if(prStep->eAction == WIFI_TEST_SWEEP_ACTION_RX &&
+            wifi_sweep_read_counters(prStep->eAction, au4Base, prResult) != 0) {
+        goto done;
+    }
+
+    if(wifi_sweep_set(prCache, RF_AT_FUNCID_COMMAND,
+                prStep->eAction == WIFI_TEST_SWEEP_ACTION_TX ?
+                RF_AT_COMMAND_STARTTX : RF_AT_COMMAND_STARTRX,
+                prResult) != 0) {
+        goto done;
+    }
+
+    /* STARTTX may clear the TX counters, so count from after it */
+    if(prStep->eAction == WIFI_TEST_SWEEP_ACTION_TX &&
+            wifi_sweep_read_counters(prStep->eAction, au4Base, prResult) != 0) {
+        wifi_sweep_set(prCache, RF_AT_FUNCID_COMMAND, RF_AT_COMMAND_STOPTEST, prResult);
+        goto done;
+    }
+
+    u4ActionStart = wifi_sweep_now_ms();
+    for(u4Tick = 1; ; u4Tick++) {
+        uint32_t u4Deadline = u4PollIntervalMs * u4Tick;
+
+        if(u4Deadline > prStep->u4DwellMs) {
+            u4Deadline = prStep->u4DwellMs;
+        }
+        u4Now = wifi_sweep_now_ms() - u4ActionStart;
+        if(u4Now < u4Deadline) {
+            usleep((u4Deadline - u4Now) * 1000);
+        }
+        if(u4Deadline >= prStep->u4DwellMs) {
+            break;
+        }
+
+        if(prStep->u4TargetFrames == 0) {
+            continue;
+        }
+        if(wifi_sweep_read_counters(prStep->eAction, au4Count, prResult) != 0) {
+            break;
+        }
+        u4Frames = au4Count[0] - au4Base[0];
+        if(prStep->eAction == WIFI_TEST_SWEEP_ACTION_RX) {
+            u4Frames += au4Count[1] - au4Base[1];
+        }
+        if(u4Frames >= prStep->u4TargetFrames) {
+            break;
+        }
+    }
+
+    /* stop even if a counter read failed */
+    wifi_sweep_set(prCache, RF_AT_FUNCID_COMMAND, RF_AT_COMMAND_STOPTEST, prResult);
+
+    if(wifi_sweep_read_counters(prStep->eAction, au4Count, prResult) == 0) {
+        if(prStep->eAction == WIFI_TEST_SWEEP_ACTION_TX) {
+            prResult->u4TxCount = au4Count[0] - au4Base[0];
+            prResult->u4TxGoodCount = au4Count[1] - au4Base[1];
+        }
+        else {
+            prResult->u4RxGoodCount = au4Count[0] - au4Base[0];
+            prResult->u4RxErrorCount = au4Count[1] - au4Base[1];
+        }
+    }
+
+    if(prStep->eAction == WIFI_TEST_SWEEP_ACTION_RX &&
+            WIFI_TEST_get(RF_AT_FUNCID_RX_RSSI, 0, NULL, &u4Result) == 0) {
+        /* u4Result[0:7]    Average RSSI (dbM) */
+        prResult->i4Rssi = (int8_t)(u4Result & BITS(0,7));
+    }
+
+done:
+    prResult->u4ElapsedMs = wifi_sweep_now_ms() - u4Start;
+}
+
+/*----------------------------------------------------------------------------*/
+/*!
+ * @brief This API runs a sweep plan: the steps in order, skipping set commands
+ *        for parameters already at the requested value
+ *
+ * @param   prSteps             steps to run
+ *          u4StepNum           number of steps
+ *          u4PollIntervalMs    counter sampling period, 0 for
+ *                              WIFI_TEST_SWEEP_POLL_INTERVAL_MS
+ *          prResults           one result per step
+ *
+ * @return  number of failed steps, -1 on bad arguments
+ */
+/*----------------------------------------------------------------------------*/
+int WIFI_TEST_RunSweep(const WIFI_TEST_SWEEP_STEP_T *prSteps, uint32_t u4StepNum,
+    uint32_t u4PollIntervalMs, WIFI_TEST_SWEEP_RESULT_T *prResults)
+{
+    WIFI_TEST_SWEEP_CACHE_T arCache[WIFI_TEST_SWEEP_CACHE_SIZE];
+    uint32_t i;
+    int failed = 0;
+
+    if(!prSteps || !prResults) {
+        return -1;
+    }
+
+    if(u4PollIntervalMs == 0) {
+        u4PollIntervalMs = WIFI_TEST_SWEEP_POLL_INTERVAL_MS;
+    }
+
+    /* nothing is known of what the driver holds before the sweep */
+    memset(arCache, 0, sizeof(arCache));
+
+    for(i = 0; i < u4StepNum; i++) {
+        wifi_sweep_run_step(&prSteps[i], u4PollIntervalMs, arCache, &prResults[i]);
+        if(prResults[i].i4Status != 0) {
+            failed++;
+        }
+
+        DBGLOG("step[%u] status[%d] set[%u] poll[%u] tx[%u/%u] rx[%u/%u] %ums\n",
+            i, prResults[i].i4Status, prResults[i].u2SetCount,
+            prResults[i].u2PollCount, prResults[i].u4TxGoodCount,
+            prResults[i].u4TxCount, prResults[i].u4RxGoodCount,
+            prResults[i].u4RxErrorCount, prResults[i].u4ElapsedMs);
+    }
+
+    return failed;
+}
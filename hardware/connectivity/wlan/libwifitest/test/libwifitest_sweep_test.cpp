@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "libwifitest.h"
+}
+
+namespace {
+
+// Stub driver backend: stores parameters, and counts frames at a fixed rate
+// while TX or RX runs.
+struct StubDriver {
+    std::vector<std::pair<uint32_t, uint32_t>> sets;
+    std::map<uint32_t, uint32_t> params;
+    uint32_t failIndex = UINT32_MAX;
+    uint32_t failGetIndex = UINT32_MAX;
+    uint32_t failGetAfter = 0;  // reads of failGetIndex that still succeed
+    uint32_t framesPerMs = 10;
+    uint32_t rxErrorEvery = 10;  // one RX frame in this many is bad
+    // Cumulative counters, as the firmware keeps them
+    uint32_t counters[2] = {1000, 500};
+    bool startTxClears = false;  // STARTTX restarts the counters from 0
+    uint32_t running = RF_AT_COMMAND_STOPTEST;
+    std::chrono::steady_clock::time_point since;
+
+    uint32_t framesSoFar() const {
+        if (running == RF_AT_COMMAND_STOPTEST) return 0;
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - since).count();
+        return static_cast<uint32_t>(ms) * framesPerMs;
+    }
+
+    // Folds the frames of the running test into the counters
+    void settle() {
+        uint32_t frames = framesSoFar();
+        if (running == RF_AT_COMMAND_STARTTX) {
+            counters[0] += frames;
+            counters[1] += frames;
+        } else if (running == RF_AT_COMMAND_STARTRX) {
+            counters[0] += frames - frames / rxErrorEvery;
+            counters[1] += frames / rxErrorEvery;
+        }
+        since = std::chrono::steady_clock::now();
+    }
+};
+
+StubDriver* gDriver;
+
+size_t countSets(uint32_t funcIndex) {
+    size_t n = 0;
+    for (const auto& set : gDriver->sets) n += set.first == funcIndex;
+    return n;
+}
+
+WIFI_TEST_SWEEP_STEP_T makeStep(
+    std::vector<std::pair<uint32_t, uint32_t>> config,
+    ENUM_WIFI_TEST_SWEEP_ACTION action = WIFI_TEST_SWEEP_ACTION_NONE,
+    uint32_t targetFrames = 0, uint32_t dwellMs = 0) {
+    WIFI_TEST_SWEEP_STEP_T step = {};
+    for (const auto& c : config) {
+        step.arConfig[step.u4ConfigNum].u4FuncIndex = c.first;
+        step.arConfig[step.u4ConfigNum].u4FuncData = c.second;
+        step.u4ConfigNum++;
+    }
+    step.eAction = action;
+    step.u4TargetFrames = targetFrames;
+    step.u4DwellMs = dwellMs;
+    return step;
+}
+
+}  // namespace
+
+extern "C" {
+
+bool fgDebugMode = false;
+
+int WIFI_TEST_set(uint32_t u4FuncIndex, uint32_t u4FuncData,
+                  uint32_t* /* pu4FuncIndex */, uint32_t* /* pu4FuncData */) {
+    gDriver->sets.emplace_back(u4FuncIndex, u4FuncData);
+    if (u4FuncIndex == gDriver->failIndex) return -1;
+    if (u4FuncIndex == RF_AT_FUNCID_COMMAND) {
+        gDriver->settle();
+        gDriver->running = u4FuncData;
+        if (u4FuncData == RF_AT_COMMAND_STARTTX && gDriver->startTxClears) {
+            gDriver->counters[0] = gDriver->counters[1] = 0;
+        }
+    } else {
+        gDriver->params[u4FuncIndex] = u4FuncData;
+    }
+    return 0;
+}
+
+int WIFI_TEST_get(uint32_t u4FuncIndex, uint32_t /* u4FuncData */,
+                  uint32_t* /* pu4FuncIndex */, uint32_t* pu4FuncData) {
+    if (u4FuncIndex == gDriver->failGetIndex) {
+        if (gDriver->failGetAfter == 0) return -1;
+        gDriver->failGetAfter--;
+    }
+    gDriver->settle();
+    switch (u4FuncIndex) {
+        case RF_AT_FUNCID_TXED_COUNT:
+        case RF_AT_FUNCID_RXOK_COUNT:
+            *pu4FuncData = gDriver->counters[0];
+            return 0;
+        case RF_AT_FUNCID_TXOK_COUNT:
+        case RF_AT_FUNCID_RXERROR_COUNT:
+            *pu4FuncData = gDriver->counters[1];
+            return 0;
+        case RF_AT_FUNCID_RX_RSSI:
+            *pu4FuncData = static_cast<uint8_t>(-52);
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+}  // extern "C"
+
+class WifiTestSweepTest : public ::testing::Test {
+   protected:
+    void SetUp() override { gDriver = &driver_; }
+    void TearDown() override { gDriver = nullptr; }
+
+    StubDriver driver_;
+};
+
+TEST_F(WifiTestSweepTest, UnchangedParametersAreNotSetAgain) {
+    std::vector<WIFI_TEST_SWEEP_STEP_T> steps;
+    for (uint32_t power : {20, 30, 40}) {
+        steps.push_back(makeStep({{RF_AT_FUNCID_CHNL_FREQ, 2412000},
+                                  {RF_AT_FUNCID_RATE, RF_AT_PARAM_RATE_54M},
+                                  {RF_AT_FUNCID_POWER, power}}));
+    }
+    std::vector<WIFI_TEST_SWEEP_RESULT_T> results(steps.size());
+    EXPECT_EQ(0, WIFI_TEST_RunSweep(steps.data(), steps.size(), 0, results.data()));
+
+    EXPECT_EQ(1u, countSets(RF_AT_FUNCID_CHNL_FREQ));
+    EXPECT_EQ(1u, countSets(RF_AT_FUNCID_RATE));
+    EXPECT_EQ(3u, countSets(RF_AT_FUNCID_POWER));
+    EXPECT_EQ(3u, results[0].u2SetCount);
+    EXPECT_EQ(1u, results[1].u2SetCount);
+    EXPECT_EQ(40u, driver_.params[RF_AT_FUNCID_POWER]);
+}
+
+TEST_F(WifiTestSweepTest, ChannelChangeSetsParametersAgain) {
+    std::vector<WIFI_TEST_SWEEP_STEP_T> steps;
+    for (uint32_t freq : {2412000, 2437000, 2437000}) {
+        steps.push_back(makeStep({{RF_AT_FUNCID_CHNL_FREQ, freq},
+                                  {RF_AT_FUNCID_POWER, 30}}));
+    }
+    std::vector<WIFI_TEST_SWEEP_RESULT_T> results(steps.size());
+    EXPECT_EQ(0, WIFI_TEST_RunSweep(steps.data(), steps.size(), 0, results.data()));
+
+    EXPECT_EQ(2u, countSets(RF_AT_FUNCID_CHNL_FREQ));
+    EXPECT_EQ(2u, countSets(RF_AT_FUNCID_POWER));
+    EXPECT_EQ(0u, results[2].u2SetCount);
+}
+
+TEST_F(WifiTestSweepTest, ActionFunctionsAreAlwaysSent) {
+    std::vector<WIFI_TEST_SWEEP_STEP_T> steps = {
+        makeStep({{RF_AT_FUNCID_TEMP_COMPEN, 1}, {RF_AT_FUNCID_RF_SX_SHUTDOWN, 0}}),
+        makeStep({{RF_AT_FUNCID_TEMP_COMPEN, 1}, {RF_AT_FUNCID_RF_SX_SHUTDOWN, 0}}),
+    };
+    std::vector<WIFI_TEST_SWEEP_RESULT_T> results(steps.size());
+    EXPECT_EQ(0, WIFI_TEST_RunSweep(steps.data(), steps.size(), 0, results.data()));
+
+    EXPECT_EQ(2u, countSets(RF_AT_FUNCID_TEMP_COMPEN));
+    EXPECT_EQ(2u, countSets(RF_AT_FUNCID_RF_SX_SHUTDOWN));
+}
+
+TEST_F(WifiTestSweepTest, TxStepEndsAtTargetFrames) {
+    WIFI_TEST_SWEEP_STEP_T step = makeStep({{RF_AT_FUNCID_PKTCNT, 500}},
+                                           WIFI_TEST_SWEEP_ACTION_TX, 500, 2000);
+    WIFI_TEST_SWEEP_RESULT_T result;
+    EXPECT_EQ(0, WIFI_TEST_RunSweep(&step, 1, 10, &result));
+
+    EXPECT_EQ(0, result.i4Status);
+    EXPECT_GE(result.u4TxCount, 500u);
+    EXPECT_EQ(result.u4TxCount, result.u4TxGoodCount);
+    // 500 frames at 10 per ms, far from the 2 s dwell
+    EXPECT_LT(result.u4ElapsedMs, 500u);
+    EXPECT_GE(result.u2PollCount, 2u);
+    EXPECT_EQ(RF_AT_COMMAND_STOPTEST, driver_.running);
+}
+
+TEST_F(WifiTestSweepTest, TxCountsOnlyFramesOfStep) {
+    for (bool clears : {false, true}) {
+        SCOPED_TRACE(clears ? "STARTTX clears counters" : "counters run on");
+        driver_.startTxClears = clears;
+        driver_.counters[0] = 100000;
+        driver_.counters[1] = 90000;
+        WIFI_TEST_SWEEP_STEP_T step = makeStep({}, WIFI_TEST_SWEEP_ACTION_TX, 500, 2000);
+        WIFI_TEST_SWEEP_RESULT_T result;
+        EXPECT_EQ(0, WIFI_TEST_RunSweep(&step, 1, 10, &result));
+
+        EXPECT_EQ(0, result.i4Status);
+        EXPECT_GE(result.u4TxCount, 500u);
+        EXPECT_LE(result.u4TxCount, result.u4ElapsedMs * driver_.framesPerMs);
+        EXPECT_EQ(result.u4TxCount, result.u4TxGoodCount);
+    }
+}
+
+TEST_F(WifiTestSweepTest, RxStepRunsForDwellAndCountsFromStart) {
+    WIFI_TEST_SWEEP_STEP_T step = makeStep({}, WIFI_TEST_SWEEP_ACTION_RX, 0, 100);
+    WIFI_TEST_SWEEP_RESULT_T result;
+    EXPECT_EQ(0, WIFI_TEST_RunSweep(&step, 1, 10, &result));
+
+    EXPECT_GE(result.u4ElapsedMs, 100u);
+    // Counters started at 1000/500: only the frames of the step count
+    uint32_t frames = result.u4RxGoodCount + result.u4RxErrorCount;
+    EXPECT_GE(frames, 100u * driver_.framesPerMs);
+    EXPECT_LT(frames, 1000u * driver_.framesPerMs);
+    EXPECT_EQ(frames / driver_.rxErrorEvery, result.u4RxErrorCount);
+    EXPECT_EQ(-52, result.i4Rssi);
+    // No target: only the counters before and after are read
+    EXPECT_EQ(2u, result.u2PollCount);
+}
+
+TEST_F(WifiTestSweepTest, FailedSetEndsStepOnly) {
+    driver_.failIndex = RF_AT_FUNCID_GI;
+    std::vector<WIFI_TEST_SWEEP_STEP_T> steps = {
+        makeStep({{RF_AT_FUNCID_GI, 1}, {RF_AT_FUNCID_POWER, 30}},
+                 WIFI_TEST_SWEEP_ACTION_TX, 100, 1000),
+        makeStep({{RF_AT_FUNCID_POWER, 30}}),
+    };
+    std::vector<WIFI_TEST_SWEEP_RESULT_T> results(steps.size());
+    EXPECT_EQ(1, WIFI_TEST_RunSweep(steps.data(), steps.size(), 0, results.data()));
+
+    EXPECT_EQ(-1, results[0].i4Status);
+    EXPECT_EQ(static_cast<uint32_t>(RF_AT_FUNCID_GI), results[0].u4FailedFuncIndex);
+    EXPECT_EQ(0u, countSets(RF_AT_FUNCID_COMMAND));
+    EXPECT_EQ(0, results[1].i4Status);
+    EXPECT_EQ(1u, countSets(RF_AT_FUNCID_POWER));
+}
+
+TEST_F(WifiTestSweepTest, TestIsStoppedWhenCountersFail) {
+    WIFI_TEST_SWEEP_STEP_T step = makeStep({}, WIFI_TEST_SWEEP_ACTION_TX, 100000, 1000);
+    WIFI_TEST_SWEEP_RESULT_T result;
+    // The baseline read works, the first sample fails
+    driver_.failGetIndex = RF_AT_FUNCID_TXED_COUNT;
+    driver_.failGetAfter = 1;
+    EXPECT_EQ(1, WIFI_TEST_RunSweep(&step, 1, 10, &result));
+
+    EXPECT_EQ(-1, result.i4Status);
+    EXPECT_EQ(static_cast<uint32_t>(RF_AT_FUNCID_TXED_COUNT), result.u4FailedFuncIndex);
+    EXPECT_LT(result.u4ElapsedMs, 500u);
+    ASSERT_FALSE(driver_.sets.empty());
+    EXPECT_EQ(std::make_pair(static_cast<uint32_t>(RF_AT_FUNCID_COMMAND),
+                             static_cast<uint32_t>(RF_AT_COMMAND_STOPTEST)),
+              driver_.sets.back());
+    EXPECT_EQ(RF_AT_COMMAND_STOPTEST, driver_.running);
+}
+
+TEST_F(WifiTestSweepTest, TestIsNotStartedWithoutBaseline) {
+    WIFI_TEST_SWEEP_STEP_T step = makeStep({}, WIFI_TEST_SWEEP_ACTION_RX, 100, 1000);
+    WIFI_TEST_SWEEP_RESULT_T result;
+    driver_.failGetIndex = RF_AT_FUNCID_RXERROR_COUNT;
+    EXPECT_EQ(1, WIFI_TEST_RunSweep(&step, 1, 10, &result));
+
+    EXPECT_EQ(0u, countSets(RF_AT_FUNCID_COMMAND));
+    EXPECT_EQ(static_cast<uint32_t>(RF_AT_FUNCID_RXERROR_COUNT), result.u4FailedFuncIndex);
+}
+
+TEST_F(WifiTestSweepTest, TxIsStoppedWithoutBaseline) {
+    WIFI_TEST_SWEEP_STEP_T step = makeStep({}, WIFI_TEST_SWEEP_ACTION_TX, 100, 1000);
+    WIFI_TEST_SWEEP_RESULT_T result;
+    driver_.failGetIndex = RF_AT_FUNCID_TXOK_COUNT;
+    EXPECT_EQ(1, WIFI_TEST_RunSweep(&step, 1, 10, &result));
+
+    EXPECT_EQ(static_cast<uint32_t>(RF_AT_FUNCID_TXOK_COUNT), result.u4FailedFuncIndex);
+    EXPECT_EQ(1u, result.u2PollCount);
+    EXPECT_EQ(RF_AT_COMMAND_STOPTEST, driver_.running);
+}
+
+TEST_F(WifiTestSweepTest, ResetForgetsParameters) {
+    std::vector<WIFI_TEST_SWEEP_STEP_T> steps = {
+        makeStep({{RF_AT_FUNCID_POWER, 30}}),
+        makeStep({{RF_AT_FUNCID_COMMAND, RF_AT_COMMAND_RESET}, {RF_AT_FUNCID_POWER, 30}}),
+        makeStep({{RF_AT_FUNCID_POWER, 30}}),
+    };
+    std::vector<WIFI_TEST_SWEEP_RESULT_T> results(steps.size());
+    EXPECT_EQ(0, WIFI_TEST_RunSweep(steps.data(), steps.size(), 0, results.data()));
+    EXPECT_EQ(2u, countSets(RF_AT_FUNCID_POWER));
+}
+
+TEST_F(WifiTestSweepTest, RejectsMissingArguments) {
+    WIFI_TEST_SWEEP_STEP_T step = makeStep({});
+    WIFI_TEST_SWEEP_RESULT_T result;
+    EXPECT_EQ(-1, WIFI_TEST_RunSweep(nullptr, 1, 0, &result));
+    EXPECT_EQ(-1, WIFI_TEST_RunSweep(&step, 1, 0, nullptr));
+}
@@ -33,6 +33,7 @@ LOCAL_C_INCLUDES := \
     vendor/mediatek/wifi/libwifi/include
 
 LOCAL_SRC_FILES := \
+    cpio_util.cpp \
     hidl_struct_util.cpp \
     hidl_sync_util.cpp \
     ringbuffer.cpp \
@@ -59,6 +60,7 @@ LOCAL_SHARED_LIBRARIES := \
     libutils \
     libwifi-hal-mtk \
     libwifi-system-iface \
+    libz \
     android.hardware.wifi@1.0 \
     android.hardware.wifi@1.1 \
     android.hardware.wifi@1.2 \
@@ -87,6 +89,7 @@ LOCAL_SHARED_LIBRARIES := \
     libutils \
     libwifi-hal-mtk \
     libwifi-system-iface \
+    libz \
     android.hardware.wifi@1.0 \
     android.hardware.wifi@1.1 \
     android.hardware.wifi@1.2 \
@@ -119,6 +122,7 @@ LOCAL_SHARED_LIBRARIES := \
     libutils \
     libwifi-hal-mtk \
     libwifi-system-iface \
+    libz \
     android.hardware.wifi@1.0 \
     android.hardware.wifi@1.1 \
     android.hardware.wifi@1.2 \
@@ -128,3 +132,65 @@ LOCAL_STATIC_LIBRARIES := \
     android.hardware.wifi@1.0-service-lib-mediatek
 LOCAL_INIT_RC := android.hardware.wifi@1.0-service-lazy-mediatek.rc
 include $(BUILD_EXECUTABLE)
+
+###
+### android.hardware.wifi unit tests.
+###
+include $(CLEAR_VARS)
+LOCAL_MODULE := android.hardware.wifi@1.0-service-tests-mediatek
+LOCAL_PROPRIETARY_MODULE := true
+LOCAL_CPPFLAGS := -Wall -Werror -Wextra
+LOCAL_SRC_FILES := \
+    tests/ringbuffer_unit_tests.cpp
+LOCAL_STATIC_LIBRARIES := \
+    android.hardware.wifi@1.0-service-lib-mediatek
+LOCAL_SHARED_LIBRARIES := \
+    libbase \
+    liblog
+LOCAL_COMPATIBILITY_SUITE := device-tests
+include $(BUILD_NATIVE_TEST)
+
+###
+### android.hardware.wifi HIDL struct conversion benchmark.
+###
+include $(CLEAR_VARS)
+LOCAL_MODULE := android.hardware.wifi@1.0-service-hidl-struct-benchmark-mediatek
+LOCAL_PROPRIETARY_MODULE := true
+LOCAL_CPPFLAGS := -Wall -Werror -Wextra
+LOCAL_SRC_FILES := \
+    tests/hidl_struct_util_benchmark.cpp
+LOCAL_STATIC_LIBRARIES := \
+    android.hardware.wifi@1.0-service-lib-mediatek
+LOCAL_SHARED_LIBRARIES := \
+    libbase \
+    libcutils \
+    libhidlbase \
+    liblog \
+    libnl \
+    libutils \
+    libwifi-hal-mtk \
+    libwifi-system-iface \
+    libz \
+    android.hardware.wifi@1.0 \
+    android.hardware.wifi@1.1 \
+    android.hardware.wifi@1.2 \
+    android.hardware.wifi@1.3 \
+    android.hardware.wifi@1.4
+include $(BUILD_NATIVE_BENCHMARK)
+
+###
+### android.hardware.wifi debug dump cpio archiver benchmark.
+###
+include $(CLEAR_VARS)
+LOCAL_MODULE := android.hardware.wifi@1.0-service-cpio-benchmark-mediatek
+LOCAL_PROPRIETARY_MODULE := true
+LOCAL_CPPFLAGS := -Wall -Werror -Wextra
+LOCAL_SRC_FILES := \
+    tests/cpio_util_benchmark.cpp
+LOCAL_STATIC_LIBRARIES := \
+    android.hardware.wifi@1.0-service-lib-mediatek
+LOCAL_SHARED_LIBRARIES := \
+    libbase \
+    liblog \
+    libz
+include $(BUILD_NATIVE_BENCHMARK)
@@ -0,0 +1,318 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <string>
+
+#include <android-base/logging.h>
+#include <android-base/unique_fd.h>
+
+#include "cpio_util.h"
+
+namespace {
+using android::base::unique_fd;
+
+constexpr char kCpioMagic[] = "070701";
+// Chunk of file data read for compression, or copied where the kernel can't.
+constexpr size_t kCopyChunkSize = 256 * 1024;
+constexpr int kMaxIovecs = 4;
+const uint8_t kZeroPad[4] = {};
+
+// Number of NUL bytes padding |len| bytes up to a multiple of 4.
+size_t padLength(size_t len) { return (4 - len % 4) % 4; }
+
+// Where the archive goes: straight into |out_fd|, or gzip compressed into it.
+class CpioWriter {
+   public:
+    CpioWriter(int out_fd, bool gzip)
+        : out_fd_(out_fd), gzip_(gzip), zstream_initialized_(false) {}
+    ~CpioWriter() {
+        if (zstream_initialized_) {
+            deflateEnd(&zstream_);
+        }
+    }
+
+    bool init() {
+        if (!gzip_) {
+            return true;
+        }
+        zstream_ = {};
+        // windowBits 15 + 16 asks for a gzip header and trailer.
+        if (deflateInit2(&zstream_, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8,
+                         Z_DEFAULT_STRATEGY) != Z_OK) {
+            LOG(ERROR) << "Failed to initialize gzip stream";
+            return false;
+        }
+        zstream_initialized_ = true;
+        out_buf_.reset(new uint8_t[kCopyChunkSize]);
+        return true;
+    }
+
+    // Writes the |iovcnt| buffers, with a single writev() when uncompressed.
+    bool write(const struct iovec* iov, int iovcnt) {
+        if (!gzip_) {
+            return writeFully(iov, iovcnt);
+        }
+        for (int i = 0; i < iovcnt; i++) {
+            if (!deflateTo(static_cast<const uint8_t*>(iov[i].iov_base),
+                           iov[i].iov_len, Z_NO_FLUSH)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Writes the next |size| bytes of |fd_read|.
+    bool copyFile(int fd_read, size_t size) {
+        if (!gzip_ && !copyInKernel(fd_read, &size)) {
+            return false;
+        }
+        if (size > 0 && !buf_) {
+            buf_.reset(new uint8_t[kCopyChunkSize]);
+        }
+        while (size > 0) {
+            ssize_t bytes_read = TEMP_FAILURE_RETRY(
+                read(fd_read, buf_.get(), std::min(size, kCopyChunkSize)));
+            if (bytes_read == -1) {
+                PLOG(ERROR) << "Error reading file";
+                return false;
+            }
+            if (bytes_read == 0) {
+                LOG(ERROR) << "Unexpected end of file";
+                return false;
+            }
+            size -= bytes_read;
+            if (gzip_) {
+                if (!deflateTo(buf_.get(), bytes_read, Z_NO_FLUSH)) {
+                    return false;
+                }
+            } else {
+                struct iovec iov = {buf_.get(), static_cast<size_t>(bytes_read)};
+                if (!writeFully(&iov, 1)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Flushes the gzip stream.
+    bool finish() { return !gzip_ || deflateTo(nullptr, 0, Z_FINISH); }
+
+   private:
+    bool writeFully(const struct iovec* iov, int iovcnt) {
+        struct iovec left[kMaxIovecs];
+        CHECK_LE(iovcnt, kMaxIovecs);
+        std::copy(iov, iov + iovcnt, left);
+        struct iovec* cur = left;
+        while (iovcnt > 0) {
+            ssize_t written = TEMP_FAILURE_RETRY(writev(out_fd_, cur, iovcnt));
+            if (written == -1) {
+                PLOG(ERROR) << "Error writing to archive";
+                return false;
+            }
+            while (iovcnt > 0 && static_cast<size_t>(written) >= cur->iov_len) {
+                written -= cur->iov_len;
+                cur++;
+                iovcnt--;
+            }
+            if (iovcnt > 0) {
+                cur->iov_base = static_cast<uint8_t*>(cur->iov_base) + written;
+                cur->iov_len -= written;
+            }
+        }
+        return true;
+    }
+
+    bool deflateTo(const uint8_t* data, size_t size, int flush) {
+        zstream_.next_in = const_cast<uint8_t*>(data);
+        zstream_.avail_in = size;
+        do {
+            zstream_.next_out = out_buf_.get();
+            zstream_.avail_out = kCopyChunkSize;
+            if (deflate(&zstream_, flush) == Z_STREAM_ERROR) {
+                LOG(ERROR) << "Error compressing archive";
+                return false;
+            }
+            struct iovec iov = {out_buf_.get(),
+                                kCopyChunkSize - zstream_.avail_out};
+            if (iov.iov_len > 0 && !writeFully(&iov, 1)) {
+                return false;
+            }
+        } while (zstream_.avail_out == 0);
+        return true;
+    }
+
+    // Copies what it can of the next |*size| bytes of |fd_read| without going
+    // through user space, copy_file_range() for a file |out_fd_| and
+    // sendfile() for anything else, and leaves the rest in |*size|. A method
+    // |out_fd_| does not support is not tried again.
+    bool copyInKernel(int fd_read, size_t* size) {
+        while (*size > 0 && (copy_file_range_supported_ || sendfile_supported_)) {
+            bool* supported;
+            ssize_t copied;
+            if (copy_file_range_supported_) {
+                supported = &copy_file_range_supported_;
+#if defined(__NR_copy_file_range)
+                copied = syscall(__NR_copy_file_range, fd_read, nullptr,
+                                 out_fd_, nullptr, *size, 0);
+#else
+                copied = -1;
+                errno = ENOSYS;
+#endif
+            } else {
+                supported = &sendfile_supported_;
+                copied = sendfile(out_fd_, fd_read, nullptr, *size);
+            }
+            if (copied == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EINVAL || errno == ENOSYS || errno == EXDEV ||
+                    errno == EBADF || errno == EOPNOTSUPP) {
+                    *supported = false;
+                    continue;
+                }
+                PLOG(ERROR) << "Error copying data to archive";
+                return false;
+            }
+            if (copied == 0) {
+                LOG(ERROR) << "Unexpected end of file";
+                return false;
+            }
+            *size -= copied;
+        }
+        return true;
+    }
+
+    int out_fd_;
+    bool gzip_;
+    bool copy_file_range_supported_ = true;
+    bool sendfile_supported_ = true;
+    z_stream zstream_;
+    bool zstream_initialized_;
+    std::unique_ptr<uint8_t[]> buf_;
+    std::unique_ptr<uint8_t[]> out_buf_;
+};
+
+}  // namespace
+
+namespace android {
+namespace hardware {
+namespace wifi {
+namespace V1_4 {
+namespace implementation {
+namespace cpio_util {
+
+// Logic obtained from //external/toybox/toys/posix/cpio.c "Output cpio archive"
+// portion
+size_t archiveFilesInDir(int out_fd, const char* input_dir, bool gzip) {
+    struct dirent* dp;
+    size_t n_error = 0;
+    CpioWriter writer(out_fd, gzip);
+    if (!writer.init()) {
+        return ++n_error;
+    }
+    std::unique_ptr<DIR, decltype(&closedir)> dir_dump(opendir(input_dir),
+                                                       closedir);
+    if (!dir_dump) {
+        PLOG(ERROR) << "Failed to open directory";
+        return ++n_error;
+    }
+    // NUL padding owed by the previous file content, written with the next
+    // header.
+    size_t content_pad = 0;
+    while ((dp = readdir(dir_dump.get()))) {
+        if (dp->d_type != DT_REG) {
+            continue;
+        }
+        std::string cur_file_name(dp->d_name);
+        // string.size() does not include the null terminator. The cpio FreeBSD
+        // file header expects the null character to be included in the length.
+        const size_t file_name_len = cur_file_name.size() + 1;
+        const std::string cur_file_path =
+            std::string(input_dir) + "/" + cur_file_name;
+        const int fd_read = open(cur_file_path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd_read == -1) {
+            PLOG(ERROR) << "Failed to open file " << cur_file_path;
+            n_error++;
+            continue;
+        }
+        unique_fd file_auto_closer(fd_read);
+        struct stat st;
+        if (fstat(fd_read, &st) == -1) {
+            PLOG(ERROR) << "Failed to get file stat for " << cur_file_path;
+            n_error++;
+            continue;
+        }
+        char header[128];
+        const int header_len = snprintf(
+            header, sizeof(header),
+            "%s%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X",
+            kCpioMagic, static_cast<int>(st.st_ino), st.st_mode, st.st_uid,
+            st.st_gid, static_cast<int>(st.st_nlink),
+            static_cast<int>(st.st_mtime), static_cast<int>(st.st_size),
+            major(st.st_dev), minor(st.st_dev), major(st.st_rdev),
+            minor(st.st_rdev), static_cast<uint32_t>(file_name_len), 0);
+        // Previous padding, header, name and the NUL padding after it.
+        const struct iovec iov[] = {
+            {const_cast<uint8_t*>(kZeroPad), content_pad},
+            {header, static_cast<size_t>(header_len)},
+            {&cur_file_name[0], file_name_len},
+            {const_cast<uint8_t*>(kZeroPad), padLength(header_len + file_name_len)}};
+        if (!writer.write(iov, kMaxIovecs)) {
+            LOG(ERROR) << "Error writing cpio header for " << cur_file_name;
+            return ++n_error;
+        }
+        if (!writer.copyFile(fd_read, st.st_size)) {
+            return ++n_error;
+        }
+        content_pad = padLength(st.st_size);
+    }
+    std::array<char, 128> trailer = {};
+    const int trailer_len = snprintf(trailer.data(), trailer.size(),
+                                     "070701%040X%056X%08XTRAILER!!!", 1, 0x0b,
+                                     0) + 4;
+    const struct iovec iov[] = {
+        {const_cast<uint8_t*>(kZeroPad), content_pad},
+        {trailer.data(), static_cast<size_t>(trailer_len)}};
+    if (!writer.write(iov, 2) || !writer.finish()) {
+        LOG(ERROR) << "Error writing trailing bytes";
+        return ++n_error;
+    }
+    return n_error;
+}
+
+}  // namespace cpio_util
+}  // namespace implementation
+}  // namespace V1_4
+}  // namespace wifi
+}  // namespace hardware
+}  // namespace android
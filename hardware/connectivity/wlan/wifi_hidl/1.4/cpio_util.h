@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CPIO_UTIL_H_
+#define CPIO_UTIL_H_
+
+#include <stddef.h>
+
+namespace android {
+namespace hardware {
+namespace wifi {
+namespace V1_4 {
+namespace implementation {
+namespace cpio_util {
+
+// Archives all regular files in |input_dir| as a "newc" cpio archive and
+// writes it into |out_fd|. File contents are copied in the kernel where
+// |out_fd| allows it. With |gzip| set, the archive is gzip compressed on the
+// fly instead. Returns the number of errors, 0 on success.
+size_t archiveFilesInDir(int out_fd, const char* input_dir, bool gzip = false);
+
+}  // namespace cpio_util
+}  // namespace implementation
+}  // namespace V1_4
+}  // namespace wifi
+}  // namespace hardware
+}  // namespace android
+
+#endif  // CPIO_UTIL_H_
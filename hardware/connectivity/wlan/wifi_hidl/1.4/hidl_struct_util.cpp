@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+
 #include <android-base/logging.h>
 #include <utils/SystemClock.h>
 
@@ -39,6 +41,28 @@ hidl_string safeConvertChar(const char* str, size_t max_len) {
     return hidl_string(str, size);
 }
 
+// Resizes |vec|, keeping its buffer if the size is unchanged and moving the
+// elements over otherwise (hidl_vec::resize() copies them).
+template <typename T>
+void resizeHidlVec(hidl_vec<T>* vec, size_t size) {
+    if (vec->size() == size) {
+        return;
+    }
+    hidl_vec<T> resized;
+    resized.resize(size);
+    for (size_t i = 0; i < std::min(size, vec->size()); i++) {
+        resized[i] = std::move((*vec)[i]);
+    }
+    *vec = std::move(resized);
+}
+
+// Sets |vec| to [|begin|, |end|), reallocating only if the size changed.
+template <typename T>
+void assignHidlVec(hidl_vec<T>* vec, const T* begin, const T* end) {
+    resizeHidlVec(vec, end - begin);
+    std::copy(begin, end, vec->data());
+}
+
 IWifiChip::ChipCapabilityMask convertLegacyLoggerFeatureToHidlChipCapability(
     uint32_t feature) {
     using HidlChipCaps = IWifiChip::ChipCapabilityMask;
@@ -545,16 +569,17 @@ bool convertLegacyIeToHidl(
 }
 
 bool convertLegacyIeBlobToHidl(const uint8_t* ie_blob, uint32_t ie_blob_len,
-                               std::vector<WifiInformationElement>* hidl_ies) {
+                               hidl_vec<WifiInformationElement>* hidl_ies) {
     if (!ie_blob || !hidl_ies) {
         return false;
     }
-    *hidl_ies = {};
     const uint8_t* ies_begin = ie_blob;
     const uint8_t* ies_end = ie_blob + ie_blob_len;
-    const uint8_t* next_ie = ies_begin;
     using wifi_ie = legacy_hal::wifi_information_element;
     constexpr size_t kIeHeaderLen = sizeof(wifi_ie);
+    // Count the IEs first, to size |hidl_ies| once.
+    size_t num_ies = 0;
+    const uint8_t* next_ie = ies_begin;
     // Each IE should atleast have the header (i.e |id| & |len| fields).
     while (next_ie + kIeHeaderLen <= ies_end) {
         const wifi_ie& legacy_ie = (*reinterpret_cast<const wifi_ie*>(next_ie));
@@ -565,13 +590,7 @@ bool convertLegacyIeBlobToHidl(const uint8_t* ie_blob, uint32_t ie_blob_len,
                        << ", IEs End: " << (void*)ies_end;
             break;
         }
-        WifiInformationElement hidl_ie;
-        if (!convertLegacyIeToHidl(legacy_ie, &hidl_ie)) {
-            LOG(ERROR) << "Error converting IE. Id: " << legacy_ie.id
-                       << ", len: " << legacy_ie.len;
-            break;
-        }
-        hidl_ies->push_back(std::move(hidl_ie));
+        num_ies++;
         next_ie += curr_ie_len;
     }
     // Check if the blob has been fully consumed.
@@ -579,6 +598,15 @@ bool convertLegacyIeBlobToHidl(const uint8_t* ie_blob, uint32_t ie_blob_len,
         LOG(ERROR) << "Failed to fully parse IE blob. Next IE: "
                    << (void*)next_ie << ", IEs End: " << (void*)ies_end;
     }
+    resizeHidlVec(hidl_ies, num_ies);
+    next_ie = ies_begin;
+    for (auto& hidl_ie : *hidl_ies) {
+        const wifi_ie& legacy_ie = (*reinterpret_cast<const wifi_ie*>(next_ie));
+        hidl_ie.id = legacy_ie.id;
+        assignHidlVec(&hidl_ie.data, legacy_ie.data,
+                      legacy_ie.data + legacy_ie.len);
+        next_ie += kIeHeaderLen + legacy_ie.len;
+    }
     return true;
 }
 
@@ -588,12 +616,11 @@ bool convertLegacyGscanResultToHidl(
     if (!hidl_scan_result) {
         return false;
     }
-    *hidl_scan_result = {};
     hidl_scan_result->timeStampInUs = legacy_scan_result.ts;
-    hidl_scan_result->ssid = std::vector<uint8_t>(
-        legacy_scan_result.ssid,
-        legacy_scan_result.ssid + strnlen(legacy_scan_result.ssid,
-                                          sizeof(legacy_scan_result.ssid) - 1));
+    const uint8_t* ssid = reinterpret_cast<const uint8_t*>(legacy_scan_result.ssid);
+    assignHidlVec(&hidl_scan_result->ssid, ssid,
+                  ssid + strnlen(legacy_scan_result.ssid,
+                                 sizeof(legacy_scan_result.ssid) - 1));
     memcpy(hidl_scan_result->bssid.data(), legacy_scan_result.bssid,
            hidl_scan_result->bssid.size());
     hidl_scan_result->frequency = legacy_scan_result.channel;
@@ -601,13 +628,14 @@ bool convertLegacyGscanResultToHidl(
     hidl_scan_result->beaconPeriodInMs = legacy_scan_result.beacon_period;
     hidl_scan_result->capability = legacy_scan_result.capability;
     if (has_ie_data) {
-        std::vector<WifiInformationElement> ies;
         if (!convertLegacyIeBlobToHidl(
                 reinterpret_cast<const uint8_t*>(legacy_scan_result.ie_data),
-                legacy_scan_result.ie_length, &ies)) {
+                legacy_scan_result.ie_length,
+                &hidl_scan_result->informationElements)) {
             return false;
         }
-        hidl_scan_result->informationElements = std::move(ies);
+    } else {
+        resizeHidlVec(&hidl_scan_result->informationElements, 0);
     }
     return true;
 }
@@ -618,7 +646,6 @@ bool convertLegacyCachedGscanResultsToHidl(
     if (!hidl_scan_data) {
         return false;
     }
-    *hidl_scan_data = {};
     hidl_scan_data->flags = 0;
     for (const auto flag : {legacy_hal::WIFI_SCAN_FLAG_INTERRUPTED}) {
         if (legacy_cached_scan_result.flags & flag) {
@@ -631,36 +658,52 @@ bool convertLegacyCachedGscanResultsToHidl(
 
     CHECK(legacy_cached_scan_result.num_results >= 0 &&
           legacy_cached_scan_result.num_results <= MAX_AP_CACHE_PER_SCAN);
-    std::vector<StaScanResult> hidl_scan_results;
-    for (int32_t result_idx = 0;
-         result_idx < legacy_cached_scan_result.num_results; result_idx++) {
-        StaScanResult hidl_scan_result;
+    // Line the previous results up with the new ones by BSSID, so an AP seen
+    // again is rewritten in its old buffers. Scans mostly report the APs in
+    // the same order, making the search short.
+    hidl_vec<StaScanResult>& hidl_scan_results = hidl_scan_data->results;
+    const size_t num_results = legacy_cached_scan_result.num_results;
+    for (size_t result_idx = 0;
+         result_idx < std::min(num_results, hidl_scan_results.size());
+         result_idx++) {
+        const uint8_t* bssid =
+            legacy_cached_scan_result.results[result_idx].bssid;
+        for (size_t old_idx = result_idx; old_idx < hidl_scan_results.size();
+             old_idx++) {
+            if (memcmp(hidl_scan_results[old_idx].bssid.data(), bssid,
+                       hidl_scan_results[old_idx].bssid.size()) == 0) {
+                if (old_idx != result_idx) {
+                    std::swap(hidl_scan_results[result_idx],
+                              hidl_scan_results[old_idx]);
+                }
+                break;
+            }
+        }
+    }
+    resizeHidlVec(&hidl_scan_results, num_results);
+    for (size_t result_idx = 0; result_idx < num_results; result_idx++) {
         if (!convertLegacyGscanResultToHidl(
                 legacy_cached_scan_result.results[result_idx], false,
-                &hidl_scan_result)) {
+                &hidl_scan_results[result_idx])) {
             return false;
         }
-        hidl_scan_results.push_back(hidl_scan_result);
     }
-    hidl_scan_data->results = std::move(hidl_scan_results);
     return true;
 }
 
 bool convertLegacyVectorOfCachedGscanResultsToHidl(
     const std::vector<legacy_hal::wifi_cached_scan_results>&
         legacy_cached_scan_results,
-    std::vector<StaScanData>* hidl_scan_datas) {
+    hidl_vec<StaScanData>* hidl_scan_datas) {
     if (!hidl_scan_datas) {
         return false;
     }
-    *hidl_scan_datas = {};
-    for (const auto& legacy_cached_scan_result : legacy_cached_scan_results) {
-        StaScanData hidl_scan_data;
-        if (!convertLegacyCachedGscanResultsToHidl(legacy_cached_scan_result,
-                                                   &hidl_scan_data)) {
+    resizeHidlVec(hidl_scan_datas, legacy_cached_scan_results.size());
+    for (size_t i = 0; i < legacy_cached_scan_results.size(); i++) {
+        if (!convertLegacyCachedGscanResultsToHidl(
+                legacy_cached_scan_results[i], &(*hidl_scan_datas)[i])) {
             return false;
         }
-        hidl_scan_datas->push_back(hidl_scan_data);
     }
     return true;
 }
@@ -817,15 +860,16 @@ bool convertLegacyLinkLayerRadioStatsToHidl(
     if (!hidl_radio_stat) {
         return false;
     }
-    *hidl_radio_stat = {};
 
     hidl_radio_stat->V1_0.onTimeInMs = legacy_radio_stat.stats.on_time;
     hidl_radio_stat->V1_0.txTimeInMs = legacy_radio_stat.stats.tx_time;
     hidl_radio_stat->V1_0.rxTimeInMs = legacy_radio_stat.stats.rx_time;
     hidl_radio_stat->V1_0.onTimeInMsForScan =
         legacy_radio_stat.stats.on_time_scan;
-    hidl_radio_stat->V1_0.txTimeInMsPerLevel =
-        legacy_radio_stat.tx_time_per_levels;
+    assignHidlVec(&hidl_radio_stat->V1_0.txTimeInMsPerLevel,
+                  legacy_radio_stat.tx_time_per_levels.data(),
+                  legacy_radio_stat.tx_time_per_levels.data() +
+                      legacy_radio_stat.tx_time_per_levels.size());
     hidl_radio_stat->onTimeInMsForNanScan = legacy_radio_stat.stats.on_time_nbd;
     hidl_radio_stat->onTimeInMsForBgScan =
         legacy_radio_stat.stats.on_time_gscan;
@@ -836,10 +880,12 @@ bool convertLegacyLinkLayerRadioStatsToHidl(
     hidl_radio_stat->onTimeInMsForHs20Scan =
         legacy_radio_stat.stats.on_time_hs20;
 
-    std::vector<V1_3::WifiChannelStats> hidl_channel_stats;
-
-    for (const auto& channel_stat : legacy_radio_stat.channel_stats) {
-        V1_3::WifiChannelStats hidl_channel_stat;
+    resizeHidlVec(&hidl_radio_stat->channelStats,
+                  legacy_radio_stat.channel_stats.size());
+    for (size_t i = 0; i < legacy_radio_stat.channel_stats.size(); i++) {
+        const auto& channel_stat = legacy_radio_stat.channel_stats[i];
+        V1_3::WifiChannelStats& hidl_channel_stat =
+            hidl_radio_stat->channelStats[i];
         hidl_channel_stat.onTimeInMs = channel_stat.on_time;
         hidl_channel_stat.ccaBusyTimeInMs = channel_stat.cca_busy_time;
         /*
@@ -852,11 +898,8 @@ bool convertLegacyLinkLayerRadioStatsToHidl(
             channel_stat.channel.center_freq0;
         hidl_channel_stat.channel.centerFreq1 =
             channel_stat.channel.center_freq1;
-        hidl_channel_stats.push_back(hidl_channel_stat);
     }
 
-    hidl_radio_stat->channelStats = hidl_channel_stats;
-
     return true;
 }
 
@@ -866,7 +909,6 @@ bool convertLegacyLinkLayerStatsToHidl(
     if (!hidl_stats) {
         return false;
     }
-    *hidl_stats = {};
     // iface legacy_stats conversion.
     hidl_stats->iface.beaconRx = legacy_stats.iface.beacon_rx;
     hidl_stats->iface.avgRssiMgmt = legacy_stats.iface.rssi_mgmt;
@@ -903,16 +945,13 @@ bool convertLegacyLinkLayerStatsToHidl(
     hidl_stats->iface.wmeVoPktStats.retries =
         legacy_stats.iface.ac[legacy_hal::WIFI_AC_VO].retries;
     // radio legacy_stats conversion.
-    std::vector<V1_3::StaLinkLayerRadioStats> hidl_radios_stats;
-    for (const auto& legacy_radio_stats : legacy_stats.radios) {
-        V1_3::StaLinkLayerRadioStats hidl_radio_stats;
-        if (!convertLegacyLinkLayerRadioStatsToHidl(legacy_radio_stats,
-                                                    &hidl_radio_stats)) {
+    resizeHidlVec(&hidl_stats->radios, legacy_stats.radios.size());
+    for (size_t i = 0; i < legacy_stats.radios.size(); i++) {
+        if (!convertLegacyLinkLayerRadioStatsToHidl(legacy_stats.radios[i],
+                                                    &hidl_stats->radios[i])) {
             return false;
         }
-        hidl_radios_stats.push_back(hidl_radio_stats);
     }
-    hidl_stats->radios = hidl_radios_stats;
     // Timestamp in the HAL wrapper here since it's not provided in the legacy
     // HAL API.
     hidl_stats->timeStampInMs = uptimeMillis();
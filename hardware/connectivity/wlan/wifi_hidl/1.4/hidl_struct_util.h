@@ -82,6 +82,10 @@ legacy_hal::wifi_band convertHidlWifiBandToLegacy(V1_0::WifiBand band);
 bool convertHidlGscanParamsToLegacy(
     const StaBackgroundScanParameters& hidl_scan_params,
     legacy_hal::wifi_scan_cmd_params* legacy_scan_params);
+// The scan result and link layer stats conversions overwrite their output in
+// place, reusing its buffers: pass the output of the previous call to only
+// reallocate what changed size. Scan results are matched with the previous
+// ones by BSSID, radio stats by radio index.
 // |has_ie_data| indicates whether or not the wifi_scan_result includes 802.11
 // Information Elements (IEs)
 bool convertLegacyGscanResultToHidl(
@@ -91,7 +95,7 @@ bool convertLegacyGscanResultToHidl(
 bool convertLegacyVectorOfCachedGscanResultsToHidl(
     const std::vector<legacy_hal::wifi_cached_scan_results>&
         legacy_cached_scan_results,
-    std::vector<StaScanData>* hidl_scan_datas);
+    hidl_vec<StaScanData>* hidl_scan_datas);
 bool convertLegacyLinkLayerStatsToHidl(
     const legacy_hal::LinkLayerStats& legacy_stats,
     V1_3::StaLinkLayerStats* hidl_stats);
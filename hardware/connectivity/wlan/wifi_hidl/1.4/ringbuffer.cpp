@@ -14,6 +14,10 @@
  * limitations under the License.
  */
 
+#include <string.h>
+
+#include <algorithm>
+
 #include <android-base/logging.h>
 
 #include "ringbuffer.h"
@@ -24,7 +28,8 @@ namespace wifi {
 namespace V1_4 {
 namespace implementation {
 
-Ringbuffer::Ringbuffer(size_t maxSize) : size_(0), maxSize_(maxSize) {}
+Ringbuffer::Ringbuffer(size_t maxSize)
+    : head_(0), size_(0), maxSize_(maxSize) {}
 
 void Ringbuffer::append(const std::vector<uint8_t>& input) {
     if (input.size() == 0) {
@@ -35,16 +40,61 @@ void Ringbuffer::append(const std::vector<uint8_t>& input) {
                   << " bytes is dropped";
         return;
     }
-    data_.push_back(input);
-    size_ += input.size() * sizeof(input[0]);
-    while (size_ > maxSize_) {
-        size_ -= data_.front().size() * sizeof(data_.front()[0]);
-        data_.pop_front();
+    if (!buffer_) {
+        // Not value-initialized: pages are only touched as data arrives.
+        buffer_.reset(new uint8_t[maxSize_]);
+        head_ = 0;
+    }
+    while (size_ + input.size() > maxSize_) {
+        head_ = (head_ + record_sizes_.front()) % maxSize_;
+        size_ -= record_sizes_.front();
+        record_sizes_.pop_front();
+    }
+    size_t tail = (head_ + size_) % maxSize_;
+    size_t first = std::min(input.size(), maxSize_ - tail);
+    memcpy(buffer_.get() + tail, input.data(), first);
+    memcpy(buffer_.get(), input.data() + first, input.size() - first);
+    record_sizes_.push_back(input.size());
+    size_ += input.size();
+}
+
+bool Ringbuffer::empty() const { return size_ == 0; }
+
+size_t Ringbuffer::size() const { return size_; }
+
+size_t Ringbuffer::numRecords() const { return record_sizes_.size(); }
+
+int Ringbuffer::getSegments(struct iovec iov[2]) const {
+    if (size_ == 0) {
+        return 0;
+    }
+    size_t first = std::min(size_, maxSize_ - head_);
+    iov[0].iov_base = buffer_.get() + head_;
+    iov[0].iov_len = first;
+    if (first == size_) {
+        return 1;
+    }
+    iov[1].iov_base = buffer_.get();
+    iov[1].iov_len = size_ - first;
+    return 2;
+}
+
+void Ringbuffer::copyTo(std::vector<uint8_t>* out) const {
+    struct iovec iov[2];
+    int iovcnt = getSegments(iov);
+    out->clear();
+    out->reserve(size_);
+    for (int i = 0; i < iovcnt; i++) {
+        const uint8_t* base = static_cast<const uint8_t*>(iov[i].iov_base);
+        out->insert(out->end(), base, base + iov[i].iov_len);
     }
 }
 
-const std::list<std::vector<uint8_t>>& Ringbuffer::getData() const {
-    return data_;
+void Ringbuffer::clear() {
+    buffer_.reset();
+    record_sizes_.clear();
+    head_ = 0;
+    size_ = 0;
 }
 
 }  // namespace implementation
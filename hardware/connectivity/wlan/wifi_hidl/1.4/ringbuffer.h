@@ -17,7 +17,10 @@
 #ifndef RINGBUFFER_H_
 #define RINGBUFFER_H_
 
-#include <list>
+#include <sys/uio.h>
+
+#include <deque>
+#include <memory>
 #include <vector>
 
 namespace android {
@@ -28,6 +31,10 @@ namespace implementation {
 
 /**
  * Ringbuffer object used to store debug data.
+ *
+ * Records are stored back to back in one byte ring of |maxSize_| bytes,
+ * allocated on the first append, and whole records are evicted from the front
+ * to make room. The stored data is at most two contiguous segments.
  */
 class Ringbuffer {
    public:
@@ -36,10 +43,22 @@ class Ringbuffer {
     // Appends the data buffer and deletes from the front until buffer is
     // within |maxSize_|.
     void append(const std::vector<uint8_t>& input);
-    const std::list<std::vector<uint8_t>>& getData() const;
+    bool empty() const;
+    // Bytes stored, and number of records they hold.
+    size_t size() const;
+    size_t numRecords() const;
+    // Points |iov| at the stored data, oldest first, and returns the number
+    // of segments (0, 1 or 2).
+    int getSegments(struct iovec iov[2]) const;
+    // Copies the stored data, oldest first, into |out|. The buffer keeps it.
+    void copyTo(std::vector<uint8_t>* out) const;
+    // Drops the data, releasing the ring.
+    void clear();
 
    private:
-    std::list<std::vector<uint8_t>> data_;
+    std::unique_ptr<uint8_t[]> buffer_;
+    std::deque<size_t> record_sizes_;
+    size_t head_;
     size_t size_;
     size_t maxSize_;
 };
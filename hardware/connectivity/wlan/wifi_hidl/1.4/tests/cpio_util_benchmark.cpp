@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include <array>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <android-base/logging.h>
+#include <android-base/unique_fd.h>
+#include <benchmark/benchmark.h>
+
+#include "cpio_util.h"
+
+namespace {
+using android::base::unique_fd;
+using android::hardware::wifi::V1_4::implementation::cpio_util::
+    archiveFilesInDir;
+
+// Like /data/vendor/tombstones/wifi/ after a few flushes of full rings
+constexpr int kRingDumps = 8;
+constexpr size_t kRingDumpSize = 1024 * 1024 * 3;
+
+// The archiver as it was: a 32 KB buffer between read() and write(), and a
+// write() for each of header, name and padding.
+size_t legacyArchiveFilesInDir(int out_fd, const std::string& input_dir) {
+    std::unique_ptr<DIR, decltype(&closedir)> dir_dump(
+        opendir(input_dir.c_str()), closedir);
+    struct dirent* dp;
+    size_t n_error = 0;
+    const uint32_t zero = 0;
+    while ((dp = readdir(dir_dump.get()))) {
+        if (dp->d_type != DT_REG) {
+            continue;
+        }
+        std::string cur_file_name(dp->d_name);
+        const size_t file_name_len = cur_file_name.size() + 1;
+        const std::string cur_file_path = input_dir + "/" + cur_file_name;
+        struct stat st;
+        stat(cur_file_path.c_str(), &st);
+        unique_fd fd_read(open(cur_file_path.c_str(), O_RDONLY));
+        std::array<char, 32 * 1024> read_buf;
+        ssize_t llen = sprintf(
+            read_buf.data(),
+            "070701%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X",
+            static_cast<int>(st.st_ino), st.st_mode, st.st_uid, st.st_gid,
+            static_cast<int>(st.st_nlink), static_cast<int>(st.st_mtime),
+            static_cast<int>(st.st_size), major(st.st_dev), minor(st.st_dev),
+            major(st.st_rdev), minor(st.st_rdev),
+            static_cast<uint32_t>(file_name_len), 0);
+        n_error += write(out_fd, read_buf.data(), llen) == -1;
+        n_error += write(out_fd, cur_file_name.c_str(), file_name_len) == -1;
+        llen = (llen + file_name_len) % 4;
+        if (llen != 0) {
+            n_error += write(out_fd, &zero, 4 - llen) == -1;
+        }
+        llen = st.st_size;
+        while (llen > 0) {
+            ssize_t bytes_read =
+                read(fd_read.get(), read_buf.data(), read_buf.size());
+            if (bytes_read <= 0) {
+                return ++n_error;
+            }
+            llen -= bytes_read;
+            n_error += write(out_fd, read_buf.data(), bytes_read) == -1;
+        }
+        llen = st.st_size % 4;
+        if (llen != 0) {
+            n_error += write(out_fd, &zero, 4 - llen) == -1;
+        }
+    }
+    std::array<char, 4096> read_buf;
+    read_buf.fill(0);
+    n_error += write(out_fd, read_buf.data(),
+                     sprintf(read_buf.data(), "070701%040X%056X%08XTRAILER!!!",
+                             1, 0x0b, 0) + 4) == -1;
+    return n_error;
+}
+
+// mkstemp()/mkdtemp() template in $TMPDIR, /data/local/tmp on a device
+std::string tempTemplate(const char* name) {
+    const char* tmpdir = getenv("TMPDIR");
+    return std::string(tmpdir ? tmpdir : "/tmp") + "/" + name + "XXXXXX";
+}
+
+// Fills a temporary directory with ring dumps of driver log lines.
+const std::string& ringDumpDir() {
+    static const std::string dir = []() {
+        std::string path = tempTemplate("cpio_util_benchmark");
+        CHECK(mkdtemp(&path[0]) != nullptr);
+        std::string line;
+        for (int i = 0; i < kRingDumps; i++) {
+            std::string file = path + "/wifi_fw_log" +
+                               std::to_string(i) + "XXXXXXXXXX";
+            unique_fd fd(mkstemp(&file[0]));
+            size_t written = 0;
+            for (uint32_t seq = 0; written < kRingDumpSize; seq++) {
+                line = "[" + std::to_string(seq * 1237 % 100000) +
+                       "] wlan: RX seq " + std::to_string(seq) + " rssi -" +
+                       std::to_string(40 + seq % 37) + " rate " +
+                       std::to_string(seq * 31 % 866) + "\n";
+                CHECK_EQ(write(fd.get(), line.data(), line.size()),
+                         static_cast<ssize_t>(line.size()));
+                written += line.size();
+            }
+        }
+        return path;
+    }();
+    return dir;
+}
+
+// Archives into a pipe drained by another thread, as dumpstate reads the
+// debug fd.
+template <typename Archiver>
+void archiveToPipe(benchmark::State& state, Archiver archiver) {
+    const std::string& dir = ringDumpDir();
+    size_t out_bytes = 0;
+    for (auto _ : state) {
+        int fds[2];
+        CHECK_EQ(pipe(fds), 0);
+        std::thread reader([&out_bytes, fd = fds[0]]() {
+            std::array<char, 64 * 1024> buf;
+            ssize_t ret;
+            while ((ret = read(fd, buf.data(), buf.size())) > 0) {
+                out_bytes += ret;
+            }
+        });
+        CHECK_EQ(archiver(fds[1], dir), 0u);
+        close(fds[1]);
+        reader.join();
+        close(fds[0]);
+    }
+    state.SetBytesProcessed(state.iterations() * kRingDumps * kRingDumpSize);
+    state.counters["out_bytes"] = out_bytes / state.iterations();
+}
+
+// Archives into a regular file.
+template <typename Archiver>
+void archiveToFile(benchmark::State& state, Archiver archiver) {
+    const std::string& dir = ringDumpDir();
+    std::string path = tempTemplate("cpio_util_benchmark_out");
+    unique_fd fd(mkstemp(&path[0]));
+    unlink(path.c_str());
+    for (auto _ : state) {
+        CHECK_EQ(ftruncate(fd.get(), 0), 0);
+        CHECK_EQ(lseek(fd.get(), 0, SEEK_SET), 0);
+        CHECK_EQ(archiver(fd.get(), dir), 0u);
+    }
+    state.SetBytesProcessed(state.iterations() * kRingDumps * kRingDumpSize);
+}
+
+size_t archive(int out_fd, const std::string& dir) {
+    return archiveFilesInDir(out_fd, dir.c_str());
+}
+
+size_t archiveGzip(int out_fd, const std::string& dir) {
+    return archiveFilesInDir(out_fd, dir.c_str(), true);
+}
+
+void BM_ArchiveToPipe(benchmark::State& state) {
+    archiveToPipe(state, archive);
+}
+void BM_ArchiveGzipToPipe(benchmark::State& state) {
+    archiveToPipe(state, archiveGzip);
+}
+void BM_LegacyArchiveToPipe(benchmark::State& state) {
+    archiveToPipe(state, legacyArchiveFilesInDir);
+}
+void BM_ArchiveToFile(benchmark::State& state) {
+    archiveToFile(state, archive);
+}
+void BM_LegacyArchiveToFile(benchmark::State& state) {
+    archiveToFile(state, legacyArchiveFilesInDir);
+}
+
+}  // namespace
+
+BENCHMARK(BM_ArchiveToPipe)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_ArchiveGzipToPipe)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_LegacyArchiveToPipe)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_ArchiveToFile)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_LegacyArchiveToFile)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
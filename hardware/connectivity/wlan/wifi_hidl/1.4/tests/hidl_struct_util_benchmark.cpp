@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <new>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "hidl_struct_util.h"
+
+using namespace android::hardware::wifi::V1_4::implementation;
+
+namespace {
+
+std::atomic<size_t> num_allocations{0};
+
+}  // namespace
+
+// Counts the allocations made by the conversions.
+void* operator new(size_t size) {
+    num_allocations++;
+    void* ptr = malloc(size);
+    if (!ptr) {
+        abort();
+    }
+    return ptr;
+}
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+
+namespace {
+
+// 200 APs, over the 8 cached scans of a background scan
+constexpr int kCachedScans = 8;
+constexpr int kApsPerScan = 25;
+// A dual band chip reporting per channel stats
+constexpr int kRadios = 2;
+constexpr int kChannels = 40;
+constexpr int kTxLevels = 8;
+
+std::vector<legacy_hal::wifi_cached_scan_results> makeScanResults() {
+    std::vector<legacy_hal::wifi_cached_scan_results> scans(kCachedScans);
+    for (int scan = 0; scan < kCachedScans; scan++) {
+        scans[scan] = {};
+        scans[scan].scan_id = scan;
+        scans[scan].buckets_scanned = 1;
+        scans[scan].num_results = kApsPerScan;
+        for (int ap = 0; ap < kApsPerScan; ap++) {
+            legacy_hal::wifi_scan_result& result = scans[scan].results[ap];
+            std::string ssid = "AndroidAP_" + std::to_string(scan * 100 + ap);
+            strncpy(result.ssid, ssid.c_str(), sizeof(result.ssid) - 1);
+            result.bssid[0] = 0x02;
+            result.bssid[4] = scan;
+            result.bssid[5] = ap;
+            result.channel = ap % 2 ? 5180 + 20 * (ap % 8) : 2412 + 5 * (ap % 11);
+            result.rssi = -40 - ap;
+            result.beacon_period = 100;
+        }
+    }
+    return scans;
+}
+
+// Another poll of the same APs: new timestamps and RSSIs, and two APs of each
+// scan reported in swapped order.
+void rescan(std::vector<legacy_hal::wifi_cached_scan_results>* scans,
+            int64_t poll) {
+    for (auto& scan : *scans) {
+        for (int ap = 0; ap < scan.num_results; ap++) {
+            scan.results[ap].ts = poll * 1000000 + ap;
+            scan.results[ap].rssi = -40 - (ap + poll) % 50;
+        }
+        std::swap(scan.results[poll % kApsPerScan],
+                  scan.results[(poll + 1) % kApsPerScan]);
+    }
+}
+
+legacy_hal::LinkLayerStats makeLinkLayerStats() {
+    legacy_hal::LinkLayerStats stats{};
+    stats.radios.resize(kRadios);
+    for (int radio = 0; radio < kRadios; radio++) {
+        stats.radios[radio].stats.radio = radio;
+        stats.radios[radio].tx_time_per_levels.assign(kTxLevels, 0);
+        stats.radios[radio].channel_stats.resize(kChannels);
+        for (int ch = 0; ch < kChannels; ch++) {
+            stats.radios[radio].channel_stats[ch].channel.center_freq =
+                radio ? 5180 + 20 * ch : 2412 + 5 * (ch % 13);
+        }
+    }
+    return stats;
+}
+
+void poll(legacy_hal::LinkLayerStats* stats, int64_t poll) {
+    stats->iface.beacon_rx = poll;
+    for (auto& radio : stats->radios) {
+        radio.stats.on_time = poll;
+        for (auto& level : radio.tx_time_per_levels) level = poll;
+        for (auto& channel : radio.channel_stats) channel.on_time = poll;
+    }
+}
+
+template <typename Legacy, typename Hidl, typename Update, typename Convert>
+void runConversion(benchmark::State& state, Legacy legacy, Update update,
+                   Convert convert, bool reuse) {
+    Hidl hidl{};
+    int64_t polls = 0;
+    size_t allocations = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        update(&legacy, polls++);
+        if (!reuse) {
+            hidl = {};
+        }
+        size_t before = num_allocations;
+        state.ResumeTiming();
+        if (!convert(legacy, &hidl)) {
+            state.SkipWithError("conversion failed");
+            break;
+        }
+        allocations += num_allocations - before;
+    }
+    state.counters["allocs_per_call"] =
+        static_cast<double>(allocations) / state.iterations();
+}
+
+void BM_ConvertCachedScanResults(benchmark::State& state) {
+    runConversion<std::vector<legacy_hal::wifi_cached_scan_results>,
+                  android::hardware::hidl_vec<StaScanData>>(
+        state, makeScanResults(), rescan,
+        hidl_struct_util::convertLegacyVectorOfCachedGscanResultsToHidl,
+        state.range(0));
+}
+
+void BM_ConvertLinkLayerStats(benchmark::State& state) {
+    runConversion<legacy_hal::LinkLayerStats, V1_3::StaLinkLayerStats>(
+        state, makeLinkLayerStats(), poll,
+        hidl_struct_util::convertLegacyLinkLayerStatsToHidl, state.range(0));
+}
+
+}  // namespace
+
+// Arg 0: into an empty struct on every call, as before. Arg 1: into the
+// previous call's struct, as WifiStaIface does now.
+BENCHMARK(BM_ConvertCachedScanResults)->Arg(0)->Arg(1);
+BENCHMARK(BM_ConvertLinkLayerStats)->Arg(0)->Arg(1);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "ringbuffer.h"
+
+namespace android {
+namespace hardware {
+namespace wifi {
+namespace V1_4 {
+namespace implementation {
+
+namespace {
+
+// Record of |size| bytes, all holding |seq|
+std::vector<uint8_t> record(size_t size, uint8_t seq) {
+    return std::vector<uint8_t>(size, seq);
+}
+
+// The stored data, oldest first
+std::vector<uint8_t> contents(const Ringbuffer& buffer) {
+    struct iovec iov[2];
+    int iovcnt = buffer.getSegments(iov);
+    std::vector<uint8_t> data;
+    for (int i = 0; i < iovcnt; i++) {
+        const uint8_t* base = static_cast<const uint8_t*>(iov[i].iov_base);
+        data.insert(data.end(), base, base + iov[i].iov_len);
+    }
+    return data;
+}
+
+int createTempFile() {
+    char path[] = "/tmp/ringbuffer_unit_testsXXXXXX";
+    int fd = mkstemp(path);
+    unlink(path);
+    return fd;
+}
+
+}  // namespace
+
+class RingbufferTest : public ::testing::Test {
+   public:
+    const uint32_t maxBufferSize_ = 10;
+    Ringbuffer buffer_{maxBufferSize_};
+};
+
+TEST_F(RingbufferTest, CreateEmptyBuffer) {
+    ASSERT_TRUE(buffer_.empty());
+    struct iovec iov[2];
+    EXPECT_EQ(0, buffer_.getSegments(iov));
+}
+
+TEST_F(RingbufferTest, CanUseFullBufferCapacity) {
+    const std::vector<uint8_t> first(maxBufferSize_ / 2, '\0');
+    const std::vector<uint8_t> second(maxBufferSize_ / 2, '\1');
+    buffer_.append(first);
+    buffer_.append(second);
+    ASSERT_EQ(2u, buffer_.numRecords());
+    EXPECT_EQ(maxBufferSize_, buffer_.size());
+    std::vector<uint8_t> expected(first);
+    expected.insert(expected.end(), second.begin(), second.end());
+    EXPECT_EQ(expected, contents(buffer_));
+}
+
+TEST_F(RingbufferTest, OldDataIsRemovedOnOverflow) {
+    const std::vector<uint8_t> first(maxBufferSize_ / 2, '\0');
+    const std::vector<uint8_t> second(maxBufferSize_ / 2, '\1');
+    const std::vector<uint8_t> third = {'\2'};
+    buffer_.append(first);
+    buffer_.append(second);
+    buffer_.append(third);
+    ASSERT_EQ(2u, buffer_.numRecords());
+    std::vector<uint8_t> expected(second);
+    expected.insert(expected.end(), third.begin(), third.end());
+    EXPECT_EQ(expected, contents(buffer_));
+}
+
+TEST_F(RingbufferTest, MultipleOldDataIsRemovedOnOverflow) {
+    const std::vector<uint8_t> first(maxBufferSize_ / 2, '\0');
+    const std::vector<uint8_t> second(maxBufferSize_ / 2, '\1');
+    const std::vector<uint8_t> third(maxBufferSize_, '\2');
+    buffer_.append(first);
+    buffer_.append(second);
+    buffer_.append(third);
+    ASSERT_EQ(1u, buffer_.numRecords());
+    EXPECT_EQ(third, contents(buffer_));
+}
+
+TEST_F(RingbufferTest, AppendWrapsAroundTheEnd) {
+    buffer_.append(record(4, 1));
+    buffer_.append(record(4, 2));
+    buffer_.append(record(4, 3));  // evicts 1, 2 bytes at the end and 2 wrapped
+    struct iovec iov[2];
+    ASSERT_EQ(2, buffer_.getSegments(iov));
+    EXPECT_EQ(6u, iov[0].iov_len);
+    EXPECT_EQ(2u, iov[1].iov_len);
+    std::vector<uint8_t> expected = record(4, 2);
+    std::vector<uint8_t> third = record(4, 3);
+    expected.insert(expected.end(), third.begin(), third.end());
+    EXPECT_EQ(expected, contents(buffer_));
+}
+
+TEST_F(RingbufferTest, OversizedAppendIsDropped) {
+    const std::vector<uint8_t> first = {1};
+    const std::vector<uint8_t> second(maxBufferSize_ + 1, '\0');
+    buffer_.append(first);
+    buffer_.append(second);
+    ASSERT_EQ(1u, buffer_.numRecords());
+    EXPECT_EQ(first, contents(buffer_));
+}
+
+TEST_F(RingbufferTest, CopyToLeavesBufferIntact) {
+    buffer_.append(record(4, 1));
+    buffer_.append(record(4, 2));
+    buffer_.append(record(4, 3));  // wrapped
+    std::vector<uint8_t> copy = record(2, 9);
+    buffer_.copyTo(&copy);
+    EXPECT_EQ(contents(buffer_), copy);
+    EXPECT_EQ(2u, buffer_.numRecords());
+
+    buffer_.append(record(2, 4));
+    std::vector<uint8_t> expected = copy;
+    std::vector<uint8_t> fourth = record(2, 4);
+    expected.insert(expected.end(), fourth.begin(), fourth.end());
+    EXPECT_EQ(expected, contents(buffer_));
+}
+
+// Appends as the ring buffer data callback does, under the lock WifiChip holds
+// it with, while another thread keeps copying the buffer out and writing the
+// copy to a file the way WifiChip::writeRingbufferFilesInternal() does. The
+// callback must not wait for the file writes.
+TEST(RingbufferStressTest, AppendLatencyDuringFlush) {
+    constexpr size_t kMaxSize = 1024 * 1024 * 3;
+    constexpr size_t kRecordSize = 1024;
+    // 2 MB at a few MB/s, as the driver hands out verbose logs
+    constexpr size_t kRecords = 2048;
+    constexpr auto kMaxCallbackLatency = std::chrono::milliseconds(50);
+    std::mutex lock;
+    Ringbuffer buffer(kMaxSize);
+    std::atomic<bool> done(false);
+    int fd = createTempFile();
+    ASSERT_NE(-1, fd);
+
+    size_t flushes = 0;
+    std::thread flusher([&]() {
+        std::vector<uint8_t> snapshot;
+        while (!done) {
+            {
+                std::unique_lock<std::mutex> lk(lock);
+                buffer.copyTo(&snapshot);
+            }
+            ASSERT_EQ(0, ftruncate(fd, 0));
+            ASSERT_EQ(static_cast<ssize_t>(snapshot.size()),
+                      pwrite(fd, snapshot.data(), snapshot.size(), 0));
+            fsync(fd);
+            flushes++;
+        }
+    });
+
+    std::chrono::steady_clock::duration max_latency{0};
+    for (size_t i = 0; i < kRecords; i++) {
+        std::vector<uint8_t> data = record(kRecordSize, i);
+        auto start = std::chrono::steady_clock::now();
+        {
+            std::unique_lock<std::mutex> lk(lock);
+            buffer.append(data);
+        }
+        max_latency =
+            std::max(max_latency, std::chrono::steady_clock::now() - start);
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    done = true;
+    flusher.join();
+
+    // The flushes left the buffer whole: every record is still there, intact
+    // and in order, as less than kMaxSize was logged.
+    std::vector<uint8_t> data = contents(buffer);
+    close(fd);
+    ASSERT_EQ(kRecords * kRecordSize, data.size());
+    for (size_t i = 0; i < kRecords; i++) {
+        ASSERT_EQ(record(kRecordSize, i), std::vector<uint8_t>(
+            data.begin() + i * kRecordSize,
+            data.begin() + (i + 1) * kRecordSize));
+    }
+    EXPECT_GT(flushes, 0u);
+    EXPECT_LT(max_latency, kMaxCallbackLatency);
+}
+
+}  // namespace implementation
+}  // namespace V1_4
+}  // namespace wifi
+}  // namespace hardware
+}  // namespace android
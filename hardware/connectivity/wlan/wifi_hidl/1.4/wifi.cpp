@@ -82,12 +82,12 @@ Return<void> Wifi::getChip(ChipId chip_id, getChip_cb hidl_status_cb) {
 }
 
 Return<void> Wifi::debug(const hidl_handle& handle,
-                         const hidl_vec<hidl_string>&) {
+                         const hidl_vec<hidl_string>& options) {
     LOG(INFO) << "-----------Debug is called----------------";
     if (!chip_.get()) {
         return Void();
     }
-    return chip_->debug(handle, {});
+    return chip_->debug(handle, options);
 }
 
 WifiStatus Wifi::registerEventCallbackInternal(
@@ -398,11 +398,13 @@ WifiStatus WifiStaIface::startBackgroundScanInternal(
                 LOG(ERROR) << "Callback invoked on an invalid object";
                 return;
             }
-            std::vector<StaScanData> hidl_scan_datas;
+            hidl_vec<StaScanData>& hidl_scan_datas =
+                shared_ptr_this->cached_scan_datas_;
             if (!hidl_struct_util::
                     convertLegacyVectorOfCachedGscanResultsToHidl(
                         results, &hidl_scan_datas)) {
                 LOG(ERROR) << "Failed to convert scan results to HIDL structs";
+                hidl_scan_datas = {};
                 return;
             }
             for (const auto& callback : shared_ptr_this->getEventCallbacks()) {
@@ -468,21 +470,27 @@ WifiStaIface::getLinkLayerStatsInternal() {
     return {createWifiStatus(WifiStatusCode::ERROR_NOT_SUPPORTED), {}};
 }
 
-std::pair<WifiStatus, V1_3::StaLinkLayerStats>
+// Returns |link_layer_stats_|, which the framework polls often: converting
+// into it again reallocates only what changed size, and the HIDL callback
+// reads it without a copy.
+std::pair<WifiStatus, const V1_3::StaLinkLayerStats&>
 WifiStaIface::getLinkLayerStatsInternal_1_3() {
     legacy_hal::wifi_error legacy_status;
     legacy_hal::LinkLayerStats legacy_stats;
     std::tie(legacy_status, legacy_stats) =
         legacy_hal_.lock()->getLinkLayerStats(ifname_);
     if (legacy_status != legacy_hal::WIFI_SUCCESS) {
-        return {createWifiStatusFromLegacyError(legacy_status), {}};
+        link_layer_stats_ = {};
+        return {createWifiStatusFromLegacyError(legacy_status),
+                link_layer_stats_};
     }
-    V1_3::StaLinkLayerStats hidl_stats;
-    if (!hidl_struct_util::convertLegacyLinkLayerStatsToHidl(legacy_stats,
-                                                             &hidl_stats)) {
-        return {createWifiStatus(WifiStatusCode::ERROR_UNKNOWN), {}};
+    if (!hidl_struct_util::convertLegacyLinkLayerStatsToHidl(
+            legacy_stats, &link_layer_stats_)) {
+        link_layer_stats_ = {};
+        return {createWifiStatus(WifiStatusCode::ERROR_UNKNOWN),
+                link_layer_stats_};
     }
-    return {createWifiStatus(WifiStatusCode::SUCCESS), hidl_stats};
+    return {createWifiStatus(WifiStatusCode::SUCCESS), link_layer_stats_};
 }
 
 WifiStatus WifiStaIface::startRssiMonitoringInternal(uint32_t cmd_id,
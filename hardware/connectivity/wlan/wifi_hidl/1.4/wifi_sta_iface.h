@@ -136,7 +136,7 @@ class WifiStaIface : public V1_3::IWifiStaIface {
     WifiStatus enableLinkLayerStatsCollectionInternal(bool debug);
     WifiStatus disableLinkLayerStatsCollectionInternal();
     std::pair<WifiStatus, V1_0::StaLinkLayerStats> getLinkLayerStatsInternal();
-    std::pair<WifiStatus, V1_3::StaLinkLayerStats>
+    std::pair<WifiStatus, const V1_3::StaLinkLayerStats&>
     getLinkLayerStatsInternal_1_3();
     WifiStatus startRssiMonitoringInternal(uint32_t cmd_id, int32_t max_rssi,
                                            int32_t min_rssi);
@@ -167,6 +167,9 @@ class WifiStaIface : public V1_3::IWifiStaIface {
     bool is_valid_;
     hidl_callback_util::HidlCallbackHandler<IWifiStaIfaceEventCallback>
         event_cb_handler_;
+    // Last results handed out, converted into again by the next request.
+    V1_3::StaLinkLayerStats link_layer_stats_;
+    hidl_vec<StaScanData> cached_scan_datas_;
 
     DISALLOW_COPY_AND_ASSIGN(WifiStaIface);
 };
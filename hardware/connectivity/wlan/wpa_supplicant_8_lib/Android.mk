@@ -26,6 +26,7 @@ WPA_SUPPL_DIR_INCLUDE = $(WPA_SUPPL_DIR)/src \
 ifdef CONFIG_DRIVER_NL80211
 WPA_SUPPL_DIR_INCLUDE += external/libnl/include
 WPA_SRC_FILE += mediatek_driver_cmd_nl80211.c
+WPA_SRC_FILE += mediatek_nl80211_batch.c
 endif
 
 ifdef CONFIG_DRIVER_WEXT
@@ -98,6 +99,7 @@ WPA_SUPPL_DIR_INCLUDE = $(WPA_SUPPL_DIR)/src \
 ifdef CONFIG_DRIVER_NL80211
 WPA_SUPPL_DIR_INCLUDE += external/libnl/include
 WPA_SRC_FILE += mediatek_driver_cmd_nl80211.c
+WPA_SRC_FILE += mediatek_nl80211_batch.c
 endif
 
 ifeq ($(MTK_WAPI_SUPPORT), yes)
@@ -136,4 +138,20 @@ include $(BUILD_STATIC_LIBRARY)
 
 ########################
 
+ifdef CONFIG_DRIVER_NL80211
+include $(CLEAR_VARS)
+LOCAL_MODULE := lib_driver_cmd_mt66xx_tests
+LOCAL_PROPRIETARY_MODULE := true
+LOCAL_MODULE_OWNER := mtk
+LOCAL_SHARED_LIBRARIES := libnl
+LOCAL_CFLAGS := $(L_CFLAGS) -DCONFIG_NO_STDOUT_DEBUG
+LOCAL_SRC_FILES := \
+	mediatek_nl80211_batch.c \
+	tests/mediatek_nl80211_batch_test.cpp
+LOCAL_C_INCLUDES := $(WPA_SUPPL_DIR_INCLUDE)
+include $(BUILD_NATIVE_TEST)
+endif
+
+########################
+
 endif
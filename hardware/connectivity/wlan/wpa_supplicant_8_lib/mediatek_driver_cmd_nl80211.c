@@ -27,6 +27,7 @@
 #endif
 
 #include "mediatek_driver_nl80211.h"
+#include "mediatek_nl80211_batch.h"
 #include "driver_i.h"
 
 #include "p2p/p2p_i.h"
@@ -42,6 +43,22 @@ typedef struct android_wifi_priv_cmd {
 
 static int drv_errors = 0;
 
+/* Longest wait for the driver to answer a command of a batch */
+#define TESTMODE_BATCH_TIMEOUT_MS 5000
+
+/*
+ * Testmode commands of DRIVER BATCH queued to go out together, for the driver
+ * of testmode_batch_drv. They are sent on a netlink socket of their own: the
+ * ACKs of commands that timed out may still come, and on drv->global->nl
+ * send_and_recv_msgs() would take them for its own, as it runs without
+ * sequence checks. All of it is set up by mtk_testmode_batch_begin() and
+ * released by mtk_testmode_batch_end(), so nothing outlives the command.
+ */
+static struct mtk_nl80211_batch *testmode_batch;
+static struct nl_sock *testmode_batch_sock;
+static struct wpa_driver_nl80211_data *testmode_batch_drv;
+static int testmode_batch_failed;
+
 static void wpa_driver_send_hang_msg(struct wpa_driver_nl80211_data *drv)
 {
     drv_errors++;
@@ -314,13 +331,120 @@ static int testmode_available_channel_handler(struct nl_msg *msg, void *arg)
 }
 #endif
 
+/*
+ * Sends the testmode commands queued so far in one netlink transaction. The
+ * batch stays open for more.
+ */
+static int mtk_testmode_batch_flush(void)
+{
+    size_t count;
+    int ret;
+
+    if (!testmode_batch)
+        return 0;
+    count = mtk_nl80211_batch_count(testmode_batch);
+    if (count == 0)
+        return 0;
+
+    ret = mtk_nl80211_batch_commit(testmode_batch,
+                                   nl_socket_get_fd(testmode_batch_sock),
+                                   TESTMODE_BATCH_TIMEOUT_MS);
+    wpa_printf(MSG_DEBUG, "nl80211 test mode: sent %zu batched commands, ret=%d",
+               count, ret);
+    if (ret < 0) {
+        testmode_batch_failed = 1;
+        wpa_driver_send_hang_msg(testmode_batch_drv);
+    } else {
+        drv_errors = 0;
+    }
+    return ret;
+}
+
+/*
+ * Queues testmode commands of |drv| until mtk_testmode_batch_end(), instead
+ * of sending each on its own and waiting for its ACK.
+ */
+static int mtk_testmode_batch_begin(struct wpa_driver_nl80211_data *drv)
+{
+    if (testmode_batch) {
+        wpa_printf(MSG_ERROR, "nl80211 test mode: batch already open");
+        return -1;
+    }
+    testmode_batch_sock = nl_socket_alloc();
+    if (!testmode_batch_sock)
+        return -1;
+    if (nl_connect(testmode_batch_sock, NETLINK_GENERIC) < 0) {
+        nl_socket_free(testmode_batch_sock);
+        testmode_batch_sock = NULL;
+        return -1;
+    }
+    testmode_batch = mtk_nl80211_batch_alloc();
+    if (!testmode_batch) {
+        nl_socket_free(testmode_batch_sock);
+        testmode_batch_sock = NULL;
+        return -1;
+    }
+    testmode_batch_drv = drv;
+    testmode_batch_failed = 0;
+    return 0;
+}
+
+/* Returns -1 if any command of the batch failed */
+static int mtk_testmode_batch_end(void)
+{
+    int ret;
+
+    if (!testmode_batch)
+        return 0;
+    mtk_testmode_batch_flush();
+    ret = testmode_batch_failed ? -1 : 0;
+    mtk_nl80211_batch_free(testmode_batch);
+    testmode_batch = NULL;
+    /* Late replies of commands that timed out go with the socket */
+    nl_socket_free(testmode_batch_sock);
+    testmode_batch_sock = NULL;
+    testmode_batch_drv = NULL;
+    return ret;
+}
+
+/*
+ * Queues |msg| on the open batch. A command with a reply handler has its
+ * caller waiting for the reply, so it goes out right away with everything
+ * queued before it; others report their result on flush.
+ */
+static int mtk_testmode_batch_queue(struct nl_msg *msg,
+                                    int (*handler)(struct nl_msg *, void *),
+                                    void *arg)
+{
+    int result = 0;
+
+    if (mtk_nl80211_batch_count(testmode_batch) == MTK_NL80211_BATCH_MAX_CMDS)
+        mtk_testmode_batch_flush();
+
+    /* Sequence number and ACK flag from the socket of the batch */
+    nl_complete_msg(testmode_batch_sock, msg);
+    if (mtk_nl80211_batch_add(testmode_batch, msg, handler, arg,
+                              handler ? &result : NULL) < 0) {
+        nlmsg_free(msg);
+        return -ENOBUFS;
+    }
+
+    if (handler) {
+        mtk_testmode_batch_flush();
+        return result;
+    }
+    return 0;
+}
+
 static int wpa_driver_nl80211_testmode(void *priv, const u8 *data, size_t data_len)
 {
     struct i802_bss *bss = priv;
     struct wpa_driver_nl80211_data *drv = bss->drv;
     struct nl_msg *msg, *cqm = NULL;
     struct wpa_driver_testmode_params *params;
-    int index;
+    int (*handler)(struct nl_msg *, void *) = NULL;
+    void *handler_arg = NULL;
+    int index, ret;
 
     msg = nlmsg_alloc();
     if (!msg)
@@ -343,16 +467,22 @@ static int wpa_driver_nl80211_testmode(void *priv, const u8 *data, size_t data_l
         {
             struct wpa_driver_get_sta_statistics_params *sta_params =
                            (struct wpa_driver_get_sta_statistics_params *)data;
-            return send_and_recv_msgs(drv, msg, testmode_sta_statistics_handler, sta_params->buf);
+            handler = testmode_sta_statistics_handler;
+            handler_arg = sta_params->buf;
+            break;
         }
         default:
-        {
-            int ret = send_and_recv_msgs(drv, msg, NULL, NULL);
-            wpa_printf(MSG_EXCESSIVE, "ret=%d, nl=%p", ret, drv->global->nl);
-            return ret;
-        }
+            break;
     }
 
+    if (testmode_batch && testmode_batch_drv == drv)
+        return mtk_testmode_batch_queue(msg, handler, handler_arg);
+
+    ret = send_and_recv_msgs(drv, msg, handler, handler_arg);
+    if (!handler)
+        wpa_printf(MSG_EXCESSIVE, "ret=%d, nl=%p", ret, drv->global->nl);
+    return ret;
+
 nla_put_failure:
     nlmsg_free(msg);
     return -ENOBUFS;
@@ -1444,6 +1574,48 @@ static int mtk_get_shared_radio_freqs(struct wpa_supplicant *wpa_s,
 }
 #endif
 
+int wpa_driver_nl80211_driver_cmd(void *priv, char *cmd, char *buf,
+                  size_t buf_len );
+
+/*
+ * "BATCH <cmd>;<cmd>;..." runs the driver commands in order. The testmode
+ * commands of a run of rxfilter-* commands, which send nothing else, go to
+ * the driver together in as few netlink transactions as possible; the batch
+ * is closed before any other command, so nothing can overtake them. Returns
+ * -1 if any of the commands failed.
+ */
+static int wpa_driver_nl80211_driver_batch_cmd(void *priv, char *cmds,
+                  char *buf, size_t buf_len)
+{
+    struct i802_bss *bss = priv;
+    struct wpa_driver_nl80211_data *drv = bss->drv;
+    char *pos, *next;
+    int failed = 0;
+
+    for (pos = cmds; pos; pos = next) {
+        next = os_strchr(pos, ';');
+        if (next)
+            *next++ = '\0';
+        while (*pos == ' ')
+            pos++;
+        if (*pos == '\0')
+            continue;
+        if (os_strncasecmp(pos, "rxfilter-", 9) == 0) {
+            if (!testmode_batch && mtk_testmode_batch_begin(drv) < 0)
+                wpa_printf(MSG_ERROR, "BATCH: no batch, sending one by one");
+        } else if (mtk_testmode_batch_end() < 0) {
+            failed++;
+        }
+        if (wpa_driver_nl80211_driver_cmd(priv, pos, buf, buf_len) < 0)
+            failed++;
+    }
+
+    if (mtk_testmode_batch_end() < 0)
+        failed++;
+    wpa_printf(MSG_DEBUG, "BATCH: %d commands failed", failed);
+    return failed ? -1 : 0;
+}
+
 int wpa_driver_nl80211_driver_cmd(void *priv, char *cmd, char *buf,
                   size_t buf_len )
 {
@@ -1486,6 +1658,8 @@ int wpa_driver_nl80211_driver_cmd(void *priv, char *cmd, char *buf,
         int state;
         state = atoi(cmd + 10);
         wpa_printf(MSG_DEBUG, "POWERMODE=%d", state);
+    }  else if (os_strncasecmp(cmd, "BATCH ", 6) == 0) {
+        ret = wpa_driver_nl80211_driver_batch_cmd(priv, cmd + 6, buf, buf_len);
     }  else if (os_strncasecmp(cmd, "GET_STA_STATISTICS ", 19) == 0) {
         ret = wpa_driver_get_sta_statistics(wpa_s, cmd + 19, buf, buf_len);
     }  else if (os_strncmp(cmd, "MACADDR", os_strlen("MACADDR")) == 0) {
@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "includes.h"
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <linux/netlink.h>
+
+#include "common.h"
+#include "mediatek_nl80211_batch.h"
+
+struct mtk_nl80211_batch_cmd {
+    struct nl_msg *msg;
+    u32 seq;
+    mtk_nl80211_batch_handler handler;
+    void *arg;
+    int *result;
+    int done;
+    int err;
+};
+
+struct mtk_nl80211_batch {
+    struct mtk_nl80211_batch_cmd cmds[MTK_NL80211_BATCH_MAX_CMDS];
+    size_t num_cmds;
+    /* Receive buffer, grown to the largest reply seen */
+    u8 *rx_buf;
+    size_t rx_buf_len;
+};
+
+struct mtk_nl80211_batch *mtk_nl80211_batch_alloc(void)
+{
+    struct mtk_nl80211_batch *batch;
+
+    batch = os_malloc(sizeof(*batch));
+    if (batch)
+        os_memset(batch, 0, sizeof(*batch));
+    return batch;
+}
+
+static void mtk_nl80211_batch_clear(struct mtk_nl80211_batch *batch)
+{
+    size_t i;
+
+    for (i = 0; i < batch->num_cmds; i++)
+        nlmsg_free(batch->cmds[i].msg);
+    batch->num_cmds = 0;
+}
+
+void mtk_nl80211_batch_free(struct mtk_nl80211_batch *batch)
+{
+    if (!batch)
+        return;
+    mtk_nl80211_batch_clear(batch);
+    os_free(batch->rx_buf);
+    os_free(batch);
+}
+
+int mtk_nl80211_batch_add(struct mtk_nl80211_batch *batch, struct nl_msg *msg,
+                          mtk_nl80211_batch_handler handler, void *arg,
+                          int *result)
+{
+    struct mtk_nl80211_batch_cmd *cmd;
+
+    if (batch->num_cmds == MTK_NL80211_BATCH_MAX_CMDS)
+        return -1;
+
+    cmd = &batch->cmds[batch->num_cmds++];
+    os_memset(cmd, 0, sizeof(*cmd));
+    cmd->msg = msg;
+    cmd->seq = nlmsg_hdr(msg)->nlmsg_seq;
+    cmd->handler = handler;
+    cmd->arg = arg;
+    cmd->result = result;
+    return 0;
+}
+
+size_t mtk_nl80211_batch_count(const struct mtk_nl80211_batch *batch)
+{
+    return batch->num_cmds;
+}
+
+/* Records the outcome of |cmd|, keeping an earlier error */
+static void mtk_nl80211_batch_complete(struct mtk_nl80211_batch_cmd *cmd,
+                                       int err)
+{
+    if (!cmd->err)
+        cmd->err = err;
+    cmd->done = 1;
+}
+
+/* Returns 1 if |hdr| completed a command */
+static int mtk_nl80211_batch_dispatch(struct mtk_nl80211_batch *batch,
+                                      struct nlmsghdr *hdr)
+{
+    struct mtk_nl80211_batch_cmd *cmd = NULL;
+    struct nl_msg *msg;
+    size_t i;
+
+    for (i = 0; i < batch->num_cmds; i++) {
+        if (!batch->cmds[i].done && batch->cmds[i].seq == hdr->nlmsg_seq) {
+            cmd = &batch->cmds[i];
+            break;
+        }
+    }
+    if (!cmd) {
+        /* Left over from an earlier, abandoned request */
+        wpa_printf(MSG_DEBUG, "nl80211 batch: ignore message type=%u seq=%u",
+                   hdr->nlmsg_type, hdr->nlmsg_seq);
+        return 0;
+    }
+
+    switch (hdr->nlmsg_type) {
+    case NLMSG_ERROR:
+    {
+        struct nlmsgerr *e = NLMSG_DATA(hdr);
+
+        if (hdr->nlmsg_len < NLMSG_LENGTH(sizeof(*e)))
+            mtk_nl80211_batch_complete(cmd, -EPROTO);
+        else
+            mtk_nl80211_batch_complete(cmd, e->error);
+        return 1;
+    }
+    case NLMSG_DONE:
+        mtk_nl80211_batch_complete(cmd, 0);
+        return 1;
+    case NLMSG_NOOP:
+    case NLMSG_OVERRUN:
+        return 0;
+    default:
+        if (!cmd->handler)
+            return 0;
+        msg = nlmsg_convert(hdr);
+        if (!msg) {
+            /* Still wait for the ACK, the reply is lost either way */
+            if (!cmd->err)
+                cmd->err = -ENOMEM;
+            return 0;
+        }
+        cmd->handler(msg, cmd->arg);
+        nlmsg_free(msg);
+        return 0;
+    }
+}
+
+/* Reads one datagram of replies, growing the receive buffer to fit it */
+static ssize_t mtk_nl80211_batch_recv(struct mtk_nl80211_batch *batch, int sock)
+{
+    ssize_t len;
+    u8 *buf;
+
+    len = recv(sock, NULL, 0, MSG_PEEK | MSG_TRUNC | MSG_DONTWAIT);
+    if (len < 0)
+        return -errno;
+    if ((size_t) len > batch->rx_buf_len) {
+        buf = os_realloc(batch->rx_buf, len);
+        if (!buf)
+            return -ENOMEM;
+        batch->rx_buf = buf;
+        batch->rx_buf_len = len;
+    }
+    len = recv(sock, batch->rx_buf, batch->rx_buf_len, MSG_DONTWAIT);
+    return len < 0 ? -errno : len;
+}
+
+static int mtk_nl80211_batch_send(struct mtk_nl80211_batch *batch, int sock)
+{
+    static const u8 pad[NLMSG_ALIGNTO] = {};
+    struct iovec iov[MTK_NL80211_BATCH_MAX_CMDS * 2];
+    struct msghdr mh;
+    size_t i, iovcnt = 0;
+    ssize_t res;
+
+    for (i = 0; i < batch->num_cmds; i++) {
+        struct nlmsghdr *hdr = nlmsg_hdr(batch->cmds[i].msg);
+
+        iov[iovcnt].iov_base = hdr;
+        iov[iovcnt].iov_len = hdr->nlmsg_len;
+        iovcnt++;
+        /* The kernel steps from one message to the next aligned one */
+        if (NLMSG_ALIGN(hdr->nlmsg_len) != hdr->nlmsg_len) {
+            iov[iovcnt].iov_base = (void *) pad;
+            iov[iovcnt].iov_len = NLMSG_ALIGN(hdr->nlmsg_len) - hdr->nlmsg_len;
+            iovcnt++;
+        }
+    }
+
+    os_memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = iov;
+    mh.msg_iovlen = iovcnt;
+    do {
+        res = sendmsg(sock, &mh, 0);
+    } while (res < 0 && errno == EINTR);
+    return res < 0 ? -errno : 0;
+}
+
+int mtk_nl80211_batch_commit(struct mtk_nl80211_batch *batch, int sock,
+                             int timeout_ms)
+{
+    size_t i, pending = batch->num_cmds;
+    int err, ret = 0;
+
+    if (pending == 0)
+        return 0;
+
+    err = mtk_nl80211_batch_send(batch, sock);
+    if (err < 0)
+        wpa_printf(MSG_ERROR, "nl80211 batch: send of %zu commands failed: %s",
+                   pending, strerror(-err));
+
+    while (!err && pending > 0) {
+        struct pollfd pfd;
+        struct nlmsghdr *hdr;
+        ssize_t len;
+        int res;
+
+        pfd.fd = sock;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        res = poll(&pfd, 1, timeout_ms);
+        if (res < 0 && errno == EINTR)
+            continue;
+        if (res <= 0) {
+            err = res == 0 ? -ETIMEDOUT : -errno;
+            break;
+        }
+
+        len = mtk_nl80211_batch_recv(batch, sock);
+        if (len == -EINTR || len == -EAGAIN)
+            continue;
+        if (len <= 0) {
+            err = len < 0 ? (int) len : -ECONNRESET;
+            break;
+        }
+
+        res = len;
+        for (hdr = (struct nlmsghdr *) batch->rx_buf; NLMSG_OK(hdr, res);
+             hdr = NLMSG_NEXT(hdr, res))
+            pending -= mtk_nl80211_batch_dispatch(batch, hdr);
+    }
+    if (err < 0 && pending > 0)
+        wpa_printf(MSG_ERROR, "nl80211 batch: %zu commands unanswered: %s",
+                   pending, strerror(-err));
+
+    for (i = 0; i < batch->num_cmds; i++) {
+        struct mtk_nl80211_batch_cmd *cmd = &batch->cmds[i];
+
+        if (!cmd->done)
+            mtk_nl80211_batch_complete(cmd, err);
+        if (cmd->result)
+            *cmd->result = cmd->err;
+        if (cmd->err && !ret)
+            ret = cmd->err;
+    }
+    mtk_nl80211_batch_clear(batch);
+    return ret;
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _MTK_NL80211_BATCH_H_
+#define _MTK_NL80211_BATCH_H_
+
+#include <netlink/msg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Commands sent in one netlink transaction at most */
+#define MTK_NL80211_BATCH_MAX_CMDS 16
+
+struct mtk_nl80211_batch;
+
+/* Called for each reply to a command, before its ACK */
+typedef int (*mtk_nl80211_batch_handler)(struct nl_msg *msg, void *arg);
+
+struct mtk_nl80211_batch *mtk_nl80211_batch_alloc(void);
+void mtk_nl80211_batch_free(struct mtk_nl80211_batch *batch);
+
+/**
+ * mtk_nl80211_batch_add - queue a command for the next commit
+ * @batch: batch from mtk_nl80211_batch_alloc()
+ * @msg: complete netlink message, with its sequence number set; the batch
+ *	frees it once committed
+ * @handler: reply handler, or %NULL if the command only gets an ACK
+ * @arg: argument passed to @handler
+ * @result: where to store the command's 0 or -errno on commit, or %NULL
+ *
+ * Returns: 0 on success, -1 if the batch is full (@msg is not taken)
+ */
+int mtk_nl80211_batch_add(struct mtk_nl80211_batch *batch, struct nl_msg *msg,
+                          mtk_nl80211_batch_handler handler, void *arg,
+                          int *result);
+
+/* Number of commands queued */
+size_t mtk_nl80211_batch_count(const struct mtk_nl80211_batch *batch);
+
+/**
+ * mtk_nl80211_batch_commit - send all queued commands and wait for them
+ * @batch: batch from mtk_nl80211_batch_alloc()
+ * @sock: netlink socket the commands go to
+ * @timeout_ms: longest wait for the next reply, -1 to wait forever
+ *
+ * The commands are written with a single sendmsg() and the replies and ACKs
+ * are matched to them by sequence number as they come, in any order. The
+ * batch is empty again afterwards.
+ *
+ * Replies to commands that timed out may still arrive on @sock later. Later
+ * commits skip them, but a reader that does not check sequence numbers would
+ * take them for its own: give the batch a socket of its own.
+ *
+ * Returns: 0 if every command was acknowledged, else the first -errno
+ */
+int mtk_nl80211_batch_commit(struct mtk_nl80211_batch *batch, int sock,
+                             int timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MTK_NL80211_BATCH_H_ */
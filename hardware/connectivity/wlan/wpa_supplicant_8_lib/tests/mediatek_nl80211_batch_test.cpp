@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <linux/netlink.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mediatek_nl80211_batch.h"
+
+namespace {
+
+// Stand-ins for the nl80211 family and its testmode command
+constexpr uint16_t kFamily = 0x1c;
+constexpr uint16_t kReplyFamily = 0x1d;
+// Payload opcodes the fake responder acts on
+constexpr uint32_t kOpAck = 0;
+constexpr uint32_t kOpFail = 1;
+constexpr uint32_t kOpReply = 2;
+constexpr uint32_t kOpIgnore = 3;
+
+struct nl_msg* makeCommand(uint32_t seq, uint32_t op) {
+    struct nl_msg* msg = nlmsg_alloc_simple(kFamily, NLM_F_REQUEST | NLM_F_ACK);
+    nlmsg_hdr(msg)->nlmsg_seq = seq;
+    nlmsg_append(msg, &op, sizeof(op), NLMSG_ALIGNTO);
+    return msg;
+}
+
+void appendMessage(std::vector<uint8_t>* out, uint16_t type, uint32_t seq,
+                   const void* payload, size_t len) {
+    struct nlmsghdr hdr = {};
+    hdr.nlmsg_len = NLMSG_LENGTH(len);
+    hdr.nlmsg_type = type;
+    hdr.nlmsg_seq = seq;
+    size_t off = out->size();
+    out->resize(off + NLMSG_ALIGN(hdr.nlmsg_len));
+    memcpy(out->data() + off, &hdr, sizeof(hdr));
+    memcpy(out->data() + off + NLMSG_HDRLEN, payload, len);
+}
+
+void appendAck(std::vector<uint8_t>* out, const struct nlmsghdr* req, int error) {
+    struct nlmsgerr err = {};
+    err.error = error;
+    err.msg = *req;
+    appendMessage(out, NLMSG_ERROR, req->nlmsg_seq, &err, sizeof(err));
+}
+
+// Answers commands as a kernel family would: an optional reply and an ACK
+// for each, in one or more datagrams.
+class FakeResponder {
+   public:
+    // Handles one request datagram. With |split|, every response goes in its
+    // own datagram, else all of them in one.
+    void serveOnce(int sock, bool split) {
+        std::vector<uint8_t> req(8192);
+        ssize_t len = recv(sock, req.data(), req.size(), 0);
+        ASSERT_GT(len, 0);
+        requests_++;
+        std::vector<std::vector<uint8_t>> out(1);
+        int rem = len;
+        for (struct nlmsghdr* hdr = reinterpret_cast<struct nlmsghdr*>(req.data());
+             NLMSG_OK(hdr, rem); hdr = NLMSG_NEXT(hdr, rem)) {
+            commands_++;
+            uint32_t op;
+            memcpy(&op, NLMSG_DATA(hdr), sizeof(op));
+            if (op == kOpIgnore) {
+                continue;
+            }
+            if (op == kOpReply) {
+                uint32_t value = hdr->nlmsg_seq * 10;
+                appendMessage(&out.back(), kReplyFamily, hdr->nlmsg_seq, &value,
+                              sizeof(value));
+                if (split) out.emplace_back();
+            }
+            appendAck(&out.back(), hdr, op == kOpFail ? -EINVAL : 0);
+            if (split) out.emplace_back();
+        }
+        for (const auto& datagram : out) {
+            if (!datagram.empty()) {
+                ASSERT_EQ(static_cast<ssize_t>(datagram.size()),
+                          send(sock, datagram.data(), datagram.size(), 0));
+            }
+        }
+    }
+
+    int requests_ = 0;
+    int commands_ = 0;
+};
+
+int replyHandler(struct nl_msg* msg, void* arg) {
+    uint32_t value;
+    memcpy(&value, nlmsg_data(nlmsg_hdr(msg)), sizeof(value));
+    static_cast<std::vector<uint32_t>*>(arg)->push_back(value);
+    return NL_SKIP;
+}
+
+}  // namespace
+
+class MtkNl80211BatchTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds_));
+        batch_ = mtk_nl80211_batch_alloc();
+        ASSERT_NE(nullptr, batch_);
+    }
+
+    void TearDown() override {
+        mtk_nl80211_batch_free(batch_);
+        close(fds_[0]);
+        close(fds_[1]);
+    }
+
+    // Commits the batch while the responder serves one request.
+    int commit(bool split, int timeout_ms = 1000) {
+        std::thread responder([this, split]() { responder_.serveOnce(fds_[1], split); });
+        int ret = mtk_nl80211_batch_commit(batch_, fds_[0], timeout_ms);
+        responder.join();
+        return ret;
+    }
+
+    int fds_[2];
+    struct mtk_nl80211_batch* batch_;
+    FakeResponder responder_;
+};
+
+TEST_F(MtkNl80211BatchTest, CommandsGoOutInOneTransaction) {
+    int results[3] = {-1, -1, -1};
+    for (uint32_t i = 0; i < 3; i++) {
+        ASSERT_EQ(0, mtk_nl80211_batch_add(batch_, makeCommand(100 + i, kOpAck),
+                                           nullptr, nullptr, &results[i]));
+    }
+    EXPECT_EQ(3u, mtk_nl80211_batch_count(batch_));
+    EXPECT_EQ(0, commit(false));
+    EXPECT_EQ(1, responder_.requests_);
+    EXPECT_EQ(3, responder_.commands_);
+    for (int result : results) EXPECT_EQ(0, result);
+    EXPECT_EQ(0u, mtk_nl80211_batch_count(batch_));
+}
+
+TEST_F(MtkNl80211BatchTest, ErrorsAreReportedPerCommand) {
+    int results[3] = {-1, -1, -1};
+    const uint32_t ops[3] = {kOpAck, kOpFail, kOpAck};
+    for (uint32_t i = 0; i < 3; i++) {
+        ASSERT_EQ(0, mtk_nl80211_batch_add(batch_, makeCommand(100 + i, ops[i]),
+                                           nullptr, nullptr, &results[i]));
+    }
+    EXPECT_EQ(-EINVAL, commit(true));
+    EXPECT_EQ(0, results[0]);
+    EXPECT_EQ(-EINVAL, results[1]);
+    EXPECT_EQ(0, results[2]);
+}
+
+TEST_F(MtkNl80211BatchTest, RepliesReachTheirHandler) {
+    std::vector<uint32_t> first, second;
+    ASSERT_EQ(0, mtk_nl80211_batch_add(batch_, makeCommand(7, kOpReply),
+                                       replyHandler, &first, nullptr));
+    ASSERT_EQ(0, mtk_nl80211_batch_add(batch_, makeCommand(8, kOpAck),
+                                       replyHandler, &second, nullptr));
+    ASSERT_EQ(0, mtk_nl80211_batch_add(batch_, makeCommand(9, kOpReply),
+                                       nullptr, nullptr, nullptr));
+    EXPECT_EQ(0, commit(false));
+    EXPECT_EQ(std::vector<uint32_t>{70}, first);
+    EXPECT_TRUE(second.empty());
+}
+
+TEST_F(MtkNl80211BatchTest, StaleMessagesAreIgnored) {
+    std::vector<uint8_t> stale;
+    struct nlmsghdr req = {};
+    req.nlmsg_seq = 41;
+    appendAck(&stale, &req, -EBUSY);
+    ASSERT_EQ(static_cast<ssize_t>(stale.size()),
+              send(fds_[1], stale.data(), stale.size(), 0));
+
+    int result = -1;
+    ASSERT_EQ(0, mtk_nl80211_batch_add(batch_, makeCommand(42, kOpAck), nullptr,
+                                       nullptr, &result));
+    EXPECT_EQ(0, commit(false));
+    EXPECT_EQ(0, result);
+}
+
+TEST_F(MtkNl80211BatchTest, UnansweredCommandsTimeOut) {
+    int results[2] = {-1, -1};
+    ASSERT_EQ(0, mtk_nl80211_batch_add(batch_, makeCommand(1, kOpAck), nullptr,
+                                       nullptr, &results[0]));
+    ASSERT_EQ(0, mtk_nl80211_batch_add(batch_, makeCommand(2, kOpIgnore),
+                                       nullptr, nullptr, &results[1]));
+    EXPECT_EQ(-ETIMEDOUT, commit(false, 50));
+    EXPECT_EQ(0, results[0]);
+    EXPECT_EQ(-ETIMEDOUT, results[1]);
+}
+
+TEST_F(MtkNl80211BatchTest, FullBatchRejectsCommands) {
+    for (uint32_t i = 0; i < MTK_NL80211_BATCH_MAX_CMDS; i++) {
+        ASSERT_EQ(0, mtk_nl80211_batch_add(batch_, makeCommand(i, kOpAck),
+                                           nullptr, nullptr, nullptr));
+    }
+    struct nl_msg* extra = makeCommand(MTK_NL80211_BATCH_MAX_CMDS, kOpAck);
+    EXPECT_EQ(-1, mtk_nl80211_batch_add(batch_, extra, nullptr, nullptr, nullptr));
+    nlmsg_free(extra);
+    EXPECT_EQ(0, commit(true));
+    EXPECT_EQ(MTK_NL80211_BATCH_MAX_CMDS, static_cast<size_t>(responder_.commands_));
+}
+
+TEST_F(MtkNl80211BatchTest, EmptyCommitSendsNothing) {
+    EXPECT_EQ(0, mtk_nl80211_batch_commit(batch_, fds_[0], 0));
+}